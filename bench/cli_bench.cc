@@ -0,0 +1,272 @@
+/**
+ * @file cli_bench.cc
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Google Benchmark suite of the input path, the dispatch and the history
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "bench/cli_internal.h"
+
+#include <benchmark/benchmark.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static size_t null_write(const void *ptr, size_t size) {
+  benchmark::DoNotOptimize(ptr);
+  return size;
+}
+
+static int null_flush(void) { return 0; }
+
+static int nop_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  benchmark::DoNotOptimize(argv[argc - 1]);
+  return 0;
+}
+
+static const cli_cmd_t poll_cmds[] = {
+    {"poll", "Do nothing", nop_handler, 0},
+};
+
+static const cli_cmd_list_t poll_cmd_list = {NULL, 0, poll_cmds, 1};
+
+// n top-level commands, or n commands in groups of 10
+struct table {
+  std::vector<std::string> names;
+  std::vector<cli_cmd_t> cmds;
+  std::vector<cli_cmd_group_t> groups;
+  std::vector<const cli_cmd_group_t *> group_ptrs;
+  cli_cmd_list_t list;
+
+  table(size_t n, bool grouped) {
+    char name[24];
+
+    names.reserve(n + n / 10);
+    cmds.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      snprintf(name, sizeof(name), grouped ? "c%zu" : "cmd%zu",
+               grouped ? i % 10 : i);
+      names.push_back(name);
+      cmds.push_back({names.back().c_str(), "Do nothing", nop_handler, 0});
+    }
+    list = {NULL, 0, NULL, 0};
+    if (!grouped) {
+      list.cmds = cmds.data();
+      list.cmds_length = n;
+      return;
+    }
+    for (size_t i = 0; i < n / 10; i++) {
+      snprintf(name, sizeof(name), "grp%zu", i);
+      names.push_back(name);
+      groups.push_back({names.back().c_str(), "Group", &cmds[i * 10], 10});
+    }
+    for (const cli_cmd_group_t &group : groups) {
+      group_ptrs.push_back(&group);
+    }
+    list.groups = group_ptrs.data();
+    list.length = group_ptrs.size();
+  }
+};
+
+static void setup(cli_t *cli, const cli_cmd_list_t *cmd_list) {
+  cli_init(cli, cmd_list);
+  cli->write = null_write;
+  cli->flush = null_flush;
+}
+
+static void BM_RingbufferPutGet(benchmark::State &state) {
+  uint8_t buf[256];
+  ringbuffer_t rb;
+  uint8_t ch = 0;
+
+  ringbuffer_wrap(&rb, buf, sizeof(buf));
+  for (auto _ : state) {
+    for (size_t i = 0; i < sizeof(buf) - 1; i++) {
+      ringbuffer_put(&rb, (uint8_t)i);
+    }
+    for (size_t i = 0; i < sizeof(buf) - 1; i++) {
+      ringbuffer_get(&rb, &ch);
+    }
+    benchmark::DoNotOptimize(ch);
+  }
+  state.SetBytesProcessed(state.iterations() * (sizeof(buf) - 1));
+}
+BENCHMARK(BM_RingbufferPutGet);
+
+static void BM_RingbufferPutRead(benchmark::State &state) {
+  uint8_t buf[256];
+  uint8_t out[256];
+  ringbuffer_t rb;
+
+  ringbuffer_wrap(&rb, buf, sizeof(buf));
+  for (auto _ : state) {
+    for (size_t i = 0; i < sizeof(buf) - 1; i++) {
+      ringbuffer_put(&rb, (uint8_t)i);
+    }
+    benchmark::DoNotOptimize(ringbuffer_read(&rb, out, sizeof(out)));
+  }
+  state.SetBytesProcessed(state.iterations() * (sizeof(buf) - 1));
+}
+BENCHMARK(BM_RingbufferPutRead);
+
+// A paste of state.range(0) bytes received and echoed through the receive
+// buffer, as many chunks as it holds
+static void BM_PasteInput(benchmark::State &state) {
+  cli_t cli;
+  std::string paste;
+
+  setup(&cli, &poll_cmd_list);
+  while (paste.size() < (size_t)state.range(0)) {
+    paste += "poll " + std::to_string(paste.size()) + "\r\n";
+  }
+  for (auto _ : state) {
+    size_t off = 0;
+    while (off < paste.size()) {
+      off += cli_putbuf(&cli, paste.data() + off, paste.size() - off);
+      cli_mainloop(&cli);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * paste.size());
+}
+BENCHMARK(BM_PasteInput)->Arg(1024)->Arg(16384);
+
+static void BM_Tokenize(benchmark::State &state) {
+  std::string line = "cmd";
+  char buf[CLI_LINE_MAX];
+  char *argv[CLI_ARGV_NUM];
+
+  for (int i = 1; i < state.range(0); i++) {
+    line += "  arg" + std::to_string(i);
+  }
+  for (auto _ : state) {
+    memcpy(buf, line.c_str(), line.size() + 1);
+    benchmark::DoNotOptimize(cli_internal_tokenize(buf, argv, CLI_ARGV_NUM));
+  }
+}
+BENCHMARK(BM_Tokenize)->Arg(1)->Arg(4)->Arg(CLI_ARGV_NUM);
+
+// Lookup of the last command of a table, the worst case
+static void BM_Dispatch(benchmark::State &state) {
+  table t((size_t)state.range(0), false);
+  cli_t cli;
+  std::string name = t.cmds.back().name;
+  char *argv[] = {&name[0]};
+
+  setup(&cli, &t.list);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cli_internal_find(&cli, 1, argv));
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Dispatch)->RangeMultiplier(10)->Range(10, 10000)->Complexity();
+
+static void BM_DispatchGrouped(benchmark::State &state) {
+  table t((size_t)state.range(0), true);
+  cli_t cli;
+  std::string group = t.groups.back().name;
+  std::string name = t.cmds.back().name;
+  char *argv[] = {&group[0], &name[0]};
+
+  setup(&cli, &t.list);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cli_internal_find(&cli, 2, argv));
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_DispatchGrouped)
+    ->RangeMultiplier(10)
+    ->Range(10, 10000)
+    ->Complexity();
+
+// A whole line: tokenize, lookup and handler
+static void BM_Exec(benchmark::State &state) {
+  table t((size_t)state.range(0), false);
+  cli_t cli;
+  std::string line = std::string(t.cmds.back().name) + " a b";
+
+  setup(&cli, &t.list);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cli_exec(&cli, line.c_str(), NULL, 0, NULL));
+  }
+}
+BENCHMARK(BM_Exec)->RangeMultiplier(10)->Range(10, 10000);
+
+static void BM_Help(benchmark::State &state) {
+  table t((size_t)state.range(0), true);
+  cli_t cli;
+  size_t len = 0;
+
+  setup(&cli, &t.list);
+  for (auto _ : state) {
+    len = cli_exec(&cli, "help", NULL, 0, NULL);
+    benchmark::DoNotOptimize(len);
+  }
+  state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_Help)->RangeMultiplier(10)->Range(10, 1000);
+
+// Distinct lines, each push evicting the oldest entries
+static void BM_HistoryPush(benchmark::State &state) {
+  cli_t cli;
+  char line[32];
+  size_t i = 0;
+
+  setup(&cli, &poll_cmd_list);
+  cli.echo = false;
+  for (auto _ : state) {
+    int len = snprintf(line, sizeof(line), "poll %zu\r\n", i++ % 64);
+    cli_feed(&cli, line, (size_t)len);
+  }
+}
+BENCHMARK(BM_HistoryPush);
+
+// 16 Up then 16 Down keys through a full history, with echo
+static void BM_HistoryNavigate(benchmark::State &state) {
+  cli_t cli;
+  char line[32];
+  std::string keys;
+
+  setup(&cli, &poll_cmd_list);
+  for (size_t i = 0; i < 64; i++) {
+    int len = snprintf(line, sizeof(line), "poll %zu\r\n", i);
+    cli_feed(&cli, line, (size_t)len);
+  }
+  for (int i = 0; i < 16; i++) {
+    keys += "\x1b[A";
+  }
+  for (int i = 0; i < 16; i++) {
+    keys += "\x1b[B";
+  }
+  for (auto _ : state) {
+    cli_feed(&cli, keys.data(), keys.size());
+  }
+  state.SetItemsProcessed(state.iterations() * 32);
+}
+BENCHMARK(BM_HistoryNavigate);
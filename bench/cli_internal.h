@@ -0,0 +1,66 @@
+/**
+ * @file cli_internal.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Static functions of cli.c exposed to the benchmarks
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_INTERNAL_H
+#define _CLI_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lib/cli.h"
+
+/**
+ * @brief tokenise a line in place, see cli_tokenize_line in cli.c
+ *
+ * @param line the NULL terminated line to tokenise
+ * @param argv arguments vector filled with pointers into line
+ * @param argv_num arguments vector length
+ * @return int number of tokens found. -1 if number of token exceeded argv_num
+ */
+int cli_internal_tokenize(char *line, char **argv, size_t argv_num);
+
+/**
+ * @brief find the command matching the arguments vector, see cli_cmd_find in
+ * cli.c
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return const cli_cmd_t* the matching command. NULL if none was found
+ */
+const cli_cmd_t *cli_internal_find(const cli_t *cli, int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_INTERNAL_H */
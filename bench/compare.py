@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Compare Google Benchmark JSON results against a baseline.
+
+Exits with 1 when a benchmark of the baseline is slower by more than the
+threshold, 0 otherwise. Benchmarks missing from either side are reported but
+do not fail the comparison.
+"""
+
+import argparse
+import json
+import sys
+
+UNITS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    """Return the real and cpu times of every benchmark by name, in ns.
+
+    The median of the repetitions is used when there are several, see
+    --benchmark_repetitions.
+    """
+    with open(path) as f:
+        results = json.load(f)
+    runs = {}
+    medians = {}
+    for bench in results.get("benchmarks", []):
+        # The complexity fits have no times
+        if "real_time" not in bench:
+            continue
+        scale = UNITS[bench["time_unit"]]
+        times = {
+            "real_time": bench["real_time"] * scale,
+            "cpu_time": bench["cpu_time"] * scale,
+        }
+        name = bench.get("run_name", bench["name"])
+        if bench.get("run_type", "iteration") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[name] = times
+            continue
+        runs.setdefault(name, []).append(times)
+
+    for name, reps in runs.items():
+        if name not in medians:
+            medians[name] = {
+                key: sum(rep[key] for rep in reps) / len(reps)
+                for key in ("real_time", "cpu_time")
+            }
+    return medians
+
+
+def compare(baseline_path, current_path, threshold=0.25, metric="cpu_time"):
+    """Print the change of every benchmark, return the number of regressions."""
+    baseline = load(baseline_path)
+    current = load(current_path)
+    regressions = 0
+
+    print("%-32s %12s %12s %8s" % ("benchmark", "baseline ns", "current ns",
+                                    "change"))
+    for name, base in baseline.items():
+        if name not in current:
+            print("%-32s %12.1f %12s %8s" % (name, base[metric], "-",
+                                              "missing"))
+            continue
+        old = base[metric]
+        new = current[name][metric]
+        change = (new - old) / old if old > 0 else 0.0
+        flag = ""
+        if change > threshold:
+            flag = " REGRESSION"
+            regressions += 1
+        print("%-32s %12.1f %12.1f %+7.1f%%%s" % (name, old, new,
+                                                   change * 100, flag))
+    for name in current:
+        if name not in baseline:
+            print("%-32s %12s %12.1f %8s" % (name, "-", current[name][metric],
+                                              "new"))
+
+    if regressions:
+        print("%d benchmark(s) slower than the baseline by more than %.0f%%" %
+              (regressions, threshold * 100))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline", help="JSON results of the baseline")
+    parser.add_argument("current", help="JSON results to check")
+    parser.add_argument("-t", "--threshold", type=float, default=0.25,
+                        help="tolerated slowdown (default 0.25, i.e. 25%%)")
+    parser.add_argument("-m", "--metric", default="cpu_time",
+                        choices=("cpu_time", "real_time"),
+                        help="time compared (default cpu_time)")
+    args = parser.parse_args()
+
+    if compare(args.baseline, args.current, args.threshold, args.metric):
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Run cli_bench and fail on a regression against the baseline.
+
+As a test, the medians of the repetitions are compared with the baseline by
+compare.py. With --record, through bazel run, the results are saved as the
+baseline of the workspace instead, so that both come from the same target.
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from bench import compare
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("cli_bench", help="benchmark binary")
+    parser.add_argument("baseline", help="JSON results of the baseline")
+    parser.add_argument("-r", "--repetitions", type=int, default=5,
+                        help="repetitions of every benchmark (default 5)")
+    parser.add_argument("-t", "--threshold", type=float, default=0.25,
+                        help="tolerated slowdown (default 0.25, i.e. 25%%)")
+    parser.add_argument("--record", action="store_true",
+                        help="save the results as bench/baseline.json of the "
+                        "workspace")
+    args = parser.parse_args()
+
+    tmpdir = os.environ.get("TEST_TMPDIR", tempfile.gettempdir())
+    out = os.path.join(tmpdir, "cli_bench.json")
+    subprocess.run([
+        args.cli_bench,
+        "--benchmark_repetitions=%d" % args.repetitions,
+        "--benchmark_report_aggregates_only=true",
+        "--benchmark_out=" + out,
+        "--benchmark_out_format=json",
+    ], check=True, stdout=subprocess.DEVNULL)
+
+    if args.record:
+        workspace = os.environ.get("BUILD_WORKSPACE_DIRECTORY")
+        if workspace is None:
+            print("--record needs bazel run")
+            return 1
+        dest = os.path.join(workspace, "bench", "baseline.json")
+        shutil.copyfile(out, dest)
+        print("recorded " + dest)
+        return 0
+    if compare.compare(args.baseline, out, args.threshold):
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
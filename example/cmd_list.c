@@ -126,17 +126,16 @@ const cli_cmd_list_t cli_cmd_list = {
 };
 
 static int cli_cmd_handler(cli_t *cli, int argc, char **argv) {
-  (void)cli;
   (void)argc;
   (void)argv;
 
-  cli->write("cmd: ", 5);
+  cli_write(cli, "cmd: ", 5);
   for (int i = 0; i < argc; i++) {
-    cli->write("`", 1);
-    cli->write(argv[i], strlen(argv[i]));
-    cli->write("`, ", 2);
+    cli_write(cli, "`", 1);
+    cli_write(cli, argv[i], strlen(argv[i]));
+    cli_write(cli, "`, ", 2);
   }
-  cli->write("\r\n", 2);
+  cli_write(cli, "\r\n", 2);
 
   return 0;
 }
\ No newline at end of file
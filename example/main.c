@@ -33,51 +33,31 @@
 #include "lib/cli.h"
 
 #include "uart.h"
+#include "waiter.h"
 
+#include <stdatomic.h>
 #include <stdio.h>
-#include <string.h>
-
-#ifdef WIN32
-#include <windows.h>
-#elif _POSIX_C_SOURCE >= 199309L
-#include <time.h> // for nanosleep
-#else
-#include <unistd.h> // for usleep
-#endif
+#include <stdlib.h>
 
 static cli_t cli;
+static waiter_t waiter;
+static atomic_size_t rx_dropped;
 
-void sleep_ms(int milliseconds) // cross-platform sleep function
-{
-#ifdef WIN32
-  Sleep(milliseconds);
-#elif _POSIX_C_SOURCE >= 199309L
-  struct timespec ts;
-  ts.tv_sec = milliseconds / 1000;
-  ts.tv_nsec = (milliseconds % 1000) * 1000000;
-  nanosleep(&ts, NULL);
-#else
-  usleep(milliseconds * 1000);
-#endif
-}
-
-void uart_rx_callback(char ch) {
-  if (cli_putchar(&cli, ch) != ch) {
-    ; // could not write. buffer full
+static void uart_rx_callback(const char *buf, size_t len) {
+  size_t n = cli_putbuf(&cli, buf, len);
+  if (n != len) {
+    // could not write. buffer full
+    atomic_fetch_add_explicit(&rx_dropped, len - n, memory_order_relaxed);
   }
 }
 
-// Wrapper function to adapt uart_putchar to cli.write signature
-static size_t uart_write_wrapper(const void *ptr, size_t size) {
-  const char *p = (const char *)ptr;
-  size_t written = 0;
-  for (size_t i = 0; i < size; i++) {
-    if (uart_putchar(p[i]) == EOF) {
-      break;
-    }
-    written++;
-  }
-  return written;
+// Reports the input lost to a full receive buffer before exiting
+static void quit_callback(void) {
+  char msg[48];
+  int n = snprintf(msg, sizeof(msg), "rx dropped: %zu bytes\r\n",
+                   atomic_load_explicit(&rx_dropped, memory_order_relaxed));
+  uart_write(msg, (size_t)n);
+  exit(0);
 }
 
 int main(int argc, char **argv) {
@@ -86,20 +66,30 @@ int main(int argc, char **argv) {
 
   uart_init();
 
-  uart_register_rx_callback(uart_rx_callback);
-
   cli_init(&cli, &cli_cmd_list);
 
-  // Set write function to use our wrapper
-  cli.write = uart_write_wrapper;
+  // The RX thread wakes the main loop up, there is no polling
+  if (waiter_init(&waiter) < 0) {
+    return 1;
+  }
+  cli_register_notify_callback(&cli, waiter_notify, &waiter);
+  cli_register_quit_callback(&cli, quit_callback);
+
+  uart_register_rx_callback(uart_rx_callback);
+
+  cli.write = uart_write;
   cli.flush = uart_flush;
 
   cli_print_prompt(&cli);
   while (1) {
 
-    cli_mainloop(&cli);
+    waiter_wait(&waiter);
+
+    do {
+      cli_mainloop(&cli);
+    } while (!ringbuffer_is_empty(&cli.rb_inbuf));
 
-    sleep_ms(10);
+    uart_flush();
   }
   return 0;
 }
@@ -0,0 +1,574 @@
+/**
+ * @file pty_bench.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief End-to-end benchmark of the example under a pseudo-terminal
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+#define PTY_PROMPT "ucli> "
+#define PTY_RESPONSE "cmd: " /**< Output of every command of the example */
+#define PTY_DROPPED "rx dropped: "
+#define PTY_TIMEOUT_NS (2000000000ull) /**< Longest silence of the example */
+#define PTY_LINE_MAX (32) /**< Longest command of pty_cmds */
+
+// Commands of //example:cli_example, each answered by PTY_RESPONSE
+static const char *const pty_cmds[] = {
+    "version\r",
+    "uptime\r",
+    "gpio output-set LED1 1\r",
+    "adc get VBAT\r",
+    "gpio input-get BTN0\r",
+    "mcu sleep 5\r",
+    "adc start-conv T\r",
+    "gpio output-get LED2\r",
+};
+
+/**
+ * @brief The example running on the slave side of a pseudo-terminal
+ *
+ */
+typedef struct session_s {
+  pid_t pid;
+  int fd;                /**< master side */
+  char *out;             /**< everything received */
+  size_t len;            /**< bytes received */
+  size_t cap;            /**< size of out */
+  size_t scanned;        /**< offset up to which out was scanned */
+  size_t resp_matched;   /**< bytes of PTY_RESPONSE matched at scanned */
+  size_t prompt_matched; /**< bytes of PTY_PROMPT matched at scanned */
+  size_t responses;      /**< PTY_RESPONSE received */
+  size_t prompts;        /**< PTY_PROMPT received */
+  uint64_t *resp_ns;     /**< arrival time of every response */
+  size_t resp_cap;       /**< size of resp_ns */
+} session_t;
+
+typedef struct result_s {
+  size_t commands; /**< commands sent */
+  size_t answered; /**< responses received */
+  double rate;     /**< commands per second, 0 if not measured */
+  double p50_us;   /**< median latency */
+  double p99_us;   /**< 99th percentile latency */
+  long dropped;    /**< input bytes lost by the example */
+} result_t;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void percentiles(uint64_t *samples, size_t n, result_t *res) {
+  if (n == 0) {
+    return;
+  }
+  qsort(samples, n, sizeof(*samples), cmp_u64);
+  res->p50_us = samples[n / 2] / 1e3;
+  res->p99_us = samples[(n * 99) / 100] / 1e3;
+}
+
+/**
+ * @brief Advance the match of str by c, returning true when it completes.
+ * Neither searched string starts again within itself
+ *
+ */
+static bool match(const char *str, size_t *matched, char c) {
+  if (c == str[*matched]) {
+    (*matched)++;
+  } else {
+    *matched = (c == str[0]);
+  }
+  if (str[*matched] == '\0') {
+    *matched = 0;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Read what the example wrote, waiting at most timeout_ns for it, and
+ * time the new responses
+ *
+ * @return 0 on success or timeout, -1 once the example exited
+ */
+static int session_read(session_t *s, uint64_t timeout_ns) {
+  struct pollfd pfd = {.fd = s->fd, .events = POLLIN};
+  struct timespec ts = {(time_t)(timeout_ns / 1000000000u),
+                        (long)(timeout_ns % 1000000000u)};
+
+  if (ppoll(&pfd, 1, &ts, NULL) < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+  if ((pfd.revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+    return 0;
+  }
+  for (;;) {
+    if (s->cap - s->len < 4096) {
+      s->cap = s->cap ? 2 * s->cap : 65536;
+      s->out = realloc(s->out, s->cap);
+      if (s->out == NULL) {
+        return -1;
+      }
+    }
+    ssize_t n = read(s->fd, s->out + s->len, s->cap - s->len);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      break;
+    }
+    if (n <= 0) {
+      return -1; // EIO once the slave side is closed
+    }
+    s->len += (size_t)n;
+  }
+
+  // Either string may be split between two reads
+  uint64_t t = now_ns();
+  for (; s->scanned < s->len; s->scanned++) {
+    char c = s->out[s->scanned];
+    if (match(PTY_RESPONSE, &s->resp_matched, c)) {
+      if (s->responses < s->resp_cap) {
+        s->resp_ns[s->responses] = t;
+      }
+      s->responses++;
+    }
+    s->prompts += match(PTY_PROMPT, &s->prompt_matched, c);
+  }
+  return 0;
+}
+
+/**
+ * @brief Read until cond holds, failing after PTY_TIMEOUT_NS of silence
+ *
+ */
+static int session_wait(session_t *s, bool (*cond)(const session_t *s,
+                                                   size_t arg),
+                        size_t arg) {
+  uint64_t last = now_ns();
+  size_t len = s->len;
+
+  while (!cond(s, arg)) {
+    if (session_read(s, 10000000u) < 0) {
+      return -1;
+    }
+    if (s->len != len) {
+      len = s->len;
+      last = now_ns();
+    } else if (now_ns() - last > PTY_TIMEOUT_NS) {
+      fprintf(stderr, "timeout waiting for the example\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static bool has_prompts(const session_t *s, size_t n) {
+  return s->prompts >= n;
+}
+
+static bool has_bytes(const session_t *s, size_t n) { return s->len >= n; }
+
+static int session_start(session_t *s, const char *path, size_t resp_cap) {
+  memset(s, 0, sizeof(*s));
+  s->resp_ns = calloc(resp_cap, sizeof(*s->resp_ns));
+  s->resp_cap = resp_cap;
+  if (s->resp_ns == NULL) {
+    return -1;
+  }
+  s->pid = forkpty(&s->fd, NULL, NULL, NULL);
+  if (s->pid < 0) {
+    perror("forkpty");
+    return -1;
+  }
+  if (s->pid == 0) {
+    execl(path, path, (char *)NULL);
+    perror(path);
+    _exit(127);
+  }
+  fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) | O_NONBLOCK);
+  // The terminal is in raw mode once the first prompt is printed
+  return session_wait(s, has_prompts, 1);
+}
+
+/**
+ * @brief Write data at the rate of a 8N1 UART at baud, reading the output
+ * meanwhile. The time at which every end of line is written is stored in
+ * eol_ns if not NULL
+ *
+ */
+static int session_send(session_t *s, const char *data, size_t len, long baud,
+                        uint64_t *eol_ns) {
+  double ns_per_byte = 10e9 / (double)baud;
+  uint64_t t0 = now_ns();
+  size_t sent = 0, eol = 0;
+
+  while (sent < len) {
+    uint64_t elapsed = now_ns() - t0;
+    size_t due = (size_t)((double)elapsed / ns_per_byte) + 1;
+    due = due < len ? due : len;
+    if (due > sent) {
+      ssize_t n = write(s->fd, data + sent, due - sent);
+      if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        return -1;
+      }
+      uint64_t t = now_ns();
+      for (ssize_t i = 0; i < n; i++) {
+        if (data[sent + (size_t)i] == '\r' && eol_ns != NULL) {
+          eol_ns[eol++] = t;
+        }
+      }
+      sent += n > 0 ? (size_t)n : 0;
+    }
+    // Until the next byte is due
+    uint64_t next = (uint64_t)((double)sent * ns_per_byte);
+    elapsed = now_ns() - t0;
+    if (session_read(s, next > elapsed ? next - elapsed : 0) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Quit the example and get the number of input bytes it dropped
+ *
+ */
+static long session_stop(session_t *s) {
+  long dropped = -1;
+  size_t from = s->len;
+  uint64_t t0 = now_ns();
+
+  // Ctrl-U clears what is left of a command which lost its end of line
+  if (write(s->fd, "\x15quit\r", 6) == 6) {
+    while (session_read(s, 10000000u) == 0 &&
+           now_ns() - t0 < PTY_TIMEOUT_NS) {
+    }
+  }
+  char *p = memmem(s->out + from, s->len - from, PTY_DROPPED,
+                   sizeof(PTY_DROPPED) - 1);
+  if (p != NULL) {
+    dropped = strtol(p + sizeof(PTY_DROPPED) - 1, NULL, 10);
+  }
+  kill(s->pid, SIGKILL);
+  waitpid(s->pid, NULL, 0);
+  close(s->fd);
+  free(s->out);
+  free(s->resp_ns);
+  return dropped;
+}
+
+static size_t make_script(char *buf, size_t n) {
+  size_t len = 0;
+  for (size_t i = 0; i < n; i++) {
+    const char *cmd = pty_cmds[i % ARRAY_SIZE(pty_cmds)];
+    memcpy(buf + len, cmd, strlen(cmd));
+    len += strlen(cmd);
+  }
+  return len;
+}
+
+/**
+ * @brief Type the commands one key every interval_ms, timing the echo of
+ * every key
+ *
+ */
+static int run_typing(const char *path, size_t n, unsigned interval_ms,
+                      result_t *res) {
+  session_t s;
+  uint64_t *samples = malloc(n * PTY_LINE_MAX * sizeof(*samples));
+  size_t num = 0;
+
+  if (samples == NULL || session_start(&s, path, n) < 0) {
+    free(samples);
+    return -1;
+  }
+  for (size_t i = 0; i < n; i++) {
+    const char *c = pty_cmds[i % ARRAY_SIZE(pty_cmds)];
+    for (; *c != '\0'; c++) {
+      uint64_t t = now_ns();
+      size_t len = s.len;
+      if (write(s.fd, c, 1) != 1 ||
+          (*c == '\r' ? session_wait(&s, has_prompts, s.prompts + 1)
+                      : session_wait(&s, has_bytes, len + 1)) < 0) {
+        break;
+      }
+      if (*c != '\r') {
+        samples[num++] = now_ns() - t;
+      }
+      usleep(interval_ms * 1000u);
+    }
+    if (*c != '\0') {
+      break;
+    }
+  }
+  res->commands = n;
+  res->answered = s.responses;
+  percentiles(samples, num, res);
+  res->dropped = session_stop(&s);
+  free(samples);
+  return 0;
+}
+
+/**
+ * @brief Send every command once the prompt of the previous one is received,
+ * timing the round trip from its first byte to the prompt
+ *
+ */
+static int run_back_to_back(const char *path, size_t n, long baud,
+                            result_t *res) {
+  session_t s;
+  uint64_t *samples = calloc(n, sizeof(*samples));
+
+  if (samples == NULL || session_start(&s, path, n) < 0) {
+    free(samples);
+    return -1;
+  }
+  // A lost end of line is never answered, which ends the workload
+  uint64_t t0 = now_ns();
+  size_t i;
+  for (i = 0; i < n; i++) {
+    const char *cmd = pty_cmds[i % ARRAY_SIZE(pty_cmds)];
+    uint64_t t = now_ns();
+    size_t prompts = s.prompts;
+    if (session_send(&s, cmd, strlen(cmd), baud, NULL) < 0 ||
+        session_wait(&s, has_prompts, prompts + 1) < 0) {
+      break;
+    }
+    samples[i] = now_ns() - t;
+  }
+  res->commands = n;
+  res->answered = s.responses;
+  if (i > 0) {
+    res->rate = (double)i * 1e9 / (double)(now_ns() - t0);
+  }
+  percentiles(samples, i, res);
+  res->dropped = session_stop(&s);
+  free(samples);
+  return 0;
+}
+
+/**
+ * @brief Paste all the commands at once, timing every command from its end
+ * of line to its response. The example may lose input, so commands are only
+ * waited for until it falls silent
+ *
+ */
+static int run_paste(const char *path, size_t n, long baud, result_t *res) {
+  session_t s;
+  char *script = malloc(n * PTY_LINE_MAX);
+  uint64_t *eol_ns = calloc(n, sizeof(*eol_ns));
+  uint64_t *samples = calloc(n, sizeof(*samples));
+  int ret = -1;
+
+  if (script == NULL || eol_ns == NULL || samples == NULL ||
+      session_start(&s, path, n) < 0) {
+    free(script);
+    free(eol_ns);
+    free(samples);
+    return -1;
+  }
+  size_t len = make_script(script, n);
+  uint64_t t0 = now_ns();
+  if (session_send(&s, script, len, baud, eol_ns) < 0) {
+    goto out;
+  }
+  // Lost commands are never answered: stop after a short silence
+  uint64_t last = now_ns();
+  size_t seen = s.len;
+  while (s.responses < n && now_ns() - last < PTY_TIMEOUT_NS / 10) {
+    if (session_read(&s, 10000000u) < 0) {
+      goto out;
+    }
+    if (s.len != seen) {
+      seen = s.len;
+      last = now_ns();
+    }
+  }
+  size_t answered = s.responses < n ? s.responses : n;
+  for (size_t i = 0; i < answered; i++) {
+    // Responses of lost commands shift the later ones
+    samples[i] = s.resp_ns[i] > eol_ns[i] ? s.resp_ns[i] - eol_ns[i] : 0;
+  }
+  res->commands = n;
+  res->answered = s.responses;
+  if (answered > 0) {
+    res->rate = (double)answered * 1e9 / (double)(s.resp_ns[answered - 1] - t0);
+  }
+  percentiles(samples, answered, res);
+  ret = 0;
+
+out:
+  res->dropped = session_stop(&s);
+  free(script);
+  free(eol_ns);
+  free(samples);
+  return ret;
+}
+
+static size_t parse_list(const char *str, long *list, size_t max) {
+  size_t n = 0;
+  char *end;
+
+  while (n < max && *str != '\0') {
+    list[n++] = strtol(str, &end, 0);
+    str = *end == ',' ? end + 1 : end;
+    if (end == str && *end != '\0') {
+      break;
+    }
+  }
+  return n;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-b BAUDS] [-n COMMANDS] [-t MS] [-s] EXAMPLE\n"
+          "  -b BAUDS     comma separated emulated baud rates\n"
+          "               (default 115200,230400,460800,921600,1500000,"
+          "3000000)\n"
+          "  -n COMMANDS  commands sent per workload (default 200)\n"
+          "  -t MS        typing interval between keys (default 30)\n"
+          "  -s           fail when a paste drops input\n"
+          "  EXAMPLE      path of the example binary\n",
+          prog);
+}
+
+static void print_result(const char *workload, long baud, const result_t *r) {
+  char col[3][24] = {"-", "-", "-"};
+
+  if (baud > 0) {
+    snprintf(col[0], sizeof(col[0]), "%ld", baud);
+  }
+  if (r->rate > 0) {
+    snprintf(col[1], sizeof(col[1]), "%.0f", r->rate);
+  }
+  if (r->dropped >= 0) {
+    snprintf(col[2], sizeof(col[2]), "%ld", r->dropped);
+  }
+  printf("%-12s %8s %9zu %9zu %11s %9.1f %9.1f %8s\n", workload, col[0],
+         r->commands, r->answered, col[1], r->p50_us, r->p99_us, col[2]);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  static const long default_bauds[] = {115200,  230400,  460800,
+                                       921600, 1500000, 3000000};
+  long bauds[32];
+  size_t num_bauds = 0;
+  size_t n = 200;
+  unsigned interval_ms = 30;
+  bool strict = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:n:t:sh")) != -1) {
+    switch (opt) {
+    case 'b':
+      num_bauds = parse_list(optarg, bauds, ARRAY_SIZE(bauds));
+      break;
+    case 'n':
+      n = strtoul(optarg, NULL, 0);
+      break;
+    case 't':
+      interval_ms = (unsigned)strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      strict = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind != argc - 1 || n == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (num_bauds == 0) {
+    memcpy(bauds, default_bauds, sizeof(default_bauds));
+    num_bauds = ARRAY_SIZE(default_bauds);
+  }
+  for (size_t i = 0; i < num_bauds; i++) {
+    if (bauds[i] <= 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  const char *path = argv[optind];
+  int ret = 0;
+
+  printf("%-12s %8s %9s %9s %11s %9s %9s %8s\n", "workload", "baud",
+         "commands", "answered", "commands/s", "p50 (us)", "p99 (us)",
+         "dropped");
+  fflush(stdout);
+
+  // Typed keys are far apart, whatever the baud rate
+  result_t res = {0};
+  size_t typed = ARRAY_SIZE(pty_cmds);
+  if (run_typing(path, typed, interval_ms, &res) < 0) {
+    return 1;
+  }
+  print_result("typing", 0, &res);
+  ret |= res.answered != typed || res.dropped != 0;
+
+  for (size_t i = 0; i < num_bauds; i++) {
+    memset(&res, 0, sizeof(res));
+    if (run_back_to_back(path, n, bauds[i], &res) < 0) {
+      return 1;
+    }
+    print_result("back-to-back", bauds[i], &res);
+    ret |= res.answered != n || res.dropped != 0;
+  }
+  for (size_t i = 0; i < num_bauds; i++) {
+    memset(&res, 0, sizeof(res));
+    if (run_paste(path, n, bauds[i], &res) < 0) {
+      return 1;
+    }
+    print_result("paste", bauds[i], &res);
+    ret |= res.dropped < 0 || (strict && res.dropped != 0);
+  }
+  return ret;
+}
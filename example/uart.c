@@ -31,15 +31,29 @@
  */
 #include "uart.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
-#include <stdio.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
 
+#define UART_RX_CHUNK 256
+#define UART_TX_BUF 512
+
+typedef void (*uart_rx_cb_t)(const char *, size_t);
+
 static struct termios termios_orig;
-static void (*uart_rx_callback)(char ch);
-static pthread_spinlock_t spinlock;
+static int stdin_flags;
+static int stdout_flags;
+static _Atomic(uart_rx_cb_t) uart_rx_callback;
+
+// Written by the main loop only, see uart_write
+static char tx_buf[UART_TX_BUF];
+static size_t tx_len;
 
 void termios_enable_raw_mode(void) {
   tcgetattr(STDIN_FILENO, &termios_orig);
@@ -52,50 +66,113 @@ void termios_disable_raw_mode(void) {
   tcsetattr(STDIN_FILENO, TCSANOW, &termios_orig);
 }
 
-void uart_default_rx_callback(char ch) { (void)ch; }
+static void uart_enable_nonblock(void) {
+  stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
+  stdout_flags = fcntl(STDOUT_FILENO, F_GETFL);
+  fcntl(STDIN_FILENO, F_SETFL, stdin_flags | O_NONBLOCK);
+  fcntl(STDOUT_FILENO, F_SETFL, stdout_flags | O_NONBLOCK);
+}
 
-static void *uart_rx_thread(void *arg) {
+// stdin and stdout usually share the terminal with the shell, leave them as
+// they were found
+static void uart_disable_nonblock(void) {
+  uart_flush();
+  fcntl(STDIN_FILENO, F_SETFL, stdin_flags);
+  fcntl(STDOUT_FILENO, F_SETFL, stdout_flags);
+}
 
-  (void)arg;
+void uart_default_rx_callback(const char *buf, size_t len) {
+  (void)buf;
+  (void)len;
+}
 
-  int ch;
+/**
+ * @brief wait until fd is ready for events
+ *
+ * @return 0 on success, -1 on error or hang up with nothing left to read
+ */
+static int uart_poll(int fd, short events) {
+  struct pollfd pfd = {.fd = fd, .events = events};
 
-  while (ch = uart_getchar(), ch != EOF) {
-    pthread_spin_lock(&spinlock);
-    void (*cb)(char) = uart_rx_callback;
-    pthread_spin_unlock(&spinlock);
-    cb(ch);
+  while (poll(&pfd, 1, -1) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
   }
+  return (pfd.revents & (events | POLLHUP)) ? 0 : -1;
+}
 
-  pthread_exit(&ch);
+static void *uart_rx_thread(void *arg) {
+  char buf[UART_RX_CHUNK];
+
+  (void)arg;
+
+  // Hands every chunk read to the callback at once, not byte per byte
+  while (uart_poll(STDIN_FILENO, POLLIN) == 0) {
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n == 0) {
+      break; // EOF
+    }
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    uart_rx_cb_t cb =
+        atomic_load_explicit(&uart_rx_callback, memory_order_acquire);
+    cb(buf, (size_t)n);
+  }
 
   return NULL;
 }
 
-int uart_putchar(int ch) {
-  size_t n = fwrite(&ch, 1, 1, stdout);
-  if (n != 1) {
-    return EOF;
+static int uart_write_all(const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(STDOUT_FILENO, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN || uart_poll(STDOUT_FILENO, POLLOUT) < 0) {
+        return -1;
+      }
+      continue;
+    }
+    buf += n;
+    len -= (size_t)n;
   }
-  return ch;
+  return 0;
 }
 
-int uart_getchar(void) {
-  char ch;
-  size_t n = fread(&ch, 1, 1, stdin);
-  if (n != 1) {
-    return EOF;
+size_t uart_write(const void *ptr, size_t size) {
+  const char *p = (const char *)ptr;
+
+  if (tx_len + size > sizeof(tx_buf)) {
+    if (uart_flush() < 0) {
+      return 0;
+    }
+    // Too large to be buffered, write it out straight away
+    if (size > sizeof(tx_buf)) {
+      return uart_write_all(p, size) < 0 ? 0 : size;
+    }
   }
-  return ch;
+  memcpy(&tx_buf[tx_len], p, size);
+  tx_len += size;
+  return size;
 }
 
-int uart_flush(void) { return fflush(stdout); }
+int uart_flush(void) {
+  int ret = uart_write_all(tx_buf, tx_len);
 
-void uart_register_rx_callback(void (*cb)(char)) {
+  tx_len = 0;
+  return ret;
+}
 
-  pthread_spin_lock(&spinlock);
-  uart_rx_callback = cb ? cb : uart_default_rx_callback;
-  pthread_spin_unlock(&spinlock);
+void uart_register_rx_callback(void (*cb)(const char *, size_t)) {
+  atomic_store_explicit(&uart_rx_callback,
+                        cb ? cb : uart_default_rx_callback,
+                        memory_order_release);
 }
 
 void uart_init(void) {
@@ -103,10 +180,11 @@ void uart_init(void) {
   termios_enable_raw_mode();
   atexit(termios_disable_raw_mode);
 
-  pthread_spin_init(&spinlock, 0);
+  uart_enable_nonblock();
+  atexit(uart_disable_nonblock);
 
-  uart_rx_callback = uart_default_rx_callback;
+  atomic_init(&uart_rx_callback, uart_default_rx_callback);
 
   pthread_t thread_id;
   pthread_create(&thread_id, NULL, uart_rx_thread, NULL);
-}
\ No newline at end of file
+}
@@ -32,13 +32,29 @@
 #ifndef UART_H
 #define UART_H
 
-int uart_putchar(int);
+#include <stddef.h>
 
-int uart_getchar(void);
+/**
+ * @brief buffers size bytes of ptr, they are written out on \link uart_flush
+ * \endlink or when the transmit buffer is full. Not thread-safe, it must only
+ * be called from the main loop
+ *
+ * @return the number of bytes written, 0 on error
+ */
+size_t uart_write(const void *ptr, size_t size);
 
+/**
+ * @brief writes the transmit buffer out, waiting for the terminal if needed
+ *
+ * @return 0 on success, -1 on error
+ */
 int uart_flush(void);
 
-void uart_register_rx_callback(void (*)(char));
+/**
+ * @brief registers the callback receiving every chunk read from the UART. It
+ * is called from the RX thread
+ */
+void uart_register_rx_callback(void (*)(const char *buf, size_t len));
 
 void uart_init(void);
 
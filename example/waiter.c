@@ -0,0 +1,86 @@
+/**
+ * @file waiter.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Blocks the main loop until the command line interpreter has input
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "waiter.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+int waiter_init(waiter_t *w) {
+  w->fd = -1;
+  w->ready = false;
+#ifdef __linux__
+  w->fd = eventfd(0, EFD_CLOEXEC);
+  if (w->fd >= 0) {
+    return 0;
+  }
+#endif
+  if (pthread_mutex_init(&w->mutex, NULL) != 0 ||
+      pthread_cond_init(&w->cond, NULL) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+void waiter_notify(void *ctx, int events) {
+  waiter_t *w = ctx;
+  (void)events;
+
+  if (w->fd >= 0) {
+    uint64_t one = 1;
+    (void)write(w->fd, &one, sizeof(one));
+    return;
+  }
+
+  pthread_mutex_lock(&w->mutex);
+  w->ready = true;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+void waiter_wait(waiter_t *w) {
+  if (w->fd >= 0) {
+    uint64_t value;
+    (void)read(w->fd, &value, sizeof(value));
+    return;
+  }
+
+  pthread_mutex_lock(&w->mutex);
+  while (!w->ready) {
+    pthread_cond_wait(&w->cond, &w->mutex);
+  }
+  w->ready = false;
+  pthread_mutex_unlock(&w->mutex);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file waiter.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Blocks the main loop until the command line interpreter has input
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef WAITER_H
+#define WAITER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/**
+ * @brief Wake-up source of the main loop. An eventfd on Linux, so that it may
+ * also be polled along with other descriptors, and a condition variable
+ * elsewhere
+ *
+ */
+typedef struct waiter_s {
+  int fd;                /**< eventfd. -1 if the condition variable is used */
+  pthread_mutex_t mutex; /**< protects ready */
+  pthread_cond_t cond;   /**< signaled when ready is set */
+  bool ready;            /**< notified since the last wait */
+} waiter_t;
+
+/**
+ * @brief Initialize the waiter
+ *
+ * @param w the waiter
+ * @return int 0 on success, -1 on error
+ */
+int waiter_init(waiter_t *w);
+
+/**
+ * @brief Notify callback to register with cli_register_notify_callback, with
+ * the waiter as context
+ *
+ * @param ctx the waiter
+ * @param events CLI_NOTIFY_ flags
+ */
+void waiter_notify(void *ctx, int events);
+
+/**
+ * @brief Block until notified. Notifications received since the last call
+ * return at once
+ *
+ * @param w the waiter
+ */
+void waiter_wait(waiter_t *w);
+
+#endif /*WAITER_H*/
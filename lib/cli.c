@@ -30,6 +30,9 @@
  * SOFTWARE.
  */
 #include "cli.h"
+#ifdef CLI_USE_TRACE
+#include "trace.h"
+#endif
 
 #include <ctype.h>
 #include <stdio.h>
@@ -38,6 +41,49 @@
 // strings.h may not be available on all embedded toolchains
 // We'll provide our own strcasecmp if needed
 
+#if !defined(CLI_NO_SOURCE) &&                                               \
+    (defined(__unix__) || defined(__linux__) ||                              \
+     (defined(__APPLE__) && defined(__MACH__)))
+#define CLI_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef CLI_THREAD_LOCAL
+#if defined(CLI_NO_THREAD_LOCAL)
+#define CLI_THREAD_LOCAL
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) &&           \
+    !defined(__STDC_NO_THREADS__)
+#define CLI_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define CLI_THREAD_LOCAL __thread
+#else
+#define CLI_THREAD_LOCAL
+#endif
+#endif
+
+#ifdef CLI_USE_TRACE
+#define CLI_TRACE(cli, event, phase, arg) cli_trace(cli, event, phase, arg)
+#else
+#define CLI_TRACE(cli, event, phase, arg) ((void)0)
+#endif
+
+// Relaxed access of the CLI_ATOMIC fields, which order no other memory
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&               \
+    !defined(__STDC_NO_ATOMICS__)
+#define CLI_LOAD(obj) atomic_load_explicit(&(obj), memory_order_relaxed)
+#define CLI_STORE(obj, val)                                                    \
+  atomic_store_explicit(&(obj), (val), memory_order_relaxed)
+#define CLI_ADD(obj, val)                                                      \
+  ((void)atomic_fetch_add_explicit(&(obj), (val), memory_order_relaxed))
+#else
+#define CLI_LOAD(obj) (obj)
+#define CLI_STORE(obj, val) ((obj) = (val))
+#define CLI_ADD(obj, val) ((void)((obj) += (val)))
+#endif
+
 #define CLI_CMD_LIST_TRV_NEXT (0)
 #define CLI_CMD_LIST_TRV_SKIP (1)
 #define CLI_CMD_LIST_TRV_END (2)
@@ -49,6 +95,18 @@ static int cli_cmd_clear(cli_t *cli, int argc, char **argv);
 #ifdef CLI_USE_HISTORY
 static int cli_cmd_history(cli_t *cli, int argc, char **argv);
 #endif
+#ifdef CLI_HAVE_MMAP
+static int cli_cmd_source(cli_t *cli, int argc, char **argv);
+#endif
+#ifdef CLI_USE_WATCH
+static int cli_cmd_watch(cli_t *cli, int argc, char **argv);
+#endif
+#ifdef CLI_USE_CACHE
+static int cli_cmd_cache(cli_t *cli, int argc, char **argv);
+#endif
+#ifdef CLI_USE_STATS
+static int cli_cmd_stats(cli_t *cli, int argc, char **argv);
+#endif
 
 static const char *const cli_default_prompt = CLI_PROMPT;
 static const char *const CLI_MSG_CMD_OK = "Ok\r\n";
@@ -58,6 +116,14 @@ static const char *const CLI_MSG_NUM_ARG_ERR =
 static const char *const CLI_MSG_LINE_LENGTH_ERR =
     "Error: The line length exceeds maximum of CLI_LINE_MAX\r\n";
 static const char *const CLI_MSG_CMD_UNKNOWN = "Unknown command\r\n";
+static const char *const CLI_MSG_CMD_CANCELLED = "Cancelled\r\n";
+static const char *const CLI_MSG_SCRIPT_DEPTH_ERR =
+    "Error: Scripts nesting exceeds maximum of CLI_SCRIPT_DEPTH\r\n";
+#ifdef CLI_USE_WATCH
+static const char *const CLI_MSG_WATCH_NUM_ERR =
+    "Error: The number of watches exceeds maximum of CLI_WATCH_NUM\r\n";
+static const cli_time_t cli_watch_default_period = 1000;
+#endif
 
 /**
  * @brief default command line interpreter write function
@@ -119,6 +185,106 @@ static void cli_cmd_quit_default_cb(void) {
 #endif
 }
 
+/**
+ * @brief output capture of \link cli_exec \endlink
+ *
+ */
+typedef struct cli_capture_s {
+  char *buf;  /**< caller buffer */
+  size_t cap; /**< caller buffer capacity, not counting the NULL byte */
+  size_t len; /**< number of bytes written by the handler */
+} cli_capture_t;
+
+/**
+ * @brief command line interpreter whose command handler is running on this
+ * thread. It routes the legacy write and flush fields, which have no context
+ * argument, to the right session
+ */
+static CLI_THREAD_LOCAL cli_t *cli_current;
+
+size_t cli_write(cli_t *cli, const void *ptr, size_t size) {
+  cli_capture_t *capture = cli->capture;
+
+  if (capture != NULL) {
+    // Bytes that do not fit the caller buffer are counted but dropped
+    if (capture->len < capture->cap) {
+      size_t n = capture->cap - capture->len;
+      memcpy(capture->buf + capture->len, ptr, size < n ? size : n);
+    }
+    capture->len += size;
+    return size;
+  }
+
+  if (cli->ops != NULL) {
+    return cli->ops->write(cli->ctx, ptr, size);
+  }
+  return cli->write(ptr, size);
+}
+
+int cli_flush(cli_t *cli) {
+  if (cli->capture != NULL) {
+    return 0;
+  }
+  if (cli->ops != NULL) {
+    return cli->ops->flush(cli->ctx);
+  }
+  return cli->flush();
+}
+
+/**
+ * @brief lock the command line interpreter if a lock function is registered
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_lock(cli_t *cli) {
+  if (cli->ops != NULL) {
+    if (cli->ops->lock) {
+      cli->ops->lock(cli->ctx);
+    }
+  } else if (cli->lock) {
+    cli->lock();
+  }
+}
+
+/**
+ * @brief unlock the command line interpreter if an unlock function is
+ * registered
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_unlock(cli_t *cli) {
+  if (cli->ops != NULL) {
+    if (cli->ops->unlock) {
+      cli->ops->unlock(cli->ctx);
+    }
+  } else if (cli->unlock) {
+    cli->unlock();
+  }
+}
+
+/**
+ * @brief legacy write field of a command line interpreter using an ops table
+ * or capturing. It writes to the command line interpreter whose handler runs
+ * on this thread
+ *
+ * @param ptr pinter to the buffer to be written
+ * @param size number of bytes to write
+ * @return size_t number of bytes written. 0 if no handler is running
+ */
+static size_t cli_current_write(const void *ptr, size_t size) {
+  return cli_current ? cli_write(cli_current, ptr, size) : 0;
+}
+
+/**
+ * @brief legacy flush field of a command line interpreter using an ops table
+ * or capturing
+ *
+ * @return int Upon successful completion 0 is returned.
+ */
+static int cli_current_flush(void) {
+  return cli_current ? cli_flush(cli_current) : 0;
+}
+
 /**
  * @brief build-in default command list
  *
@@ -134,6 +300,28 @@ static const cli_cmd_t cli_default_cmd_list[] = {
      .desc = "(|clear). Print or clear past commands",
      .handler = cli_cmd_history},
 #endif /* CLI_USE_HISTORY */
+#ifdef CLI_HAVE_MMAP
+    {.name = "source",
+     .desc = "[-e] FILE. Execute commands from FILE. -e stops on first error",
+     .handler = cli_cmd_source},
+#endif /* CLI_HAVE_MMAP */
+#ifdef CLI_USE_WATCH
+    {.name = "watch",
+     .desc = "[-n MS] CMD. Run CMD every MS (default 1000) milliseconds "
+             "until a key is pressed. List watches if CMD is omitted",
+     .handler = cli_cmd_watch},
+#endif /* CLI_USE_WATCH */
+#ifdef CLI_USE_CACHE
+    {.name = "cache",
+     .desc = "(|clear). Print or clear the hot-line cache hits and misses",
+     .handler = cli_cmd_cache},
+#endif /* CLI_USE_CACHE */
+#ifdef CLI_USE_STATS
+    {.name = "stats",
+     .desc = "(|clear). Print or clear the commands calls, errors and "
+             "latency histograms",
+     .handler = cli_cmd_stats},
+#endif /* CLI_USE_STATS */
     {.name = "quit",
      .desc = "Quit command line interpreter",
      .handler = cli_cmd_quit},
@@ -169,609 +357,2566 @@ static int cli_cmd_clear(cli_t *cli, int argc, char **argv) {
     return -1;
   }
 
-  cli->write("\x1b[2J\x1b[H", 7);
+  cli_write(cli, "\x1b[2J\x1b[H", 7);
 
   return 0;
 }
 
-#ifdef CLI_USE_HISTORY
-static void cli_history_push(cli_t *cli, const char *line) {
-  if (strlen(line) == 0) {
-    return;
-  }
-  // Don't add if same as last
-  if (cli->history.count > 0) {
-    size_t last_idx =
-        (cli->history.write_idx + CLI_HISTORY_NUM - 1) % CLI_HISTORY_NUM;
-    if (strcmp(cli->history.buf[last_idx], line) == 0) {
-      return;
-    }
-  }
+#if defined(CLI_USE_HISTORY_DEDUP) || defined(CLI_USE_CACHE)
+#define CLI_FNV1A_INIT (2166136261u) /**< FNV-1a offset basis */
 
-  strncpy(cli->history.buf[cli->history.write_idx], line, CLI_LINE_MAX - 1);
-  cli->history.buf[cli->history.write_idx][CLI_LINE_MAX - 1] = '\0';
-  cli->history.write_idx = (cli->history.write_idx + 1) % CLI_HISTORY_NUM;
-  if (cli->history.count < CLI_HISTORY_NUM) {
-    cli->history.count++;
-  }
-}
+/**
+ * @brief continue a FNV-1a hash over len bytes
+ *
+ * @param hash the hash of the previous bytes, \link CLI_FNV1A_INIT \endlink
+ * for none
+ * @param ptr the bytes
+ * @param len the number of bytes
+ * @return uint32_t the hash
+ */
+static uint32_t cli_fnv1a(uint32_t hash, const void *ptr, size_t len) {
+  const uint8_t *p = (const uint8_t *)ptr;
 
-static int cli_cmd_history(cli_t *cli, int argc, char **argv) {
-  if (argc == 2 && strcmp(argv[1], "clear") == 0) {
-    cli->history.count = 0;
-    cli->history.write_idx = 0;
-    cli->history.browse_idx = -1;
-    return 0;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ p[i]) * 16777619u;
   }
+  return hash;
+}
+#endif
 
-  if (argc > 1) {
-    return -1;
-  }
+#ifdef CLI_USE_HISTORY
+/**
+ * @brief Size of the length prefix of a history entry. The length is repeated
+ * after the entry so that the ring is walked backward too
+ *
+ */
+#define CLI_HISTORY_HDR ((CLI_LINE_MAX > 256) ? 2u : 1u)
 
-  for (size_t i = 0; i < cli->history.count; i++) {
-    size_t idx =
-        (cli->history.write_idx + CLI_HISTORY_NUM - cli->history.count + i) %
-        CLI_HISTORY_NUM;
-    char num[24];
-    snprintf(num, sizeof(num), "%2zu ", i + 1);
-    cli->write(num, strlen(num));
-    cli->write(cli->history.buf[idx], strlen(cli->history.buf[idx]));
-    cli->write("\r\n", 2);
-  }
-  return 0;
-}
+#ifdef CLI_USE_HISTORY_DEDUP
+/**
+ * @brief Size of the link following the length prefix, the offset + 1 of the
+ * next older entry of the same index slot. An erased entry links to itself
+ *
+ */
+#define CLI_HISTORY_LINK (2u)
+#else
+#define CLI_HISTORY_LINK (0u)
 #endif
 
 /**
- * @brief Traverse the commands list and callback the caller for every group and
- * command using cb. cb function takes 3 parameters: Pointer to the command
- * line interpreter struct, pointer to command group struct and pointer to the
- * command struct. for every new group found the command struct argument is set
- * to NULL. cb return \link CLI_CMD_LIST_TRV_NEXT \endlink to indicated to
- * traverser to continue traversing,  \link CLI_CMD_LIST_TRV_SKIP \endlink to
- * skip the current group \link CLI_CMD_LIST_TRV_END \endlink to end traversing.
+ * @brief Offset of the line in a history entry
+ *
+ */
+#define CLI_HISTORY_DATA (CLI_HISTORY_HDR + CLI_HISTORY_LINK)
+
+/**
+ * @brief Number of bytes of a history entry of length len
+ *
+ */
+#define CLI_HISTORY_ENTRY_SIZE(len) (CLI_HISTORY_DATA + CLI_HISTORY_HDR + (len))
+
+/**
+ * @brief copy len bytes of src into the history ring at offset off
+ *
  * @param cli the command line interpreter struct
- * @param cb callback function
- * @return int 0 if the whole list was traversed, 1 if the traversing ended at a
- * group or 2  if the traversing ended at a command
+ * @param off the ring offset
+ * @param src the bytes to copy
+ * @param len the number of bytes
  */
-static int cli_cmd_list_traverser(cli_t *cli,
-                                  int (*cb)(cli_t *, const cli_cmd_group_t *,
-                                            const cli_cmd_t *)) {
+static void cli_history_put(cli_t *cli, size_t off, const void *src,
+                            size_t len) {
+  size_t first = cli->history.size - off;
 
-  if (cli->cmd_list == NULL) {
-    return 0;
+  if (first > len) {
+    first = len;
   }
+  memcpy(&cli->history.buf[off], src, first);
+  memcpy(cli->history.buf, (const char *)src + first, len - first);
+}
 
-  if (cli->cmd_list->cmds != NULL) {
-    for (size_t i = 0; i < cli->cmd_list->cmds_length; i++) {
-      int ret = cb(cli, NULL, &cli->cmd_list->cmds[i]);
-      if (ret == CLI_CMD_LIST_TRV_END) {
-        return 2;
-      }
-    }
-  }
+/**
+ * @brief get the length of the entry at offset off
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @return size_t the entry length, without its prefix
+ */
+static size_t cli_history_len(const cli_t *cli, size_t off) {
+  const uint8_t *buf = (const uint8_t *)cli->history.buf;
+  size_t len = buf[off];
 
-  if (cli->cmd_list->groups == NULL) {
-    return 0;
+  if (CLI_HISTORY_HDR > 1) {
+    len |= (size_t)buf[(off + 1) % cli->history.size] << 8;
   }
+  return len;
+}
 
-  for (size_t i = 0; i < cli->cmd_list->length; i++) {
+/**
+ * @brief get the offset of the entry stored after the one at offset off,
+ * erased or not
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @return size_t the ring offset of the following entry
+ */
+static size_t cli_history_step(const cli_t *cli, size_t off) {
+  return (off + CLI_HISTORY_ENTRY_SIZE(cli_history_len(cli, off))) %
+         cli->history.size;
+}
 
-    const cli_cmd_group_t *group = cli->cmd_list->groups[i];
+/**
+ * @brief get the offset of the entry stored before the one at offset off,
+ * erased or not
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry, or of the end of the newest one
+ * @return size_t the ring offset of the preceding entry
+ */
+static size_t cli_history_back(const cli_t *cli, size_t off) {
+  size_t size = cli->history.size;
+  size_t trailer = (off + size - CLI_HISTORY_HDR) % size;
 
-    int ret = cb(cli, group, NULL);
+  return (trailer + size - CLI_HISTORY_DATA - cli_history_len(cli, trailer)) %
+         size;
+}
 
-    if (ret == CLI_CMD_LIST_TRV_SKIP) {
-      continue;
-    } else if (ret == CLI_CMD_LIST_TRV_END) {
-      return 1;
-    } else {
-      ;
-    }
+#ifdef CLI_USE_HISTORY_DEDUP
+/**
+ * @brief get the link of the entry at offset off
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @return size_t the offset + 1 of the next older entry of its index slot, 0
+ * if none
+ */
+static size_t cli_history_link(const cli_t *cli, size_t off) {
+  const uint8_t *buf = (const uint8_t *)cli->history.buf;
+  size_t size = cli->history.size;
 
-    if (group->cmds == NULL) {
-      continue;
-    }
-    for (size_t j = 0; j < group->length; j++) {
+  return buf[(off + CLI_HISTORY_HDR) % size] |
+         (size_t)buf[(off + CLI_HISTORY_HDR + 1) % size] << 8;
+}
 
-      const cli_cmd_t *cmd = &group->cmds[j];
+/**
+ * @brief check that the entry at offset off was erased, see \link
+ * cli_history_erase \endlink
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @return true if it was erased
+ */
+static bool cli_history_dead(const cli_t *cli, size_t off) {
+  return cli_history_link(cli, off) == off + 1;
+}
+#endif
 
-      ret = cb(cli, group, cmd);
-      if (ret == CLI_CMD_LIST_TRV_SKIP) {
-        continue;
-      } else if (ret == CLI_CMD_LIST_TRV_END) {
-        return 2;
-      } else {
-        ;
-      }
-    }
+/**
+ * @brief get the offset of the entry following the one at offset off
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @return size_t the ring offset of the next entry
+ */
+static size_t cli_history_next(const cli_t *cli, size_t off) {
+  off = cli_history_step(cli, off);
+#ifdef CLI_USE_HISTORY_DEDUP
+  // The newest entry is never erased, nor read past
+  size_t end = (cli->history.head + cli->history.used) % cli->history.size;
+  while (off != end && cli_history_dead(cli, off)) {
+    off = cli_history_step(cli, off);
   }
-  return 0;
+#endif
+  return off;
 }
 
-static int cli_cmd_help_traverser_cb(cli_t *cli, const cli_cmd_group_t *group,
-                                     const cli_cmd_t *cmd) {
-  const char *name;
-  const char *desc;
-  if (group && !cmd) {
-    name = group->name;
-    desc = group->desc;
-    cli->write("\r\n", 2);
-  } else {
-    if (group) {
-      cli->write(" ", 1);
-    }
-    name = cmd->name;
-    desc = cmd->desc;
+/**
+ * @brief get the offset of the entry preceding the one at offset off
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry, or of the end of the newest one
+ * @return size_t the ring offset of the previous entry
+ */
+static size_t cli_history_prev(const cli_t *cli, size_t off) {
+  off = cli_history_back(cli, off);
+#ifdef CLI_USE_HISTORY_DEDUP
+  // The oldest entry is never erased, see cli_history_trim
+  while (cli_history_dead(cli, off)) {
+    off = cli_history_back(cli, off);
   }
-
-  cli->write(name, strlen(name));
-  cli->write("\t", 1);
-  cli->write(desc, strlen(desc));
-  cli->write("\r\n", 2);
-
-  return CLI_CMD_LIST_TRV_NEXT;
+#endif
+  return off;
 }
 
 /**
- * @brief build-in help command handler
+ * @brief get the number of leading bytes of the entry at offset off that are
+ * the same as the ones of str
  *
  * @param cli the command line interpreter struct
- * @param argc arguments count
- * @param argv arguments vector
- * @return int On success 0 is return. Otherwise non zero value
+ * @param off the ring offset of the entry
+ * @param pos the position in the entry to start comparing from
+ * @param str the string to compare
+ * @param len the string length
+ * @return size_t number of matching bytes
  */
-static int cli_cmd_help(cli_t *cli, int argc, char **argv) {
-
-  (void)argv;
+static size_t cli_history_common(const cli_t *cli, size_t off, size_t pos,
+                                 const char *str, size_t len) {
+  size_t entry_len = cli_history_len(cli, off);
+  size_t i;
 
-  if (argc > 3) {
-    return -1;
+  if (pos >= entry_len) {
+    return 0;
   }
-
-  for (size_t i = 0; i < ARRAY_SIZE(cli_default_cmd_list); i++) {
-    cli->write(cli_default_cmd_list[i].name,
-               strlen(cli_default_cmd_list[i].name));
-    cli->write("\t", 1);
-    cli->write(cli_default_cmd_list[i].desc,
-               strlen(cli_default_cmd_list[i].desc));
-    cli->write("\r\n", 2);
+  if (len > entry_len - pos) {
+    len = entry_len - pos;
   }
-
-  cli_cmd_list_traverser(cli, cli_cmd_help_traverser_cb);
-
-  return 0;
+  off = (off + CLI_HISTORY_DATA + pos) % cli->history.size;
+  for (i = 0; i < len && cli->history.buf[off] == str[i]; i++) {
+    if (++off == cli->history.size) {
+      off = 0;
+    }
+  }
+  return i;
 }
 
 /**
- * @brief build-in echo command handler
+ * @brief check that the entry at offset off contains str
  *
  * @param cli the command line interpreter struct
- * @param argc arguments count
- * @param argv arguments vector
- * @return int On success 0 is return. Otherwise non zero value
+ * @param off the ring offset of the entry
+ * @param str the string to find
+ * @param len the string length
+ * @return true if str was found
  */
-static int cli_cmd_echo(cli_t *cli, int argc, char **argv) {
+static bool cli_history_contains(const cli_t *cli, size_t off,
+                                 const char *str, size_t len) {
+  size_t entry_len = cli_history_len(cli, off);
 
-  if (argc != 2) {
-    return -1;
+  for (size_t pos = 0; pos + len <= entry_len; pos++) {
+    if (cli_history_common(cli, off, pos, str, len) == len) {
+      return true;
+    }
   }
+  return false;
+}
 
-  if (!strcmp("on", argv[1])) {
-    cli->echo = true;
-  } else if (!strcmp("off", argv[1])) {
-    cli->echo = false;
-  } else {
-    return -2;
+/**
+ * @brief compare the entry at offset off with line
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @param line the line to compare
+ * @param len the line length
+ * @return true if they are the same
+ */
+static bool cli_history_equal(const cli_t *cli, size_t off, const char *line,
+                              size_t len) {
+  if (cli_history_len(cli, off) != len) {
+    return false;
   }
 
-  return 0;
+  off = (off + CLI_HISTORY_DATA) % cli->history.size;
+  size_t first = cli->history.size - off;
+  if (first > len) {
+    first = len;
+  }
+  return memcmp(&cli->history.buf[off], line, first) == 0 &&
+         memcmp(cli->history.buf, line + first, len - first) == 0;
 }
 
 /**
- * @brief build-in quit command handler
+ * @brief call cb with the entry at offset off, in one or two chunks if it
+ * wraps around the end of the ring
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @param cb called with every chunk
+ * @param ctx passed to cb
+ */
+static void cli_history_read(cli_t *cli, size_t off,
+                             void (*cb)(void *ctx, const char *ptr,
+                                        size_t len),
+                             void *ctx) {
+  size_t len = cli_history_len(cli, off);
+
+  off = (off + CLI_HISTORY_DATA) % cli->history.size;
+  size_t first = cli->history.size - off;
+  if (first > len) {
+    first = len;
+  }
+  cb(ctx, &cli->history.buf[off], first);
+  if (len > first) {
+    cb(ctx, cli->history.buf, len - first);
+  }
+}
+
+#ifdef CLI_USE_HISTORY_DEDUP
+static void cli_history_hash_cb(void *ctx, const char *ptr, size_t len) {
+  uint32_t *hash = (uint32_t *)ctx;
+
+  *hash = cli_fnv1a(*hash, ptr, len);
+}
+
+/**
+ * @brief get the index slot of a line, from its FNV-1a hash
+ *
+ * @param cli the command line interpreter struct
+ * @param line the line, not NULL terminated
+ * @param len the line length
+ * @return uint16_t* the slot
+ */
+static uint16_t *cli_history_slot(cli_t *cli, const char *line, size_t len) {
+  uint32_t hash = cli_fnv1a(CLI_FNV1A_INIT, line, len);
+
+  return &cli->history.index[hash % CLI_HISTORY_HASH_NUM];
+}
+
+/**
+ * @brief get the index slot of the entry at offset off
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @return uint16_t* the slot
+ */
+static uint16_t *cli_history_entry_slot(cli_t *cli, size_t off) {
+  uint32_t hash = CLI_FNV1A_INIT;
+
+  cli_history_read(cli, off, cli_history_hash_cb, &hash);
+  return &cli->history.index[hash % CLI_HISTORY_HASH_NUM];
+}
+
+/**
+ * @brief set the link of the entry at offset off
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ * @param link the offset + 1 of the next older entry of its index slot, 0 if
+ * none, off + 1 to erase it
+ */
+static void cli_history_set_link(cli_t *cli, size_t off, size_t link) {
+  uint8_t bytes[CLI_HISTORY_LINK] = {(uint8_t)link, (uint8_t)(link >> 8)};
+
+  cli_history_put(cli, (off + CLI_HISTORY_HDR) % cli->history.size, bytes,
+                  CLI_HISTORY_LINK);
+}
+
+/**
+ * @brief get the number of bytes stored before the entry at offset off
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset
+ * @return size_t the distance from the oldest entry
+ */
+static size_t cli_history_age(const cli_t *cli, size_t off) {
+  return (off + cli->history.size - cli->history.head) % cli->history.size;
+}
+
+/**
+ * @brief find the entry equal to line among the entries of its index slot,
+ * and unlink it from them
+ *
+ * @param cli the command line interpreter struct
+ * @param slot the index slot of the line
+ * @param line the line, not NULL terminated
+ * @param len the line length
+ * @return size_t the offset + 1 of the entry, 0 if none
+ */
+static size_t cli_history_unlink(cli_t *cli, uint16_t *slot, const char *line,
+                                 size_t len) {
+  size_t prev = 0;
+  size_t cur = *slot;
+
+  while (cur != 0) {
+    size_t link = cli_history_link(cli, cur - 1);
+    // The slot links newest first. An entry that is not older than the one
+    // linking it was evicted, and the link is stale
+    if (link != 0 &&
+        cli_history_age(cli, link - 1) >= cli_history_age(cli, cur - 1)) {
+      link = 0;
+    }
+    if (cli_history_equal(cli, cur - 1, line, len)) {
+      if (prev == 0) {
+        *slot = (uint16_t)link;
+      } else {
+        cli_history_set_link(cli, prev - 1, link);
+      }
+      return cur;
+    }
+    prev = cur;
+    cur = link;
+  }
+  return 0;
+}
+
+/**
+ * @brief drop the erased entries at the start of the ring, so that the oldest
+ * entry is never an erased one
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_history_trim(cli_t *cli) {
+  size_t head = cli->history.head;
+
+  while (cli->history.count > 0 && cli_history_dead(cli, head)) {
+    size_t entry = CLI_HISTORY_ENTRY_SIZE(cli_history_len(cli, head));
+    cli->history.used -= entry;
+    cli->history.dead -= entry;
+    head = cli_history_step(cli, head);
+  }
+  cli->history.head = head;
+}
+
+/**
+ * @brief erase the entry at offset off, already unlinked. It keeps its bytes
+ * until it is evicted or \link cli_history_compact \endlink runs
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry, not the newest one
+ */
+static void cli_history_erase(cli_t *cli, size_t off) {
+  cli_history_set_link(cli, off, off + 1);
+  cli->history.dead += CLI_HISTORY_ENTRY_SIZE(cli_history_len(cli, off));
+  cli->history.count--;
+  cli_history_trim(cli);
+}
+
+/**
+ * @brief move the entries back over the erased ones and index them again. It
+ * runs once the erased entries fill a quarter of the ring, so its cost is
+ * spread over the pushes that erased them
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_history_compact(cli_t *cli) {
+  size_t size = cli->history.size;
+  size_t src = cli->history.head;
+  size_t dst = cli->history.head;
+
+  memset(cli->history.index, 0, sizeof(cli->history.index));
+  for (size_t left = cli->history.used; left > 0;) {
+    size_t entry = CLI_HISTORY_ENTRY_SIZE(cli_history_len(cli, src));
+    left -= entry;
+    if (cli_history_dead(cli, src)) {
+      src = (src + entry) % size;
+      continue;
+    }
+    size_t off = dst;
+    for (size_t i = 0; i < entry; i++) {
+      cli->history.buf[dst] = cli->history.buf[src];
+      dst = (dst + 1 == size) ? 0 : dst + 1;
+      src = (src + 1 == size) ? 0 : src + 1;
+    }
+    uint16_t *slot = cli_history_entry_slot(cli, off);
+    cli_history_set_link(cli, off, *slot);
+    *slot = (uint16_t)(off + 1);
+    cli->history.last = off;
+  }
+  cli->history.used -= cli->history.dead;
+  cli->history.dead = 0;
+}
+#endif /* CLI_USE_HISTORY_DEDUP */
+
+static void cli_history_clear(cli_t *cli) {
+#ifdef CLI_USE_HISTORY_DEDUP
+  memset(cli->history.index, 0, sizeof(cli->history.index));
+  cli->history.dead = 0;
+#endif
+  cli->history.head = 0;
+  cli->history.used = 0;
+  cli->history.last = 0;
+  cli->history.count = 0;
+  cli->history.browse_idx = -1;
+  cli->history.search.active = false;
+}
+
+/**
+ * @brief add an entry to the history ring, evicting the oldest entries
+ *
+ * @param cli the command line interpreter struct
+ * @param line the entry, not NULL terminated
+ * @param len the entry length
+ * @return true if it was added, false if empty, too long or same as last
+ */
+static bool cli_history_add(cli_t *cli, const char *line, size_t len) {
+  uint8_t hdr[2] = {(uint8_t)len, (uint8_t)(len >> 8)};
+  size_t need = CLI_HISTORY_ENTRY_SIZE(len);
+
+  if (len == 0 || len >= cli->line_max || need > cli->history.size) {
+    return false;
+  }
+  // Don't add if same as last
+  if (cli->history.count > 0 &&
+      cli_history_equal(cli, cli->history.last, line, len)) {
+    return false;
+  }
+#ifdef CLI_USE_HISTORY_DEDUP
+  // Erase the older duplicate, the new entry takes its place in the index
+  uint16_t *slot = cli_history_slot(cli, line, len);
+  size_t dup = cli_history_unlink(cli, slot, line, len);
+  if (dup != 0) {
+    cli_history_erase(cli, dup - 1);
+  }
+  if (cli->history.used + need > cli->history.size &&
+      cli->history.dead >= cli->history.size / 4) {
+    cli_history_compact(cli);
+  }
+#endif
+
+  // Evict the oldest entries until the new one fits
+  while (cli->history.used + need > cli->history.size) {
+#ifdef CLI_USE_HISTORY_DEDUP
+    // The oldest entry heads its slot only if it is the last one there
+    uint16_t *head_slot = cli_history_entry_slot(cli, cli->history.head);
+    if (*head_slot == cli->history.head + 1) {
+      *head_slot = 0;
+    }
+#endif
+    cli->history.used -=
+        CLI_HISTORY_ENTRY_SIZE(cli_history_len(cli, cli->history.head));
+    cli->history.head = cli_history_step(cli, cli->history.head);
+    cli->history.count--;
+#ifdef CLI_USE_HISTORY_DEDUP
+    cli_history_trim(cli);
+#endif
+  }
+  if (cli->history.count == 0) {
+    cli->history.head = 0;
+    cli->history.used = 0;
+#ifdef CLI_USE_HISTORY_DEDUP
+    cli->history.dead = 0;
+#endif
+  }
+
+  size_t off = (cli->history.head + cli->history.used) % cli->history.size;
+  cli_history_put(cli, off, hdr, CLI_HISTORY_HDR);
+#ifdef CLI_USE_HISTORY_DEDUP
+  cli_history_set_link(cli, off, *slot);
+  *slot = (uint16_t)(off + 1);
+#endif
+  cli_history_put(cli, (off + CLI_HISTORY_DATA) % cli->history.size, line,
+                  len);
+  cli_history_put(cli, (off + CLI_HISTORY_DATA + len) % cli->history.size, hdr,
+                  CLI_HISTORY_HDR);
+  cli->history.last = off;
+  cli->history.used += need;
+  cli->history.count++;
+  return true;
+}
+
+static void cli_history_push(cli_t *cli, const char *line) {
+  size_t len = strlen(line);
+  const cli_history_store_t *store = cli->history.store;
+
+  if (cli_history_add(cli, line, len) && store != NULL) {
+    store->append(cli->history.store_ctx, line, len);
+  }
+}
+
+size_t cli_set_history_store(cli_t *cli, const cli_history_store_t *store,
+                             void *ctx) {
+  size_t num = 0;
+  size_t used = 0;
+  int len;
+
+  cli->history.store = store;
+  cli->history.store_ctx = ctx;
+  if (store == NULL) {
+    return 0;
+  }
+
+  // The line is the scratch buffer, the newest entries that fit are counted
+  // first then pushed oldest first. Entries too long for the line are skipped
+  while ((len = store->read(ctx, num, cli->line, cli->line_max)) >= 0) {
+    if ((size_t)len < cli->line_max) {
+      used += CLI_HISTORY_ENTRY_SIZE((size_t)len);
+      if (used > cli->history.size) {
+        break;
+      }
+    }
+    num++;
+  }
+
+  cli_history_clear(cli);
+  for (size_t i = num; i-- > 0;) {
+    len = store->read(ctx, i, cli->line, cli->line_max);
+    if (len >= 0 && (size_t)len < cli->line_max) {
+      (void)cli_history_add(cli, cli->line, (size_t)len);
+    }
+  }
+
+  cli->ptr = NULL;
+  *cli->line = '\0';
+  return cli->history.count;
+}
+
+static void cli_history_write_cb(void *ctx, const char *ptr, size_t len) {
+  cli_write((cli_t *)ctx, ptr, len);
+}
+
+static int cli_cmd_history(cli_t *cli, int argc, char **argv) {
+  if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+    cli_history_clear(cli);
+    if (cli->history.store != NULL && cli->history.store->clear != NULL) {
+      cli->history.store->clear(cli->history.store_ctx);
+    }
+    return 0;
+  }
+
+  if (argc > 1) {
+    return -1;
+  }
+
+  size_t off = cli->history.head;
+  for (size_t i = 0; i < cli->history.count; i++) {
+    char num[24];
+    snprintf(num, sizeof(num), "%2zu ", i + 1);
+    cli_write(cli, num, strlen(num));
+    cli_history_read(cli, off, cli_history_write_cb, cli);
+    cli_write(cli, "\r\n", 2);
+    off = cli_history_next(cli, off);
+  }
+  return 0;
+}
+#endif
+
+/**
+ * @brief Traverse the commands list and callback the caller for every group and
+ * command using cb. cb function takes 3 parameters: Pointer to the command
+ * line interpreter struct, pointer to command group struct and pointer to the
+ * command struct. for every new group found the command struct argument is set
+ * to NULL. cb return \link CLI_CMD_LIST_TRV_NEXT \endlink to indicated to
+ * traverser to continue traversing,  \link CLI_CMD_LIST_TRV_SKIP \endlink to
+ * skip the current group \link CLI_CMD_LIST_TRV_END \endlink to end traversing.
+ * @param cli the command line interpreter struct
+ * @param cb callback function
+ * @return int 0 if the whole list was traversed, 1 if the traversing ended at a
+ * group or 2  if the traversing ended at a command
+ */
+static int cli_cmd_list_traverser(cli_t *cli,
+                                  int (*cb)(cli_t *, const cli_cmd_group_t *,
+                                            const cli_cmd_t *)) {
+
+  if (cli->cmd_list == NULL) {
+    return 0;
+  }
+
+  if (cli->cmd_list->cmds != NULL) {
+    for (size_t i = 0; i < cli->cmd_list->cmds_length; i++) {
+      int ret = cb(cli, NULL, &cli->cmd_list->cmds[i]);
+      if (ret == CLI_CMD_LIST_TRV_END) {
+        return 2;
+      }
+    }
+  }
+
+  if (cli->cmd_list->groups == NULL) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < cli->cmd_list->length; i++) {
+
+    const cli_cmd_group_t *group = cli->cmd_list->groups[i];
+
+    int ret = cb(cli, group, NULL);
+
+    if (ret == CLI_CMD_LIST_TRV_SKIP) {
+      continue;
+    } else if (ret == CLI_CMD_LIST_TRV_END) {
+      return 1;
+    } else {
+      ;
+    }
+
+    if (group->cmds == NULL) {
+      continue;
+    }
+    for (size_t j = 0; j < group->length; j++) {
+
+      const cli_cmd_t *cmd = &group->cmds[j];
+
+      ret = cb(cli, group, cmd);
+      if (ret == CLI_CMD_LIST_TRV_SKIP) {
+        continue;
+      } else if (ret == CLI_CMD_LIST_TRV_END) {
+        return 2;
+      } else {
+        ;
+      }
+    }
+  }
+  return 0;
+}
+
+static int cli_cmd_help_traverser_cb(cli_t *cli, const cli_cmd_group_t *group,
+                                     const cli_cmd_t *cmd) {
+  const char *name;
+  const char *desc;
+  if (group && !cmd) {
+    name = group->name;
+    desc = group->desc;
+    cli_write(cli, "\r\n", 2);
+  } else {
+    if (group) {
+      cli_write(cli, " ", 1);
+    }
+    name = cmd->name;
+    desc = cmd->desc;
+  }
+
+  cli_write(cli, name, strlen(name));
+  cli_write(cli, "\t", 1);
+  cli_write(cli, desc, strlen(desc));
+  cli_write(cli, "\r\n", 2);
+
+  return CLI_CMD_LIST_TRV_NEXT;
+}
+
+/**
+ * @brief build-in help command handler
  *
  * @param cli the command line interpreter struct
  * @param argc arguments count
  * @param argv arguments vector
  * @return int On success 0 is return. Otherwise non zero value
  */
-static int cli_cmd_quit(cli_t *cli, int argc, char **argv) {
+static int cli_cmd_help(cli_t *cli, int argc, char **argv) {
 
-  (void)cli;
   (void)argv;
 
-  if (argc != 1) {
+  if (argc > 3) {
     return -1;
   }
 
-  cli->cmd_quit_cb();
+  for (size_t i = 0; i < ARRAY_SIZE(cli_default_cmd_list); i++) {
+    cli_write(cli, cli_default_cmd_list[i].name,
+               strlen(cli_default_cmd_list[i].name));
+    cli_write(cli, "\t", 1);
+    cli_write(cli, cli_default_cmd_list[i].desc,
+               strlen(cli_default_cmd_list[i].desc));
+    cli_write(cli, "\r\n", 2);
+  }
+
+  cli_cmd_list_traverser(cli, cli_cmd_help_traverser_cb);
 
   return 0;
 }
 
 /**
- * @brief write buffer pointed to by ptr of size size to the command line
- * interpreter write to output function. If the echoing is not enable nothing is
- * written
+ * @brief build-in echo command handler
+ *
  * @param cli the command line interpreter struct
- * @param ptr pointer to buffer to be written
- * @param size number of byte to be written
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return int On success 0 is return. Otherwise non zero value
+ */
+static int cli_cmd_echo(cli_t *cli, int argc, char **argv) {
+
+  if (argc != 2) {
+    return -1;
+  }
+
+  if (!strcmp("on", argv[1])) {
+    cli->echo = true;
+  } else if (!strcmp("off", argv[1])) {
+    cli->echo = false;
+  } else {
+    return -2;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief build-in quit command handler
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return int On success 0 is return. Otherwise non zero value
+ */
+static int cli_cmd_quit(cli_t *cli, int argc, char **argv) {
+
+  (void)cli;
+  (void)argv;
+
+  if (argc != 1) {
+    return -1;
+  }
+
+  if (cli->ops != NULL && cli->ops->quit != NULL) {
+    cli->ops->quit(cli->ctx);
+  } else {
+    cli->cmd_quit_cb();
+  }
+
+  return 0;
+}
+
+/**
+ * @brief write buffer pointed to by ptr of size size to the command line
+ * interpreter write to output function. If the echoing is not enable nothing is
+ * written
+ * @param cli the command line interpreter struct
+ * @param ptr pointer to buffer to be written
+ * @param size number of byte to be written
+ */
+static void cli_echo(cli_t *cli, const void *ptr, size_t size) {
+  if (cli->echo) {
+    CLI_TRACE(cli, CLI_TRACE_ECHO, CLI_TRACE_BEGIN, (uint32_t)size);
+    cli_write(cli, ptr, size);
+    cli_flush(cli);
+    CLI_TRACE(cli, CLI_TRACE_ECHO, CLI_TRACE_END, (uint32_t)size);
+  }
+}
+
+/**
+ * @brief tokenise line in place using space and tab as token delimiter
+ *
+ * @param line the NULL terminated line to tokenise
+ * @param argv arguments vector filled with pointers into line
+ * @param argv_num arguments vector length
+ * @return int number of tokens found. -1 if number of token exceeded argv_num
+ */
+static int cli_tokenize_line(char *line, char **argv, size_t argv_num) {
+  char *token;
+  char *saveptr = line;
+  int argc = 0;
+
+  for (token = strtok_r(line, " \t", &saveptr); token != NULL;
+       token = strtok_r(NULL, " \t", &saveptr)) {
+
+    if ((size_t)argc >= argv_num) {
+      return -1;
+    }
+
+    argv[argc++] = token;
+  }
+  return argc;
+}
+
+void cli_print_prompt(cli_t *cli) {
+  cli_write(cli, cli->prompt, strlen(cli->prompt));
+  cli_write(cli, "> ", 2);
+  cli_flush(cli);
+}
+
+#ifdef CLI_USE_HISTORY
+/**
+ * @brief move the cursor back from the end of the echoed text of old_len
+ * columns to column col, so that only the text after it is redrawn
+ *
+ * @param cli the command line interpreter struct
+ * @param old_len number of columns echoed after the prompt
+ * @param col first column to redraw
+ */
+static void cli_redraw_begin(cli_t *cli, size_t old_len, size_t col) {
+  static const char bs[] = "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
+
+  for (size_t n = old_len - col; n > 0;) {
+    size_t chunk = (n < sizeof(bs) - 1) ? n : sizeof(bs) - 1;
+    cli_echo(cli, bs, chunk);
+    n -= chunk;
+  }
+}
+
+/**
+ * @brief erase what is left of the old text once the new one was echoed
+ *
+ * @param cli the command line interpreter struct
+ * @param old_len number of columns of the old text
+ * @param new_len number of columns of the new text
+ */
+static void cli_redraw_end(cli_t *cli, size_t old_len, size_t new_len) {
+  if (new_len < old_len) {
+    cli_echo(cli, "\x1b[K", 3);
+  }
+}
+
+static const char cli_search_label[] = "(reverse-i-search)`";
+static const char cli_search_sep[] = "': ";
+
+static void cli_history_line_cb(void *ctx, const char *ptr, size_t len) {
+  cli_t *cli = (cli_t *)ctx;
+
+  memcpy(cli->ptr, ptr, len);
+  cli->ptr += len;
+}
+
+static void cli_history_echo_cb(void *ctx, const char *ptr, size_t len) {
+  cli_echo((cli_t *)ctx, ptr, len);
+}
+
+/**
+ * @brief replace the line with the entry at offset off, redrawing from the
+ * first byte they do not have in common
+ *
+ * @param cli the command line interpreter struct
+ * @param off the ring offset of the entry
+ */
+static void cli_history_show(cli_t *cli, size_t off) {
+  size_t old_len = (size_t)(cli->ptr - cli->line);
+  size_t len = cli_history_len(cli, off);
+  size_t col = cli_history_common(cli, off, 0, cli->line, old_len);
+
+  cli_redraw_begin(cli, old_len, col);
+  cli->ptr = cli->line;
+  cli_history_read(cli, off, cli_history_line_cb, cli);
+  *cli->ptr = '\0';
+  cli_echo(cli, cli->line + col, len - col);
+  cli_redraw_end(cli, old_len, len);
+}
+
+/**
+ * @brief browse the entries starting with the text typed before the first UP,
+ * one step from the browsed entry
+ *
+ * @param cli the command line interpreter struct
+ * @param up true for an older entry, false for a newer one
+ */
+static void cli_history_navigate(cli_t *cli, bool up) {
+  int idx = cli->history.browse_idx;
+  size_t off = cli->history.browse_off;
+  size_t prefix_len;
+
+  // Also the case of an instance without history
+  if (cli->history.count == 0) {
+    return;
+  }
+  if (idx == -1) {
+    if (!up) {
+      return;
+    }
+    // One past the newest entry
+    cli->history.prefix_len = (size_t)(cli->ptr - cli->line);
+    idx = (int)cli->history.count;
+    off = (cli->history.head + cli->history.used) % cli->history.size;
+  }
+  prefix_len = cli->history.prefix_len;
+
+  if (up) { // UP or CTRL-P
+    while (idx > 0) {
+      off = cli_history_prev(cli, off);
+      idx--;
+      if (cli_history_common(cli, off, 0, cli->line, prefix_len) ==
+          prefix_len) {
+        cli->history.browse_idx = idx;
+        cli->history.browse_off = off;
+        cli_history_show(cli, off);
+        return;
+      }
+    }
+    // No older entry, stay on the browsed one
+    return;
+  }
+
+  // DOWN or CTRL-N
+  while (idx < (int)cli->history.count - 1) {
+    off = cli_history_next(cli, off);
+    idx++;
+    if (cli_history_common(cli, off, 0, cli->line, prefix_len) ==
+        prefix_len) {
+      cli->history.browse_idx = idx;
+      cli->history.browse_off = off;
+      cli_history_show(cli, off);
+      return;
+    }
+  }
+  // Past the newest entry, back to the typed text
+  size_t old_len = (size_t)(cli->ptr - cli->line);
+  cli_redraw_begin(cli, old_len, prefix_len);
+  cli->ptr = cli->line + prefix_len;
+  *cli->ptr = '\0';
+  cli_redraw_end(cli, old_len, prefix_len);
+  cli->history.browse_idx = -1;
+}
+
+/**
+ * @brief get the number of columns of the search line
+ *
+ * @param cli the command line interpreter struct
+ * @return size_t the number of columns
+ */
+static size_t cli_history_search_cols(const cli_t *cli) {
+  size_t cols = sizeof(cli_search_label) - 1 + cli->history.search.len +
+                sizeof(cli_search_sep) - 1;
+
+  if (cli->history.search.idx != -1) {
+    cols += cli_history_len(cli, cli->history.search.off);
+  }
+  return cols;
+}
+
+/**
+ * @brief redraw the search line from column col, which is not past the start
+ * of the match
+ *
+ * @param cli the command line interpreter struct
+ * @param old_cols number of columns of the old search line
+ * @param col first column to redraw
+ */
+static void cli_history_search_draw(cli_t *cli, size_t old_cols, size_t col) {
+  const char *parts[] = {cli_search_label, cli->history.search.query,
+                         cli_search_sep};
+  size_t lens[] = {sizeof(cli_search_label) - 1, cli->history.search.len,
+                   sizeof(cli_search_sep) - 1};
+  size_t pos = 0;
+
+  cli_redraw_begin(cli, old_cols, col);
+  for (size_t i = 0; i < 3; pos += lens[i++]) {
+    if (pos + lens[i] > col) {
+      size_t skip = (col > pos) ? col - pos : 0;
+      cli_echo(cli, parts[i] + skip, lens[i] - skip);
+    }
+  }
+  if (cli->history.search.idx != -1) {
+    cli_history_read(cli, cli->history.search.off, cli_history_echo_cb, cli);
+  }
+  cli_redraw_end(cli, old_cols, cli_history_search_cols(cli));
+}
+
+/**
+ * @brief find the newest entry containing the query, starting from the entry
+ * idx at offset off and going back in time
+ *
+ * @param cli the command line interpreter struct
+ * @param idx the index of the first entry to check
+ * @param off the ring offset of the first entry to check
+ * @return true if an entry was found, which becomes the match
+ */
+static bool cli_history_search_from(cli_t *cli, int idx, size_t off) {
+  for (; idx >= 0; idx--) {
+    if (cli_history_contains(cli, off, cli->history.search.query,
+                             cli->history.search.len)) {
+      cli->history.search.idx = idx;
+      cli->history.search.off = off;
+      return true;
+    }
+    off = cli_history_prev(cli, off);
+  }
+  return false;
+}
+
+/**
+ * @brief enter the reverse incremental search on CTRL-R. The line is kept
+ * untouched until the search is accepted
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_history_search_start(cli_t *cli) {
+  size_t old_len = (size_t)(cli->ptr - cli->line);
+
+  if (cli->history.size == 0) {
+    return;
+  }
+  cli->history.browse_idx = -1;
+  cli->history.search.active = true;
+  cli->history.search.failed = false;
+  cli->history.search.len = 0;
+  cli->history.search.idx = -1;
+  cli_history_search_draw(cli, old_len, 0);
+}
+
+/**
+ * @brief leave the search and redraw the line
+ *
+ * @param cli the command line interpreter struct
+ * @param accept true to replace the line with the match
+ */
+static void cli_history_search_stop(cli_t *cli, bool accept) {
+  size_t old_cols = cli_history_search_cols(cli);
+
+  if (accept && cli->history.search.idx != -1) {
+    cli->ptr = cli->line;
+    cli_history_read(cli, cli->history.search.off, cli_history_line_cb, cli);
+    *cli->ptr = '\0';
+  }
+  cli->history.search.active = false;
+  cli_redraw_begin(cli, old_cols, 0);
+  cli_echo(cli, cli->line, (size_t)(cli->ptr - cli->line));
+  cli_redraw_end(cli, old_cols, (size_t)(cli->ptr - cli->line));
+}
+
+/**
+ * @brief handle a key while searching. A printable char refines the current
+ * match, since no newer entry contains the shorter query. CTRL-R looks for an
+ * older match, backspace shortens the query and CTRL-G cancels the search
+ *
+ * @param cli the command line interpreter struct
+ * @param ch the received char
+ * @return true if the key was consumed, false if it accepted the match and is
+ * to be handled as a line editing key
+ */
+static bool cli_history_search_key(cli_t *cli, char ch) {
+  size_t old_cols = cli_history_search_cols(cli);
+  size_t label_len = sizeof(cli_search_label) - 1;
+  int idx = cli->history.search.idx;
+  size_t off = cli->history.search.off;
+
+  if (idx == -1) {
+    idx = (int)cli->history.count - 1;
+    off = cli->history.last;
+  }
+
+  switch (ch) {
+  case 0x12: // CTRL-R
+    if (cli->history.search.idx != -1) {
+      idx--;
+      off = cli_history_prev(cli, off);
+    }
+    if (cli->history.search.failed || !cli_history_search_from(cli, idx, off)) {
+      cli_echo(cli, "\a", 1);
+      return true;
+    }
+    cli_history_search_draw(cli, old_cols,
+                            label_len + cli->history.search.len +
+                                sizeof(cli_search_sep) - 1);
+    return true;
+  case 0x07: // CTRL-G
+    cli->history.search.idx = -1;
+    cli_history_search_stop(cli, false);
+    return true;
+  case '\b':
+  case 0x7f:
+    if (cli->history.search.len == 0) {
+      return true;
+    }
+    // A shorter query may match a newer entry
+    cli->history.search.len--;
+    cli->history.search.failed = false;
+    cli->history.search.idx = -1;
+    if (cli->history.search.len > 0) {
+      (void)cli_history_search_from(cli, (int)cli->history.count - 1,
+                                    cli->history.last);
+    }
+    cli_history_search_draw(cli, old_cols, label_len + cli->history.search.len);
+    return true;
+  default:
+    if (!isprint((unsigned char)ch)) {
+      cli_history_search_stop(cli, true);
+      return false;
+    }
+    if (cli->history.search.len == sizeof(cli->history.search.query)) {
+      cli_echo(cli, "\a", 1);
+      return true;
+    }
+    cli->history.search.query[cli->history.search.len++] = ch;
+    if (!cli->history.search.failed &&
+        !cli_history_search_from(cli, idx, off)) {
+      cli->history.search.failed = true;
+      cli_echo(cli, "\a", 1);
+    }
+    cli_history_search_draw(cli, old_cols,
+                            label_len + cli->history.search.len - 1);
+    return true;
+  }
+}
+#endif /* CLI_USE_HISTORY */
+
+/**
+ * @brief add a received char to the line buffer. Only printing character are
+ * added, control characters are handled as line editing keys
+ * @param cli the command line interpreter struct
+ * @param ch the received char
+ * @return int strlen of the line if a newline delimiter was found, 0 if the
+ * line was discarded because it is too long. -1 while the line is incomplete
+ */
+static int cli_edit_char(cli_t *cli, char ch) {
+
+  if (cli->ptr == NULL) {
+    cli->ptr = cli->line;
+    *cli->ptr = '\0';
+  }
+
+#ifdef CLI_USE_HISTORY
+  if (cli->history.search.active && cli_history_search_key(cli, ch)) {
+    return -1;
+  }
+  // Editing the line changes the text filtering UP and DOWN
+  if (ch != 0x10 && ch != 0x0E && ch != '\e' && cli->esc_state == 0) {
+    cli->history.browse_idx = -1;
+  }
+#endif /* CLI_USE_HISTORY */
+
+  switch (ch) {
+  case '\r':
+  case '\n': {
+    cli_write(cli, "\r\n", 2);
+    cli_flush(cli);
+    cli->ptr = NULL;
+    size_t len = strlen(cli->line);
+    if (len == 0) {
+      cli_print_prompt(cli);
+    }
+    return (int)len;
+  }
+  case 0x15: // CTRL-U
+    while (cli->ptr != cli->line) {
+      cli_echo(cli, "\b \b", 3);
+      --cli->ptr;
+    }
+    *cli->ptr = '\0';
+    break;
+  case 0x03: // CTRL-C
+    cli_write(cli, "^C\r\n", 4);
+    cli->ptr = cli->line;
+    *cli->ptr = '\0';
+    cli_print_prompt(cli);
+    break;
+  case 0x0C: // CTRL-L
+    cli_write(cli, "\x1b[2J\x1b[H", 7);
+    cli_print_prompt(cli);
+    cli_echo(cli, cli->line, strlen(cli->line));
+    break;
+  case 0x17: // CTRL-W
+    while (cli->ptr > cli->line && isspace((unsigned char)cli->ptr[-1])) {
+      cli_echo(cli, "\b \b", 3);
+      --cli->ptr;
+    }
+    while (cli->ptr > cli->line && !isspace((unsigned char)cli->ptr[-1])) {
+      cli_echo(cli, "\b \b", 3);
+      --cli->ptr;
+    }
+    *cli->ptr = '\0';
+    break;
+  case 0x10: // CTRL-P
+#ifdef CLI_USE_HISTORY
+    cli_history_navigate(cli, true);
+#endif /* CLI_USE_HISTORY */
+    break;
+  case 0x0E: // CTRL-N
+#ifdef CLI_USE_HISTORY
+    cli_history_navigate(cli, false);
+#endif
+    break;
+  case 0x12: // CTRL-R
+#ifdef CLI_USE_HISTORY
+    cli_history_search_start(cli);
+#endif /* CLI_USE_HISTORY */
+    break;
+  case '\e': // ESC
+#ifdef CLI_USE_HISTORY
+    cli->esc_state = 1;
+#else
+    cli_write(cli, "\r\n", 2);
+    cli->ptr = cli->line;
+    *cli->ptr = '\0';
+    cli_print_prompt(cli);
+#endif /* CLI_USE_HISTORY */
+    break;
+  case '\b': // <-
+  case 0x7f:
+    if (cli->ptr > cli->line) {
+      *--cli->ptr = '\0';
+      cli_echo(cli, "\b \b", 3);
+    }
+    break;
+  default:
+#ifdef CLI_USE_HISTORY
+    if (cli->esc_state == 1) {
+      if (ch == '[') {
+        cli->esc_state = 2;
+      } else {
+        cli->esc_state = 0;
+      }
+      break;
+    } else if (cli->esc_state == 2) {
+      cli->esc_state = 0;
+      if (ch == 'A' || ch == 'B') { // UP or DOWN
+        cli_history_navigate(cli, ch == 'A');
+      }
+      break;
+    }
+#endif /* CLI_USE_HISTORY */
+    if (isprint(ch)) {
+      if (cli->ptr < (cli->line + cli->line_max - 1)) {
+        *cli->ptr++ = ch; // Preserve original case
+        *cli->ptr = '\0';
+        cli_echo(cli, &ch, 1);
+      } else {
+
+        cli_write(cli, "\r\n", 2);
+        cli_write(cli, CLI_MSG_LINE_LENGTH_ERR,
+                  strlen(CLI_MSG_LINE_LENGTH_ERR));
+        cli->ptr = NULL;
+        cli->discard = true;
+        cli_print_prompt(cli);
+        return 0;
+      }
+    }
+    break;
+  }
+
+  return -1;
+}
+
+#ifdef CLI_USE_WATCH
+/**
+ * @brief stop the running watches when a key is received. CR-LF and CR-NUL
+ * tails are ignored
+ * @param cli the command line interpreter struct
+ * @param ch the received char
+ */
+static void cli_watch_key(cli_t *cli, char ch) {
+  if (ch != '\n' && ch != '\0') {
+    cli_watch_stop(cli);
+    cli_print_prompt(cli);
+  }
+}
+#endif /* CLI_USE_WATCH */
+
+/**
+ * @brief check for a line terminator
+ * @param ch the char to check
+ * @return true if ch is a line terminator
+ */
+static bool cli_is_eol(char ch) { return ch == '\r' || ch == '\n'; }
+
+bool cli_cancelled(cli_t *cli) {
+  if (!CLI_LOAD(cli->cancel) && cli->cmd_budget != 0 && cli->clock != NULL &&
+      (cli_time_t)(cli->clock() - cli->cmd_start) >= cli->cmd_budget) {
+    CLI_STORE(cli->cancel, true);
+  }
+  return CLI_LOAD(cli->cancel);
+}
+
+/**
+ * @brief call the notify callback if any event occurred
+ *
+ * @param cli the command line interpreter struct
+ * @param events CLI_NOTIFY_ flags
+ */
+static void cli_notify(cli_t *cli, int events) {
+  void (*notify_cb)(void *, int) = cli->notify_cb;
+
+  if (events != 0 && notify_cb != NULL) {
+    notify_cb(cli->notify_ctx, events);
+  }
+}
+
+int cli_putchar(cli_t *cli, int ch) {
+  int ret;
+  int events;
+
+  CLI_TRACE(cli, CLI_TRACE_PUTCHAR, CLI_TRACE_INSTANT, (uint32_t)ch);
+  // CTRL-C while a command runs
+  if (ch == 0x03 && CLI_LOAD(cli->cmd_depth) > 0) {
+    CLI_STORE(cli->cancel, true);
+    return ch;
+  }
+
+  cli_lock(cli);
+  events = ringbuffer_is_empty(&cli->rb_inbuf) ? CLI_NOTIFY_INPUT : 0;
+  ret = ringbuffer_put(&cli->rb_inbuf, ch) ? -1 : ch;
+  cli_unlock(cli);
+
+  if (ret >= 0) {
+    cli_notify(cli, events | (cli_is_eol(ch) ? CLI_NOTIFY_LINE : 0));
+  }
+  return ret;
+}
+
+size_t cli_putbuf(cli_t *cli, const void *buf, size_t len) {
+  const char *p = (const char *)buf;
+  int events = 0;
+  size_t n;
+
+  CLI_TRACE(cli, CLI_TRACE_PUTBUF, CLI_TRACE_INSTANT, (uint32_t)len);
+  cli_lock(cli);
+
+  bool was_empty = ringbuffer_is_empty(&cli->rb_inbuf);
+
+  for (n = 0; n < len; n++) {
+    // CTRL-C while a command runs
+    if (p[n] == 0x03 && CLI_LOAD(cli->cmd_depth) > 0) {
+      CLI_STORE(cli->cancel, true);
+    } else if (ringbuffer_put(&cli->rb_inbuf, p[n]) < 0) {
+      break;
+    } else {
+      events |= was_empty ? CLI_NOTIFY_INPUT : 0;
+      events |= cli_is_eol(p[n]) ? CLI_NOTIFY_LINE : 0;
+    }
+  }
+
+  cli_unlock(cli);
+
+  cli_notify(cli, events);
+  return n;
+}
+
+int cli_puts(cli_t *cli, const char *str) {
+  size_t len = strlen(str);
+
+  return (cli_putbuf(cli, str, len) == len) ? 0 : -1;
+}
+
+// Embedded-friendly case-insensitive string comparison
+// Use this instead of strcasecmp() which may not be available
+static int cli_strcasecmp(const char *s1, const char *s2) {
+  while (*s1 != '\0' && *s2 != '\0') {
+    unsigned char c1 = (unsigned char)*s1;
+    unsigned char c2 = (unsigned char)*s2;
+    int diff = tolower(c1) - tolower(c2);
+    if (diff != 0) {
+      return diff;
+    }
+    s1++;
+    s2++;
+  }
+  
+  // Both must be at end to be equal
+  return tolower((unsigned char)*s1) - tolower((unsigned char)*s2);
+}
+
+/**
+ * @brief find the command matching the arguments vector. Build-in commands are
+ * looked up first, then top-level commands and finally grouped commands where
+ * argv[0] is the group name and argv[1] the command name.
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return const cli_cmd_t* the matching command. NULL if none was found
+ */
+static const cli_cmd_t *cli_cmd_find(const cli_t *cli, int argc, char **argv) {
+
+  for (size_t i = 0; i < ARRAY_SIZE(cli_default_cmd_list); i++) {
+    if (!cli_strcasecmp(argv[0], cli_default_cmd_list[i].name)) {
+      return &cli_default_cmd_list[i];
+    }
+  }
+
+  if (cli->cmd_list == NULL) {
+    return NULL;
+  }
+
+  if (cli->cmd_list->cmds != NULL) {
+    for (size_t i = 0; i < cli->cmd_list->cmds_length; i++) {
+      if (!cli_strcasecmp(argv[0], cli->cmd_list->cmds[i].name)) {
+        return &cli->cmd_list->cmds[i];
+      }
+    }
+  }
+
+  if (cli->cmd_list->groups == NULL || argc < 2) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < cli->cmd_list->length; i++) {
+
+    const cli_cmd_group_t *group = cli->cmd_list->groups[i];
+
+    if (group->cmds == NULL || cli_strcasecmp(argv[0], group->name)) {
+      continue;
+    }
+
+    for (size_t j = 0; j < group->length; j++) {
+      if (!cli_strcasecmp(argv[1], group->cmds[j].name)) {
+        return &group->cmds[j];
+      }
+    }
+  }
+  return NULL;
+}
+
+#ifdef CLI_USE_CACHE
+/**
+ * @brief drop every resolved line
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_cache_flush(cli_t *cli) {
+  for (size_t i = 0; i < CLI_CACHE_NUM; i++) {
+    cli->cache.entries[i].cmd = NULL;
+  }
+  cli->cache.cmd_list = cli->cmd_list;
+}
+
+/**
+ * @brief find a resolved line and rebuild its arguments vector in line, as
+ * the tokeniser would
+ *
+ * @param cli the command line interpreter struct
+ * @param line the NULL terminated line, tokenised in place on a hit
+ * @param len the line length
+ * @param hash the line hash
+ * @param argv arguments vector filled with pointers into line
+ * @param argv_num arguments vector length
+ * @param argc the number of tokens on a hit
+ * @return const cli_cmd_t* the resolved command, NULL on a miss
+ */
+static const cli_cmd_t *cli_cache_find(cli_t *cli, char *line, size_t len,
+                                       uint32_t hash, char **argv,
+                                       size_t argv_num, int *argc) {
+  for (size_t i = 0; i < CLI_CACHE_NUM; i++) {
+    cli_cache_entry_t *entry = &cli->cache.entries[i];
+
+    if (entry->cmd == NULL || entry->hash != hash || entry->len != len ||
+        entry->argc > argv_num || memcmp(entry->line, line, len) != 0) {
+      continue;
+    }
+    for (size_t j = 0; j < entry->argc; j++) {
+      argv[j] = &line[entry->tok[j][0]];
+      line[entry->tok[j][1]] = '\0';
+    }
+    entry->stamp = ++cli->cache.clock;
+    *argc = entry->argc;
+    cli->cache.hits++;
+    return entry->cmd;
+  }
+  return NULL;
+}
+
+/**
+ * @brief keep a resolved line in place of the least recently used one
+ *
+ * @param cli the command line interpreter struct
+ * @param raw the raw line
+ * @param len the line length
+ * @param hash the line hash
+ * @param line the tokenised line argv points into
+ * @param argv arguments vector
+ * @param argc number of tokens
+ * @param cmd the resolved command
+ */
+static void cli_cache_add(cli_t *cli, const char *raw, size_t len,
+                          uint32_t hash, const char *line, char **argv,
+                          int argc, const cli_cmd_t *cmd) {
+  cli_cache_entry_t *entry = &cli->cache.entries[0];
+
+  for (size_t i = 1; i < CLI_CACHE_NUM && entry->cmd != NULL; i++) {
+    cli_cache_entry_t *other = &cli->cache.entries[i];
+    if (other->cmd == NULL || other->stamp < entry->stamp) {
+      entry = other;
+    }
+  }
+
+  entry->cmd = cmd;
+  entry->hash = hash;
+  entry->stamp = ++cli->cache.clock;
+  entry->len = (uint16_t)len;
+  entry->argc = (uint16_t)argc;
+  memcpy(entry->line, raw, len);
+  for (int i = 0; i < argc; i++) {
+    entry->tok[i][0] = (uint16_t)(argv[i] - line);
+    entry->tok[i][1] = (uint16_t)(argv[i] - line + strlen(argv[i]));
+  }
+}
+
+/**
+ * @brief build-in cache command handler. Print the hits and misses of the
+ * hot-line cache, or clear it
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return int On success 0 is return. Otherwise non zero value
+ */
+static int cli_cmd_cache(cli_t *cli, int argc, char **argv) {
+  char buf[64];
+  size_t used = 0;
+
+  if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+    cli_cache_flush(cli);
+    cli->cache.hits = 0;
+    cli->cache.misses = 0;
+    return 0;
+  }
+  if (argc != 1) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < CLI_CACHE_NUM; i++) {
+    used += (cli->cache.entries[i].cmd != NULL);
+  }
+  snprintf(buf, sizeof(buf), "hits %lu misses %lu lines %u/%u\r\n",
+           (unsigned long)cli->cache.hits, (unsigned long)cli->cache.misses,
+           (unsigned)used, (unsigned)CLI_CACHE_NUM);
+  cli_write(cli, buf, strlen(buf));
+  return 0;
+}
+#endif /* CLI_USE_CACHE */
+
+#ifdef CLI_USE_STATS
+/**
+ * @brief read the statistics clock
+ *
+ * @param cli the command line interpreter struct
+ * @return cli_cycles_t the current cycles. 0 without clock
+ */
+static cli_cycles_t cli_stats_now(const cli_t *cli) {
+  return (cli->cycles != NULL) ? cli->cycles() : 0;
+}
+
+/**
+ * @brief histogram bucket of a duration, its number of significant bits
+ *
+ * @param d the duration in cycles
+ * @return size_t the bucket
+ */
+static size_t cli_stats_bucket(cli_cycles_t d) {
+  size_t b = 0;
+
+#if defined(__GNUC__)
+  if (d != 0) {
+    b = (size_t)(32 - __builtin_clz((unsigned int)d));
+  }
+#else
+  for (; d != 0; d >>= 1) {
+    b++;
+  }
+#endif
+  return (b < CLI_STATS_BUCKET_NUM) ? b : CLI_STATS_BUCKET_NUM - 1;
+}
+
+/**
+ * @brief count a run in the statistics of a command
+ *
+ * @param cli the command line interpreter struct
+ * @param entry the statistics of the command
+ * @param start the cycles read before the run
+ * @param failed the run failed
+ */
+static void cli_stats_count(const cli_t *cli, cli_stats_entry_t *entry,
+                            cli_cycles_t start, bool failed) {
+  entry->calls++;
+  entry->errors += failed;
+  if (cli->cycles != NULL) {
+    cli_cycles_t d = (cli_cycles_t)(cli->cycles() - start);
+
+    if (d > entry->max) {
+      entry->max = d;
+    }
+    entry->hist[cli_stats_bucket(d)]++;
+  }
+}
+
+/**
+ * @brief find the statistics of a command, the command address being the key.
+ * A command run for the first time takes a free entry
+ *
+ * @param cli the command line interpreter struct
+ * @param cmd the command
+ * @return cli_stats_entry_t* the statistics. NULL if the table is full
+ */
+static cli_stats_entry_t *cli_stats_entry(cli_t *cli, const cli_cmd_t *cmd) {
+  size_t i = ((uintptr_t)cmd / sizeof(*cmd)) % CLI_STATS_NUM;
+
+  for (size_t n = 0; n < CLI_STATS_NUM; n++) {
+    cli_stats_entry_t *entry = &cli->stats.entries[i];
+
+    if (entry->cmd == cmd) {
+      return entry;
+    }
+    if (entry->cmd == NULL) {
+      entry->cmd = cmd;
+      return entry;
+    }
+    i = (i + 1) % CLI_STATS_NUM;
+  }
+  return NULL;
+}
+
+/**
+ * @brief reset every statistics
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_stats_clear(cli_t *cli) {
+  memset(&cli->stats, 0, sizeof(cli->stats));
+}
+
+/**
+ * @brief print the statistics of a command, with the non empty buckets only
+ *
+ * @param cli the command line interpreter struct
+ * @param group the group name. NULL if none
+ * @param name the command name
+ * @param entry the statistics
+ */
+static void cli_stats_print(cli_t *cli, const char *group, const char *name,
+                            const cli_stats_entry_t *entry) {
+  char buf[48];
+
+  if (group != NULL) {
+    cli_write(cli, group, strlen(group));
+    cli_write(cli, " ", 1);
+  }
+  cli_write(cli, name, strlen(name));
+  snprintf(buf, sizeof(buf), " calls %lu errors %lu",
+           (unsigned long)entry->calls, (unsigned long)entry->errors);
+  cli_write(cli, buf, strlen(buf));
+  if (cli->cycles != NULL) {
+    snprintf(buf, sizeof(buf), " max %lu", (unsigned long)entry->max);
+    cli_write(cli, buf, strlen(buf));
+  }
+  for (size_t b = 0; b < CLI_STATS_BUCKET_NUM; b++) {
+    if (entry->hist[b] == 0) {
+      continue;
+    }
+    if (b < CLI_STATS_BUCKET_NUM - 1) {
+      snprintf(buf, sizeof(buf), " <%lu:%lu", 1ul << b,
+               (unsigned long)entry->hist[b]);
+    } else {
+      snprintf(buf, sizeof(buf), " >=%lu:%lu", 1ul << (b - 1),
+               (unsigned long)entry->hist[b]);
+    }
+    cli_write(cli, buf, strlen(buf));
+  }
+  cli_write(cli, "\r\n", 2);
+}
+
+/**
+ * @brief print the statistics of a command of the commands list if it ran
+ *
+ * @param cli the command line interpreter struct
+ * @param group the group of the command. NULL for top-level commands
+ * @param cmd the command. NULL for a new group
+ * @return int \link CLI_CMD_LIST_TRV_NEXT \endlink
+ */
+static int cli_cmd_stats_traverser_cb(cli_t *cli, const cli_cmd_group_t *group,
+                                      const cli_cmd_t *cmd) {
+  for (size_t i = 0; cmd != NULL && i < CLI_STATS_NUM; i++) {
+    if (cli->stats.entries[i].cmd == cmd) {
+      cli_stats_print(cli, group ? group->name : NULL, cmd->name,
+                      &cli->stats.entries[i]);
+      break;
+    }
+  }
+  return CLI_CMD_LIST_TRV_NEXT;
+}
+
+/**
+ * @brief build-in stats command handler
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return int On success 0 is return. Otherwise non zero value
+ */
+static int cli_cmd_stats(cli_t *cli, int argc, char **argv) {
+  char buf[32];
+
+  if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+    cli_stats_clear(cli);
+    return 0;
+  }
+  if (argc != 1) {
+    return -1;
+  }
+
+  if (cli->stats.parse.calls != 0) {
+    cli_stats_print(cli, NULL, "(parse)", &cli->stats.parse);
+  }
+  for (size_t i = 0; i < ARRAY_SIZE(cli_default_cmd_list); i++) {
+    cli_cmd_stats_traverser_cb(cli, NULL, &cli_default_cmd_list[i]);
+  }
+  cli_cmd_list_traverser(cli, cli_cmd_stats_traverser_cb);
+  if (cli->stats.dropped != 0) {
+    snprintf(buf, sizeof(buf), "(dropped) calls %lu\r\n",
+             (unsigned long)cli->stats.dropped);
+    cli_write(cli, buf, strlen(buf));
+  }
+  return 0;
+}
+#endif /* CLI_USE_STATS */
+
+/**
+ * @brief \link cli_tokenize_line \endlink, traced with CLI_USE_TRACE
+ *
+ * @param cli the command line interpreter struct
+ * @param line the NULL terminated line to tokenise
+ * @param argv arguments vector filled with pointers into line
+ * @param argv_num arguments vector length
+ * @return int number of tokens found. -1 if number of token exceeded argv_num
+ */
+static int cli_tokenize(cli_t *cli, char *line, char **argv, size_t argv_num) {
+  int argc;
+
+  (void)cli;
+  CLI_TRACE(cli, CLI_TRACE_TOKENIZE, CLI_TRACE_BEGIN, 0);
+  argc = cli_tokenize_line(line, argv, argv_num);
+  CLI_TRACE(cli, CLI_TRACE_TOKENIZE, CLI_TRACE_END, (uint32_t)argc);
+  return argc;
+}
+
+/**
+ * @brief \link cli_cmd_find \endlink, traced with CLI_USE_TRACE
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count. No command is found if not greater than 0
+ * @param argv arguments vector
+ * @return const cli_cmd_t* the matching command. NULL if none was found
+ */
+static const cli_cmd_t *cli_find(cli_t *cli, int argc, char **argv) {
+  const cli_cmd_t *cmd;
+
+  if (argc <= 0) {
+    return NULL;
+  }
+  CLI_TRACE(cli, CLI_TRACE_FIND, CLI_TRACE_BEGIN, (uint32_t)argc);
+  cmd = cli_cmd_find(cli, argc, argv);
+  CLI_TRACE(cli, CLI_TRACE_FIND, CLI_TRACE_END, cmd != NULL);
+  return cmd;
+}
+
+/**
+ * @brief tokenise a line in place and resolve its command. With
+ * CLI_USE_CACHE, a line already resolved skips both
+ *
+ * @param cli the command line interpreter struct
+ * @param line the NULL terminated line to tokenise
+ * @param argv arguments vector filled with pointers into line
+ * @param argv_num arguments vector length
+ * @param cmd the resolved command. NULL if unknown or the line is empty
+ * @return int number of tokens found. -1 if number of token exceeded argv_num
+ */
+static int cli_resolve(cli_t *cli, char *line, char **argv, size_t argv_num,
+                       const cli_cmd_t **cmd) {
+#ifdef CLI_USE_CACHE
+  char raw[CLI_LINE_MAX];
+  size_t len = strlen(line);
+  uint32_t hash = cli_fnv1a(CLI_FNV1A_INIT, line, len);
+  int argc;
+
+  // The commands list was replaced without cli_set_cmd_list
+  if (cli->cache.cmd_list != cli->cmd_list) {
+    cli_cache_flush(cli);
+  }
+  *cmd = cli_cache_find(cli, line, len, hash, argv, argv_num, &argc);
+  if (*cmd != NULL) {
+    return argc;
+  }
+  cli->cache.misses++;
+  memcpy(raw, line, len);
+  argc = cli_tokenize(cli, line, argv, argv_num);
+  *cmd = cli_find(cli, argc, argv);
+  if (*cmd != NULL) {
+    cli_cache_add(cli, raw, len, hash, line, argv, argc, *cmd);
+  }
+  return argc;
+#else
+  int argc = cli_tokenize(cli, line, argv, argv_num);
+
+  *cmd = cli_find(cli, argc, argv);
+  return argc;
+#endif /* CLI_USE_CACHE */
+}
+
+/**
+ * @brief \link cli_resolve \endlink a line. With CLI_USE_STATS, the time it
+ * takes is counted in the parse statistics, with CLI_USE_TRACE it is traced
+ *
+ * @param cli the command line interpreter struct
+ * @param line the NULL terminated line to tokenise
+ * @param argv arguments vector filled with pointers into line
+ * @param argv_num arguments vector length
+ * @param cmd the resolved command. NULL if unknown or the line is empty
+ * @return int number of tokens found. -1 if number of token exceeded argv_num
+ */
+static int cli_parse(cli_t *cli, char *line, char **argv, size_t argv_num,
+                     const cli_cmd_t **cmd) {
+  int argc;
+#ifdef CLI_USE_STATS
+  cli_cycles_t start = cli_stats_now(cli);
+#endif
+
+  CLI_TRACE(cli, CLI_TRACE_PARSE, CLI_TRACE_BEGIN, 0);
+  argc = cli_resolve(cli, line, argv, argv_num, cmd);
+  CLI_TRACE(cli, CLI_TRACE_PARSE, CLI_TRACE_END, (uint32_t)argc);
+#ifdef CLI_USE_STATS
+  if (argc != 0) {
+    cli_stats_count(cli, &cli->stats.parse, start, *cmd == NULL);
+  }
+#endif
+  return argc;
+}
+
+/**
+ * @brief run the handler of an already resolved command
+ *
+ * @param cli the command line interpreter struct
+ * @param cmd the command to run
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return int \link CLI_OK \endlink on success or \link CLI_ERR_HANDLER
+ * \endlink if the handler failed
+ */
+static int cli_cmd_run(cli_t *cli, const cli_cmd_t *cmd, int argc,
+                       char **argv) {
+
+  cli_cmd_handler_t handler =
+      cmd->handler ? cmd->handler : cli_cmd_default_handler;
+  cli_time_t saved_start = cli->cmd_start;
+  cli_time_t saved_budget = cli->cmd_budget;
+  int ret;
+
+  // Nested commands, e.g. from a script, share the outer cancellation
+  if (CLI_LOAD(cli->cmd_depth) == 0) {
+    CLI_STORE(cli->cancel, false);
+  }
+  if (cmd->budget != 0 && cli->clock != NULL) {
+    cli->cmd_start = cli->clock();
+    cli->cmd_budget = cmd->budget;
+  }
+
+  cli_t *saved_current = cli_current;
+#ifdef CLI_USE_STATS
+  cli_cycles_t start = cli_stats_now(cli);
+#endif
+
+#ifdef CLI_USE_TRACE
+  cli_trace(cli, CLI_TRACE_RUN, CLI_TRACE_BEGIN, (uint32_t)argc);
+  cli_trace_name(cli,
+                 (argc > 1 && cli_strcasecmp(argv[0], cmd->name)) ? argv[0]
+                                                                  : NULL,
+                 cmd->name);
+#endif
+
+  cli_current = cli;
+  CLI_ADD(cli->cmd_depth, 1);
+  ret = handler(cli, argc, argv);
+  CLI_ADD(cli->cmd_depth, -1);
+  cli_current = saved_current;
+  CLI_TRACE(cli, CLI_TRACE_RUN, CLI_TRACE_END, (uint32_t)ret);
+
+#ifdef CLI_USE_STATS
+  cli_stats_entry_t *entry = cli_stats_entry(cli, cmd);
+
+  if (entry != NULL) {
+    cli_stats_count(cli, entry, start, ret != 0);
+  } else {
+    cli->stats.dropped++;
+  }
+#endif
+
+  cli->cmd_start = saved_start;
+  cli->cmd_budget = saved_budget;
+
+  if (ret == 0) {
+    return CLI_OK;
+  }
+  return CLI_LOAD(cli->cancel) ? CLI_ERR_CANCELLED : CLI_ERR_HANDLER;
+}
+
+/**
+ * @brief run the command resolved by \link cli_parse \endlink
+ *
+ * @param cli the command line interpreter struct
+ * @param cmd the resolved command. NULL if none was found
+ * @param argc arguments count. MUST be greater than 0
+ * @param argv arguments vector
+ * @param line the raw line pushed into history when the command is found. NULL
+ * to leave the history untouched
+ * @return int \link CLI_OK \endlink on success, \link CLI_ERR_UNKNOWN
+ * \endlink if no command was found or \link CLI_ERR_HANDLER \endlink if the
+ * handler failed
+ */
+static int cli_cmd_exec(cli_t *cli, const cli_cmd_t *cmd, int argc,
+                        char **argv, const char *line) {
+  if (cmd == NULL) {
+    return CLI_ERR_UNKNOWN;
+  }
+
+#ifdef CLI_USE_HISTORY
+  if (line != NULL) {
+    cli_history_push(cli, line);
+  }
+#else
+  (void)line;
+#endif
+
+  return cli_cmd_run(cli, cmd, argc, argv);
+}
+
+/**
+ * @brief write the message matching a command status
+ *
+ * @param cli the command line interpreter struct
+ * @param status the status returned by \link cli_cmd_exec \endlink
+ */
+static void cli_print_status(cli_t *cli, int status) {
+  const char *msg;
+
+  switch (status) {
+  case CLI_OK:
+    msg = CLI_MSG_CMD_OK;
+    break;
+  case CLI_ERR_UNKNOWN:
+    msg = CLI_MSG_CMD_UNKNOWN;
+    break;
+  case CLI_ERR_ARGV_NUM:
+    msg = CLI_MSG_NUM_ARG_ERR;
+    break;
+  case CLI_ERR_LINE_MAX:
+    msg = CLI_MSG_LINE_LENGTH_ERR;
+    break;
+  case CLI_ERR_CANCELLED:
+    msg = CLI_MSG_CMD_CANCELLED;
+    break;
+  default:
+    msg = CLI_MSG_CMD_ERROR;
+    break;
+  }
+
+  cli_write(cli, msg, strlen(msg));
+}
+
+int cli_exec_script(cli_t *cli, const char *buf, size_t len) {
+  char line[CLI_LINE_MAX];
+  char *argv[CLI_ARGV_NUM];
+  const char *end;
+  unsigned int lineno = 0;
+  int first_err = 0;
+
+  if (cli->script_depth >= CLI_SCRIPT_DEPTH) {
+    cli_write(cli, CLI_MSG_SCRIPT_DEPTH_ERR, strlen(CLI_MSG_SCRIPT_DEPTH_ERR));
+    return -1;
+  }
+
+  // A NULL byte ends the script, e.g. erased or padded flash
+  end = memchr(buf, '\0', len);
+  if (end == NULL) {
+    end = buf + len;
+  }
+
+  if (CLI_LOAD(cli->cmd_depth) == 0) {
+    CLI_STORE(cli->cancel, false);
+  }
+
+  cli->script_depth++;
+
+  while (buf < end) {
+    const char *eol = memchr(buf, '\n', (size_t)(end - buf));
+    const char *next = eol ? eol + 1 : end;
+    size_t n = (size_t)((eol ? eol : end) - buf);
+    int status = CLI_OK;
+
+    lineno++;
+
+    if (n > 0 && buf[n - 1] == '\r') {
+      n--;
+    }
+
+    if (cli_cancelled(cli)) {
+      status = CLI_ERR_CANCELLED;
+    } else if (n >= sizeof(line)) {
+      status = CLI_ERR_LINE_MAX;
+    } else {
+      memcpy(line, buf, n);
+      line[n] = '\0';
+
+      const cli_cmd_t *cmd;
+      int argc = cli_parse(cli, line, argv, ARRAY_SIZE(argv), &cmd);
+      if (argc < 0) {
+        status = CLI_ERR_ARGV_NUM;
+      } else if (argc > 0 && argv[0][0] != '#') {
+        status = cli_cmd_exec(cli, cmd, argc, argv, NULL);
+      } else {
+        ; // empty line or comment
+      }
+    }
+
+    if (status != CLI_OK) {
+      char num[24];
+      snprintf(num, sizeof(num), "line %u: ", lineno);
+      cli_write(cli, num, strlen(num));
+      cli_print_status(cli, status);
+
+      if (first_err == 0) {
+        first_err = (int)lineno;
+      }
+      if (cli->script_stop_on_error || status == CLI_ERR_CANCELLED) {
+        break;
+      }
+    }
+
+    buf = next;
+  }
+
+  cli->script_depth--;
+
+  return first_err;
+}
+
+size_t cli_exec(cli_t *cli, const char *line, char *out_buf, size_t out_cap,
+                int *status) {
+  char buf[CLI_LINE_MAX];
+  char *argv[CLI_ARGV_NUM];
+  cli_capture_t capture = {out_buf, out_cap ? out_cap - 1 : 0, 0};
+  size_t n = strcspn(line, "\r\n");
+  int ret = CLI_OK;
+
+  if (n >= sizeof(buf)) {
+    ret = CLI_ERR_LINE_MAX;
+  } else {
+    memcpy(buf, line, n);
+    buf[n] = '\0';
+
+    const cli_cmd_t *cmd;
+    int argc = cli_parse(cli, buf, argv, ARRAY_SIZE(argv), &cmd);
+    if (argc < 0) {
+      ret = CLI_ERR_ARGV_NUM;
+    } else if (argc > 0) {
+      cli_capture_t *saved_capture = cli->capture;
+      size_t (*saved_write)(const void *, size_t) = cli->write;
+      int (*saved_flush)(void) = cli->flush;
+
+      // Handlers writing through the legacy fields are captured too
+      cli->capture = &capture;
+      cli->write = cli_current_write;
+      cli->flush = cli_current_flush;
+
+      ret = cli_cmd_exec(cli, cmd, argc, argv, NULL);
+
+      cli->write = saved_write;
+      cli->flush = saved_flush;
+      cli->capture = saved_capture;
+    } else {
+      ; // empty line
+    }
+  }
+
+  if (out_cap > 0) {
+    out_buf[capture.len < capture.cap ? capture.len : capture.cap] = '\0';
+  }
+  if (status != NULL) {
+    *status = ret;
+  }
+
+  return capture.len;
+}
+
+#ifdef CLI_HAVE_MMAP
+/**
+ * @brief build-in source command handler. The file is memory mapped and run
+ * with \link cli_exec_script \endlink
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return int On success 0 is return. Otherwise non zero value
+ */
+static int cli_cmd_source(cli_t *cli, int argc, char **argv) {
+  bool stop_on_error = cli->script_stop_on_error;
+  const char *path;
+  struct stat st;
+  void *map;
+  int fd;
+
+  if (argc == 3 && !strcmp(argv[1], "-e")) {
+    stop_on_error = true;
+    path = argv[2];
+  } else if (argc == 2) {
+    path = argv[1];
+  } else {
+    return -1;
+  }
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -2;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -2;
+  }
+
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -2;
+  }
+
+  bool saved_stop_on_error = cli->script_stop_on_error;
+  cli->script_stop_on_error = stop_on_error;
+  int ret = cli_exec_script(cli, map, (size_t)st.st_size);
+  cli->script_stop_on_error = saved_stop_on_error;
+
+  munmap(map, (size_t)st.st_size);
+
+  return (ret == 0) ? 0 : -3;
+}
+#endif /* CLI_HAVE_MMAP */
+
+#ifdef CLI_USE_WATCH
+/**
+ * @brief compare two wrapping times
+ *
+ * @param a first time
+ * @param b second time
+ * @return true if a is before b
  */
-static void cli_echo(cli_t *cli, const void *ptr, size_t size) {
-  if (cli->echo) {
-    cli->write(ptr, size);
-    cli->flush();
-  }
+static bool cli_time_before(cli_time_t a, cli_time_t b) {
+  return (int32_t)(a - b) < 0;
 }
 
 /**
- * @brief tokenise the command line interpreter line using space and tab as
- * token delimiter
+ * @brief insert a watch in the timer wheel slot of its deadline
  *
  * @param cli the command line interpreter struct
- * @return int number of tokens found. -1 if number of token exceeded  \link
- * CLI_ARGV_NUM \endlink
+ * @param idx the watch index
  */
-static int cli_tokenize(cli_t *cli) {
-  char *token;
-  char *saveptr = cli->line;
-
-  cli->argc = 0;
+static void cli_watch_schedule(cli_t *cli, int idx) {
+  size_t slot = (cli->watch.entries[idx].deadline / CLI_WATCH_RESOLUTION) %
+                CLI_WATCH_WHEEL_SIZE;
 
-  for (token = strtok_r(cli->line, " \t", &saveptr); token != NULL;
-       token = strtok_r(NULL, " \t", &saveptr)) {
-
-    if ((size_t)cli->argc >= ARRAY_SIZE(cli->argv)) {
-      return -1;
-    }
+  cli->watch.entries[idx].next = cli->watch.wheel[slot];
+  cli->watch.wheel[slot] = idx;
+}
 
-    cli->argv[cli->argc++] = token;
+void cli_watch_stop(cli_t *cli) {
+  for (size_t i = 0; i < CLI_WATCH_NUM; i++) {
+    cli->watch.entries[i].next = (i + 1 < CLI_WATCH_NUM) ? (int)i + 1 : -1;
+    cli->watch.entries[i].cmd = NULL;
+  }
+  for (size_t i = 0; i < CLI_WATCH_WHEEL_SIZE; i++) {
+    cli->watch.wheel[i] = -1;
   }
-  return cli->argc;
+  cli->watch.free = 0;
+  cli->watch.count = 0;
 }
 
-void cli_print_prompt(cli_t *cli) {
-  cli->write(cli->prompt, strlen(cli->prompt));
-  cli->write("> ", 2);
-  cli->flush();
-}
+void cli_tick(cli_t *cli, cli_time_t now) {
+  cli_time_t last = cli->watch.now;
+  size_t slots;
+  size_t slot;
 
-#ifdef CLI_USE_HISTORY
-static void cli_history_navigate(cli_t *cli, bool up) {
-  if (cli->history.count == 0) {
+  if (cli->watch.count == 0 || cli_time_before(now, last)) {
+    cli->watch.now = now;
     return;
   }
 
-  if (up) { // UP or CTRL-P
-    if (cli->history.browse_idx == -1) {
-      cli->history.browse_idx = (int)cli->history.count - 1;
-    } else if (cli->history.browse_idx > 0) {
-      cli->history.browse_idx--;
-    }
-  } else { // DOWN or CTRL-N
-    if (cli->history.browse_idx != -1) {
-      if (cli->history.browse_idx < (int)cli->history.count - 1) {
-        cli->history.browse_idx++;
-      } else {
-        cli->history.browse_idx = -1;
-      }
-    }
-  }
-
-  // Clear current line
-  while (cli->ptr > cli->line) {
-    cli_echo(cli, "\b \b", 3);
-    cli->ptr--;
+  // Visit every slot elapsed since the last tick, including the last tick
+  // slot itself which may hold watches that were not due yet
+  slots = (now / CLI_WATCH_RESOLUTION) - (last / CLI_WATCH_RESOLUTION) + 1;
+  if (slots > CLI_WATCH_WHEEL_SIZE) {
+    slots = CLI_WATCH_WHEEL_SIZE;
   }
+  slot = (last / CLI_WATCH_RESOLUTION) % CLI_WATCH_WHEEL_SIZE;
 
-  if (cli->history.browse_idx != -1) {
-    size_t idx = (cli->history.write_idx + CLI_HISTORY_NUM -
-                  cli->history.count + (size_t)cli->history.browse_idx) %
-                 CLI_HISTORY_NUM;
-    strncpy(cli->line, cli->history.buf[idx], CLI_LINE_MAX - 1);
-    cli->line[CLI_LINE_MAX - 1] = '\0';
-    cli->ptr = cli->line + strlen(cli->line);
-    cli_echo(cli, cli->line, strlen(cli->line));
-  } else {
-    *cli->line = '\0';
-    cli->ptr = cli->line;
-  }
-}
-#endif /* CLI_USE_HISTORY */
+  cli->watch.now = now;
 
-/**
- * @brief read bytes from the receive buffer and add them to the line buffer.
- * Only printing character are added, If newline delimiter is found the the
- * function return the strlen of line
- * @param cli the command line interpreter struct
- * @return size_t strlen of the line. 0 if the receive buffer was emptied before
- * detecting a new line
- */
-static size_t cli_getline(cli_t *cli) {
+  for (size_t i = 0; i < slots; i++) {
+    int idx = cli->watch.wheel[slot];
 
-  if (cli->ptr == NULL) {
-    cli->ptr = cli->line;
-    *cli->ptr = '\0';
-  }
+    cli->watch.wheel[slot] = -1;
 
-  char ch;
-  while (!ringbuffer_get(&cli->rb_inbuf, (uint8_t *)&ch)) {
+    while (idx != -1) {
+      cli_watch_t *watch = &cli->watch.entries[idx];
+      int next = watch->next;
 
-    switch (ch) {
-    case '\r':
-    case '\n': {
-      while (!ringbuffer_peek(&cli->rb_inbuf, (uint8_t *)&ch)) {
-        if (ch != '\r' && ch != '\n') {
-          break;
-        }
-        ringbuffer_get(&cli->rb_inbuf, (uint8_t *)&ch);
-      }
-      cli->write("\r\n", 2);
-      cli->flush();
-      cli->ptr = NULL;
-      size_t len = strlen(cli->line);
-      if (len == 0) {
-        cli_print_prompt(cli);
-      }
-      return len;
-    }
-    case 0x15: // CTRL-U
-      while (cli->ptr != cli->line) {
-        cli_echo(cli, "\b \b", 3);
-        --cli->ptr;
-      }
-      *cli->ptr = '\0';
-      break;
-    case 0x03: // CTRL-C
-      cli->write("^C\r\n", 4);
-      cli->ptr = cli->line;
-      *cli->ptr = '\0';
-      cli_print_prompt(cli);
-      break;
-    case 0x0C: // CTRL-L
-      cli->write("\x1b[2J\x1b[H", 7);
-      cli_print_prompt(cli);
-      cli_echo(cli, cli->line, strlen(cli->line));
-      break;
-    case 0x17: // CTRL-W
-      while (cli->ptr > cli->line && isspace((unsigned char)cli->ptr[-1])) {
-        cli_echo(cli, "\b \b", 3);
-        --cli->ptr;
-      }
-      while (cli->ptr > cli->line && !isspace((unsigned char)cli->ptr[-1])) {
-        cli_echo(cli, "\b \b", 3);
-        --cli->ptr;
-      }
-      *cli->ptr = '\0';
-      break;
-    case 0x10: // CTRL-P
-#ifdef CLI_USE_HISTORY
-      cli_history_navigate(cli, true);
-#endif /* CLI_USE_HISTORY */
-      break;
-    case 0x0E: // CTRL-N
-#ifdef CLI_USE_HISTORY
-      cli_history_navigate(cli, false);
-#endif
-      break;
-    case '\e': // ESC
-#ifdef CLI_USE_HISTORY
-      cli->esc_state = 1;
-#else
-      cli->write("\r\n", 2);
-      cli->ptr = cli->line;
-      *cli->ptr = '\0';
-      cli_print_prompt(cli);
-#endif /* CLI_USE_HISTORY */
-      break;
-    case '\b': // <-
-    case 0x7f:
-      if (cli->ptr > cli->line) {
-        *--cli->ptr = '\0';
-        cli_echo(cli, "\b \b", 3);
-      }
-      break;
-    default:
-#ifdef CLI_USE_HISTORY
-      if (cli->esc_state == 1) {
-        if (ch == '[') {
-          cli->esc_state = 2;
-        } else {
-          cli->esc_state = 0;
+      if (!cli_time_before(now, watch->deadline)) {
+        int status = cli_cmd_run(cli, watch->cmd, watch->argc, watch->argv);
+        if (status != CLI_OK) {
+          cli_print_status(cli, status);
         }
-        break;
-      } else if (cli->esc_state == 2) {
-        cli->esc_state = 0;
-        if (ch == 'A' || ch == 'B') { // UP or DOWN
-          cli_history_navigate(cli, ch == 'A');
+        cli_flush(cli);
+
+        if (cli->watch.count == 0) {
+          return; // stopped by the handler
         }
-        break;
-      }
-#endif /* CLI_USE_HISTORY */
-      if (isprint(ch)) {
-        if (cli->ptr < (cli->line + sizeof(cli->line) - 1)) {
-          *cli->ptr++ = ch; // Preserve original case
-          *cli->ptr = '\0';
-          cli_echo(cli, &ch, 1);
-        } else {
-
-          cli->write("\r\n", 2);
-          cli->write(CLI_MSG_LINE_LENGTH_ERR, strlen(CLI_MSG_LINE_LENGTH_ERR));
-          cli->ptr = NULL;
-          cli_print_prompt(cli);
-          return 0;
+
+        // Keep the phase: skip missed periods instead of drifting
+        watch->deadline += watch->period;
+        if (!cli_time_before(now, watch->deadline)) {
+          watch->deadline +=
+              ((now - watch->deadline) / watch->period + 1) * watch->period;
         }
       }
-      break;
-    }
-  }
 
-  return 0;
-}
+      cli_watch_schedule(cli, idx);
+      idx = next;
+    }
 
-int cli_putchar(cli_t *cli, int ch) {
-  int ret;
-  if (cli->lock) {
-    cli->lock();
+    slot = (slot + 1) % CLI_WATCH_WHEEL_SIZE;
   }
-  ret = ringbuffer_put(&cli->rb_inbuf, ch) ? -1 : ch;
-  if (cli->unlock) {
-    cli->unlock();
-  }
-  return ret;
 }
 
-int cli_puts(cli_t *cli, const char *str) {
-  const char *p = str;
-
-  if (cli->lock) {
-    cli->lock();
-  }
-
-  while (*p) {
-    if (ringbuffer_put(&cli->rb_inbuf, *p) < 0) {
-      if (cli->unlock) {
-        cli->unlock();
-      }
-      return -1;
+/**
+ * @brief write the command line of a watch
+ *
+ * @param cli the command line interpreter struct
+ * @param watch the watch
+ */
+static void cli_watch_print(cli_t *cli, const cli_watch_t *watch) {
+  char num[24];
+
+  snprintf(num, sizeof(num), "%lu\t", (unsigned long)watch->period);
+  cli_write(cli, num, strlen(num));
+  for (int i = 0; i < watch->argc; i++) {
+    if (i) {
+      cli_write(cli, " ", 1);
     }
-    p++;
-  }
-
-  if (cli->unlock) {
-    cli->unlock();
+    cli_write(cli, watch->argv[i], strlen(watch->argv[i]));
   }
-
-  return 0;
+  cli_write(cli, "\r\n", 2);
 }
 
-// Embedded-friendly case-insensitive string comparison
-// Use this instead of strcasecmp() which may not be available
-static int cli_strcasecmp(const char *s1, const char *s2) {
-  while (*s1 != '\0' && *s2 != '\0') {
-    unsigned char c1 = (unsigned char)*s1;
-    unsigned char c2 = (unsigned char)*s2;
-    int diff = tolower(c1) - tolower(c2);
-    if (diff != 0) {
-      return diff;
+/**
+ * @brief build-in watch command handler
+ *
+ * @param cli the command line interpreter struct
+ * @param argc arguments count
+ * @param argv arguments vector
+ * @return int On success 0 is return. Otherwise non zero value
+ */
+static int cli_cmd_watch(cli_t *cli, int argc, char **argv) {
+  cli_time_t period = cli_watch_default_period;
+  const cli_cmd_t *cmd;
+  cli_watch_t *watch;
+  char *ptr;
+  int first = 1;
+  int idx;
+
+  if (argc == 1) {
+    for (size_t i = 0; i < CLI_WATCH_NUM; i++) {
+      // free watches have no command
+      if (cli->watch.entries[i].cmd != NULL) {
+        cli_watch_print(cli, &cli->watch.entries[i]);
+      }
     }
-    s1++;
-    s2++;
+    return 0;
   }
-  
-  // Both must be at end to be equal
-  return tolower((unsigned char)*s1) - tolower((unsigned char)*s2);
-}
 
-static int cli_cmd_run_traverser_cb(cli_t *cli, const cli_cmd_group_t *group,
-                                    const cli_cmd_t *cmd) {
+  if (!strcmp(argv[1], "-n")) {
+    char *end;
+    unsigned long ms;
 
-  if (group && !cmd) {
-    if (cli_strcasecmp(cli->argv[0], group->name)) {
-      return CLI_CMD_LIST_TRV_SKIP;
+    if (argc < 4) {
+      return -1;
     }
-  } else if (cmd) {
-    const char *cmd_name_to_match;
-    if (group) {
-      if (cli->argc < 2) {
-        return CLI_CMD_LIST_TRV_SKIP;
-      }
-      cmd_name_to_match = cli->argv[1];
-    } else {
-      cmd_name_to_match = cli->argv[0];
+    ms = strtoul(argv[2], &end, 10);
+    if (*end != '\0' || ms == 0 || ms > INT32_MAX) {
+      return -1;
     }
+    period = (cli_time_t)ms;
+    first = 3;
+  }
 
-    if (cli_strcasecmp(cmd_name_to_match, cmd->name)) {
-      return CLI_CMD_LIST_TRV_SKIP;
-    } else {
+  cmd = cli_cmd_find(cli, argc - first, argv + first);
+  if (cmd == NULL || cmd->handler == cli_cmd_watch) {
+    return -2;
+  }
 
-      cli_cmd_handler_t handler =
-          cmd->handler ? cmd->handler : cli_cmd_default_handler;
+  idx = cli->watch.free;
+  if (idx == -1) {
+    cli_write(cli, CLI_MSG_WATCH_NUM_ERR, strlen(CLI_MSG_WATCH_NUM_ERR));
+    return -3;
+  }
+  watch = &cli->watch.entries[idx];
+  cli->watch.free = watch->next;
+
+  // Tokenize once, every run reuses argv
+  ptr = watch->line;
+  for (int i = first; i < argc; i++) {
+    size_t n = strlen(argv[i]);
+    memcpy(ptr, argv[i], n);
+    ptr += n;
+    *ptr++ = ' ';
+  }
+  ptr[-1] = '\0';
+  watch->argc = cli_tokenize_line(watch->line, watch->argv,
+                                  ARRAY_SIZE(watch->argv));
+  watch->cmd = cmd;
+  watch->period = period;
+  watch->deadline = cli->watch.now + period;
 
-      if (handler(cli, cli->argc, cli->argv) == 0) {
-        cli->write(CLI_MSG_CMD_OK, strlen(CLI_MSG_CMD_OK));
-      } else {
-        cli->write(CLI_MSG_CMD_ERROR, strlen(CLI_MSG_CMD_ERROR));
-      }
+  cli_watch_schedule(cli, idx);
+  cli->watch.count++;
 
-      return CLI_CMD_LIST_TRV_END;
-    }
+  return 0;
+}
+#endif /* CLI_USE_WATCH */
+
+void cli_set_ops(cli_t *cli, const cli_ops_t *ops, void *ctx) {
+  cli->ops = ops;
+  cli->ctx = ctx;
+  if (ops != NULL) {
+    cli->write = cli_current_write;
+    cli->flush = cli_current_flush;
+  } else {
+    cli->write = cli_default_write;
+    cli->flush = cli_default_flush;
   }
-  return CLI_CMD_LIST_TRV_NEXT;
+}
+
+void cli_set_cmd_list(cli_t *cli, const cli_cmd_list_t *cmd_list) {
+  cli->cmd_list = cmd_list;
+#ifdef CLI_USE_CACHE
+  // The list may have changed in place
+  cli_cache_flush(cli);
+#endif
 }
 
 void cli_register_quit_callback(cli_t *cli, void (*cmd_quit_cb)(void)) {
   cli->cmd_quit_cb = cmd_quit_cb ? cmd_quit_cb : cli_cmd_quit_default_cb;
 }
 
-void cli_mainloop(cli_t *cli) {
-  size_t len;
+void cli_register_notify_callback(cli_t *cli,
+                                  void (*notify_cb)(void *ctx, int events),
+                                  void *ctx) {
+  cli->notify_ctx = ctx;
+  cli->notify_cb = notify_cb;
+}
+
+/**
+ * @brief tokenise and run the completed line, then print the command status
+ * and the prompt
+ *
+ * @param cli the command line interpreter struct
+ */
+static void cli_process_line(cli_t *cli) {
+  const cli_cmd_t *cmd;
+  int status;
 #ifdef CLI_USE_HISTORY
   char line_copy[CLI_LINE_MAX];
-#endif
-
-  if (cli->lock) {
-    cli->lock();
-  }
-  len = cli_getline(cli);
-  if (cli->unlock) {
-    cli->unlock();
-  }
-
-  if (len == 0) {
-    return;
-  }
 
-#ifdef CLI_USE_HISTORY
   strncpy(line_copy, cli->line, sizeof(line_copy) - 1);
   line_copy[sizeof(line_copy) - 1] = '\0';
   cli->history.browse_idx = -1;
 #endif
 
-  if (cli_tokenize(cli) < 0) {
-    cli->write(CLI_MSG_NUM_ARG_ERR, strlen(CLI_MSG_NUM_ARG_ERR));
-    goto cli_mainloop_exit;
+  cli->argc = cli_parse(cli, cli->line, cli->argv, cli->argv_num, &cmd);
+  if (cli->argc < 0) {
+    status = CLI_ERR_ARGV_NUM;
+  } else if (cli->argc == 0) {
+    goto cli_process_line_exit;
+  } else {
+#ifdef CLI_USE_HISTORY
+    status = cli_cmd_exec(cli, cmd, cli->argc, cli->argv, line_copy);
+#else
+    status = cli_cmd_exec(cli, cmd, cli->argc, cli->argv, NULL);
+#endif
   }
 
-  if (cli->argc == 0) {
-    goto cli_mainloop_exit;
+  cli_print_status(cli, status);
+
+cli_process_line_exit:
+  cli_print_prompt(cli);
+}
+
+void cli_mainloop(cli_t *cli) {
+  char buf[CLI_IN_BUF_MAX];
+  size_t len;
+  size_t total = 0;
+
+  // Only the copy runs under the lock, echo and commands run outside of it.
+  // A receive buffer larger than buf is drained in several copies, up to what
+  // it holds
+  do {
+    CLI_TRACE(cli, CLI_TRACE_READ, CLI_TRACE_BEGIN, 0);
+    cli_lock(cli);
+    len = ringbuffer_read(&cli->rb_inbuf, (uint8_t *)buf, sizeof(buf));
+    cli_unlock(cli);
+    CLI_TRACE(cli, CLI_TRACE_READ, CLI_TRACE_END, (uint32_t)len);
+
+    if (len == 0) {
+      return;
+    }
+
+    if (cli->ptr == NULL) {
+      cli->ptr = cli->line;
+      *cli->ptr = '\0';
+    }
+
+    cli_feed(cli, buf, len);
+    total += len;
+  } while (len == sizeof(buf) && total < ringbuffer_capacity(&cli->rb_inbuf));
+}
+
+void cli_feed(cli_t *cli, const char *buf, size_t len) {
+  const char *end = buf + len;
+
+  // CR-LF split between two chunks
+  if (cli->feed_cr && buf < end && *buf == '\n') {
+    buf++;
   }
+  cli->feed_cr = (len > 0 && end[-1] == '\r');
 
-  for (size_t i = 0; i < ARRAY_SIZE(cli_default_cmd_list); i++) {
+  while (buf < end) {
+    char ch = *buf++;
 
-    if (!cli_strcasecmp(cli->argv[0], cli_default_cmd_list[i].name)) {
-#ifdef CLI_USE_HISTORY
-      cli_history_push(cli, line_copy);
-#endif
-      if (cli_default_cmd_list[i].handler(cli, cli->argc, cli->argv) == 0) {
-        cli->write(CLI_MSG_CMD_OK, strlen(CLI_MSG_CMD_OK));
-      } else {
-        cli->write(CLI_MSG_CMD_ERROR, strlen(CLI_MSG_CMD_ERROR));
+#ifdef CLI_USE_WATCH
+    if (cli->watch.count > 0) {
+      cli_watch_key(cli, ch);
+      continue;
+    }
+#endif /* CLI_USE_WATCH */
+
+    if (cli->discard) {
+      // Drop the tail of a too long line, it is not a command on its own
+      if (cli_is_eol(ch)) {
+        cli->discard = false;
+        while (buf < end && cli_is_eol(*buf)) {
+          buf++;
+        }
       }
-      goto cli_mainloop_exit;
+      continue;
     }
-  }
 
-  if (cli_cmd_list_traverser(cli, cli_cmd_run_traverser_cb)) {
-#ifdef CLI_USE_HISTORY
-    cli_history_push(cli, line_copy);
-#endif
-  } else {
-    cli->write(CLI_MSG_CMD_UNKNOWN, strlen(CLI_MSG_CMD_UNKNOWN));
+    int n = cli_edit_char(cli, ch);
+
+    if (n < 0) {
+      continue;
+    }
+
+    if (cli_is_eol(ch)) {
+      // Swallow the terminators of this chunk, e.g. CR-LF
+      while (buf < end && cli_is_eol(*buf)) {
+        buf++;
+      }
+    }
+
+    if (n > 0) {
+      cli_process_line(cli);
+    }
   }
-cli_mainloop_exit:
-  cli_print_prompt(cli);
 }
 
-void cli_init(cli_t *cli, const cli_cmd_list_t *cmd_list) {
+/**
+ * @brief initialise the command line interpreter struct over the given storage
+ *
+ * @param cli the command line interpreter struct
+ * @param cmd_list the command list struct
+ * @param cfg the sizes of the storage
+ * @param inbuf the receive buffer of cfg->in_buf_len bytes
+ * @param line the line of cfg->line_max bytes
+ * @param argv the arguments vector of cfg->argv_num entries
+ * @param history the history of cfg->history_size bytes. Unused without
+ * CLI_USE_HISTORY
+ */
+static void cli_init_mem(cli_t *cli, const cli_cmd_list_t *cmd_list,
+                         const cli_config_t *cfg, char *inbuf, char *line,
+                         char **argv, char *history) {
+
+  ringbuffer_wrap(&cli->rb_inbuf, (uint8_t *)inbuf, cfg->in_buf_len);
 
-  ringbuffer_wrap(&cli->rb_inbuf, (uint8_t *)cli->inbuf, sizeof(cli->inbuf));
+  cli->line = line;
+  cli->line_max = cfg->line_max;
+  *cli->line = '\0';
+  cli->argv = argv;
+  cli->argv_num = cfg->argv_num;
+  cli->argc = 0;
 
   cli->echo = true;
   cli->ptr = NULL;
 
+  cli->feed_cr = false;
+  cli->discard = false;
+
+  cli->script_stop_on_error = false;
+  cli->script_depth = 0;
+
+#ifdef CLI_USE_WATCH
+  cli->watch.now = 0;
+  cli_watch_stop(cli);
+#endif
+
   cli->prompt = cli_default_prompt;
   cli->write = cli_default_write;
   cli->flush = cli_default_flush;
@@ -779,14 +2924,95 @@ void cli_init(cli_t *cli, const cli_cmd_list_t *cmd_list) {
   cli->lock = NULL;
   cli->unlock = NULL;
 
+  cli->ops = NULL;
+  cli->ctx = NULL;
+  cli->capture = NULL;
+  cli->notify_cb = NULL;
+  cli->notify_ctx = NULL;
+
 #ifdef CLI_USE_HISTORY
-  cli->history.count = 0;
-  cli->history.write_idx = 0;
-  cli->history.browse_idx = -1;
+  cli->history.buf = history;
+  cli->history.size = cfg->history_size;
+  cli->history.store = NULL;
+  cli->history.store_ctx = NULL;
+  cli_history_clear(cli);
   cli->esc_state = 0;
+#else
+  (void)history;
 #endif
 
   cli->cmd_quit_cb = cli_cmd_quit_default_cb;
 
+  cli->clock = NULL;
+  CLI_STORE(cli->cancel, false);
+  CLI_STORE(cli->cmd_depth, 0);
+  cli->cmd_start = 0;
+  cli->cmd_budget = 0;
+
   cli->cmd_list = cmd_list;
+#ifdef CLI_USE_CACHE
+  cli_cache_flush(cli);
+  cli->cache.clock = 0;
+  cli->cache.hits = 0;
+  cli->cache.misses = 0;
+#endif
+#ifdef CLI_USE_STATS
+  cli->cycles = NULL;
+  cli_stats_clear(cli);
+#endif
+}
+
+#ifndef CLI_NO_DEFAULT_MEM
+void cli_init(cli_t *cli, const cli_cmd_list_t *cmd_list) {
+  static const cli_config_t cfg = CLI_CONFIG_DEFAULT;
+  char *history = NULL;
+
+#ifdef CLI_USE_HISTORY
+  history = cli->mem.history;
+#endif
+
+  cli_init_mem(cli, cmd_list, &cfg, cli->mem.inbuf, cli->mem.line,
+               cli->mem.argv, history);
+}
+#endif /* CLI_NO_DEFAULT_MEM */
+
+size_t cli_mem_size(const cli_config_t *cfg) {
+  size_t size = cfg->argv_num * sizeof(char *) + cfg->in_buf_len +
+                cfg->line_max;
+
+#ifdef CLI_USE_HISTORY
+  size += cfg->history_size;
+#endif
+
+  return size + sizeof(char *) - 1; // mem may not be aligned for argv
+}
+
+int cli_init_ex(cli_t *cli, const cli_cmd_list_t *cmd_list,
+                const cli_config_t *cfg, void *mem, size_t mem_len) {
+  uintptr_t addr = (uintptr_t)mem;
+  char *p;
+
+  if (cfg->in_buf_len < 2 || cfg->line_max < 2 ||
+      cfg->line_max > CLI_LINE_MAX || cfg->argv_num < 1 ||
+      cfg->argv_num > CLI_ARGV_NUM || mem_len < cli_mem_size(cfg)) {
+    return -1;
+  }
+#ifdef CLI_USE_HISTORY_DEDUP
+  // The index holds 16 bits offsets
+  if (cfg->history_size > UINT16_MAX) {
+    return -1;
+  }
+#endif
+
+  // The arguments vector first, it is the only one needing an alignment
+  p = (char *)mem + ((sizeof(char *) - addr % sizeof(char *)) % sizeof(char *));
+  char **argv = (char **)(void *)p;
+  p += cfg->argv_num * sizeof(char *);
+  char *inbuf = p;
+  p += cfg->in_buf_len;
+  char *line = p;
+  p += cfg->line_max;
+
+  cli_init_mem(cli, cmd_list, cfg, inbuf, line, argv, p);
+  return 0;
 }
@@ -32,6 +32,25 @@
 #ifndef _CLI_H
 #define _CLI_H
 
+/**
+ * @brief Qualify a field set from the receive context, e.g. an ISR or an RX
+ * thread, while a command runs. A C11 atomic if the compiler has them, else
+ * volatile
+ *
+ */
+#if defined(__cplusplus)
+extern "C++" { // cli.h may be included in an extern "C" block
+#include <atomic>
+}
+#define CLI_ATOMIC(type) std::atomic<type>
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&             \
+    !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define CLI_ATOMIC(type) _Atomic type
+#else
+#define CLI_ATOMIC(type) volatile type
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,21 +66,86 @@ extern "C" {
 #endif
 
 #ifndef CLI_IN_BUF_MAX
-#define CLI_IN_BUF_MAX (128) /**< Input receive buffer max length*/
+#define CLI_IN_BUF_MAX (128) /**< Input receive buffer default length*/
 #endif
 
 #ifndef CLI_LINE_MAX
-#define CLI_LINE_MAX (64) /**< Command line max length*/
+#define CLI_LINE_MAX (64) /**< Command line max length, see \link cli_init_ex
+                             \endlink */
 #endif
 
 #ifndef CLI_ARGV_NUM
-#define CLI_ARGV_NUM (8) /**< Command arguments max  length*/
+#define CLI_ARGV_NUM (8) /**< Command arguments max  length, see \link
+                            cli_init_ex \endlink */
+#endif
+
+#ifndef CLI_HISTORY_SIZE
+#ifdef CLI_HISTORY_NUM
+#define CLI_HISTORY_SIZE (CLI_HISTORY_NUM * CLI_LINE_MAX)
+#else
+#define CLI_HISTORY_SIZE (512) /**< History size in bytes */
+#endif
+#endif
+
+#ifndef CLI_HISTORY_QUERY_MAX
+#define CLI_HISTORY_QUERY_MAX (32) /**< Length of a CTRL-R search query */
+#endif
+
+#ifndef CLI_HISTORY_HASH_NUM
+#define CLI_HISTORY_HASH_NUM (32) /**< Slots of the CLI_USE_HISTORY_DEDUP
+                                     index */
+#endif
+
+#ifdef CLI_USE_HISTORY_DEDUP
+#if CLI_HISTORY_SIZE > 65535
+#error "CLI_USE_HISTORY_DEDUP needs CLI_HISTORY_SIZE up to 65535 bytes"
+#endif
+#endif
+
+#ifndef CLI_SCRIPT_DEPTH
+#define CLI_SCRIPT_DEPTH (4) /**< Maximum nesting of scripts */
+#endif
+
+#ifndef CLI_WATCH_NUM
+#define CLI_WATCH_NUM (4) /**< Number of concurrent watches */
 #endif
 
-#ifndef CLI_HISTORY_NUM
-#define CLI_HISTORY_NUM (8) /**< Number of commands to keep in history */
+#ifndef CLI_WATCH_WHEEL_SIZE
+#define CLI_WATCH_WHEEL_SIZE (8) /**< Number of timer wheel slots */
 #endif
 
+#ifndef CLI_WATCH_RESOLUTION
+#define CLI_WATCH_RESOLUTION (10) /**< Timer wheel slot duration in ms */
+#endif
+
+#ifndef CLI_CACHE_NUM
+#define CLI_CACHE_NUM (4) /**< Number of CLI_USE_CACHE resolved lines */
+#endif
+
+#ifndef CLI_STATS_NUM
+#define CLI_STATS_NUM (16) /**< Number of commands CLI_USE_STATS tracks */
+#endif
+
+#ifndef CLI_STATS_BUCKET_NUM
+#define CLI_STATS_BUCKET_NUM (20) /**< Buckets of a CLI_USE_STATS latency
+                                     histogram, powers of 2 */
+#endif
+
+#if CLI_STATS_BUCKET_NUM < 2 || CLI_STATS_BUCKET_NUM > 33
+#error "CLI_STATS_BUCKET_NUM must be between 2 and 33"
+#endif
+
+#define CLI_OK (0)            /**< Command ran successfully */
+#define CLI_ERR_HANDLER (-1)  /**< Command handler returned non zero value */
+#define CLI_ERR_UNKNOWN (-2)  /**< Unknown command */
+#define CLI_ERR_ARGV_NUM (-3) /**< Arguments exceed \link CLI_ARGV_NUM
+                                 \endlink*/
+#define CLI_ERR_LINE_MAX (-4) /**< Line exceeds \link CLI_LINE_MAX \endlink*/
+#define CLI_ERR_CANCELLED (-5) /**< Command handler failed after cancellation*/
+
+#define CLI_NOTIFY_INPUT (1 << 0) /**< The receive buffer became non empty */
+#define CLI_NOTIFY_LINE (1 << 1)  /**< A line terminator was received */
+
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
 #endif
@@ -72,6 +156,35 @@ extern "C" {
  */
 typedef struct cli_s cli_t;
 
+/**
+ * @brief Time in milliseconds. It is expected to wrap around
+ *
+ */
+typedef uint32_t cli_time_t;
+
+/**
+ * @brief Free running counter of the CLI_USE_STATS clock, e.g. CPU cycles or
+ * microseconds. It is expected to wrap around
+ *
+ */
+typedef uint32_t cli_cycles_t;
+
+/**
+ * @brief Definition of the I/O operations struct. Every operation receives the
+ * context registered with \link cli_set_ops \endlink so that many command
+ * line interpreters may share the same operations
+ *
+ */
+typedef struct cli_ops_s {
+  size_t (*write)(void *ctx, const void *ptr,
+                  size_t size); /**< write to output function */
+  int (*flush)(void *ctx);      /**< flush output function */
+  void (*lock)(void *ctx);      /**< optional lock function */
+  void (*unlock)(void *ctx);    /**< optional unlock function */
+  void (*quit)(void *ctx);      /**< optional callback function called by quit.
+                                   cmd_quit_cb is used if NULL */
+} cli_ops_t;
+
 /**
  * @brief Command handler prototype function type
  *
@@ -87,6 +200,8 @@ typedef struct cli_cmd_s {
   const char *desc; /**< command description */
   cli_cmd_handler_t
       handler; /**< command handler see \link cli_cmd_handler_t\endlink  */
+  cli_time_t budget; /**< optional time budget in ms. 0 for none see \link
+                        cli_cancelled \endlink */
 } cli_cmd_t;
 
 /**
@@ -113,26 +228,166 @@ typedef struct cli_cmd_list_s {
   size_t cmds_length; /**< Top-level commands length */
 } cli_cmd_list_t;
 
+#ifdef CLI_USE_HISTORY
+/**
+ * @brief Definition of a history store, keeping the history across restarts,
+ * e.g. in a file or in flash. See \link cli_set_history_store \endlink
+ *
+ */
+typedef struct cli_history_store_s {
+  void (*append)(void *ctx, const char *line,
+                 size_t len); /**< called for every entry pushed into the
+                                 history */
+  int (*read)(void *ctx, size_t idx, char *buf,
+              size_t cap); /**< copy up to cap bytes of the idx-th newest
+                              entry into buf, 0 being the newest. Returns the
+                              entry length, -1 past the oldest entry */
+  void (*clear)(void *ctx); /**< optional, called by "history clear" */
+} cli_history_store_t;
+#endif /* CLI_USE_HISTORY */
+
+#ifdef CLI_USE_WATCH
+/**
+ * @brief Definition of the watch struct. A watch re-runs an already tokenized
+ * command every period
+ *
+ */
+typedef struct cli_watch_s {
+  char line[CLI_LINE_MAX];  /**< tokenized command line */
+  char *argv[CLI_ARGV_NUM]; /**< arguments vector pointing into line */
+  int argc;                 /**< number of arguments */
+  const cli_cmd_t *cmd;     /**< resolved command */
+  cli_time_t period;        /**< period in ms */
+  cli_time_t deadline;      /**< next run time */
+  int next;                 /**< next watch in the same wheel slot. -1 if none*/
+} cli_watch_t;
+#endif /* CLI_USE_WATCH */
+
+#ifdef CLI_USE_CACHE
+/**
+ * @brief Definition of a hot-line cache entry, a command line with its
+ * resolved command and the position of its tokens
+ *
+ */
+typedef struct cli_cache_entry_s {
+  const cli_cmd_t *cmd;          /**< resolved command. NULL if unused */
+  uint32_t hash;                 /**< hash of the raw line */
+  uint32_t stamp;                /**< last use, the oldest one is replaced */
+  uint16_t len;                  /**< length of the raw line */
+  uint16_t argc;                 /**< number of tokens */
+  uint16_t tok[CLI_ARGV_NUM][2]; /**< start and end of every token */
+  char line[CLI_LINE_MAX];       /**< raw line */
+} cli_cache_entry_t;
+#endif /* CLI_USE_CACHE */
+
+#ifdef CLI_USE_STATS
+/**
+ * @brief Definition of the statistics of a command. Bucket b of the histogram
+ * counts the runs lasting less than 2^b cycles but not less than 2^(b-1), the
+ * last one all the longer runs
+ *
+ */
+typedef struct cli_stats_entry_s {
+  const cli_cmd_t *cmd;                /**< command. NULL if unused */
+  uint32_t calls;                      /**< number of runs */
+  uint32_t errors;                     /**< number of failed runs */
+  cli_cycles_t max;                    /**< longest run */
+  uint32_t hist[CLI_STATS_BUCKET_NUM]; /**< latency histogram */
+} cli_stats_entry_t;
+#endif /* CLI_USE_STATS */
+
+/**
+ * @brief Definition of the per instance sizes, see \link cli_init_ex \endlink
+ *
+ */
+typedef struct cli_config_s {
+  size_t in_buf_len;  /**< receive buffer length. At least 2 */
+  size_t line_max;    /**< line length, up to \link CLI_LINE_MAX \endlink */
+  size_t argv_num;    /**< arguments, up to \link CLI_ARGV_NUM \endlink */
+  size_t history_size; /**< history size in bytes. 0 for none. Ignored
+                          without CLI_USE_HISTORY */
+} cli_config_t;
+
+/**
+ * @brief The sizes used by \link cli_init \endlink
+ *
+ */
+#define CLI_CONFIG_DEFAULT                                                     \
+  { CLI_IN_BUF_MAX, CLI_LINE_MAX, CLI_ARGV_NUM, CLI_HISTORY_SIZE }
+
 /**
  * @brief Definition of command interpreter struct
  *
  */
 struct cli_s {
   bool echo;                  /**< Turn On/Off echoing */
+  bool script_stop_on_error;  /**< Stop scripts on first error */
+  int script_depth;           /**< internal scripts nesting level */
   char *ptr;                  /**<  internal pointer*/
-  char inbuf[CLI_IN_BUF_MAX]; /**<  buffer used for received bytes*/
-  char line[CLI_LINE_MAX];    /**<  buffer used for line*/
+  bool feed_cr;               /**<  internal, last fed byte was CR */
+  bool discard;               /**<  internal, skipping a too long line */
+  char *line;                 /**<  buffer used for line*/
+  size_t line_max;            /**<  size of line */
 #ifdef CLI_USE_HISTORY
   struct {
-    char buf[CLI_HISTORY_NUM][CLI_LINE_MAX];
-    size_t count;
-    size_t write_idx;
-    int browse_idx;
+    char *buf;    /**< byte ring of entries framed by their length */
+    size_t size;  /**< size of buf */
+    size_t head;  /**< offset of the oldest entry */
+    size_t used;  /**< number of bytes used */
+    size_t last;  /**< offset of the newest entry */
+    size_t count; /**< number of entries */
+    int browse_idx;    /**< index of the browsed entry, -1 if none */
+    size_t browse_off; /**< offset of the browsed entry */
+    size_t prefix_len; /**< length of the text filtering UP and DOWN */
+    const cli_history_store_t *store; /**< optional persistence */
+    void *store_ctx;                  /**< context passed to the store */
+#ifdef CLI_USE_HISTORY_DEDUP
+    uint16_t index[CLI_HISTORY_HASH_NUM]; /**< internal offset + 1 of the
+                                             newest entry per hash slot, 0 if
+                                             none */
+    size_t dead; /**< internal bytes of the erased entries */
+#endif
+    struct {
+      bool active;                        /**< CTRL-R was pressed */
+      bool failed;                        /**< no entry matches the query */
+      char query[CLI_HISTORY_QUERY_MAX];  /**< searched text */
+      size_t len;                         /**< length of the query */
+      int idx;                            /**< index of the match, -1 if none */
+      size_t off;                         /**< offset of the match */
+    } search; /**< internal reverse incremental search */
   } history;
   int esc_state;
+#endif
+#ifdef CLI_USE_WATCH
+  struct {
+    cli_watch_t entries[CLI_WATCH_NUM];
+    int wheel[CLI_WATCH_WHEEL_SIZE]; /**< first watch of every slot*/
+    int free;                        /**< first unused watch */
+    size_t count;                    /**< number of running watches */
+    cli_time_t now;                  /**< time of the last tick */
+  } watch;
+#endif
+#ifdef CLI_USE_CACHE
+  struct {
+    cli_cache_entry_t entries[CLI_CACHE_NUM];
+    const cli_cmd_list_t *cmd_list; /**< commands list the lines resolve in */
+    uint32_t clock;                 /**< last stamp */
+    uint32_t hits;                  /**< lines run from the cache */
+    uint32_t misses;                /**< lines tokenized and looked up */
+  } cache; /**< internal hot-line cache */
+#endif
+#ifdef CLI_USE_STATS
+  struct {
+    cli_stats_entry_t entries[CLI_STATS_NUM];
+    cli_stats_entry_t parse; /**< tokenizing and lookup of every line. errors
+                                counts the lines naming no command */
+    uint32_t dropped;        /**< runs of commands not tracked, the table
+                                being full */
+  } stats; /**< per command statistics */
 #endif
   int argc;                 /**<  number of arguments */
-  char *argv[CLI_ARGV_NUM]; /**<  arguments vector*/
+  char **argv;              /**<  arguments vector*/
+  size_t argv_num;          /**<  length of argv */
   ringbuffer_t rb_inbuf;    /**< ring buffer used received bytes see \link
                                ringbuffer_t \endlink*/
   size_t (*write)(const void *ptr,
@@ -141,11 +396,87 @@ struct cli_s {
   void (*lock)(void);           /**<  optional lock function */
   void (*unlock)(void);         /**<  optional unlock function */
   void (*cmd_quit_cb)(void);    /**<  calback function called by quit*/
-  char const *prompt;           /**<  command line prompt*/
+  cli_time_t (*clock)(void); /**<  optional ms clock used by time budgets */
+#ifdef CLI_USE_STATS
+  cli_cycles_t (*cycles)(void); /**< optional clock timing the commands. Only
+                                   calls and errors are counted if NULL */
+#endif
+  CLI_ATOMIC(bool) cancel;   /**<  cancellation request see \link
+                                cli_cancelled \endlink */
+  CLI_ATOMIC(int) cmd_depth; /**<  internal number of running handlers */
+  cli_time_t cmd_start;      /**<  internal start of the budgeted command */
+  cli_time_t cmd_budget;     /**<  internal budget of the running command */
+  const cli_ops_t *ops; /**<  optional I/O operations overriding the above
+                           see \link cli_set_ops \endlink */
+  void *ctx;            /**<  context passed to the I/O operations */
+  struct cli_capture_s *capture; /**< internal output capture of cli_exec */
+  void (*notify_cb)(void *ctx,
+                    int events); /**<  optional input notification callback */
+  void *notify_ctx;              /**<  context passed to notify_cb */
+  char const *prompt;            /**<  command line prompt*/
   const cli_cmd_list_t
       *cmd_list; /**<  commands list see \link cli_cmd_list_t \endlink*/
+#ifndef CLI_NO_DEFAULT_MEM
+  struct {
+    char inbuf[CLI_IN_BUF_MAX];
+    char line[CLI_LINE_MAX];
+    char *argv[CLI_ARGV_NUM];
+#ifdef CLI_USE_HISTORY
+    char history[CLI_HISTORY_SIZE];
+#endif
+  } mem; /**< internal storage used by \link cli_init \endlink */
+#endif /* CLI_NO_DEFAULT_MEM */
 };
 
+/**
+ * @brief Register I/O operations taking a context argument. They override the
+ * write, flush, lock, unlock and cmd_quit_cb fields. The write and flush fields
+ * are kept usable by command handlers. NULL ops restores the default write and
+ * flush functions
+ *
+ * @param cli the command line interpreter struct
+ * @param ops the I/O operations. write and flush are mandatory
+ * @param ctx the context passed to every operation
+ */
+void cli_set_ops(cli_t *cli, const cli_ops_t *ops, void *ctx);
+
+#ifdef CLI_USE_HISTORY
+/**
+ * @brief Register a history store and load the newest entries it holds, as
+ * many as fit in the history. The store is read newest first to size the
+ * load, then oldest first to push the entries, so that loading is linear in
+ * the number of loaded entries with a store reading in sequence in both
+ * directions. Every entry pushed into the history afterwards is appended to
+ * the store
+ *
+ * @param cli the command line interpreter struct
+ * @param store the history store. NULL to stop persisting the history
+ * @param ctx the context passed to the store
+ * @return size_t the number of loaded entries
+ */
+size_t cli_set_history_store(cli_t *cli, const cli_history_store_t *store,
+                             void *ctx);
+#endif /* CLI_USE_HISTORY */
+
+/**
+ * @brief write to the command line interpreter output. Command handlers should
+ * prefer it over the write field
+ *
+ * @param cli the command line interpreter struct
+ * @param ptr pointer to buffer to be written
+ * @param size number of byte to be written
+ * @return size_t On success, the number of bytes written
+ */
+size_t cli_write(cli_t *cli, const void *ptr, size_t size);
+
+/**
+ * @brief flush the command line interpreter output
+ *
+ * @param cli the command line interpreter struct
+ * @return int Upon successful completion 0 is returned.
+ */
+int cli_flush(cli_t *cli);
+
 /**
  * @brief print cli prompt
  * @param cli the command line interpreter struct
@@ -153,7 +484,20 @@ struct cli_s {
 void cli_print_prompt(cli_t *cli);
 
 /**
- * @brief puts ch into the internal receive  buffer
+ * @brief Used by long running command handlers to poll for cancellation. A
+ * command is cancelled when CTRL-C is received while it runs or when its time
+ * budget, if any, is exceeded. The budget is only enforced if a clock is
+ * registered in the clock field.
+ *
+ * @param cli the command line interpreter struct
+ * @return true if the running command should return as soon as possible
+ */
+bool cli_cancelled(cli_t *cli);
+
+/**
+ * @brief puts ch into the internal receive  buffer. CTRL-C received while a
+ * command handler runs is not buffered but cancels the command, see \link
+ * cli_cancelled \endlink
  *
  * @param cli the command line interpreter struct
  * @param ch the char to put
@@ -172,6 +516,19 @@ int cli_putchar(cli_t *cli, int ch);
  */
 int cli_puts(cli_t *cli, const char *str);
 
+/**
+ * @brief puts len bytes of buf into the receive buffer at once, e.g. a chunk
+ * returned by read(2) or a DMA transfer. The buffer is locked once for the
+ * whole chunk and the notification callback, if any, is called at most once
+ *
+ * @param cli the command line interpreter struct
+ * @param buf the bytes to put
+ * @param len the number of bytes in buf
+ * @return the number of bytes consumed. It is less than len if the receive
+ * buffer is full
+ */
+size_t cli_putbuf(cli_t *cli, const void *buf, size_t len);
+
 /**
  * @brief Used to register a qui callack. when the build-in quit command is
  * received The user may decided to stop calling \link cli_mainloop \endlink
@@ -181,14 +538,114 @@ int cli_puts(cli_t *cli, const char *str);
  */
 void cli_register_quit_callback(cli_t *cli, void (*quit_cb)(void));
 
+/**
+ * @brief Used to register an input notification callback, so that the host
+ * may sleep until \link cli_mainloop \endlink has work instead of polling it.
+ * It is called by \link cli_putchar \endlink, \link cli_puts \endlink and
+ * \link cli_putbuf \endlink, outside of the lock, with \link
+ * CLI_NOTIFY_INPUT \endlink when the receive buffer was empty and \link
+ * CLI_NOTIFY_LINE \endlink when a line terminator was received. It runs in the
+ * context of the caller, e.g. an RX ISR, and should only wake the host up, e.g.
+ * give a semaphore or write an eventfd
+ * @param cli the command line interpreter struct
+ * @param notify_cb callback function. NULL value for unregistering previously
+ * registered function.
+ * @param ctx context passed to notify_cb
+ */
+void cli_register_notify_callback(cli_t *cli,
+                                  void (*notify_cb)(void *ctx, int events),
+                                  void *ctx);
+
 /**
  * @brief cli main loop when called it will process received bytes. when a line
  * is received with a valid command a handler of the command is invoked.
- * Typically is should be called on regular intervals
+ * Typically is should be called on regular intervals. The receive buffer is
+ * locked only while the received bytes are moved out of it, every line
+ * received so far is then edited and dispatched without holding the lock
  * @param cli the command line interpreter struct
  */
 void cli_mainloop(cli_t *cli);
 
+/**
+ * @brief execute the commands of a script held in memory, e.g. a flash blob or
+ * a memory mapped file. The script is tokenized and dispatched line by line
+ * without going through the receive buffer, echoing or history. Empty lines
+ * and lines starting with '#' are skipped. A NULL byte ends the script. If
+ * script_stop_on_error is set the execution stops on the first error
+ *
+ * @param cli the command line interpreter struct
+ * @param buf the script buffer
+ * @param len the script buffer length
+ * @return int 0 if all lines ran successfully. Otherwise the line number of the
+ * first error or -1 if scripts are nested deeper than \link CLI_SCRIPT_DEPTH
+ * \endlink
+ */
+int cli_exec_script(cli_t *cli, const char *buf, size_t len);
+
+/**
+ * @brief Replace the commands list. With CLI_USE_CACHE, the resolved lines are
+ * dropped: call it again with the same list after changing it in place
+ *
+ * @param cli the command line interpreter struct
+ * @param cmd_list the command list struct. If NULL only build-in commands are
+ * available
+ */
+void cli_set_cmd_list(cli_t *cli, const cli_cmd_list_t *cmd_list);
+
+#ifdef CLI_USE_WATCH
+/**
+ * @brief advance the watches timer wheel and run every watch whose deadline is
+ * due. Watches run at a fixed rate, a late tick does not shift later runs.
+ * Typically it should be called on regular intervals from the same context as
+ * \link cli_mainloop \endlink
+ *
+ * @param cli the command line interpreter struct
+ * @param now the current time in ms
+ */
+void cli_tick(cli_t *cli, cli_time_t now);
+
+/**
+ * @brief stop all running watches
+ *
+ * @param cli the command line interpreter struct
+ */
+void cli_watch_stop(cli_t *cli);
+#endif /* CLI_USE_WATCH */
+
+/**
+ * @brief run a single command line and capture its output. The line is
+ * tokenized and dispatched without echo, prompt, history or receive buffer, and
+ * the line being edited by the interactive session is left untouched, so it
+ * may be called from a command handler or between \link cli_mainloop \endlink
+ * calls. It MUST be called from the context running the session
+ *
+ * @param cli the command line interpreter struct
+ * @param line the NULL terminated command line. It ends at the first CR or LF
+ * @param out_buf buffer receiving the NULL terminated output of the command.
+ * May be NULL if out_cap is 0
+ * @param out_cap out_buf capacity
+ * @param status if not NULL receives \link CLI_OK \endlink or a CLI_ERR_
+ * status
+ * @return size_t length of the whole output. If it is greater or equal than
+ * out_cap the output was truncated
+ */
+size_t cli_exec(cli_t *cli, const char *line, char *out_buf, size_t out_cap,
+                int *status);
+
+/**
+ * @brief run the line editor and the commands dispatcher directly over buf,
+ * without going through the receive buffer and without locking. Partial lines
+ * are kept between calls. It is meant for single threaded event loops that
+ * already hold the received bytes, e.g. after read(2). It MUST NOT be mixed
+ * with \link cli_mainloop \endlink on the same cli
+ *
+ * @param cli the command line interpreter struct
+ * @param buf the received bytes
+ * @param len the number of received bytes
+ */
+void cli_feed(cli_t *cli, const char *buf, size_t len);
+
+#ifndef CLI_NO_DEFAULT_MEM
 /**
  * @brief initialise command line interpreter struct and add the command list
  * struct.
@@ -198,6 +655,34 @@ void cli_mainloop(cli_t *cli);
  * commands are available
  */
 void cli_init(cli_t *cli, const cli_cmd_list_t *cmd_list);
+#endif /* CLI_NO_DEFAULT_MEM */
+
+/**
+ * @brief number of bytes \link cli_init_ex \endlink needs for cfg
+ *
+ * @param cfg the per instance sizes
+ * @return size_t the arena size
+ */
+size_t cli_mem_size(const cli_config_t *cfg);
+
+/**
+ * @brief initialise command line interpreter struct like \link cli_init
+ * \endlink, but carve the receive buffer, the line, the arguments vector and
+ * the history out of mem with the sizes of cfg. mem MUST outlive cli. Build
+ * with CLI_NO_DEFAULT_MEM to drop the storage of \link cli_init \endlink from
+ * the struct. \link CLI_LINE_MAX \endlink and \link CLI_ARGV_NUM \endlink
+ * still size the stack buffers and bound line_max and argv_num
+ *
+ * @param cli the command line interpreter struct
+ * @param cmd_list the command list struct. If NULL only build-in
+ * commands are available
+ * @param cfg the per instance sizes
+ * @param mem the arena, at least \link cli_mem_size \endlink bytes
+ * @param mem_len the size of mem
+ * @return int 0 on success, -1 if cfg is out of bounds or mem is too small
+ */
+int cli_init_ex(cli_t *cli, const cli_cmd_list_t *cmd_list,
+                const cli_config_t *cfg, void *mem, size_t mem_len);
 
 #ifdef __cplusplus
 }
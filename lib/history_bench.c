@@ -0,0 +1,218 @@
+/**
+ * @file history_bench.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief History push cost and retention under a polling workload
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "cli.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int cmd_nop_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  return 0;
+}
+
+static const cli_cmd_t bench_cmds[] = {
+    {.name = "poll", .desc = "Do nothing", .handler = cmd_nop_handler},
+    {.name = "note", .desc = "Do nothing", .handler = cmd_nop_handler},
+};
+
+static const cli_cmd_list_t bench_cmd_list = {
+    .cmds = bench_cmds,
+    .cmds_length = ARRAY_SIZE(bench_cmds),
+};
+
+static size_t bench_write(const void *ptr, size_t size) {
+  (void)ptr;
+  return size;
+}
+
+static int bench_flush(void) { return 0; }
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Push the lines through cli_feed and print the cost per line and what
+ * is left in the history
+ *
+ */
+static int bench_run(size_t history_size, size_t total, size_t polls,
+                     size_t every) {
+  cli_config_t cfg = CLI_CONFIG_DEFAULT;
+  cli_t cli;
+  char line[CLI_LINE_MAX];
+
+  cfg.history_size = history_size;
+  size_t mem_len = cli_mem_size(&cfg);
+  char *mem = malloc(mem_len);
+  size_t out_len = history_size * 4;
+  char *out = malloc(out_len);
+  if (mem == NULL || out == NULL ||
+      cli_init_ex(&cli, &bench_cmd_list, &cfg, mem, mem_len) < 0) {
+    fprintf(stderr, "cannot allocate a history of %zu bytes\n", history_size);
+    free(mem);
+    free(out);
+    return -1;
+  }
+  cli.write = bench_write;
+  cli.flush = bench_flush;
+  cli.echo = false;
+
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < total; i++) {
+    int len = (i % every == 0)
+                  ? snprintf(line, sizeof(line), "note %zu\r\n", i / every)
+                  : snprintf(line, sizeof(line), "poll sensor %zu\r\n",
+                             i % polls);
+    cli_feed(&cli, line, (size_t)len);
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  // The notes are the useful entries
+  size_t notes = 0;
+  cli_exec(&cli, "history", out, out_len, NULL);
+  for (const char *p = out; (p = strstr(p, " note ")) != NULL; p++) {
+    notes++;
+  }
+
+  printf("%10zu %10zu %12.1f %10zu %10zu\n", history_size, total,
+         (double)elapsed / (double)total, cli.history.count, notes);
+  free(mem);
+  free(out);
+  return 0;
+}
+
+/**
+ * @brief Fill the history with distinct lines, then push them again but the
+ * first one, so that every line repeats the entry following the oldest one,
+ * and print the cost per line. Every entry but the oldest one is newer than
+ * the repeated one
+ *
+ */
+static int bench_oldest(size_t history_size, size_t total) {
+  cli_config_t cfg = CLI_CONFIG_DEFAULT;
+  cli_t cli;
+  char line[CLI_LINE_MAX];
+
+  cfg.history_size = history_size;
+  size_t mem_len = cli_mem_size(&cfg);
+  char *mem = malloc(mem_len);
+  if (mem == NULL ||
+      cli_init_ex(&cli, &bench_cmd_list, &cfg, mem, mem_len) < 0) {
+    fprintf(stderr, "cannot allocate a history of %zu bytes\n", history_size);
+    free(mem);
+    return -1;
+  }
+  cli.write = bench_write;
+  cli.flush = bench_flush;
+  cli.echo = false;
+
+  // Until the first eviction, the history then holds the lines from first
+  size_t num = 0;
+  do {
+    int len = snprintf(line, sizeof(line), "poll sensor %zu\r\n", num++);
+    cli_feed(&cli, line, (size_t)len);
+  } while (cli.history.count == num);
+  size_t held = cli.history.count;
+  size_t first = num - held;
+
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < total; i++) {
+    int len = snprintf(line, sizeof(line), "poll sensor %zu\r\n",
+                       first + 1 + i % (held - 1));
+    cli_feed(&cli, line, (size_t)len);
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  printf("%10zu %10zu %12.1f %10zu %10s\n", history_size, total,
+         (double)elapsed / (double)total, cli.history.count, "-");
+  free(mem);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t total = 100000;
+  size_t polls = 4;
+  size_t every = 20;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:k:u:h")) != -1) {
+    if (opt == 'n' && (total = strtoul(optarg, NULL, 0)) > 0) {
+      continue;
+    }
+    if (opt == 'k' && (polls = strtoul(optarg, NULL, 0)) > 0) {
+      continue;
+    }
+    if (opt == 'u' && (every = strtoul(optarg, NULL, 0)) > 0) {
+      continue;
+    }
+    fprintf(stderr,
+            "usage: %s [-n LINES] [-k POLLS] [-u EVERY]\n"
+            "  -n LINES  lines pushed (default 100000)\n"
+            "  -k POLLS  number of distinct polling lines (default 4)\n"
+            "  -u EVERY  one useful line every EVERY lines (default 20)\n",
+            argv[0]);
+    return opt == 'h' ? 0 : 1;
+  }
+
+#ifdef CLI_USE_HISTORY_DEDUP
+  printf("erasing older duplicates\n");
+#else
+  printf("skipping repeats of the last entry only\n");
+#endif
+  printf("%10s %10s %12s %10s %10s\n", "history", "lines", "ns/line",
+         "entries", "useful");
+  // The cost per line stays flat as the history grows
+  static const size_t sizes[] = {512, 4096, 32768, 65535};
+  for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+    if (bench_run(sizes[i], total, polls, every) < 0) {
+      return 1;
+    }
+  }
+  printf("repeating the entry following the oldest one\n");
+  for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+    if (bench_oldest(sizes[i], total) < 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,398 @@
+/**
+ * @file history_file.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Command line history persisted in an append-only file
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "history_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HF_MAGIC_LEN (sizeof(CLI_HISTORY_FILE_MAGIC) - 1)
+#define HF_REC_HDR (2) /**< Bytes of every length field */
+
+static size_t hf_len(const uint8_t *p) {
+  return (size_t)p[0] | ((size_t)p[1] << 8);
+}
+
+static int hf_write_all(int fd, const void *ptr, size_t size) {
+  const uint8_t *p = ptr;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+static void hf_unmap(cli_history_file_t *hf) {
+  if (hf->map != NULL) {
+    munmap((void *)hf->map, hf->map_len);
+    hf->map = NULL;
+    hf->map_len = 0;
+  }
+  hf->cursor_end = 0;
+}
+
+static int hf_map(cli_history_file_t *hf) {
+  if (hf->map != NULL && hf->map_len == hf->size) {
+    return 0;
+  }
+  hf_unmap(hf);
+  void *map = mmap(NULL, hf->size, PROT_READ, MAP_SHARED, hf->fd, 0);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  hf->map = map;
+  hf->map_len = hf->size;
+  return 0;
+}
+
+/**
+ * @brief Get the start of the record ending at end, 0 if it is not a valid
+ * record
+ *
+ */
+static size_t hf_prev(const uint8_t *map, size_t end) {
+  if (end < HF_MAGIC_LEN + 2 * HF_REC_HDR) {
+    return 0;
+  }
+  size_t len = hf_len(map + end - HF_REC_HDR);
+  if (end - HF_MAGIC_LEN < 2 * HF_REC_HDR + len) {
+    return 0;
+  }
+  size_t start = end - 2 * HF_REC_HDR - len;
+  return hf_len(map + start) == len ? start : 0;
+}
+
+/**
+ * @brief Get the end of the valid records, walking them from the start. Only
+ * used when the last record is torn
+ *
+ */
+static size_t hf_scan(const uint8_t *map, size_t size) {
+  size_t end = HF_MAGIC_LEN;
+  while (end + 2 * HF_REC_HDR <= size) {
+    size_t len = hf_len(map + end);
+    size_t next = end + 2 * HF_REC_HDR + len;
+    if (next > size || hf_len(map + next - HF_REC_HDR) != len) {
+      break;
+    }
+    end = next;
+  }
+  return end;
+}
+
+static int hf_recover(cli_history_file_t *hf) {
+  struct stat st;
+  if (fstat(hf->fd, &st) < 0) {
+    return -1;
+  }
+  hf->size = (size_t)st.st_size;
+  if (hf->size == 0) {
+    if (hf_write_all(hf->fd, CLI_HISTORY_FILE_MAGIC, HF_MAGIC_LEN) < 0) {
+      return -1;
+    }
+    hf->size = HF_MAGIC_LEN;
+    return 0;
+  }
+  if (hf->size < HF_MAGIC_LEN || hf_map(hf) < 0 ||
+      memcmp(hf->map, CLI_HISTORY_FILE_MAGIC, HF_MAGIC_LEN) != 0) {
+    errno = (errno == 0) ? EINVAL : errno;
+    return -1;
+  }
+  if (hf->size == HF_MAGIC_LEN || hf_prev(hf->map, hf->size) != 0) {
+    return 0;
+  }
+  size_t end = hf_scan(hf->map, hf->size);
+  hf_unmap(hf);
+  if (ftruncate(hf->fd, (off_t)end) < 0) {
+    return -1;
+  }
+  hf->size = end;
+  return 0;
+}
+
+int cli_history_file_open(cli_history_file_t *hf, const char *path,
+                          size_t max_size) {
+  if (strlen(path) >= sizeof(hf->path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(hf->path, path);
+  hf->max_size = max_size;
+  hf->buf_len = 0;
+  hf->map = NULL;
+  hf->map_len = 0;
+  hf->cursor_end = 0;
+  hf->compacting = false;
+  hf->done = 0;
+
+  hf->fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+  if (hf->fd < 0) {
+    return -1;
+  }
+  errno = 0;
+  if (hf_recover(hf) < 0) {
+    int err = errno;
+    hf_unmap(hf);
+    close(hf->fd);
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Copy the newest records of the snapshot, about half of max_size, in
+ * the temporary file. The snapshot is never written again, so it is read
+ * without locking
+ *
+ */
+static void *hf_compact_thread(void *arg) {
+  cli_history_file_t *hf = arg;
+  char tmp[sizeof(hf->path) + sizeof(".tmp")];
+  int status = -1;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", hf->path);
+  const uint8_t *map =
+      mmap(NULL, hf->snapshot, PROT_READ, MAP_SHARED, hf->fd, 0);
+  if (map == MAP_FAILED) {
+    hf->done = -1;
+    return NULL;
+  }
+
+  size_t start = hf->snapshot;
+  size_t prev;
+  while ((prev = hf_prev(map, start)) != 0 &&
+         hf->snapshot - prev <= hf->max_size / 2) {
+    start = prev;
+  }
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd >= 0) {
+    if (hf_write_all(fd, CLI_HISTORY_FILE_MAGIC, HF_MAGIC_LEN) == 0 &&
+        hf_write_all(fd, map + start, hf->snapshot - start) == 0 &&
+        fsync(fd) == 0) {
+      status = 1;
+    }
+    close(fd);
+  }
+  munmap((void *)map, hf->snapshot);
+  __atomic_store_n(&hf->done, status, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/**
+ * @brief Append what was written since the snapshot to the temporary file and
+ * replace the log with it
+ *
+ */
+static int hf_compact_finish(cli_history_file_t *hf) {
+  char tmp[sizeof(hf->path) + sizeof(".tmp")];
+  int status;
+  int fd = -1;
+
+  pthread_join(hf->thread, NULL);
+  status = __atomic_load_n(&hf->done, __ATOMIC_ACQUIRE);
+  hf->compacting = false;
+  hf->done = 0;
+  snprintf(tmp, sizeof(tmp), "%s.tmp", hf->path);
+  if (status < 0) {
+    (void)unlink(tmp);
+    return -1;
+  }
+
+  hf_unmap(hf);
+  fd = open(tmp, O_RDWR | O_APPEND | O_CLOEXEC);
+  if (fd < 0 || hf_map(hf) < 0 ||
+      hf_write_all(fd, hf->map + hf->snapshot, hf->size - hf->snapshot) < 0 ||
+      rename(tmp, hf->path) < 0) {
+    int err = errno;
+    if (fd >= 0) {
+      close(fd);
+    }
+    (void)unlink(tmp);
+    errno = err;
+    return -1;
+  }
+  hf_unmap(hf);
+  close(hf->fd);
+  hf->fd = fd;
+  hf->size = (size_t)lseek(fd, 0, SEEK_END);
+  return 0;
+}
+
+int cli_history_file_flush(cli_history_file_t *hf) {
+  if (hf->buf_len > 0) {
+    if (hf_write_all(hf->fd, hf->buf, hf->buf_len) < 0) {
+      return -1;
+    }
+    hf->size += hf->buf_len;
+    hf->buf_len = 0;
+  }
+
+  if (hf->compacting) {
+    if (__atomic_load_n(&hf->done, __ATOMIC_ACQUIRE) == 0) {
+      return 0;
+    }
+    if (hf_compact_finish(hf) < 0) {
+      return -1;
+    }
+  }
+  if (hf->max_size > 0 && hf->size > hf->max_size) {
+    hf->snapshot = hf->size;
+    hf->done = 0;
+    if (pthread_create(&hf->thread, NULL, hf_compact_thread, hf) != 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    hf->compacting = true;
+  }
+  return 0;
+}
+
+void cli_history_file_close(cli_history_file_t *hf) {
+  (void)cli_history_file_flush(hf);
+  if (hf->compacting && hf_compact_finish(hf) == 0) {
+    // What was appended while compacting may still exceed max_size
+    (void)cli_history_file_flush(hf);
+    if (hf->compacting) {
+      (void)hf_compact_finish(hf);
+    }
+  }
+  hf_unmap(hf);
+  close(hf->fd);
+  hf->fd = -1;
+}
+
+static void hf_store_append(void *ctx, const char *line, size_t len) {
+  cli_history_file_t *hf = ctx;
+  size_t need = 2 * HF_REC_HDR + len;
+  uint8_t hdr[HF_REC_HDR] = {(uint8_t)len, (uint8_t)(len >> 8)};
+
+  if (len > UINT16_MAX) {
+    return;
+  }
+  if (hf->buf_len + need > sizeof(hf->buf)) {
+    (void)cli_history_file_flush(hf);
+  }
+  if (need > sizeof(hf->buf)) {
+    // Too long to be batched
+    if (hf_write_all(hf->fd, hdr, HF_REC_HDR) == 0 &&
+        hf_write_all(hf->fd, line, len) == 0 &&
+        hf_write_all(hf->fd, hdr, HF_REC_HDR) == 0) {
+      hf->size += need;
+    }
+    return;
+  }
+  memcpy(hf->buf + hf->buf_len, hdr, HF_REC_HDR);
+  memcpy(hf->buf + hf->buf_len + HF_REC_HDR, line, len);
+  memcpy(hf->buf + hf->buf_len + HF_REC_HDR + len, hdr, HF_REC_HDR);
+  hf->buf_len += need;
+}
+
+/**
+ * @brief Read the idx-th newest entry. Reading the entries in sequence, in
+ * either direction, walks the mapping from the last one read
+ *
+ */
+static int hf_store_read(void *ctx, size_t idx, char *buf, size_t cap) {
+  cli_history_file_t *hf = ctx;
+  size_t i = 0;
+
+  // The flush may finish a compaction, which replaces the file
+  if (cli_history_file_flush(hf) < 0 || hf_map(hf) < 0) {
+    return -1;
+  }
+  size_t end = hf->size;
+  if (hf->cursor_end != 0 && idx >= hf->cursor_idx) {
+    end = hf->cursor_end;
+    i = hf->cursor_idx;
+  } else if (hf->cursor_end != 0 && hf->cursor_idx - idx < idx) {
+    // Newer entries follow the last one read, framed on both sides
+    end = hf->cursor_end;
+    for (i = hf->cursor_idx; i > idx; i--) {
+      if (end + 2 * HF_REC_HDR > hf->size) {
+        return -1;
+      }
+      end += 2 * HF_REC_HDR + hf_len(hf->map + end);
+    }
+    if (end > hf->size) {
+      return -1;
+    }
+  }
+
+  size_t start = hf_prev(hf->map, end);
+  for (; i < idx && start != 0; i++) {
+    end = start;
+    start = hf_prev(hf->map, end);
+  }
+  if (start == 0) {
+    return -1;
+  }
+  hf->cursor_idx = idx;
+  hf->cursor_end = end;
+
+  size_t len = end - start - 2 * HF_REC_HDR;
+  memcpy(buf, hf->map + start + HF_REC_HDR, len < cap ? len : cap);
+  return (int)len;
+}
+
+static void hf_store_clear(void *ctx) {
+  cli_history_file_t *hf = ctx;
+
+  hf->buf_len = 0;
+  if (hf->compacting) {
+    (void)hf_compact_finish(hf);
+  }
+  hf_unmap(hf);
+  if (ftruncate(hf->fd, HF_MAGIC_LEN) == 0) {
+    hf->size = HF_MAGIC_LEN;
+  }
+}
+
+const cli_history_store_t cli_history_file_store = {
+    .append = hf_store_append,
+    .read = hf_store_read,
+    .clear = hf_store_clear,
+};
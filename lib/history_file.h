@@ -0,0 +1,119 @@
+/**
+ * @file history_file.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Command line history persisted in an append-only file
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_HISTORY_FILE_H
+#define _CLI_HISTORY_FILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cli.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef CLI_HISTORY_FILE_BUF_SIZE
+#define CLI_HISTORY_FILE_BUF_SIZE (4096) /**< Appends batched per write */
+#endif
+
+#define CLI_HISTORY_FILE_MAGIC "uclihist" /**< First bytes of the file */
+
+/**
+ * @brief Definition of the history file struct. The file holds the magic
+ * followed by records, each entry framed by its 16 bits little endian length
+ * on both sides so that it can be walked from the end. Appends are buffered
+ * and written in batches of \link CLI_HISTORY_FILE_BUF_SIZE \endlink bytes.
+ * Once the file exceeds max_size, a thread copies its newest half in a
+ * temporary file, which replaces the log on the next append, flush or close.
+ * The struct is not thread-safe
+ *
+ */
+typedef struct cli_history_file_s {
+  char path[PATH_MAX];   /**< path of the log */
+  int fd;                /**< internal file descriptor, opened for append */
+  size_t max_size;       /**< compaction threshold in bytes. 0 never compacts */
+  size_t size;           /**< internal number of bytes written to the file */
+  uint8_t buf[CLI_HISTORY_FILE_BUF_SIZE]; /**< internal pending appends */
+  size_t buf_len;        /**< internal number of pending bytes */
+  const uint8_t *map;    /**< internal read only mapping of the file */
+  size_t map_len;        /**< internal length of the mapping */
+  size_t cursor_idx;     /**< internal index of the last entry read */
+  size_t cursor_end;     /**< internal end offset of the last entry read */
+  pthread_t thread;      /**< internal compaction thread */
+  bool compacting;       /**< internal, the compaction thread was started */
+  volatile int done;     /**< internal, 1 once the thread copied, -1 failed */
+  size_t snapshot;       /**< internal file size seen by the thread */
+} cli_history_file_t;
+
+/**
+ * @brief Open or create the history file. A record torn by a crash at the
+ * end of the file is cut off
+ *
+ * @param hf the history file struct
+ * @param path path of the log
+ * @param max_size compaction threshold in bytes. 0 never compacts
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_history_file_open(cli_history_file_t *hf, const char *path,
+                          size_t max_size);
+
+/**
+ * @brief Write the pending appends to the file
+ *
+ * @param hf the history file struct
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_history_file_flush(cli_history_file_t *hf);
+
+/**
+ * @brief Flush the pending appends, wait for a running compaction and close
+ * the file
+ *
+ * @param hf the history file struct
+ */
+void cli_history_file_close(cli_history_file_t *hf);
+
+/**
+ * @brief History store backed by a history file, the context being a \link
+ * cli_history_file_t \endlink opened with \link cli_history_file_open
+ * \endlink. See \link cli_set_history_store \endlink
+ *
+ */
+extern const cli_history_store_t cli_history_file_store;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_HISTORY_FILE_H */
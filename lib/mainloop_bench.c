@@ -0,0 +1,228 @@
+/**
+ * @file mainloop_bench.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Receive buffer contention between an RX thread and cli_mainloop
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "cli.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static cli_t cli;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t write_ns = 200;
+static size_t lines;
+
+static int cmd_ping_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  lines++;
+  return 0;
+}
+
+static const cli_cmd_t bench_cmds[] = {
+    {.name = "ping", .desc = "Do nothing", .handler = cmd_ping_handler},
+};
+
+static const cli_cmd_list_t bench_cmd_list = {
+    .cmds = bench_cmds,
+    .cmds_length = ARRAY_SIZE(bench_cmds),
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static pthread_t main_thread;
+static uint64_t hold_start;
+static uint64_t hold_max;
+static uint64_t hold_total;
+
+static void bench_lock(void) {
+  pthread_mutex_lock(&mutex);
+  if (pthread_equal(pthread_self(), main_thread)) {
+    hold_start = now_ns();
+  }
+}
+
+// Tracks how long cli_mainloop keeps the RX thread out
+static void bench_unlock(void) {
+  if (pthread_equal(pthread_self(), main_thread)) {
+    uint64_t hold = now_ns() - hold_start;
+    hold_total += hold;
+    hold_max = hold > hold_max ? hold : hold_max;
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+// A terminal taking write_ns per byte, like a UART draining its FIFO
+static size_t bench_write(const void *ptr, size_t size) {
+  (void)ptr;
+  uint64_t end = now_ns() + write_ns * size;
+  while (now_ns() < end) {
+  }
+  return size;
+}
+
+static int bench_flush(void) { return 0; }
+
+static pthread_mutex_t wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static bool wake;
+
+static void bench_notify(void *ctx, int events) {
+  (void)ctx;
+  (void)events;
+  pthread_mutex_lock(&wake_mutex);
+  wake = true;
+  pthread_cond_signal(&wake_cond);
+  pthread_mutex_unlock(&wake_mutex);
+}
+
+// Sleeps until the RX thread has pushed something
+static void bench_wait(void) {
+  pthread_mutex_lock(&wake_mutex);
+  while (!wake) {
+    pthread_cond_wait(&wake_cond, &wake_mutex);
+  }
+  wake = false;
+  pthread_mutex_unlock(&wake_mutex);
+}
+
+typedef struct producer_s {
+  size_t total;      /**< lines to push */
+  uint64_t *samples; /**< duration of every successful cli_putchar */
+  size_t count;      /**< number of samples */
+  size_t full;       /**< retries on a full receive buffer */
+} producer_t;
+
+// The RX thread, pushing bytes as fast as the receive buffer takes them
+static void *producer_thread(void *arg) {
+  static const char line[] = "ping\r\n";
+  producer_t *p = arg;
+
+  for (size_t i = 0; i < p->total; i++) {
+    for (const char *c = line; *c; c++) {
+      for (;;) {
+        uint64_t t0 = now_ns();
+        int ret = cli_putchar(&cli, *c);
+        uint64_t t1 = now_ns();
+        if (ret >= 0) {
+          p->samples[p->count++] = t1 - t0;
+          break;
+        }
+        p->full++;
+        sched_yield();
+      }
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  producer_t prod = {.total = 200000};
+  pthread_t thread;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:w:h")) != -1) {
+    if (opt == 'n' && (prod.total = strtoul(optarg, NULL, 0)) > 0) {
+      continue;
+    }
+    if (opt == 'w') {
+      write_ns = strtoull(optarg, NULL, 0);
+      continue;
+    }
+    fprintf(stderr,
+            "usage: %s [-n LINES] [-w NS]\n"
+            "  -n LINES  lines pushed by the RX thread (default 200000)\n"
+            "  -w NS     output cost per byte in ns (default 200)\n",
+            argv[0]);
+    return opt == 'h' ? 0 : 1;
+  }
+
+  prod.samples = malloc(prod.total * 6 * sizeof(*prod.samples));
+  if (prod.samples == NULL) {
+    perror("malloc");
+    return 1;
+  }
+
+  cli_init(&cli, &bench_cmd_list);
+  cli.write = bench_write;
+  cli.flush = bench_flush;
+  cli.lock = bench_lock;
+  cli.unlock = bench_unlock;
+  cli_register_notify_callback(&cli, bench_notify, NULL);
+
+  main_thread = pthread_self();
+  uint64_t start = now_ns();
+  if (pthread_create(&thread, NULL, producer_thread, &prod) != 0) {
+    perror("pthread_create");
+    return 1;
+  }
+  while (lines < prod.total) {
+    bench_wait();
+    do {
+      cli_mainloop(&cli);
+    } while (!ringbuffer_is_empty(&cli.rb_inbuf));
+  }
+  uint64_t elapsed = now_ns() - start;
+  pthread_join(thread, NULL);
+
+  qsort(prod.samples, prod.count, sizeof(*prod.samples), cmp_u64);
+  printf("%10s %12s %12s %12s %12s %14s %14s\n", "lines", "lines/s",
+         "put p50 (ns)", "put p99 (ns)", "put max (ns)", "held max (ns)",
+         "held total %");
+  printf("%10zu %12.0f %12llu %12llu %12llu %14llu %14.1f\n", lines,
+         (double)lines * 1e9 / (double)elapsed,
+         (unsigned long long)prod.samples[prod.count / 2],
+         (unsigned long long)prod.samples[prod.count * 99 / 100],
+         (unsigned long long)prod.samples[prod.count - 1],
+         (unsigned long long)hold_max,
+         100.0 * (double)hold_total / (double)elapsed);
+
+  free(prod.samples);
+  return 0;
+}
@@ -0,0 +1,685 @@
+/**
+ * @file recorder.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Session recorder and replayer
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "recorder.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REC_MAGIC_LEN (sizeof(CLI_RECORD_MAGIC) - 1)
+#define REC_VARINT_MAX (10) /**< Bytes of the longest 64 bits varint */
+
+static uint64_t rec_monotonic_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static size_t rec_varint(uint8_t *p, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+/**
+ * @brief Decode a varint, returning its number of bytes, 0 if it does not end
+ * before end
+ *
+ */
+static size_t rec_get_varint(const uint8_t *p, const uint8_t *end,
+                             uint64_t *v) {
+  *v = 0;
+  for (size_t n = 0; n < REC_VARINT_MAX && p + n < end; n++) {
+    *v |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+    if ((p[n] & 0x80) == 0) {
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+static void rec_log(cli_recorder_t *rec, int dir, const void *ptr,
+                    size_t len) {
+  uint8_t hdr[2 * REC_VARINT_MAX];
+  size_t n;
+
+  pthread_mutex_lock(&rec->mutex);
+  uint64_t now = rec->clock();
+  n = rec_varint(hdr, ((uint64_t)len << 1) | (uint64_t)dir);
+  n += rec_varint(hdr + n, now - rec->last);
+  rec->last = now;
+  fwrite(hdr, 1, n, rec->file);
+  fwrite(ptr, 1, len, rec->file);
+  pthread_mutex_unlock(&rec->mutex);
+}
+
+static size_t rec_write(void *ctx, const void *ptr, size_t size) {
+  cli_recorder_t *rec = ctx;
+  rec_log(rec, CLI_RECORD_OUTPUT, ptr, size);
+  if (rec->ops != NULL) {
+    return rec->ops->write(rec->ctx, ptr, size);
+  }
+  return rec->write(ptr, size);
+}
+
+static int rec_flush(void *ctx) {
+  cli_recorder_t *rec = ctx;
+  if (rec->ops != NULL) {
+    return rec->ops->flush(rec->ctx);
+  }
+  return rec->flush();
+}
+
+static void rec_lock(void *ctx) {
+  cli_recorder_t *rec = ctx;
+  if (rec->ops != NULL) {
+    if (rec->ops->lock) {
+      rec->ops->lock(rec->ctx);
+    }
+  } else if (rec->cli->lock) {
+    rec->cli->lock();
+  }
+}
+
+static void rec_unlock(void *ctx) {
+  cli_recorder_t *rec = ctx;
+  if (rec->ops != NULL) {
+    if (rec->ops->unlock) {
+      rec->ops->unlock(rec->ctx);
+    }
+  } else if (rec->cli->unlock) {
+    rec->cli->unlock();
+  }
+}
+
+static void rec_quit(void *ctx) {
+  cli_recorder_t *rec = ctx;
+  if (rec->ops != NULL && rec->ops->quit != NULL) {
+    rec->ops->quit(rec->ctx);
+  } else {
+    rec->cli->cmd_quit_cb();
+  }
+}
+
+static const cli_ops_t rec_ops = {
+    rec_write, rec_flush, rec_lock, rec_unlock, rec_quit,
+};
+
+int cli_recorder_open(cli_recorder_t *rec, cli_t *cli, const char *path,
+                      cli_record_clock_t clock) {
+  rec->file = fopen(path, "wbe");
+  if (rec->file == NULL) {
+    return -1;
+  }
+  if (fwrite(CLI_RECORD_MAGIC, 1, REC_MAGIC_LEN, rec->file) != REC_MAGIC_LEN) {
+    int err = errno;
+    fclose(rec->file);
+    errno = err;
+    return -1;
+  }
+  pthread_mutex_init(&rec->mutex, NULL);
+  rec->clock = clock ? clock : rec_monotonic_us;
+  rec->last = rec->clock();
+  rec->cli = cli;
+  rec->ops = cli->ops;
+  rec->ctx = cli->ctx;
+  rec->write = cli->write;
+  rec->flush = cli->flush;
+  cli_set_ops(cli, &rec_ops, rec);
+  return 0;
+}
+
+size_t cli_recorder_putbuf(cli_recorder_t *rec, const void *buf, size_t len) {
+  rec_log(rec, CLI_RECORD_INPUT, buf, len);
+  return cli_putbuf(rec->cli, buf, len);
+}
+
+int cli_recorder_putchar(cli_recorder_t *rec, char c) {
+  rec_log(rec, CLI_RECORD_INPUT, &c, 1);
+  return cli_putchar(rec->cli, c);
+}
+
+int cli_recorder_close(cli_recorder_t *rec) {
+  cli_t *cli = rec->cli;
+
+  cli_set_ops(cli, rec->ops, rec->ctx);
+  if (rec->ops == NULL) {
+    cli->write = rec->write;
+    cli->flush = rec->flush;
+  }
+  pthread_mutex_destroy(&rec->mutex);
+  return fclose(rec->file) == 0 ? 0 : -1;
+}
+
+int cli_replay_load(cli_replay_t *rp, const char *path) {
+  size_t cap = 0;
+  long size;
+  FILE *f = fopen(path, "rbe");
+
+  rp->buf = NULL;
+  rp->events = NULL;
+  rp->event_num = 0;
+  if (f == NULL) {
+    return -1;
+  }
+  if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0 ||
+      fseek(f, 0, SEEK_SET) < 0) {
+    goto error;
+  }
+  rp->buf = malloc((size_t)size + 1);
+  if (rp->buf == NULL || fread(rp->buf, 1, (size_t)size, f) != (size_t)size) {
+    goto error;
+  }
+  if ((size_t)size < REC_MAGIC_LEN ||
+      memcmp(rp->buf, CLI_RECORD_MAGIC, REC_MAGIC_LEN) != 0) {
+    errno = EINVAL;
+    goto error;
+  }
+
+  const uint8_t *p = rp->buf + REC_MAGIC_LEN;
+  const uint8_t *end = rp->buf + size;
+  uint64_t time = 0;
+  while (p < end) {
+    uint64_t hdr, delay;
+    size_t n = rec_get_varint(p, end, &hdr);
+    size_t m = n ? rec_get_varint(p + n, end, &delay) : 0;
+    if (m == 0 || (uint64_t)(end - p - n - m) < (hdr >> 1)) {
+      break;
+    }
+    if (rp->event_num == cap) {
+      cap = cap ? 2 * cap : 64;
+      cli_replay_event_t *events =
+          realloc(rp->events, cap * sizeof(*rp->events));
+      if (events == NULL) {
+        goto error;
+      }
+      rp->events = events;
+    }
+    time += delay;
+    cli_replay_event_t *ev = &rp->events[rp->event_num++];
+    ev->time = time;
+    ev->output = (hdr & 1) == CLI_RECORD_OUTPUT;
+    ev->data = p + n + m;
+    ev->len = (size_t)(hdr >> 1);
+    p = ev->data + ev->len;
+  }
+  fclose(f);
+  return 0;
+
+error:;
+  int err = errno;
+  cli_replay_free(rp);
+  fclose(f);
+  errno = err;
+  return -1;
+}
+
+void cli_replay_free(cli_replay_t *rp) {
+  free(rp->events);
+  free(rp->buf);
+  rp->events = NULL;
+  rp->buf = NULL;
+  rp->event_num = 0;
+}
+
+/**
+ * @brief Output stream, with the time at which every write ended
+ *
+ */
+typedef struct rp_stream_s {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+  size_t *ends;    /**< end offset of every write */
+  uint64_t *times; /**< microseconds at which every write ended */
+  size_t write_num;
+  size_t write_cap;
+} rp_stream_t;
+
+static int rp_append(rp_stream_t *s, const void *ptr, size_t size,
+                     uint64_t time) {
+  if (s->len + size > s->cap) {
+    size_t cap = s->cap ? s->cap : 1024;
+    while (cap < s->len + size) {
+      cap *= 2;
+    }
+    uint8_t *data = realloc(s->data, cap);
+    if (data == NULL) {
+      return -1;
+    }
+    s->data = data;
+    s->cap = cap;
+  }
+  if (s->write_num == s->write_cap) {
+    size_t cap = s->write_cap ? 2 * s->write_cap : 256;
+    size_t *ends = realloc(s->ends, cap * sizeof(*ends));
+    if (ends != NULL) {
+      s->ends = ends;
+    }
+    uint64_t *times = realloc(s->times, cap * sizeof(*times));
+    if (times != NULL) {
+      s->times = times;
+    }
+    if (ends == NULL || times == NULL) {
+      return -1;
+    }
+    s->write_cap = cap;
+  }
+  memcpy(s->data + s->len, ptr, size);
+  s->len += size;
+  s->ends[s->write_num] = s->len;
+  s->times[s->write_num++] = time;
+  return 0;
+}
+
+static void rp_stream_free(rp_stream_t *s) {
+  free(s->data);
+  free(s->ends);
+  free(s->times);
+}
+
+/**
+ * @brief Input of a replay, whose thread passes the recorded chunks to
+ * cli_putbuf while the calling thread runs the main loop
+ *
+ */
+typedef struct rp_run_s {
+  const cli_replay_t *rp;
+  cli_t *cli;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_mutex_t lock; /**< rp_ops lock, serializes cli_putbuf with the loop */
+  bool pending;     /**< notified since the main loop last ran */
+  bool done;        /**< every chunk was passed */
+  uint64_t start;   /**< monotonic microseconds of the start of the replay */
+  uint64_t *times;  /**< microseconds at which every chunk was passed */
+  size_t dropped;   /**< bytes rejected by cli_putbuf */
+  rp_stream_t out;  /**< output of the replay */
+  int error;        /**< errno of a failed output allocation */
+} rp_run_t;
+
+static size_t rp_write(void *ctx, const void *ptr, size_t size) {
+  rp_run_t *run = ctx;
+  if (rp_append(&run->out, ptr, size, rec_monotonic_us() - run->start) < 0) {
+    run->error = ENOMEM;
+  }
+  return size;
+}
+
+static int rp_flush(void *ctx) {
+  (void)ctx;
+  return 0;
+}
+
+static void rp_lock(void *ctx) {
+  rp_run_t *run = ctx;
+  pthread_mutex_lock(&run->lock);
+}
+
+static void rp_unlock(void *ctx) {
+  rp_run_t *run = ctx;
+  pthread_mutex_unlock(&run->lock);
+}
+
+static const cli_ops_t rp_ops = {rp_write, rp_flush, rp_lock, rp_unlock, NULL};
+
+static void rp_notify(void *ctx, int events) {
+  rp_run_t *run = ctx;
+  (void)events;
+  pthread_mutex_lock(&run->mutex);
+  run->pending = true;
+  pthread_cond_signal(&run->cond);
+  pthread_mutex_unlock(&run->mutex);
+}
+
+static void *rp_input_thread(void *arg) {
+  rp_run_t *run = arg;
+  const cli_replay_t *rp = run->rp;
+
+  for (size_t i = 0; i < rp->event_num; i++) {
+    const cli_replay_event_t *ev = &rp->events[i];
+    if (ev->output) {
+      continue;
+    }
+    uint64_t at = run->start + ev->time;
+    struct timespec ts = {(time_t)(at / 1000000u),
+                          (long)(at % 1000000u) * 1000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR) {
+    }
+    run->times[i] = rec_monotonic_us() - run->start;
+    run->dropped += ev->len - cli_putbuf(run->cli, ev->data, ev->len);
+  }
+  pthread_mutex_lock(&run->mutex);
+  run->done = true;
+  pthread_cond_signal(&run->cond);
+  pthread_mutex_unlock(&run->mutex);
+  return NULL;
+}
+
+/**
+ * @brief Get the end offset and the time of every prompt printed in the
+ * stream
+ *
+ */
+static size_t rp_prompts(const rp_stream_t *s, const char *prompt,
+                         size_t **ends, uint64_t **times) {
+  size_t plen = strlen(prompt);
+  size_t num = 0, w = 0;
+
+  *ends = malloc((s->len / (plen + 2) + 1) * sizeof(**ends));
+  *times = malloc((s->len / (plen + 2) + 1) * sizeof(**times));
+  if (*ends == NULL || *times == NULL) {
+    return 0;
+  }
+  for (size_t off = 0; off + plen + 2 <= s->len;) {
+    const uint8_t *p = s->data + off;
+    if (memcmp(p, prompt, plen) != 0 || memcmp(p + plen, "> ", 2) != 0) {
+      off++;
+      continue;
+    }
+    off += plen + 2;
+    while (s->ends[w] < off) {
+      w++;
+    }
+    (*ends)[num] = off;
+    (*times)[num++] = s->times[w];
+  }
+  return num;
+}
+
+/**
+ * @brief Get the response time of every line, the first prompt which ends
+ * after the line was received. The end offset of the response is returned in
+ * ends if not NULL
+ *
+ */
+static void rp_responses(const rp_stream_t *s, const char *prompt,
+                         const uint64_t *received, size_t line_num,
+                         uint64_t *latency, size_t *ends) {
+  size_t *prompt_ends;
+  uint64_t *prompt_times;
+  size_t num = rp_prompts(s, prompt, &prompt_ends, &prompt_times);
+  size_t p = 0;
+
+  for (size_t i = 0; i < line_num; i++) {
+    while (p < num && prompt_times[p] < received[i]) {
+      p++;
+    }
+    latency[i] = (p < num) ? prompt_times[p] - received[i] : UINT64_MAX;
+    if (ends != NULL) {
+      ends[i] = (p < num) ? prompt_ends[p] : SIZE_MAX;
+    }
+    p += (p < num);
+  }
+  free(prompt_ends);
+  free(prompt_times);
+}
+
+/**
+ * @brief Get the index of the chunk holding the end of every line, each CR,
+ * LF or CR-LF
+ *
+ */
+static size_t rp_lines(const cli_replay_t *rp, size_t *chunks) {
+  size_t num = 0;
+  uint8_t prev = 0;
+
+  for (size_t i = 0; i < rp->event_num; i++) {
+    const cli_replay_event_t *ev = &rp->events[i];
+    for (size_t j = 0; !ev->output && j < ev->len; j++) {
+      uint8_t c = ev->data[j];
+      if (c == '\r' || (c == '\n' && prev != '\r')) {
+        if (chunks != NULL) {
+          chunks[num] = i;
+        }
+        num++;
+      }
+      prev = c;
+    }
+  }
+  return num;
+}
+
+static int rp_result(const cli_replay_t *rp, const cli_t *cli, rp_run_t *run,
+                     cli_replay_result_t *res) {
+  rp_stream_t rec = {0};
+  size_t line_num = rp_lines(rp, NULL);
+  size_t *chunks = calloc(line_num + 1, sizeof(*chunks));
+  size_t *ends = calloc(line_num + 1, sizeof(*ends));
+  uint64_t *received = calloc(line_num + 1, sizeof(*received));
+  uint64_t *latency = calloc(line_num + 1, sizeof(*latency));
+  int status = -1;
+
+  res->lines = calloc(line_num + 1, sizeof(*res->lines));
+  if (chunks == NULL || ends == NULL || received == NULL || latency == NULL ||
+      res->lines == NULL) {
+    goto exit;
+  }
+  for (size_t i = 0; i < rp->event_num; i++) {
+    const cli_replay_event_t *ev = &rp->events[i];
+    if (ev->output && rp_append(&rec, ev->data, ev->len, ev->time) < 0) {
+      goto exit;
+    }
+  }
+  rp_lines(rp, chunks);
+
+  for (size_t i = 0; i < line_num; i++) {
+    received[i] = rp->events[chunks[i]].time;
+  }
+  rp_responses(&rec, cli->prompt, received, line_num, latency, ends);
+  for (size_t i = 0; i < line_num; i++) {
+    res->lines[i].recorded = latency[i];
+    received[i] = run->times[chunks[i]];
+  }
+  rp_responses(&run->out, cli->prompt, received, line_num, latency, NULL);
+  for (size_t i = 0; i < line_num; i++) {
+    res->lines[i].replayed = latency[i];
+  }
+  res->line_num = line_num;
+
+  size_t len = rec.len < run->out.len ? rec.len : run->out.len;
+  res->diff = 0;
+  while (res->diff < len && rec.data[res->diff] == run->out.data[res->diff]) {
+    res->diff++;
+  }
+  if (res->diff == len && rec.len == run->out.len) {
+    res->diff = SIZE_MAX;
+  }
+  res->diff_line = 1;
+  while (res->diff_line <= line_num && ends[res->diff_line - 1] <= res->diff) {
+    res->diff_line++;
+  }
+  status = 0;
+
+exit:
+  rp_stream_free(&rec);
+  free(chunks);
+  free(ends);
+  free(received);
+  free(latency);
+  return status;
+}
+
+int cli_replay_run(const cli_replay_t *rp, cli_t *cli,
+                   cli_replay_result_t *res) {
+  rp_run_t run = {0};
+  pthread_t thread;
+  const cli_ops_t *ops = cli->ops;
+  void *ctx = cli->ctx;
+  size_t (*write)(const void *ptr, size_t size) = cli->write;
+  int (*flush)(void) = cli->flush;
+  void (*notify_cb)(void *ctx, int events) = cli->notify_cb;
+  void *notify_ctx = cli->notify_ctx;
+  int status = -1;
+
+  memset(res, 0, sizeof(*res));
+  run.rp = rp;
+  run.cli = cli;
+  run.times = calloc(rp->event_num + 1, sizeof(*run.times));
+  if (run.times == NULL) {
+    return -1;
+  }
+  pthread_mutex_init(&run.mutex, NULL);
+  pthread_cond_init(&run.cond, NULL);
+  pthread_mutex_init(&run.lock, NULL);
+  cli_set_ops(cli, &rp_ops, &run);
+  cli_register_notify_callback(cli, rp_notify, &run);
+
+  run.start = rec_monotonic_us();
+  cli_print_prompt(cli);
+  errno = pthread_create(&thread, NULL, rp_input_thread, &run);
+  if (errno != 0) {
+    goto exit;
+  }
+  for (bool done = false; !done;) {
+    pthread_mutex_lock(&run.mutex);
+    while (!run.pending && !run.done) {
+      pthread_cond_wait(&run.cond, &run.mutex);
+    }
+    run.pending = false;
+    done = run.done;
+    pthread_mutex_unlock(&run.mutex);
+    for (bool empty = false; !empty;) {
+      cli_mainloop(cli);
+      rp_lock(&run);
+      empty = ringbuffer_is_empty(&cli->rb_inbuf);
+      rp_unlock(&run);
+    }
+  }
+  pthread_join(thread, NULL);
+
+  if (run.error != 0) {
+    errno = run.error;
+  } else if (rp_result(rp, cli, &run, res) < 0) {
+    errno = ENOMEM;
+  } else {
+    res->output = run.out.data;
+    res->output_len = run.out.len;
+    res->dropped = run.dropped;
+    run.out.data = NULL;
+    status = 0;
+  }
+
+exit:
+  cli_set_ops(cli, ops, ctx);
+  if (ops == NULL) {
+    cli->write = write;
+    cli->flush = flush;
+  }
+  cli_register_notify_callback(cli, notify_cb, notify_ctx);
+  pthread_mutex_destroy(&run.lock);
+  pthread_cond_destroy(&run.cond);
+  pthread_mutex_destroy(&run.mutex);
+  rp_stream_free(&run.out);
+  free(run.times);
+  if (status < 0) {
+    cli_replay_result_free(res);
+  }
+  return status;
+}
+
+static void rp_escape(FILE *f, const uint8_t *p, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (p[i] >= 0x20 && p[i] < 0x7f && p[i] != '"' && p[i] != '\\') {
+      fputc(p[i], f);
+    } else {
+      fprintf(f, "\\x%02x", p[i]);
+    }
+  }
+}
+
+void cli_replay_report(const cli_replay_t *rp, const cli_replay_result_t *res,
+                       FILE *f) {
+  static const size_t context = 32;
+
+  fprintf(f, "%6s %12s %12s\n", "line", "recorded us", "replayed us");
+  for (size_t i = 0; i < res->line_num; i++) {
+    const cli_replay_line_t *l = &res->lines[i];
+    fprintf(f, "%6zu", i + 1);
+    if (l->recorded == UINT64_MAX) {
+      fprintf(f, " %12s", "-");
+    } else {
+      fprintf(f, " %12llu", (unsigned long long)l->recorded);
+    }
+    if (l->replayed == UINT64_MAX) {
+      fprintf(f, " %12s\n", "-");
+    } else {
+      fprintf(f, " %12llu\n", (unsigned long long)l->replayed);
+    }
+  }
+  fprintf(f, "dropped input bytes: %zu\n", res->dropped);
+  if (res->diff == SIZE_MAX) {
+    fprintf(f, "output identical\n");
+    return;
+  }
+  fprintf(f, "output differs at byte %zu, line %zu\n", res->diff,
+          res->diff_line);
+
+  // Walk the recorded output up to the context following the difference
+  size_t off = 0, from = res->diff > context ? res->diff - context : 0;
+  fprintf(f, "  recorded: \"");
+  for (size_t i = 0; i < rp->event_num && off < res->diff + context; i++) {
+    const cli_replay_event_t *ev = &rp->events[i];
+    if (!ev->output) {
+      continue;
+    }
+    for (size_t j = 0; j < ev->len && off < res->diff + context; j++, off++) {
+      if (off >= from) {
+        rp_escape(f, ev->data + j, 1);
+      }
+    }
+  }
+  size_t to = res->diff + context;
+  fprintf(f, "\"\n  replayed: \"");
+  if (from < res->output_len) {
+    rp_escape(f, res->output + from,
+              (to < res->output_len ? to : res->output_len) - from);
+  }
+  fprintf(f, "\"\n");
+}
+
+void cli_replay_result_free(cli_replay_result_t *res) {
+  free(res->lines);
+  free(res->output);
+  res->lines = NULL;
+  res->output = NULL;
+  res->line_num = 0;
+  res->output_len = 0;
+}
@@ -0,0 +1,227 @@
+/**
+ * @file recorder.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Session recorder and replayer
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_RECORDER_H
+#define _CLI_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cli.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CLI_RECORD_MAGIC "uclirec1" /**< First bytes of the file */
+
+/**
+ * @brief Direction of a recorded chunk
+ *
+ */
+enum cli_record_dir_e {
+  CLI_RECORD_INPUT = 0,  /**< bytes received by the command line interpreter */
+  CLI_RECORD_OUTPUT = 1, /**< bytes written by the command line interpreter */
+};
+
+/**
+ * @brief Microseconds clock prototype function type
+ *
+ */
+typedef uint64_t (*cli_record_clock_t)(void);
+
+/**
+ * @brief Definition of the recorder struct. The file holds the magic followed
+ * by one record per input chunk or output write, made of a varint header
+ * (length << 1 | direction), a varint delay in microseconds since the previous
+ * record and the bytes. Input and output may be recorded from different
+ * threads
+ *
+ */
+typedef struct cli_recorder_s {
+  FILE *file;               /**< internal recording */
+  pthread_mutex_t mutex;    /**< internal lock of the file */
+  cli_record_clock_t clock; /**< internal microseconds clock */
+  uint64_t last;            /**< internal time of the previous record */
+  cli_t *cli;               /**< internal recorded command line interpreter */
+  const cli_ops_t *ops;     /**< internal I/O operations wrapped */
+  void *ctx;                /**< internal context of the wrapped operations */
+  size_t (*write)(const void *ptr, size_t size); /**< internal wrapped write */
+  int (*flush)(void);                            /**< internal wrapped flush */
+} cli_recorder_t;
+
+/**
+ * @brief Start recording a session. The output is recorded by wrapping the
+ * I/O operations of the command line interpreter, which must not be replaced
+ * until \link cli_recorder_close \endlink. Open it before printing the first
+ * prompt, which \link cli_replay_run \endlink prints when it starts
+ *
+ * @param rec the recorder struct
+ * @param cli the command line interpreter struct
+ * @param path path of the recording, truncated
+ * @param clock microseconds clock. CLOCK_MONOTONIC is used if NULL
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_recorder_open(cli_recorder_t *rec, cli_t *cli, const char *path,
+                      cli_record_clock_t clock);
+
+/**
+ * @brief Record the input and pass it to \link cli_putbuf \endlink. Input
+ * passed to the command line interpreter directly is not recorded
+ *
+ * @param rec the recorder struct
+ * @param buf the received bytes
+ * @param len number of bytes
+ * @return size_t number of bytes accepted by \link cli_putbuf \endlink
+ */
+size_t cli_recorder_putbuf(cli_recorder_t *rec, const void *buf, size_t len);
+
+/**
+ * @brief Record the input and pass it to \link cli_putchar \endlink
+ *
+ * @param rec the recorder struct
+ * @param c the received character
+ * @return int the result of \link cli_putchar \endlink
+ */
+int cli_recorder_putchar(cli_recorder_t *rec, char c);
+
+/**
+ * @brief Restore the I/O operations and close the recording
+ *
+ * @param rec the recorder struct
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_recorder_close(cli_recorder_t *rec);
+
+/**
+ * @brief Definition of a recorded chunk
+ *
+ */
+typedef struct cli_replay_event_s {
+  uint64_t time;       /**< microseconds since the recording started */
+  bool output;         /**< written, else received, bytes */
+  const uint8_t *data; /**< the bytes, in the loaded file */
+  size_t len;          /**< number of bytes */
+} cli_replay_event_t;
+
+/**
+ * @brief Definition of a loaded recording
+ *
+ */
+typedef struct cli_replay_s {
+  uint8_t *buf;               /**< internal content of the file */
+  cli_replay_event_t *events; /**< the recorded chunks */
+  size_t event_num;           /**< number of recorded chunks */
+} cli_replay_t;
+
+/**
+ * @brief Definition of the response times of a line, from the reception of
+ * its end of line to the end of the following prompt
+ *
+ */
+typedef struct cli_replay_line_s {
+  uint64_t recorded; /**< microseconds in the recording, UINT64_MAX if none */
+  uint64_t replayed; /**< microseconds in the replay, UINT64_MAX if none */
+} cli_replay_line_t;
+
+/**
+ * @brief Definition of the result of a replay
+ *
+ */
+typedef struct cli_replay_result_s {
+  cli_replay_line_t *lines; /**< response times of every line */
+  size_t line_num;          /**< number of lines */
+  size_t dropped;           /**< input bytes rejected by cli_putbuf */
+  uint8_t *output;          /**< output of the replay */
+  size_t output_len;        /**< number of bytes of the output */
+  size_t diff;   /**< offset of the first output byte which differs from the
+                    recording, SIZE_MAX if the output is the same */
+  size_t diff_line; /**< line, from 1, whose response holds diff */
+} cli_replay_result_t;
+
+/**
+ * @brief Load a recording
+ *
+ * @param rp the loaded recording struct
+ * @param path path of the recording
+ * @return int 0 on success, -1 on error with errno set. A truncated record at
+ * the end of the file is ignored
+ */
+int cli_replay_load(cli_replay_t *rp, const char *path);
+
+/**
+ * @brief Free a loaded recording
+ *
+ * @param rp the loaded recording struct
+ */
+void cli_replay_free(cli_replay_t *rp);
+
+/**
+ * @brief Replay the input of a recording in real time. A thread passes every
+ * input chunk to \link cli_putbuf \endlink at its recorded time while the
+ * calling thread prints the prompt and runs \link cli_mainloop \endlink when
+ * notified, so the command line interpreter must be initialized with the
+ * command list of the recorded session. Its I/O operations and notify
+ * callback are replaced during the replay
+ *
+ * @param rp the loaded recording struct
+ * @param cli the command line interpreter struct
+ * @param res the result, freed with \link cli_replay_result_free \endlink
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_replay_run(const cli_replay_t *rp, cli_t *cli,
+                   cli_replay_result_t *res);
+
+/**
+ * @brief Print the response times of every line, the dropped input and the
+ * first output difference of a replay
+ *
+ * @param rp the loaded recording struct
+ * @param res the result of the replay
+ * @param f the stream
+ */
+void cli_replay_report(const cli_replay_t *rp, const cli_replay_result_t *res,
+                       FILE *f);
+
+/**
+ * @brief Free the result of a replay
+ *
+ * @param res the result of the replay
+ */
+void cli_replay_result_free(cli_replay_result_t *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_RECORDER_H */
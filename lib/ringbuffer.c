@@ -31,6 +31,8 @@
  */
 #include "ringbuffer.h"
 
+#include <string.h>
+
 #define ringbuffer_lock(rb)
 #define ringbuffer_unlock(rb)
 
@@ -115,6 +117,29 @@ int ringbuffer_peek(ringbuffer_t *rb, uint8_t *pU8) {
   return res;
 }
 
+size_t ringbuffer_read(ringbuffer_t *rb, uint8_t *buf, size_t len) {
+
+  ringbuffer_lock(rb);
+
+  size_t n = ringbuffer_size(rb);
+  if (n > len) {
+    n = len;
+  }
+
+  // At most two copies, the second one when the data wraps around
+  size_t first = rb->capacity - rb->rd_pos;
+  if (first > n) {
+    first = n;
+  }
+  memcpy(buf, &rb->buffer[rb->rd_pos], first);
+  memcpy(&buf[first], rb->buffer, n - first);
+  rb->rd_pos = (rb->rd_pos + n) % rb->capacity;
+
+  ringbuffer_unlock(rb);
+
+  return n;
+}
+
 void ringbuffer_wrap(ringbuffer_t *rb, uint8_t *buffer, size_t capacity) {
   rb->buffer = buffer;
   rb->capacity = capacity;
@@ -61,6 +61,8 @@ int ringbuffer_get(ringbuffer_t *, uint8_t *);
 
 int ringbuffer_peek(ringbuffer_t *, uint8_t *);
 
+size_t ringbuffer_read(ringbuffer_t *, uint8_t *buf, size_t len);
+
 void ringbuffer_wrap(ringbuffer_t *, uint8_t *buffer, size_t capacity);
 
 #ifdef __cplusplus
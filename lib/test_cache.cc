@@ -0,0 +1,164 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::string output;
+static std::vector<std::string> calls;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int record(const char *tag, int argc, char **argv) {
+  std::string call = tag;
+  for (int i = 0; i < argc; i++) {
+    call += std::string(" ") + argv[i];
+  }
+  calls.push_back(call);
+  return 0;
+}
+
+static int cmd_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  return record("cmd:", argc, argv);
+}
+
+static int other_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  return record("other:", argc, argv);
+}
+
+static cli_cmd_t mock_cmds[] = {
+    {"cmd", "cmd", cmd_handler, 0},
+};
+
+static const cli_cmd_t sub_cmds[] = {
+    {"sub", "sub", cmd_handler, 0},
+};
+
+static const cli_cmd_group_t grp = {"grp", "group", sub_cmds, 1};
+static const cli_cmd_group_t *groups[] = {&grp};
+
+static const cli_cmd_list_t mock_cmd_list = {groups, 1, mock_cmds, 1};
+
+static const cli_cmd_t other_cmds[] = {
+    {"cmd", "cmd", other_handler, 0},
+};
+
+static const cli_cmd_list_t other_cmd_list = {NULL, 0, other_cmds, 1};
+
+class CliCacheTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    calls.clear();
+    mock_cmds[0].name = "cmd";
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  void run(const std::string &line) {
+    std::string input = line + "\r\n";
+    cli_feed(&cli, input.c_str(), input.size());
+  }
+};
+
+TEST_F(CliCacheTest, HitRunsSameArguments) {
+  run("cmd  a  b");
+  run("cmd  a  b");
+  run("grp sub x");
+  run("grp sub x");
+  ASSERT_EQ(calls.size(), 4u);
+  EXPECT_EQ(calls[0], "cmd: cmd a b");
+  EXPECT_EQ(calls[1], calls[0]);
+  EXPECT_EQ(calls[2], "cmd: grp sub x");
+  EXPECT_EQ(calls[3], calls[2]);
+  EXPECT_EQ(cli.cache.hits, 2u);
+  EXPECT_EQ(cli.cache.misses, 2u);
+
+  // Unknown commands are not kept
+  run("unknown");
+  run("unknown");
+  EXPECT_EQ(cli.cache.misses, 4u);
+
+  // cli_exec and scripts share the cache
+  cli_exec(&cli, "cmd  a  b", NULL, 0, NULL);
+  cli_exec_script(&cli, "grp sub x\n", 10);
+  EXPECT_EQ(cli.cache.hits, 4u);
+  EXPECT_EQ(calls.back(), "cmd: grp sub x");
+}
+
+TEST_F(CliCacheTest, Builtin) {
+  run("cmd a");
+  run("cmd a");
+  output.clear();
+  // The cache line itself is a miss
+  run("cache");
+  EXPECT_NE(output.find("hits 1 misses 2 lines 2/" +
+                        std::to_string(CLI_CACHE_NUM) + "\r\n"),
+            std::string::npos);
+
+  run("cache clear");
+  output.clear();
+  run("cache");
+  EXPECT_NE(output.find("hits 0 misses 1 lines 1/"), std::string::npos);
+}
+
+TEST_F(CliCacheTest, LeastRecentlyUsed) {
+  for (int i = 0; i < CLI_CACHE_NUM; i++) {
+    run("cmd " + std::to_string(i));
+  }
+  run("cmd 0");
+  EXPECT_EQ(cli.cache.hits, 1u);
+
+  // "cmd 1" is replaced
+  run("cmd new");
+  run("cmd 0");
+  EXPECT_EQ(cli.cache.hits, 2u);
+  run("cmd 1");
+  EXPECT_EQ(cli.cache.hits, 2u);
+}
+
+TEST_F(CliCacheTest, CommandsListChanged) {
+  run("cmd a");
+  cli_set_cmd_list(&cli, &other_cmd_list);
+  run("cmd a");
+  EXPECT_EQ(calls.back(), "other: cmd a");
+
+  // Replaced without cli_set_cmd_list
+  cli.cmd_list = &mock_cmd_list;
+  run("cmd a");
+  EXPECT_EQ(calls.back(), "cmd: cmd a");
+  EXPECT_EQ(cli.cache.hits, 0u);
+
+  // Changed in place
+  run("cmd a");
+  mock_cmds[0].name = "renamed";
+  cli_set_cmd_list(&cli, &mock_cmd_list);
+  output.clear();
+  run("cmd a");
+  EXPECT_NE(output.find("Unknown command"), std::string::npos);
+}
+
+TEST_F(CliCacheTest, SmallerArgumentsVector) {
+  static const cli_config_t cfg = {16, CLI_LINE_MAX, 2, 0};
+  static char mem[512];
+  ASSERT_EQ(cli_init_ex(&cli, &mock_cmd_list, &cfg, mem, sizeof(mem)), 0);
+  cli.write = mock_write;
+  cli.flush = mock_flush;
+
+  cli_exec(&cli, "cmd a b", NULL, 0, NULL);
+  EXPECT_EQ(calls.back(), "cmd: cmd a b");
+  output.clear();
+  run("cmd a b");
+  EXPECT_NE(output.find("CLI_ARGV_NUM"), std::string::npos);
+  EXPECT_EQ(calls.size(), 1u);
+}
@@ -0,0 +1,144 @@
+#include "cli.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+static std::string output;
+static cli_time_t fake_now;
+static int iterations;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static cli_time_t mock_clock(void) { return fake_now; }
+
+// Simulates the RX ISR receiving CTRL-C after a few iterations
+static int ctrl_c_handler(cli_t *cli, int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  for (iterations = 0; !cli_cancelled(cli); iterations++) {
+    if (iterations == 10) {
+      cli_putchar(cli, 0x03);
+    }
+  }
+  return -1;
+}
+
+// Every poll lasts 10 ms
+static int slow_handler(cli_t *cli, int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  for (iterations = 0; !cli_cancelled(cli); iterations++) {
+    fake_now += 10;
+    if (iterations == 1000) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int quick_handler(cli_t *cli, int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  return cli_cancelled(cli) ? -1 : 0;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"loop", "loop until CTRL-C", ctrl_c_handler, 0},
+    {"slow", "slow with budget", slow_handler, 100},
+    {"unbounded", "slow without budget", slow_handler, 0},
+    {"quick", "quick cmd", quick_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 4};
+
+class CliCancelTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    fake_now = 0;
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  void run(const char *line) {
+    cli_puts(&cli, line);
+    cli_mainloop(&cli);
+  }
+};
+
+TEST_F(CliCancelTest, CtrlCWhileRunning) {
+  run("loop\r\n");
+  EXPECT_EQ(iterations, 11);
+  EXPECT_NE(output.find("Cancelled\r\n" CLI_PROMPT "> "), std::string::npos);
+  // CTRL-C was consumed by the cancellation and not by the line editor
+  EXPECT_EQ(output.find("^C"), std::string::npos);
+
+  // The next command starts with a cleared flag
+  output.clear();
+  run("quick\r\n");
+  EXPECT_NE(output.find("Ok\r\n"), std::string::npos);
+}
+
+TEST_F(CliCancelTest, CtrlCWhileEditing) {
+  EXPECT_FALSE(cli_cancelled(&cli));
+  cli_puts(&cli, "quick");
+  cli_putchar(&cli, 0x03);
+  cli_mainloop(&cli);
+  EXPECT_NE(output.find("^C\r\n"), std::string::npos);
+  EXPECT_FALSE(cli_cancelled(&cli));
+}
+
+TEST_F(CliCancelTest, CtrlCFromThread) {
+  std::atomic<bool> done{false};
+  std::thread rx([&] {
+    while (!done) {
+      if (cli.cmd_depth > 0) {
+        cli_putchar(&cli, 0x03);
+        break;
+      }
+    }
+  });
+  run("loop\r\n");
+  done = true;
+  rx.join();
+  EXPECT_NE(output.find("Cancelled\r\n"), std::string::npos);
+}
+
+TEST_F(CliCancelTest, TimeBudget) {
+  // Without a clock budgets are not enforced
+  run("slow\r\n");
+  EXPECT_EQ(iterations, 1000);
+  EXPECT_NE(output.find("Ok\r\n"), std::string::npos);
+
+  cli.clock = mock_clock;
+  output.clear();
+  run("slow\r\n");
+  EXPECT_EQ(iterations, 10);
+  EXPECT_NE(output.find("Cancelled\r\n"), std::string::npos);
+
+  output.clear();
+  run("unbounded\r\n");
+  EXPECT_EQ(iterations, 1000);
+  EXPECT_NE(output.find("Ok\r\n"), std::string::npos);
+}
+
+TEST_F(CliCancelTest, CancelStopsScript) {
+  static const char script[] = "quick\n"
+                               "loop\n"
+                               "quick\n"
+                               "quick\n";
+  EXPECT_EQ(cli_exec_script(&cli, script, strlen(script)), 2);
+  EXPECT_NE(output.find("line 2: Cancelled\r\n"), std::string::npos);
+  EXPECT_EQ(output.find("line 3"), std::string::npos);
+  EXPECT_EQ(output.find("line 4"), std::string::npos);
+}
@@ -0,0 +1,135 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+
+static std::string output;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int print_handler(cli_t *cli, int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    cli->write(argv[i], strlen(argv[i]));
+    cli->write(";", 1);
+  }
+  cli->flush();
+  return 0;
+}
+
+static int fail_handler(cli_t *cli, int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  cli->write("failed", 6);
+  return -1;
+}
+
+// Runs a nested command and checks its own argv is left untouched
+static int nested_handler(cli_t *cli, int argc, char **argv) {
+  char buf[32];
+  int status;
+
+  cli_exec(cli, "print inner", buf, sizeof(buf), &status);
+  cli->write("[", 1);
+  cli->write(buf, strlen(buf));
+  cli->write("]", 1);
+  return (status == CLI_OK && argc == 2 && !strcmp(argv[1], "outer")) ? 0 : -1;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"print", "print args", print_handler, 0},
+    {"fail", "fail cmd", fail_handler, 0},
+    {"nested", "nested cli_exec", nested_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 3};
+
+class CliExecTest : public ::testing::Test {
+protected:
+  cli_t cli;
+  char out[64];
+  int status;
+
+  void SetUp() override {
+    output.clear();
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+    status = 1;
+  }
+};
+
+TEST_F(CliExecTest, CapturesOutput) {
+  EXPECT_EQ(cli_exec(&cli, "print a b\r\n", out, sizeof(out), &status), 4u);
+  EXPECT_STREQ(out, "a;b;");
+  EXPECT_EQ(status, CLI_OK);
+  // No echo, no status message and no prompt on the terminal
+  EXPECT_EQ(output, "");
+  EXPECT_EQ(cli.write, mock_write);
+  EXPECT_EQ(cli.flush, mock_flush);
+}
+
+TEST_F(CliExecTest, Status) {
+  cli_exec(&cli, "fail", out, sizeof(out), &status);
+  EXPECT_EQ(status, CLI_ERR_HANDLER);
+  EXPECT_STREQ(out, "failed");
+
+  cli_exec(&cli, "unknown", out, sizeof(out), &status);
+  EXPECT_EQ(status, CLI_ERR_UNKNOWN);
+  EXPECT_STREQ(out, "");
+
+  cli_exec(&cli, "  ", out, sizeof(out), &status);
+  EXPECT_EQ(status, CLI_OK);
+
+  std::string line = "print " + std::string(CLI_LINE_MAX, 'x');
+  cli_exec(&cli, line.c_str(), out, sizeof(out), &status);
+  EXPECT_EQ(status, CLI_ERR_LINE_MAX);
+
+  line = "print";
+  for (int i = 0; i < CLI_ARGV_NUM; i++) {
+    line += " a";
+  }
+  cli_exec(&cli, line.c_str(), out, sizeof(out), &status);
+  EXPECT_EQ(status, CLI_ERR_ARGV_NUM);
+  EXPECT_EQ(output, "");
+}
+
+TEST_F(CliExecTest, Truncation) {
+  char small[4];
+  EXPECT_EQ(cli_exec(&cli, "print abcdef", small, sizeof(small), &status), 7u);
+  EXPECT_STREQ(small, "abc");
+
+  // Output may be discarded
+  EXPECT_EQ(cli_exec(&cli, "print abc", NULL, 0, NULL), 4u);
+  EXPECT_EQ(output, "");
+}
+
+TEST_F(CliExecTest, Nested) {
+  cli_exec(&cli, "nested outer", out, sizeof(out), &status);
+  EXPECT_EQ(status, CLI_OK);
+  EXPECT_STREQ(out, "[inner;]");
+
+  // From the interactive session the nested output is captured too
+  cli_puts(&cli, "nested outer\r\n");
+  cli_mainloop(&cli);
+  EXPECT_NE(output.find("[inner;]Ok\r\n"), std::string::npos);
+}
+
+TEST_F(CliExecTest, InteractiveSessionUntouched) {
+  cli_puts(&cli, "print partial");
+  cli_mainloop(&cli);
+  output.clear();
+
+  cli_exec(&cli, "print x", out, sizeof(out), &status);
+  EXPECT_STREQ(out, "x;");
+  EXPECT_STREQ(cli.line, "print partial");
+  EXPECT_EQ(output, "");
+
+  cli_puts(&cli, " line\r\n");
+  cli_mainloop(&cli);
+  EXPECT_NE(output.find("partial;line;Ok"), std::string::npos);
+}
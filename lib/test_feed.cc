@@ -0,0 +1,106 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::string output;
+static std::vector<std::string> calls;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int cmd_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  std::string call;
+  for (int i = 0; i < argc; i++) {
+    call += (i ? " " : "");
+    call += argv[i];
+  }
+  calls.push_back(call);
+  return 0;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"cmd1", "cmd1", cmd_handler, 0},
+    {"cmd2", "cmd2", cmd_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 2};
+
+class CliFeedTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    calls.clear();
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  void feed(const char *str) { cli_feed(&cli, str, strlen(str)); }
+};
+
+TEST_F(CliFeedTest, SeveralLinesInOneChunk) {
+  feed("cmd1 a\r\ncmd2 b\r\n\r\nunknown\n");
+  ASSERT_EQ(calls.size(), 2u);
+  EXPECT_EQ(calls[0], "cmd1 a");
+  EXPECT_EQ(calls[1], "cmd2 b");
+  EXPECT_NE(output.find("Unknown command\r\n"), std::string::npos);
+  // Nothing went through the receive buffer
+  EXPECT_TRUE(ringbuffer_is_empty(&cli.rb_inbuf));
+}
+
+TEST_F(CliFeedTest, PartialLines) {
+  feed("cm");
+  feed("d1 a");
+  EXPECT_TRUE(calls.empty());
+  EXPECT_STREQ(cli.line, "cmd1 a");
+  feed("rg\r");
+  ASSERT_EQ(calls.size(), 1u);
+  EXPECT_EQ(calls[0], "cmd1 arg");
+  // LF of a CR-LF split between two chunks is not an empty line
+  output.clear();
+  feed("\ncmd2");
+  EXPECT_EQ(output, "cmd2");
+  feed("\r\n");
+  ASSERT_EQ(calls.size(), 2u);
+  EXPECT_EQ(calls[1], "cmd2");
+}
+
+TEST_F(CliFeedTest, SameOutputAsMainloop) {
+  static const char input[] = "cmd1 x\r\n"
+                              "abc\x7f\x7f\x7f"
+                              "cmd2 y z\x17w\r\n"
+                              "echo off\r\n"
+                              "cmd1\r\n";
+  feed(input);
+  std::string fed = output;
+  std::vector<std::string> fed_calls = calls;
+
+  SetUp();
+  cli_puts(&cli, input);
+  for (int i = 0; i < 8; i++) {
+    cli_mainloop(&cli);
+  }
+  EXPECT_EQ(fed, output);
+  EXPECT_EQ(fed_calls, calls);
+  ASSERT_EQ(fed_calls.size(), 3u);
+  EXPECT_EQ(fed_calls[1], "cmd2 y w");
+}
+
+TEST_F(CliFeedTest, LineTooLong) {
+  std::string line = "cmd1 " + std::string(CLI_LINE_MAX, 'x') + "\r\ncmd2\r\n";
+  feed(line.c_str());
+  EXPECT_NE(output.find("CLI_LINE_MAX"), std::string::npos);
+  // The tail of the long line is discarded, not dispatched
+  ASSERT_EQ(calls.size(), 1u);
+  EXPECT_EQ(calls[0], "cmd2");
+  EXPECT_EQ(output.find("Unknown command"), std::string::npos);
+}
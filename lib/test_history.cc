@@ -8,8 +8,11 @@
 static std::vector<std::string> output_lines;
 static std::string current_output;
 
+static std::string raw_output;
+
 static size_t mock_write(const void *ptr, size_t size) {
   const char *str = (const char *)ptr;
+  raw_output.append(str, size);
   for (size_t i = 0; i < size; ++i) {
     if (str[i] == '\n') {
       output_lines.push_back(current_output);
@@ -42,9 +45,22 @@ class CliHistoryTest : public ::testing::Test {
 protected:
   cli_t cli;
 
+  void run(const char *input) {
+    cli_puts(&cli, input);
+    cli_mainloop(&cli);
+  }
+
+  void push(const std::vector<std::string> &lines) {
+    for (const auto &line : lines) {
+      run((line + "\n").c_str());
+    }
+    raw_output.clear();
+  }
+
   void SetUp() override {
     output_lines.clear();
     current_output.clear();
+    raw_output.clear();
     cli_init(&cli, &mock_cmd_list);
     cli.write = mock_write;
     cli.flush = mock_flush;
@@ -233,3 +249,152 @@ TEST_F(CliHistoryTest, Shortcuts) {
   cli_mainloop(&cli);
   EXPECT_STREQ(cli.line, "");
 }
+
+TEST_F(CliHistoryTest, PackedEntries) {
+  // Short commands take their length plus two bytes
+  for (int i = 0; i < 100; i++) {
+    std::string line = "test " + std::to_string(i) + "\n";
+    cli_puts(&cli, line.c_str());
+    cli_mainloop(&cli);
+  }
+  EXPECT_LE(cli.history.used, (size_t)CLI_HISTORY_SIZE);
+  EXPECT_GT(cli.history.count, (size_t)CLI_HISTORY_SIZE / CLI_LINE_MAX);
+
+  // The newest entries are kept, in order, across the end of the ring
+  output_lines.clear();
+  cli_puts(&cli, "history\n");
+  cli_mainloop(&cli);
+  size_t count = cli.history.count - 1; // "history" itself
+  std::vector<std::string> entries;
+  for (const auto &line : output_lines) {
+    size_t pos = line.find(" test ");
+    if (pos != std::string::npos) {
+      entries.push_back(line.substr(pos + 1));
+    }
+  }
+  ASSERT_EQ(entries.size(), count);
+  for (size_t i = 0; i < count; i++) {
+    EXPECT_EQ(entries[i], "test " + std::to_string(100 - count + i));
+  }
+
+  // Up walks back through the wrapped entries
+  for (size_t i = 0; i <= count; i++) {
+    cli_puts(&cli, "\x1b[A");
+    cli_mainloop(&cli);
+  }
+  EXPECT_EQ(std::string(cli.line), "test " + std::to_string(100 - count));
+}
+
+TEST_F(CliHistoryTest, LongEntriesEvictSeveral) {
+  std::string arg(CLI_LINE_MAX - 8, 'x');
+  cli_puts(&cli, "test 1\ntest 2\ntest 3\n");
+  cli_mainloop(&cli);
+  size_t count = cli.history.count;
+  for (int i = 0; i < CLI_HISTORY_SIZE / CLI_LINE_MAX + 1; i++) {
+    std::string line = "test " + std::to_string(i) + arg + "\n";
+    cli_puts(&cli, line.c_str());
+    cli_mainloop(&cli);
+  }
+  EXPECT_LE(cli.history.used, (size_t)CLI_HISTORY_SIZE);
+  EXPECT_LT(cli.history.count, count + CLI_HISTORY_SIZE / CLI_LINE_MAX + 1);
+
+  cli_puts(&cli, "\x1b[A");
+  cli_mainloop(&cli);
+  EXPECT_EQ(std::string(cli.line),
+            "test " + std::to_string(CLI_HISTORY_SIZE / CLI_LINE_MAX) + arg);
+}
+
+TEST_F(CliHistoryTest, PrefixNavigation) {
+  push({"cmd1 a", "cmd2 b", "cmd1 c", "test x"});
+
+  // Only the entries starting with the typed text are browsed
+  run("cmd1");
+  run("\x1b[A");
+  EXPECT_STREQ(cli.line, "cmd1 c");
+  run("\x1b[A");
+  EXPECT_STREQ(cli.line, "cmd1 a");
+  run("\x10"); // CTRL-P
+  EXPECT_STREQ(cli.line, "cmd1 a");
+  run("\x1b[B");
+  EXPECT_STREQ(cli.line, "cmd1 c");
+  // Past the newest entry the typed text is back
+  run("\x0e"); // CTRL-N
+  EXPECT_STREQ(cli.line, "cmd1");
+
+  // Editing the line changes the filter
+  run("\x1b[A\x7f\x7f\x7f\x7f");
+  EXPECT_STREQ(cli.line, "cm");
+  run("\x1b[A");
+  EXPECT_STREQ(cli.line, "cmd1 c");
+  run("\x1b[A");
+  EXPECT_STREQ(cli.line, "cmd2 b");
+}
+
+TEST_F(CliHistoryTest, NavigationRedrawsChangedPart) {
+  push({"cmd1 abc", "cmd1 abd", "cmd1 x"});
+
+  run("\x1b[A");
+  EXPECT_EQ(raw_output, "cmd1 x");
+  raw_output.clear();
+  run("\x1b[A");
+  EXPECT_EQ(raw_output, "\babd");
+  raw_output.clear();
+  run("\x1b[A");
+  EXPECT_EQ(raw_output, "\bc");
+  raw_output.clear();
+  // A shorter line erases the end of the longer one
+  run("\x1b[B\x1b[B");
+  EXPECT_EQ(raw_output, "\bd\b\b\bx\x1b[K");
+  EXPECT_STREQ(cli.line, "cmd1 x");
+}
+
+TEST_F(CliHistoryTest, ReverseSearch) {
+  push({"cmd1 alpha", "cmd2 beta", "cmd1 gamma", "test"});
+
+  run("\x12" "a"); // CTRL-R
+  EXPECT_EQ(raw_output, "(reverse-i-search)`': \b\b\ba': cmd1 gamma");
+  EXPECT_STREQ(cli.line, "");
+
+  // The next key refines the match, only the end of the line is redrawn
+  raw_output.clear();
+  run("l");
+  EXPECT_EQ(raw_output, std::string(13, '\b') + "l': cmd1 alpha");
+
+  // No older match
+  raw_output.clear();
+  run("\x12");
+  EXPECT_EQ(raw_output, "\a");
+
+  // Accepted and executed
+  run("\r");
+  EXPECT_FALSE(cli.history.search.active);
+  run("\x1b[A");
+  EXPECT_STREQ(cli.line, "cmd1 alpha");
+}
+
+TEST_F(CliHistoryTest, ReverseSearchKeys) {
+  push({"cmd1 alpha", "cmd2 beta", "cmd1 gamma"});
+
+  // CTRL-R again goes back to older matches
+  run("\x12" "cmd1\x12");
+  EXPECT_EQ(cli.history.search.idx, 0);
+  // A shorter query matches the newest entry again
+  run("\x7f");
+  EXPECT_EQ(cli.history.search.idx, 2);
+  run("2");
+  EXPECT_EQ(cli.history.search.idx, 1);
+  // Failing queries keep the last match
+  run("zz");
+  EXPECT_TRUE(cli.history.search.failed);
+  EXPECT_EQ(cli.history.search.idx, 1);
+
+  // CTRL-G restores the line
+  run("\x07");
+  EXPECT_FALSE(cli.history.search.active);
+  EXPECT_STREQ(cli.line, "");
+
+  // Other keys accept the match and are handled as usual
+  run("x\x12gam\x17");
+  EXPECT_FALSE(cli.history.search.active);
+  EXPECT_STREQ(cli.line, "cmd1 ");
+}
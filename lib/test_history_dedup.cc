@@ -0,0 +1,154 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+
+static size_t mock_write(const void *ptr, size_t size) {
+  (void)ptr;
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int test_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  return 0;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"cmd", "cmd", test_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 1};
+
+class CliHistoryDedupTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  void run(const std::string &line) {
+    std::string input = line + "\r\n";
+    cli_feed(&cli, input.c_str(), input.size());
+  }
+
+  std::string history() {
+    char out[CLI_HISTORY_SIZE * 2];
+    cli_exec(&cli, "history", out, sizeof(out), NULL);
+    return out;
+  }
+};
+
+TEST_F(CliHistoryDedupTest, ErasesOlderDuplicates) {
+  run("cmd a");
+  run("cmd b");
+  run("cmd c");
+  run("cmd a");
+  EXPECT_EQ(history(), " 1 cmd b\r\n 2 cmd c\r\n 3 cmd a\r\n");
+  run("cmd b");
+  run("cmd b");
+  EXPECT_EQ(history(), " 1 cmd c\r\n 2 cmd a\r\n 3 cmd b\r\n");
+  // The oldest entry
+  run("cmd c");
+  EXPECT_EQ(history(), " 1 cmd a\r\n 2 cmd b\r\n 3 cmd c\r\n");
+  EXPECT_EQ(cli.history.count, 3u);
+
+  // Navigation walks the moved entries
+  cli_feed(&cli, "\x1b[A\x1b[A", 6);
+  EXPECT_STREQ(cli.line, "cmd b");
+  cli_feed(&cli, "\x15", 1); // CTRL-U
+
+  run("history clear");
+  run("cmd a");
+  EXPECT_EQ(history(), " 1 cmd a\r\n");
+}
+
+TEST_F(CliHistoryDedupTest, PollingKeepsUsefulEntries) {
+  run("cmd useful 1");
+  run("cmd useful 2");
+  for (int i = 0; i < 1000; i++) {
+    run("cmd poll " + std::to_string(i % 4));
+    run("cmd status");
+  }
+  std::string list = history();
+  EXPECT_NE(list.find(" 1 cmd useful 1\r\n 2 cmd useful 2\r\n"),
+            std::string::npos);
+  EXPECT_EQ(cli.history.count, 7u);
+}
+
+// Two lines sharing an index slot, alternating as when polling
+TEST_F(CliHistoryDedupTest, CollidingLines) {
+  run("cmd useful");
+  for (int i = 0; i < 20; i++) {
+    run("cmd poll 9");
+    run("cmd poll 12");
+  }
+  EXPECT_EQ(history(), " 1 cmd useful\r\n 2 cmd poll 9\r\n 3 cmd poll 12\r\n");
+  EXPECT_EQ(cli.history.count, 3u);
+}
+
+// The oldest entry is repeated, erasing it each time
+TEST_F(CliHistoryDedupTest, RepeatsOldest) {
+  for (int i = 0; i < 200; i++) {
+    run("cmd " + std::to_string(i % 5));
+  }
+  EXPECT_EQ(history(), " 1 cmd 0\r\n 2 cmd 1\r\n 3 cmd 2\r\n 4 cmd 3\r\n"
+                       " 5 cmd 4\r\n");
+  EXPECT_LE(cli.history.used, (size_t)CLI_HISTORY_SIZE);
+}
+
+// Bytes of an entry, its length on both sides and its link in the index
+static size_t entry_size(const std::string &line) { return line.size() + 4; }
+
+// The history is checked against the lines ordered by their last use, across
+// the end of the ring and with entries of every length, some of them sharing
+// an index slot
+TEST_F(CliHistoryDedupTest, Model) {
+  static const char *const args[] = {
+      "a", "bb", "ccc", "ddddddd", "eeeeeeeeeeeeeeeee",
+      "ffffffffffffffffffffffffffffffffffffff", "g1", "h22", "i333"};
+  std::deque<std::string> model;
+
+  srand(1);
+  for (int i = 0; i < 5000; i++) {
+    std::string line = "cmd " + std::string(args[rand() % 9]) +
+                       std::to_string(rand() % 5);
+    run(line);
+    for (auto it = model.begin(); it != model.end(); ++it) {
+      if (*it == line) {
+        model.erase(it);
+        break;
+      }
+    }
+    model.push_back(line);
+
+    // The entries are the lines used last
+    size_t count = cli.history.count;
+    size_t live = 0;
+    std::string expected;
+    ASSERT_LE(count, model.size()) << "push " << i;
+    for (size_t j = model.size() - count; j < model.size(); j++) {
+      char num[24];
+      snprintf(num, sizeof(num), "%2zu ", j + count - model.size() + 1);
+      expected += num + model[j] + "\r\n";
+      live += entry_size(model[j]);
+    }
+    ASSERT_EQ(history(), expected) << "push " << i;
+    ASSERT_LE(live, cli.history.used);
+    ASSERT_LE(cli.history.used, (size_t)CLI_HISTORY_SIZE);
+    // An entry is only evicted while erased ones fill less than a quarter
+    if (count < model.size()) {
+      ASSERT_GT(live + entry_size(model[model.size() - count - 1]),
+                (size_t)CLI_HISTORY_SIZE * 3 / 4)
+          << "push " << i;
+    }
+  }
+}
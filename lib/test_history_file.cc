@@ -0,0 +1,286 @@
+#include "history_file.h"
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static size_t mock_write(const void *ptr, size_t size) {
+  (void)ptr;
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int test_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  return 0;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"cmd", "cmd", test_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 1};
+
+// Flash-like store, a fixed array of fixed size slots
+struct flash_store {
+  char slots[4][16];
+  size_t count;
+};
+
+static void flash_append(void *ctx, const char *line, size_t len) {
+  flash_store *fs = (flash_store *)ctx;
+  char *slot = fs->slots[fs->count++ % 4];
+  memset(slot, 0, sizeof(fs->slots[0]));
+  memcpy(slot, line, len < 15 ? len : 15);
+}
+
+static int flash_read(void *ctx, size_t idx, char *buf, size_t cap) {
+  flash_store *fs = (flash_store *)ctx;
+  if (idx >= fs->count || idx >= 4) {
+    return -1;
+  }
+  const char *slot = fs->slots[(fs->count - 1 - idx) % 4];
+  size_t len = strlen(slot);
+  memcpy(buf, slot, len < cap ? len : cap);
+  return (int)len;
+}
+
+static const cli_history_store_t flash_ops = {flash_append, flash_read, NULL};
+
+class CliHistoryFileTest : public ::testing::Test {
+protected:
+  cli_t cli;
+  cli_history_file_t hf;
+  std::string path;
+
+  void SetUp() override {
+    char tmpl[] = "/tmp/test_history_XXXXXX";
+    int fd = mkstemp(tmpl);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path = tmpl;
+    unlink(path.c_str());
+    init();
+  }
+
+  void TearDown() override {
+    unlink(path.c_str());
+    unlink((path + ".tmp").c_str());
+  }
+
+  void init() {
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  void run(const std::string &line) {
+    std::string input = line + "\r\n";
+    cli_feed(&cli, input.c_str(), input.size());
+  }
+
+  std::string history() {
+    char out[1024];
+    cli_exec(&cli, "history", out, sizeof(out), NULL);
+    return out;
+  }
+
+  size_t file_size() {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+  }
+};
+
+TEST_F(CliHistoryFileTest, Persists) {
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  EXPECT_EQ(cli_set_history_store(&cli, &cli_history_file_store, &hf), 0u);
+  run("cmd 1");
+  run("cmd 2");
+  run("cmd 2");
+  // Appends are batched
+  EXPECT_EQ(file_size(), strlen(CLI_HISTORY_FILE_MAGIC));
+  cli_history_file_close(&hf);
+
+  // A new instance loads them
+  init();
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  EXPECT_EQ(cli_set_history_store(&cli, &cli_history_file_store, &hf), 2u);
+  EXPECT_EQ(history(), " 1 cmd 1\r\n 2 cmd 2\r\n");
+  EXPECT_STREQ(cli.line, "");
+  run("cmd 3");
+  cli_history_file_close(&hf);
+
+  init();
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  EXPECT_EQ(cli_set_history_store(&cli, &cli_history_file_store, &hf), 3u);
+  EXPECT_EQ(history(), " 1 cmd 1\r\n 2 cmd 2\r\n 3 cmd 3\r\n");
+  cli_history_file_close(&hf);
+}
+
+TEST_F(CliHistoryFileTest, LoadsNewestThatFit) {
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  for (int i = 0; i < 200; i++) {
+    cli_history_file_store.append(&hf, "cmd 123456", 10);
+    cli_history_file_store.append(&hf, ("cmd " + std::to_string(i)).c_str(),
+                                  ("cmd " + std::to_string(i)).size());
+  }
+  // Too long for the line, skipped
+  std::string long_line(CLI_LINE_MAX, 'x');
+  cli_history_file_store.append(&hf, long_line.c_str(), long_line.size());
+
+  size_t n = cli_set_history_store(&cli, &cli_history_file_store, &hf);
+  EXPECT_GT(n, 0u);
+  EXPECT_LT(n, 400u);
+  std::string list = history();
+  EXPECT_NE(list.find(" cmd 199\r\n"), std::string::npos);
+  EXPECT_EQ(list.find("xxx"), std::string::npos);
+  EXPECT_EQ(list.find(" cmd 0\r\n"), std::string::npos);
+  cli_history_file_close(&hf);
+}
+
+TEST_F(CliHistoryFileTest, TornTail) {
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  cli_set_history_store(&cli, &cli_history_file_store, &hf);
+  run("cmd 1");
+  run("cmd 2");
+  cli_history_file_close(&hf);
+  size_t size = file_size();
+
+  // A crash in the middle of an append
+  FILE *f = fopen(path.c_str(), "ab");
+  ASSERT_NE(f, nullptr);
+  fwrite("\x05\x00cmd", 1, 5, f);
+  fclose(f);
+
+  init();
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  EXPECT_EQ(file_size(), size);
+  EXPECT_EQ(cli_set_history_store(&cli, &cli_history_file_store, &hf), 2u);
+  EXPECT_EQ(history(), " 1 cmd 1\r\n 2 cmd 2\r\n");
+  cli_history_file_close(&hf);
+
+  // Not a history file
+  f = fopen(path.c_str(), "wb");
+  fwrite("garbage!", 1, 8, f);
+  fclose(f);
+  EXPECT_EQ(cli_history_file_open(&hf, path.c_str(), 0), -1);
+}
+
+TEST_F(CliHistoryFileTest, Compaction) {
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 256), 0);
+  cli_set_history_store(&cli, &cli_history_file_store, &hf);
+  for (int i = 0; i < 1000; i++) {
+    run("cmd " + std::to_string(i));
+    if (i % 10 == 0) {
+      // Appends race with the compaction started by the previous flush
+      ASSERT_EQ(cli_history_file_flush(&hf), 0);
+    }
+  }
+  cli_history_file_close(&hf);
+  EXPECT_LE(file_size(), 512u);
+  EXPECT_EQ(access((path + ".tmp").c_str(), F_OK), -1);
+
+  // The newest entries survive, in order and without gaps
+  init();
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 256), 0);
+  size_t n = cli_set_history_store(&cli, &cli_history_file_store, &hf);
+  ASSERT_GT(n, 10u);
+  std::string expected;
+  for (size_t i = 0; i < n; i++) {
+    char line[32];
+    snprintf(line, sizeof(line), "%2zu cmd %zu\r\n", i + 1, 1000 - n + i);
+    expected += line;
+  }
+  EXPECT_EQ(history(), expected);
+  cli_history_file_close(&hf);
+}
+
+TEST_F(CliHistoryFileTest, LoadLargerThanMaxSize) {
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  for (int i = 0; i < 200000; i++) {
+    std::string line = "cmd " + std::to_string(i);
+    cli_history_file_store.append(&hf, line.c_str(), line.size());
+  }
+  cli_history_file_close(&hf);
+
+  // The first flush starts a compaction, the flush of the first read when
+  // loading finishes it, shrinking the file
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 4096), 0);
+  ASSERT_EQ(cli_history_file_flush(&hf), 0);
+  usleep(100000);
+  size_t n = cli_set_history_store(&cli, &cli_history_file_store, &hf);
+  ASSERT_GT(n, 10u);
+  std::string expected;
+  for (size_t i = 0; i < n; i++) {
+    char line[32];
+    snprintf(line, sizeof(line), "%2zu cmd %zu\r\n", i + 1, 200000 - n + i);
+    expected += line;
+  }
+  char out[8192];
+  cli_exec(&cli, "history", out, sizeof(out), NULL);
+  EXPECT_EQ(std::string(out), expected);
+  cli_history_file_close(&hf);
+  EXPECT_LE(file_size(), 8192u);
+}
+
+TEST_F(CliHistoryFileTest, ReadsInAnyOrder) {
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  for (int i = 0; i < 100; i++) {
+    std::string line = "cmd " + std::to_string(i);
+    cli_history_file_store.append(&hf, line.c_str(), line.size());
+  }
+  // Backward, forward from the last entry read and from the end
+  for (size_t idx : {0, 1, 50, 99, 98, 60, 59, 3, 4, 100, 97}) {
+    char buf[16];
+    int len = cli_history_file_store.read(&hf, idx, buf, sizeof(buf));
+    if (idx == 100) {
+      EXPECT_EQ(len, -1);
+      continue;
+    }
+    ASSERT_GT(len, 0);
+    EXPECT_EQ(std::string(buf, (size_t)len), "cmd " + std::to_string(99 - idx));
+  }
+  cli_history_file_close(&hf);
+}
+
+TEST_F(CliHistoryFileTest, Clear) {
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  cli_set_history_store(&cli, &cli_history_file_store, &hf);
+  run("cmd 1");
+  run("history clear");
+  run("cmd 2");
+  cli_history_file_close(&hf);
+
+  init();
+  ASSERT_EQ(cli_history_file_open(&hf, path.c_str(), 0), 0);
+  EXPECT_EQ(cli_set_history_store(&cli, &cli_history_file_store, &hf), 1u);
+  EXPECT_EQ(history(), " 1 cmd 2\r\n");
+  cli_history_file_close(&hf);
+}
+
+TEST_F(CliHistoryFileTest, CustomStore) {
+  flash_store fs = {};
+  cli_set_history_store(&cli, &flash_ops, &fs);
+  for (int i = 1; i <= 6; i++) {
+    run("cmd " + std::to_string(i));
+  }
+  EXPECT_EQ(fs.count, 6u);
+
+  init();
+  EXPECT_EQ(cli_set_history_store(&cli, &flash_ops, &fs), 4u);
+  EXPECT_EQ(history(), " 1 cmd 3\r\n 2 cmd 4\r\n 3 cmd 5\r\n 4 cmd 6\r\n");
+  // Without a clear callback only the RAM history is cleared
+  run("history clear");
+  EXPECT_EQ(history(), "");
+  EXPECT_EQ(fs.count, 7u);
+
+  cli_set_history_store(&cli, NULL, NULL);
+  run("cmd 7");
+  EXPECT_EQ(fs.count, 7u);
+}
@@ -0,0 +1,167 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::string output;
+static std::vector<std::string> calls;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int cmd_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  std::string call;
+  for (int i = 0; i < argc; i++) {
+    call += (i ? " " : "");
+    call += argv[i];
+  }
+  calls.push_back(call);
+  return 0;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"cmd", "cmd", cmd_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 1};
+
+class CliInitExTest : public ::testing::Test {
+protected:
+  cli_t cli;
+  alignas(void *) char mem[1024];
+
+  void SetUp() override {
+    output.clear();
+    calls.clear();
+  }
+
+  void init(const cli_config_t &cfg, size_t offset = 0) {
+    ASSERT_EQ(cli_init_ex(&cli, &mock_cmd_list, &cfg, mem + offset,
+                          sizeof(mem) - offset),
+              0);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  void run(const char *str) {
+    cli_puts(&cli, str);
+    cli_mainloop(&cli);
+  }
+};
+
+TEST_F(CliInitExTest, Bounds) {
+  cli_config_t cfg = {16, 16, 4, 2};
+  size_t size = cli_mem_size(&cfg);
+
+  EXPECT_LT(size, sizeof(mem));
+  EXPECT_EQ(cli_init_ex(&cli, &mock_cmd_list, &cfg, mem, size - 1), -1);
+  EXPECT_EQ(cli_init_ex(&cli, &mock_cmd_list, &cfg, mem, size), 0);
+
+  static const cli_config_t invalid[] = {
+      {1, 16, 4, 2},
+      {16, 1, 4, 2},
+      {16, CLI_LINE_MAX + 1, 4, 2},
+      {16, 16, 0, 2},
+      {16, 16, CLI_ARGV_NUM + 1, 2},
+  };
+  for (const cli_config_t &c : invalid) {
+    EXPECT_EQ(cli_init_ex(&cli, &mock_cmd_list, &c, mem, sizeof(mem)), -1);
+  }
+}
+
+TEST_F(CliInitExTest, UnalignedArena) {
+  cli_config_t cfg = {16, 16, 4, 2};
+
+  for (size_t offset = 0; offset < sizeof(void *); offset++) {
+    init(cfg, offset);
+    EXPECT_EQ((uintptr_t)cli.argv % sizeof(void *), 0u);
+    EXPECT_GE((char *)cli.argv, mem + offset);
+    run("cmd a b\r\n");
+  }
+  EXPECT_EQ(calls.size(), sizeof(void *));
+}
+
+TEST_F(CliInitExTest, SmallInstance) {
+  cli_config_t cfg = {8, 12, 3, 0};
+  init(cfg);
+
+  EXPECT_EQ(ringbuffer_capacity(&cli.rb_inbuf), 7u);
+  EXPECT_EQ(cli_putbuf(&cli, "cmd a\r\ncmd b\r\n", 14), 7u);
+  cli_mainloop(&cli);
+  ASSERT_EQ(calls.size(), 1u);
+  EXPECT_EQ(calls[0], "cmd a");
+
+  // Sessions fed directly do not need a larger receive buffer
+  cli_feed(&cli, "cmd a b\r\n", 9);
+  ASSERT_EQ(calls.size(), 2u);
+  EXPECT_EQ(calls[1], "cmd a b");
+
+  cli_feed(&cli, "cmd a b c\r\n", 11);
+  EXPECT_NE(output.find("CLI_ARGV_NUM"), std::string::npos);
+
+  cli_feed(&cli, "cmd abcdefghij\r\n", 16);
+  EXPECT_NE(output.find("CLI_LINE_MAX"), std::string::npos);
+  EXPECT_EQ(calls.size(), 2u);
+
+#ifdef CLI_USE_HISTORY
+  // No history at all
+  output.clear();
+  cli_feed(&cli, "history\r\n", 9);
+  EXPECT_EQ(output, "history\r\nOk\r\n" CLI_PROMPT "> ");
+
+  // Navigating and searching do nothing
+  output.clear();
+  static const char keys[] = "\x1b[A\x10\x0e\x12"
+                             "cmd\r\n";
+  cli_feed(&cli, keys, sizeof(keys) - 1);
+  ASSERT_EQ(calls.size(), 3u);
+  EXPECT_EQ(calls[2], "cmd");
+  EXPECT_EQ(output.find("reverse-i-search"), std::string::npos);
+#endif
+}
+
+#ifdef CLI_USE_HISTORY
+TEST_F(CliInitExTest, HistorySize) {
+  // Room for "cmd 3" and "history" framed by their length
+  cli_config_t cfg = {16, 16, 4, 16};
+  init(cfg);
+
+  run("cmd 1\r\n");
+  run("cmd 2\r\n");
+  run("cmd 3\r\n");
+  output.clear();
+  run("history\r\n");
+  EXPECT_EQ(output.find("cmd 2"), std::string::npos);
+  EXPECT_NE(output.find(" 1 cmd 3\r\n 2 history\r\n"), std::string::npos);
+
+  // Up stops at the oldest entry
+  run("\x1b[A\x1b[A\x1b[A\r\n");
+  EXPECT_EQ(calls.back(), "cmd 3");
+  EXPECT_EQ(calls.size(), 4u);
+}
+#endif
+
+TEST_F(CliInitExTest, IndependentInstances) {
+  alignas(void *) char mem2[256];
+  cli_config_t large = CLI_CONFIG_DEFAULT;
+  cli_config_t small = {4, 8, 2, 0};
+  cli_t other;
+
+  init(large);
+  ASSERT_EQ(cli_init_ex(&other, &mock_cmd_list, &small, mem2, sizeof(mem2)),
+            0);
+  other.write = mock_write;
+  other.flush = mock_flush;
+
+  cli_feed(&other, "cmd\r\n", 5);
+  run("cmd x y\r\n");
+  ASSERT_EQ(calls.size(), 2u);
+  EXPECT_EQ(calls[0], "cmd");
+  EXPECT_EQ(calls[1], "cmd x y");
+}
@@ -0,0 +1,145 @@
+#include "cli.h"
+#include <atomic>
+#include <condition_variable>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string output;
+static std::vector<int> events;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static void mock_notify(void *ctx, int ev) {
+  EXPECT_EQ(ctx, &events);
+  events.push_back(ev);
+}
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, NULL, 0};
+
+class CliNotifyTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    events.clear();
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+    cli_register_notify_callback(&cli, mock_notify, &events);
+  }
+};
+
+TEST_F(CliNotifyTest, Putchar) {
+  cli_putchar(&cli, 'h');
+  cli_putchar(&cli, 'i');
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0], CLI_NOTIFY_INPUT);
+
+  cli_putchar(&cli, '\r');
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[1], CLI_NOTIFY_LINE);
+
+  // Drained, the next byte notifies again
+  cli_mainloop(&cli);
+  cli_putchar(&cli, '\n');
+  ASSERT_EQ(events.size(), 3u);
+  EXPECT_EQ(events[2], CLI_NOTIFY_INPUT | CLI_NOTIFY_LINE);
+}
+
+TEST_F(CliNotifyTest, Puts) {
+  cli_puts(&cli, "echo");
+  cli_puts(&cli, " on\r\n");
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[0], CLI_NOTIFY_INPUT);
+  EXPECT_EQ(events[1], CLI_NOTIFY_LINE);
+
+  cli_mainloop(&cli);
+  cli_puts(&cli, "");
+  EXPECT_EQ(events.size(), 2u);
+}
+
+TEST_F(CliNotifyTest, Putbuf) {
+  static const char chunk[] = "echo on\r\necho off\r\n";
+  EXPECT_EQ(cli_putbuf(&cli, chunk, sizeof(chunk) - 1), sizeof(chunk) - 1);
+  // One notification for the whole chunk
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0], CLI_NOTIFY_INPUT | CLI_NOTIFY_LINE);
+  for (int i = 0; i < 2; i++) {
+    cli_mainloop(&cli);
+  }
+  EXPECT_NE(output.find("echo on\r\nOk\r\n"), std::string::npos);
+  EXPECT_NE(output.find("echo off\r\nOk\r\n"), std::string::npos);
+
+  // Partially consumed when the receive buffer fills up
+  std::string big(ringbuffer_capacity(&cli.rb_inbuf) + 10, 'a');
+  EXPECT_EQ(cli_putbuf(&cli, big.data(), big.size()),
+            ringbuffer_capacity(&cli.rb_inbuf));
+  EXPECT_EQ(cli_putbuf(&cli, "a", 1), 0u);
+  EXPECT_EQ(cli_puts(&cli, "a"), -1);
+}
+
+TEST_F(CliNotifyTest, NoNotification) {
+  // Full buffer
+  for (size_t i = 0; i < ringbuffer_capacity(&cli.rb_inbuf); i++) {
+    cli_putchar(&cli, 'a');
+  }
+  events.clear();
+  EXPECT_EQ(cli_putchar(&cli, '\r'), -1);
+  EXPECT_TRUE(events.empty());
+
+  // CTRL-C cancelling a running command is not buffered
+  cli_init(&cli, &mock_cmd_list);
+  cli_register_notify_callback(&cli, mock_notify, &events);
+  cli.cmd_depth = 1;
+  cli_putchar(&cli, 0x03);
+  EXPECT_TRUE(events.empty());
+  cli.cmd_depth = 0;
+
+  cli_register_notify_callback(&cli, NULL, NULL);
+  cli_putchar(&cli, 'a');
+  EXPECT_TRUE(events.empty());
+}
+
+// The host sleeps until the RX thread has input for it
+TEST_F(CliNotifyTest, WakeUpHost) {
+  struct waiter {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool ready = false;
+  } w;
+
+  cli_register_notify_callback(
+      &cli,
+      [](void *ctx, int ev) {
+        waiter *w = (waiter *)ctx;
+        (void)ev;
+        std::lock_guard<std::mutex> lock(w->mutex);
+        w->ready = true;
+        w->cond.notify_one();
+      },
+      &w);
+
+  std::thread rx([&] { cli_puts(&cli, "echo off\r\n"); });
+
+  while (output.find("Ok") == std::string::npos) {
+    std::unique_lock<std::mutex> lock(w.mutex);
+    w.cond.wait(lock, [&] { return w.ready; });
+    w.ready = false;
+    lock.unlock();
+    do {
+      cli_mainloop(&cli);
+    } while (!ringbuffer_is_empty(&cli.rb_inbuf));
+  }
+  rx.join();
+  EXPECT_NE(output.find("echo off\r\nOk\r\n"), std::string::npos);
+}
@@ -0,0 +1,118 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+
+// One transport per session, no global state
+struct session {
+  cli_t cli;
+  std::string output;
+  int flushes = 0;
+  int locks = 0;
+  int unlocks = 0;
+  bool quit = false;
+};
+
+static size_t session_write(void *ctx, const void *ptr, size_t size) {
+  static_cast<session *>(ctx)->output.append((const char *)ptr, size);
+  return size;
+}
+
+static int session_flush(void *ctx) {
+  static_cast<session *>(ctx)->flushes++;
+  return 0;
+}
+
+static void session_lock(void *ctx) { static_cast<session *>(ctx)->locks++; }
+
+static void session_unlock(void *ctx) {
+  static_cast<session *>(ctx)->unlocks++;
+}
+
+static void session_quit(void *ctx) { static_cast<session *>(ctx)->quit = true; }
+
+static const cli_ops_t session_ops = {session_write, session_flush,
+                                      session_lock, session_unlock,
+                                      session_quit};
+
+static int print_handler(cli_t *cli, int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    cli_write(cli, argv[i], strlen(argv[i]));
+  }
+  return cli_flush(cli);
+}
+
+// Handler written against the old API
+static int legacy_handler(cli_t *cli, int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    cli->write(argv[i], strlen(argv[i]));
+  }
+  return cli->flush();
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"print", "print args", print_handler, 0},
+    {"legacy", "print args", legacy_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 2};
+
+class CliOpsTest : public ::testing::Test {
+protected:
+  session s[2];
+
+  void SetUp() override {
+    for (session &e : s) {
+      cli_init(&e.cli, &mock_cmd_list);
+      cli_set_ops(&e.cli, &session_ops, &e);
+    }
+  }
+
+  void run(session &e, const char *line) {
+    cli_puts(&e.cli, line);
+    cli_mainloop(&e.cli);
+  }
+};
+
+TEST_F(CliOpsTest, SessionsAreIsolated) {
+  run(s[0], "print aaa\r\n");
+  run(s[1], "print bbb\r\n");
+  EXPECT_NE(s[0].output.find("aaa"), std::string::npos);
+  EXPECT_EQ(s[0].output.find("bbb"), std::string::npos);
+  EXPECT_NE(s[1].output.find("bbb"), std::string::npos);
+  EXPECT_EQ(s[1].output.find("aaa"), std::string::npos);
+  EXPECT_GT(s[0].flushes, 0);
+  EXPECT_EQ(s[0].locks, 2);
+  EXPECT_EQ(s[0].locks, s[0].unlocks);
+}
+
+TEST_F(CliOpsTest, LegacyFieldsRouteToSession) {
+  run(s[1], "legacy xyz\r\n");
+  EXPECT_NE(s[1].output.find("xyzOk\r\n"), std::string::npos);
+  EXPECT_EQ(s[0].output, "");
+
+  // Outside of a handler there is no session to write to
+  EXPECT_EQ(s[0].cli.write("abc", 3), 0u);
+  EXPECT_EQ(s[0].output, "");
+}
+
+TEST_F(CliOpsTest, Quit) {
+  run(s[0], "quit\r\n");
+  EXPECT_TRUE(s[0].quit);
+  EXPECT_FALSE(s[1].quit);
+}
+
+TEST_F(CliOpsTest, Exec) {
+  char out[16];
+  int status;
+  EXPECT_EQ(cli_exec(&s[0].cli, "legacy abc", out, sizeof(out), &status), 3u);
+  EXPECT_STREQ(out, "abc");
+  EXPECT_EQ(s[0].output, "");
+}
+
+TEST_F(CliOpsTest, ResetOps) {
+  cli_set_ops(&s[0].cli, NULL, NULL);
+  EXPECT_EQ(s[0].cli.ops, nullptr);
+  EXPECT_NE(s[0].cli.write, nullptr);
+  EXPECT_NE(s[0].cli.flush, nullptr);
+}
@@ -0,0 +1,220 @@
+#include "cli.h"
+#include "recorder.h"
+#include <dirent.h>
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static std::string output;
+static uint64_t fake_us;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static uint64_t mock_clock(void) { return fake_us += 10; }
+
+static int led_handler(cli_t *cli, int argc, char **argv) {
+  if (argc != 2) {
+    return -1;
+  }
+  cli_write(cli, "led ", 4);
+  cli_write(cli, argv[1], strlen(argv[1]));
+  cli_write(cli, "\r\n", 2);
+  return 0;
+}
+
+// Lasts as many milliseconds as its argument
+static int sleep_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  if (argc != 2) {
+    return -1;
+  }
+  usleep((useconds_t)atoi(argv[1]) * 1000);
+  return 0;
+}
+
+// The command list of the sessions of lib/testdata
+static const cli_cmd_t mock_cmds[] = {
+    {"led", "led <on|off>", led_handler, 0},
+    {"sleep", "sleep <ms>", sleep_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 2};
+static const cli_cmd_list_t led_cmd_list = {NULL, 0, mock_cmds, 1};
+
+class CliRecorderTest : public ::testing::Test {
+protected:
+  cli_t cli;
+  std::string path;
+
+  void SetUp() override {
+    output.clear();
+    fake_us = 0;
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+    path = testing::TempDir() + "session.ucrec";
+  }
+
+  void TearDown() override { unlink(path.c_str()); }
+
+  // Record the chunks, each received after the delay preceding it
+  void record(const std::vector<std::pair<int, std::string>> &chunks) {
+    cli_recorder_t rec;
+    ASSERT_EQ(cli_recorder_open(&rec, &cli, path.c_str(), NULL), 0);
+    cli_print_prompt(&cli);
+    for (const auto &chunk : chunks) {
+      usleep((useconds_t)chunk.first * 1000);
+      cli_recorder_putbuf(&rec, chunk.second.data(), chunk.second.size());
+      while (!ringbuffer_is_empty(&cli.rb_inbuf)) {
+        cli_mainloop(&cli);
+      }
+    }
+    ASSERT_EQ(cli_recorder_close(&rec), 0);
+  }
+
+  void replay(const cli_cmd_list_t *cmd_list, cli_replay_result_t *res) {
+    cli_replay_t rp;
+    cli_t replayed;
+    ASSERT_EQ(cli_replay_load(&rp, path.c_str()), 0);
+    cli_init(&replayed, cmd_list);
+    ASSERT_EQ(cli_replay_run(&rp, &replayed, res), 0);
+    cli_replay_free(&rp);
+  }
+};
+
+TEST_F(CliRecorderTest, RoundTrip) {
+  cli_recorder_t rec;
+  ASSERT_EQ(cli_recorder_open(&rec, &cli, path.c_str(), mock_clock), 0);
+  cli_print_prompt(&cli);
+  EXPECT_EQ(cli_recorder_putbuf(&rec, "led on\r", 7), 7u);
+  cli_recorder_putchar(&rec, 'x');
+  cli_mainloop(&cli);
+  ASSERT_EQ(cli_recorder_close(&rec), 0);
+  // The output still reaches the wrapped write function
+  EXPECT_NE(output.find("led on\r\nOk\r\n"), std::string::npos);
+  EXPECT_EQ(cli.write, mock_write);
+
+  cli_replay_t rp;
+  ASSERT_EQ(cli_replay_load(&rp, path.c_str()), 0);
+  ASSERT_GE(rp.event_num, 4u);
+  std::string in, out;
+  for (size_t i = 0; i < rp.event_num; i++) {
+    const cli_replay_event_t *ev = &rp.events[i];
+    // Every record reads the mock clock once
+    EXPECT_EQ(ev->time, 10u * (i + 1));
+    (ev->output ? out : in).append((const char *)ev->data, ev->len);
+  }
+  EXPECT_TRUE(rp.events[0].output);
+  EXPECT_EQ(in, "led on\rx");
+  EXPECT_EQ(out, output);
+  cli_replay_free(&rp);
+
+  // A torn record at the end is ignored
+  FILE *f = fopen(path.c_str(), "ab");
+  fwrite("\x20\x01" "ab", 1, 4, f);
+  fclose(f);
+  ASSERT_EQ(cli_replay_load(&rp, path.c_str()), 0);
+  EXPECT_EQ(rp.events[rp.event_num - 1].data[0], 'x');
+  cli_replay_free(&rp);
+
+  f = fopen(path.c_str(), "wb");
+  fwrite("notarec", 1, 7, f);
+  fclose(f);
+  EXPECT_EQ(cli_replay_load(&rp, path.c_str()), -1);
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST_F(CliRecorderTest, ReplaySameOutput) {
+  record({{0, "l"}, {5, "ed o"}, {5, "n\r"}, {5, "sleep 20\r\n"},
+          {5, "led off\rbad\r"}});
+
+  cli_replay_result_t res;
+  replay(&mock_cmd_list, &res);
+  EXPECT_EQ(res.diff, SIZE_MAX);
+  EXPECT_EQ(res.dropped, 0u);
+  EXPECT_EQ(std::string((char *)res.output, res.output_len),
+            output.substr(0, res.output_len));
+  ASSERT_EQ(res.line_num, 4u);
+  for (size_t i = 0; i < res.line_num; i++) {
+    EXPECT_NE(res.lines[i].recorded, UINT64_MAX);
+    EXPECT_NE(res.lines[i].replayed, UINT64_MAX);
+  }
+  // The sleep handler runs again in the replay
+  EXPECT_GE(res.lines[1].recorded, 20000u);
+  EXPECT_GE(res.lines[1].replayed, 20000u);
+  // The two pasted lines are answered one after the other
+  EXPECT_GE(res.lines[3].replayed, res.lines[2].replayed);
+  cli_replay_result_free(&res);
+}
+
+TEST_F(CliRecorderTest, ReplayDiffers) {
+  record({{0, "led on\r"}, {5, "sleep 1\r"}, {5, "led off\r"}});
+
+  // The replayed session lacks the sleep command
+  cli_replay_result_t res;
+  replay(&led_cmd_list, &res);
+  ASSERT_NE(res.diff, SIZE_MAX);
+  EXPECT_EQ(res.diff_line, 2u);
+  EXPECT_EQ(output.compare(0, res.diff, (char *)res.output, res.diff), 0);
+
+  cli_replay_t rp;
+  char *buf;
+  size_t len;
+  FILE *f = open_memstream(&buf, &len);
+  ASSERT_EQ(cli_replay_load(&rp, path.c_str()), 0);
+  cli_replay_report(&rp, &res, f);
+  fclose(f);
+  std::string report(buf, len);
+  free(buf);
+  cli_replay_free(&rp);
+  cli_replay_result_free(&res);
+  EXPECT_NE(report.find("output differs at byte"), std::string::npos);
+  EXPECT_NE(report.find("line 2\n"), std::string::npos);
+  EXPECT_NE(report.find("Unknown command"), std::string::npos);
+}
+
+// Every session of the corpus replays with the same output and no dropped
+// input
+TEST(CliRecorderCorpus, Replay) {
+  static const char dir_path[] = "lib/testdata";
+  DIR *dir = opendir(dir_path);
+  ASSERT_NE(dir, nullptr);
+  size_t sessions = 0;
+
+  for (struct dirent *ent; (ent = readdir(dir)) != NULL;) {
+    std::string name = ent->d_name;
+    if (name.size() < 6 || name.substr(name.size() - 6) != ".ucrec") {
+      continue;
+    }
+    SCOPED_TRACE(name);
+    cli_replay_t rp;
+    cli_replay_result_t res;
+    cli_t cli;
+    ASSERT_EQ(cli_replay_load(&rp, (std::string(dir_path) + "/" + name).c_str()),
+              0);
+    cli_init(&cli, &mock_cmd_list);
+    ASSERT_EQ(cli_replay_run(&rp, &cli, &res), 0);
+    printf("%s\n", name.c_str());
+    cli_replay_report(&rp, &res, stdout);
+    EXPECT_EQ(res.diff, SIZE_MAX);
+    EXPECT_EQ(res.dropped, 0u);
+    EXPECT_GT(res.line_num, 0u);
+    for (size_t i = 0; i < res.line_num; i++) {
+      EXPECT_NE(res.lines[i].replayed, UINT64_MAX);
+    }
+    cli_replay_result_free(&res);
+    cli_replay_free(&rp);
+    sessions++;
+  }
+  closedir(dir);
+  EXPECT_GT(sessions, 0u);
+}
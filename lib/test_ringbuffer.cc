@@ -1,5 +1,6 @@
 #include "ringbuffer.h"
 #include <gtest/gtest.h>
+#include <string.h>
 
 TEST(RingBuffer, BasicPutGet) {
   uint8_t buf[4];
@@ -85,3 +86,28 @@ TEST(RingBuffer, Peek) {
   EXPECT_EQ(ch, static_cast<uint8_t>('x'));
   EXPECT_TRUE(ringbuffer_is_empty(&rb));
 }
+
+TEST(RingBuffer, Read) {
+  uint8_t buf[4];
+  ringbuffer_t rb;
+  ringbuffer_wrap(&rb, buf, sizeof(buf));
+
+  uint8_t out[8] = {0};
+  EXPECT_EQ(ringbuffer_read(&rb, out, sizeof(out)), static_cast<size_t>(0U));
+
+  ringbuffer_put(&rb, '1');
+  ringbuffer_put(&rb, '2');
+  EXPECT_EQ(ringbuffer_read(&rb, out, 1), static_cast<size_t>(1U));
+  EXPECT_EQ(out[0], static_cast<uint8_t>('1'));
+
+  // Wrap around, the data is split at the end of the buffer
+  ringbuffer_put(&rb, '3');
+  ringbuffer_put(&rb, '4');
+  EXPECT_EQ(rb.wr_pos, static_cast<size_t>(0U));
+  EXPECT_EQ(ringbuffer_read(&rb, out, sizeof(out)), static_cast<size_t>(3U));
+  EXPECT_EQ(memcmp(out, "234", 3), 0);
+  EXPECT_TRUE(ringbuffer_is_empty(&rb));
+  EXPECT_EQ(ringbuffer_put(&rb, '5'), 0);
+  EXPECT_EQ(ringbuffer_get(&rb, out), 0);
+  EXPECT_EQ(out[0], static_cast<uint8_t>('5'));
+}
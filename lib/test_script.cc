@@ -0,0 +1,163 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static std::string output;
+static std::vector<std::string> calls;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int ok_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  std::string call;
+  for (int i = 0; i < argc; i++) {
+    call += (i ? " " : "");
+    call += argv[i];
+  }
+  calls.push_back(call);
+  return 0;
+}
+
+static int fail_handler(cli_t *cli, int argc, char **argv) {
+  ok_handler(cli, argc, argv);
+  return -1;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"set", "set cmd", ok_handler, 0},
+    {"fail", "fail cmd", fail_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 2};
+
+class CliScriptTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    calls.clear();
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  std::string write_tmp_file(const char *content) {
+    const char *dir = getenv("TEST_TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/cli_script_XXXXXX";
+    std::vector<char> tmpl(path.begin(), path.end());
+    tmpl.push_back('\0');
+    int fd = mkstemp(tmpl.data());
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, content, strlen(content)), (ssize_t)strlen(content));
+    close(fd);
+    return std::string(tmpl.data());
+  }
+};
+
+TEST_F(CliScriptTest, RunsAllLines) {
+  static const char script[] = "set a 1\n"
+                               "\n"
+                               "# comment\n"
+                               "set b 2\r\n"
+                               "SET c 3";
+  EXPECT_EQ(cli_exec_script(&cli, script, strlen(script)), 0);
+  ASSERT_EQ(calls.size(), 3u);
+  EXPECT_EQ(calls[0], "set a 1");
+  EXPECT_EQ(calls[1], "set b 2");
+  EXPECT_EQ(calls[2], "SET c 3");
+  // No echo, no prompt and no Ok per line
+  EXPECT_EQ(output, "");
+}
+
+TEST_F(CliScriptTest, ReportsFirstErrorLine) {
+  static const char script[] = "set a\n"
+                               "unknown\n"
+                               "fail\n"
+                               "set b\n";
+  EXPECT_EQ(cli_exec_script(&cli, script, strlen(script)), 2);
+  EXPECT_EQ(calls.size(), 3u);
+  EXPECT_NE(output.find("line 2: Unknown command\r\n"), std::string::npos);
+  EXPECT_NE(output.find("line 3: Error\r\n"), std::string::npos);
+}
+
+TEST_F(CliScriptTest, StopOnError) {
+  static const char script[] = "set a\n"
+                               "fail\n"
+                               "set b\n";
+  cli.script_stop_on_error = true;
+  EXPECT_EQ(cli_exec_script(&cli, script, strlen(script)), 2);
+  ASSERT_EQ(calls.size(), 2u);
+  EXPECT_EQ(calls[1], "fail");
+}
+
+TEST_F(CliScriptTest, Limits) {
+  std::string script = "set " + std::string(CLI_LINE_MAX, 'x') + "\n";
+  for (int i = 0; i <= CLI_ARGV_NUM; i++) {
+    script += "a ";
+  }
+  script += "\n";
+  EXPECT_EQ(cli_exec_script(&cli, script.c_str(), script.size()), 1);
+  EXPECT_NE(output.find("line 1: Error: The line length"), std::string::npos);
+  EXPECT_NE(output.find("line 2: Error: The number of arguments"),
+            std::string::npos);
+  EXPECT_TRUE(calls.empty());
+}
+
+TEST_F(CliScriptTest, NullTerminatedBlob) {
+  // Erased or padded flash after the script
+  static const char blob[] = "set a\n\0set b\n";
+  EXPECT_EQ(cli_exec_script(&cli, blob, sizeof(blob)), 0);
+  ASSERT_EQ(calls.size(), 1u);
+}
+
+TEST_F(CliScriptTest, SourceBuiltin) {
+  std::string path = write_tmp_file("set a\nfail\nset b\n");
+  std::string line = "source " + path + "\n";
+
+  cli_puts(&cli, line.c_str());
+  cli_mainloop(&cli);
+  EXPECT_EQ(calls.size(), 3u);
+  EXPECT_NE(output.find("line 2: Error\r\nError\r\n"), std::string::npos);
+
+  calls.clear();
+  line = "source -e " + path + "\n";
+  cli_puts(&cli, line.c_str());
+  cli_mainloop(&cli);
+  EXPECT_EQ(calls.size(), 2u);
+  EXPECT_FALSE(cli.script_stop_on_error);
+
+  output.clear();
+  cli_puts(&cli, "source /nonexistent/script\n");
+  cli_mainloop(&cli);
+  EXPECT_NE(output.find("Error\r\n"), std::string::npos);
+
+  unlink(path.c_str());
+}
+
+TEST_F(CliScriptTest, SourceNesting) {
+  std::string path = write_tmp_file("");
+  std::string script = "set a\nsource " + path + "\n";
+  FILE *f = fopen(path.c_str(), "w");
+  ASSERT_NE(f, nullptr);
+  fputs(script.c_str(), f);
+  fclose(f);
+
+  // The script sources itself until CLI_SCRIPT_DEPTH is reached
+  EXPECT_EQ(cli_exec_script(&cli, script.c_str(), script.size()), 2);
+  EXPECT_EQ(calls.size(), (size_t)CLI_SCRIPT_DEPTH);
+  EXPECT_NE(output.find("CLI_SCRIPT_DEPTH"), std::string::npos);
+  EXPECT_EQ(cli.script_depth, 0);
+
+  unlink(path.c_str());
+}
@@ -0,0 +1,168 @@
+#include "cli.h"
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+
+static std::string output;
+static cli_cycles_t fake_cycles;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static cli_cycles_t mock_cycles(void) { return fake_cycles; }
+
+// Lasts as many cycles as its last argument
+static int spin_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  fake_cycles += (cli_cycles_t)atoi(argv[argc - 1]);
+  return 0;
+}
+
+static int fail_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  fake_cycles += 3;
+  return -1;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"spin", "spin", spin_handler, 0},
+    {"fail", "fail", fail_handler, 0},
+};
+
+static const cli_cmd_t sub_cmds[] = {
+    {"get", "get", spin_handler, 0},
+};
+
+static const cli_cmd_group_t grp = {"adc", "group", sub_cmds, 1};
+static const cli_cmd_group_t *groups[] = {&grp};
+
+static const cli_cmd_list_t mock_cmd_list = {groups, 1, mock_cmds, 2};
+
+class CliStatsTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    fake_cycles = 1000;
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+    cli.cycles = mock_cycles;
+  }
+
+  void run(const std::string &line) {
+    std::string input = line + "\r\n";
+    cli_feed(&cli, input.c_str(), input.size());
+  }
+
+  std::string stats() {
+    char out[512];
+    cli_exec(&cli, "stats", out, sizeof(out), NULL);
+    return out;
+  }
+
+  const cli_stats_entry_t *find(const cli_cmd_t *cmd) {
+    for (size_t i = 0; i < CLI_STATS_NUM; i++) {
+      if (cli.stats.entries[i].cmd == cmd) {
+        return &cli.stats.entries[i];
+      }
+    }
+    return NULL;
+  }
+};
+
+TEST_F(CliStatsTest, CallsErrorsAndHistogram) {
+  run("spin 0");
+  run("spin 1");
+  run("spin 5");
+  run("spin 6");
+  run("spin 100000000");
+  run("fail");
+  run("fail");
+
+  const cli_stats_entry_t *spin = find(&mock_cmds[0]);
+  ASSERT_NE(spin, nullptr);
+  EXPECT_EQ(spin->calls, 5u);
+  EXPECT_EQ(spin->errors, 0u);
+  EXPECT_EQ(spin->max, 100000000u);
+  EXPECT_EQ(spin->hist[0], 1u);
+  EXPECT_EQ(spin->hist[1], 1u);
+  EXPECT_EQ(spin->hist[3], 2u);
+  // Longer runs land in the last bucket
+  EXPECT_EQ(spin->hist[CLI_STATS_BUCKET_NUM - 1], 1u);
+
+  const cli_stats_entry_t *fail = find(&mock_cmds[1]);
+  ASSERT_NE(fail, nullptr);
+  EXPECT_EQ(fail->calls, 2u);
+  EXPECT_EQ(fail->errors, 2u);
+  EXPECT_EQ(fail->hist[2], 2u);
+
+  // The mock clock does not move while tokenizing
+  EXPECT_EQ(cli.stats.parse.calls, 7u);
+  EXPECT_EQ(cli.stats.parse.hist[0], 7u);
+}
+
+TEST_F(CliStatsTest, Builtin) {
+  run("adc get 300");
+  run("adc get 2");
+  run("fail");
+  run("unknown");
+  run("");
+
+  // The stats line itself is counted before it runs
+  std::string out = stats();
+  EXPECT_NE(out.find("(parse) calls 5 errors 1 max 0 <1:5\r\n"),
+            std::string::npos);
+  EXPECT_NE(out.find("fail calls 1 errors 1 max 3 <4:1\r\n"), std::string::npos);
+  EXPECT_NE(out.find("adc get calls 2 errors 0 max 300 <4:1 <512:1\r\n"),
+            std::string::npos);
+  // Commands which never ran are not listed
+  EXPECT_EQ(out.find("spin"), std::string::npos);
+  EXPECT_EQ(out.find("(dropped)"), std::string::npos);
+
+  // The built-ins are counted too
+  out = stats();
+  EXPECT_NE(out.find("stats calls 1 errors 0"), std::string::npos);
+
+  run("stats clear");
+  out = stats();
+  EXPECT_EQ(out.find("adc get"), std::string::npos);
+  EXPECT_NE(out.find("stats calls 1 errors 0"), std::string::npos);
+  EXPECT_NE(stats().find("stats calls 2 errors 0"), std::string::npos);
+}
+
+TEST_F(CliStatsTest, WithoutClock) {
+  cli.cycles = NULL;
+  run("spin 10");
+  run("fail");
+
+  const cli_stats_entry_t *spin = find(&mock_cmds[0]);
+  ASSERT_NE(spin, nullptr);
+  EXPECT_EQ(spin->calls, 1u);
+  for (size_t b = 0; b < CLI_STATS_BUCKET_NUM; b++) {
+    EXPECT_EQ(spin->hist[b], 0u);
+  }
+  std::string out = stats();
+  EXPECT_NE(out.find("spin calls 1 errors 0\r\n"), std::string::npos);
+  EXPECT_NE(out.find("fail calls 1 errors 1\r\n"), std::string::npos);
+}
+
+TEST_F(CliStatsTest, TableFull) {
+  // Fill every entry with fake commands
+  static cli_cmd_t fakes[CLI_STATS_NUM];
+  for (size_t i = 0; i < CLI_STATS_NUM; i++) {
+    cli.stats.entries[i].cmd = &fakes[i];
+  }
+  run("spin 1");
+  run("spin 1");
+  EXPECT_EQ(find(&mock_cmds[0]), nullptr);
+  EXPECT_EQ(cli.stats.dropped, 2u);
+  EXPECT_NE(stats().find("(dropped) calls 2\r\n"), std::string::npos);
+}
@@ -0,0 +1,186 @@
+#include "cli.h"
+#include "trace.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string output;
+static std::atomic<cli_cycles_t> fake_cycles;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static cli_cycles_t mock_cycles(void) { return fake_cycles++; }
+
+static int cmd_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argv;
+  return argc > 2 ? -1 : 0;
+}
+
+static const cli_cmd_t sub_cmds[] = {
+    {"sub", "sub", cmd_handler, 0},
+};
+
+static const cli_cmd_group_t grp = {"grp", "group", sub_cmds, 1};
+static const cli_cmd_group_t *groups[] = {&grp};
+
+static const cli_cmd_list_t mock_cmd_list = {groups, 1, NULL, 0};
+
+struct record {
+  uint32_t seq;
+  uint32_t ts;
+  uint32_t arg;
+  uint16_t session;
+  uint8_t event;
+  char phase;
+};
+
+static void dump_write(void *ctx, const void *ptr, size_t len) {
+  ((std::string *)ctx)->append((const char *)ptr, len);
+}
+
+static uint32_t get32(const std::string &s, size_t off) {
+  return (uint32_t)(uint8_t)s[off] | (uint32_t)(uint8_t)s[off + 1] << 8 |
+         (uint32_t)(uint8_t)s[off + 2] << 16 |
+         (uint32_t)(uint8_t)s[off + 3] << 24;
+}
+
+static std::vector<record> dump(void) {
+  std::string raw;
+  std::vector<record> records;
+  size_t count = cli_trace_dump(dump_write, &raw);
+
+  EXPECT_EQ(raw.substr(0, 8), CLI_TRACE_MAGIC);
+  EXPECT_EQ(get32(raw, 8), (uint32_t)CLI_TRACE_RECORD_SIZE);
+  EXPECT_EQ(raw.size(), 12 + count * CLI_TRACE_RECORD_SIZE);
+  for (size_t off = 12; off + CLI_TRACE_RECORD_SIZE <= raw.size();
+       off += CLI_TRACE_RECORD_SIZE) {
+    record r;
+    r.seq = get32(raw, off);
+    r.ts = get32(raw, off + 4);
+    r.arg = get32(raw, off + 8);
+    r.session = (uint16_t)((uint8_t)raw[off + 12] | (uint8_t)raw[off + 13] << 8);
+    r.event = (uint8_t)raw[off + 14];
+    r.phase = raw[off + 15];
+    records.push_back(r);
+  }
+  return records;
+}
+
+class CliTraceTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    fake_cycles = 0;
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+    cli_trace_start(mock_cycles);
+  }
+
+  void TearDown() override { cli_trace_stop(); }
+};
+
+TEST_F(CliTraceTest, LineStages) {
+  cli.echo = false;
+  cli_puts(&cli, "grp sub x\r");
+  cli_mainloop(&cli);
+
+  std::vector<record> records = dump();
+  std::string trace, name;
+  for (const record &r : records) {
+    if (r.event == CLI_TRACE_NAME) {
+      for (int i = 0; i < 4 && (r.arg >> (8 * i)) & 0xff; i++) {
+        name += (char)(r.arg >> (8 * i));
+      }
+      continue;
+    }
+    trace += std::to_string(r.event) + r.phase + " ";
+    EXPECT_EQ(r.session, (uint16_t)((uintptr_t)&cli >> 4));
+  }
+  // putbuf, read, parse(tokenize find) and run
+  EXPECT_EQ(trace, "2i 3B 3E 5B 6B 6E 7B 7E 5E 8B 8E ");
+  EXPECT_EQ(name, "grp sub");
+  for (size_t i = 1; i < records.size(); i++) {
+    EXPECT_EQ(records[i].seq, records[i - 1].seq + 1);
+    EXPECT_GT(records[i].ts, records[i - 1].ts);
+  }
+  // The read span ends with the number of bytes, the run with the status of
+  // the handler, failing with 3 arguments
+  ASSERT_EQ(records.size(), 13u);
+  EXPECT_EQ(records[2].arg, 10u);
+  EXPECT_EQ(records[9].arg, 3u);
+  EXPECT_EQ(records[12].arg, (uint32_t)-1);
+}
+
+TEST_F(CliTraceTest, EchoAndPutchar) {
+  cli_putchar(&cli, 'a');
+  cli_mainloop(&cli);
+  std::vector<record> records = dump();
+  ASSERT_EQ(records.size(), 5u);
+  EXPECT_EQ(records[0].event, CLI_TRACE_PUTCHAR);
+  EXPECT_EQ(records[0].arg, (uint32_t)'a');
+  EXPECT_EQ(records[3].event, CLI_TRACE_ECHO);
+  EXPECT_EQ(records[3].phase, CLI_TRACE_BEGIN);
+  EXPECT_EQ(records[4].event, CLI_TRACE_ECHO);
+  EXPECT_EQ(records[4].phase, CLI_TRACE_END);
+  EXPECT_EQ(records[4].arg, 1u);
+}
+
+TEST_F(CliTraceTest, StoppedAndWrapAround) {
+  cli_trace_stop();
+  cli_puts(&cli, "x");
+  EXPECT_TRUE(dump().empty());
+
+  cli_trace_start(mock_cycles);
+  for (uint32_t i = 0; i < CLI_TRACE_NUM + 10; i++) {
+    cli_trace(&cli, CLI_TRACE_PUTCHAR, CLI_TRACE_INSTANT, i);
+  }
+  std::vector<record> records = dump();
+  ASSERT_EQ(records.size(), (size_t)CLI_TRACE_NUM);
+  EXPECT_EQ(records.front().arg, 10u);
+  EXPECT_EQ(records.back().arg, CLI_TRACE_NUM + 9u);
+}
+
+TEST_F(CliTraceTest, ConcurrentWriters) {
+  static const int per_thread = 100000;
+  std::vector<std::thread> threads;
+
+  for (uintptr_t t = 1; t <= 3; t++) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < per_thread; i++) {
+        // The argument is checked against the session by the reader
+        cli_trace((void *)(t << 4), CLI_TRACE_PUTCHAR, CLI_TRACE_INSTANT,
+                  (uint32_t)t * 1000u);
+      }
+    });
+  }
+  // Dump while the threads write
+  size_t dumps = 0;
+  do {
+    std::vector<record> records = dump();
+    for (size_t i = 0; i < records.size(); i++) {
+      ASSERT_EQ(records[i].arg, records[i].session * 1000u);
+      ASSERT_EQ(records[i].event, CLI_TRACE_PUTCHAR);
+      if (i > 0) {
+        ASSERT_GT(records[i].seq, records[i - 1].seq);
+      }
+    }
+    dumps++;
+  } while (fake_cycles < 3u * per_thread);
+  for (std::thread &th : threads) {
+    th.join();
+  }
+  EXPECT_EQ(dump().size(), (size_t)CLI_TRACE_NUM);
+  EXPECT_GT(dumps, 0u);
+}
@@ -0,0 +1,166 @@
+#include "cli.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static std::string output;
+static std::vector<std::string> calls;
+
+static size_t mock_write(const void *ptr, size_t size) {
+  output.append((const char *)ptr, size);
+  return size;
+}
+
+static int mock_flush(void) { return 0; }
+
+static int get_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  std::string call;
+  for (int i = 0; i < argc; i++) {
+    call += (i ? " " : "");
+    call += argv[i];
+  }
+  calls.push_back(call);
+  return 0;
+}
+
+static const cli_cmd_t adc_cmds[] = {
+    {"get", "get adc", get_handler, 0},
+};
+
+static const cli_cmd_group_t adc_group = {"adc", "ADC group", adc_cmds, 1};
+
+static const cli_cmd_group_t *groups[] = {&adc_group};
+
+static const cli_cmd_list_t mock_cmd_list = {groups, 1, NULL, 0};
+
+class CliWatchTest : public ::testing::Test {
+protected:
+  cli_t cli;
+
+  void SetUp() override {
+    output.clear();
+    calls.clear();
+    cli_init(&cli, &mock_cmd_list);
+    cli.write = mock_write;
+    cli.flush = mock_flush;
+  }
+
+  void run(const char *line) {
+    cli_puts(&cli, line);
+    cli_mainloop(&cli);
+  }
+};
+
+TEST_F(CliWatchTest, FixedRate) {
+  run("watch -n 100 adc get VBAT\r\n");
+  EXPECT_NE(output.find("Ok\r\n"), std::string::npos);
+  EXPECT_EQ(cli.watch.count, 1u);
+
+  cli_tick(&cli, 50);
+  EXPECT_TRUE(calls.empty());
+  cli_tick(&cli, 100);
+  ASSERT_EQ(calls.size(), 1u);
+  EXPECT_EQ(calls[0], "adc get VBAT");
+
+  // A late tick does not shift the next deadline
+  cli_tick(&cli, 135);
+  cli_tick(&cli, 195);
+  EXPECT_EQ(calls.size(), 1u);
+  cli_tick(&cli, 208);
+  EXPECT_EQ(calls.size(), 2u);
+  cli_tick(&cli, 299);
+  EXPECT_EQ(calls.size(), 2u);
+  cli_tick(&cli, 300);
+  EXPECT_EQ(calls.size(), 3u);
+
+  // Missed periods are skipped, the phase is kept
+  cli_tick(&cli, 1050);
+  EXPECT_EQ(calls.size(), 4u);
+  cli_tick(&cli, 1099);
+  EXPECT_EQ(calls.size(), 4u);
+  cli_tick(&cli, 1100);
+  EXPECT_EQ(calls.size(), 5u);
+}
+
+TEST_F(CliWatchTest, PeriodLongerThanWheel) {
+  const cli_time_t period = CLI_WATCH_RESOLUTION * CLI_WATCH_WHEEL_SIZE * 3 + 5;
+  std::string line = "watch -n " + std::to_string(period) + " adc get A\r\n";
+  run(line.c_str());
+
+  for (cli_time_t now = 0; now < period; now += CLI_WATCH_RESOLUTION / 2) {
+    cli_tick(&cli, now);
+  }
+  EXPECT_TRUE(calls.empty());
+  cli_tick(&cli, period);
+  EXPECT_EQ(calls.size(), 1u);
+}
+
+TEST_F(CliWatchTest, ConcurrentWatches) {
+  static const char script[] = "watch -n 20 adc get A\n"
+                               "watch -n 30 adc get B\n";
+  EXPECT_EQ(cli_exec_script(&cli, script, strlen(script)), 0);
+  EXPECT_EQ(cli.watch.count, 2u);
+
+  for (cli_time_t now = 0; now <= 60; now += 10) {
+    cli_tick(&cli, now);
+  }
+  // A at 20, 40, 60 and B at 30, 60
+  ASSERT_EQ(calls.size(), 5u);
+  EXPECT_EQ(std::count(calls.begin(), calls.end(), "adc get A"), 3);
+  EXPECT_EQ(std::count(calls.begin(), calls.end(), "adc get B"), 2);
+
+  // Typing would stop the watches
+  output.clear();
+  EXPECT_EQ(cli_exec_script(&cli, "watch", 5), 0);
+  EXPECT_NE(output.find("20\tadc get A\r\n"), std::string::npos);
+  EXPECT_NE(output.find("30\tadc get B\r\n"), std::string::npos);
+}
+
+TEST_F(CliWatchTest, TimeWrapAround) {
+  cli_tick(&cli, UINT32_MAX - 15);
+  run("watch -n 10 adc get A\r\n");
+  cli_tick(&cli, UINT32_MAX - 5);
+  EXPECT_EQ(calls.size(), 1u);
+  cli_tick(&cli, 4);
+  EXPECT_EQ(calls.size(), 2u);
+  cli_tick(&cli, 5);
+  EXPECT_EQ(calls.size(), 2u);
+}
+
+TEST_F(CliWatchTest, AnyKeyStops) {
+  run("watch -n 10 adc get A\r\n");
+  cli_tick(&cli, 10);
+  EXPECT_EQ(calls.size(), 1u);
+
+  cli_putchar(&cli, 'q');
+  cli_mainloop(&cli);
+  EXPECT_EQ(cli.watch.count, 0u);
+  EXPECT_STREQ(cli.line, "");
+
+  cli_tick(&cli, 20);
+  cli_tick(&cli, 30);
+  EXPECT_EQ(calls.size(), 1u);
+}
+
+TEST_F(CliWatchTest, Errors) {
+  run("watch -n 0 adc get A\r\n");
+  run("watch -n abc adc get A\r\n");
+  run("watch -n 10\r\n");
+  run("watch adc set A\r\n");
+  run("watch watch adc get A\r\n");
+  EXPECT_EQ(cli.watch.count, 0u);
+
+  for (int i = 0; i < CLI_WATCH_NUM; i++) {
+    EXPECT_EQ(cli_exec_script(&cli, "watch adc get A", 15), 0);
+  }
+  output.clear();
+  EXPECT_EQ(cli_exec_script(&cli, "watch adc get A", 15), 1);
+  EXPECT_NE(output.find("CLI_WATCH_NUM"), std::string::npos);
+  EXPECT_EQ(cli.watch.count, (size_t)CLI_WATCH_NUM);
+
+  cli_watch_stop(&cli);
+  EXPECT_EQ(cli.watch.count, 0u);
+}
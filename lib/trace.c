@@ -0,0 +1,150 @@
+/**
+ * @file trace.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Trace points recorded in a lock-free ring
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief the ring shared by every session, written with atomic builtins so
+ * that the receive interrupt records without lock
+ *
+ */
+static struct {
+  cli_trace_record_t records[CLI_TRACE_NUM];
+  uint32_t head;                /**< index of the next record */
+  cli_cycles_t (*clock)(void); /**< NULL while stopped */
+} ring;
+
+static void trace_put32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+void cli_trace_start(cli_cycles_t (*clock)(void)) {
+  __atomic_store_n(&ring.clock, NULL, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < CLI_TRACE_NUM; i++) {
+    __atomic_store_n(&ring.records[i].seq, 0, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&ring.head, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&ring.clock, clock, __ATOMIC_RELEASE);
+}
+
+void cli_trace_stop(void) {
+  __atomic_store_n(&ring.clock, NULL, __ATOMIC_RELEASE);
+}
+
+void cli_trace(const void *session, cli_trace_event_t event, char phase,
+               uint32_t arg) {
+  cli_cycles_t (*clock)(void) = __atomic_load_n(&ring.clock, __ATOMIC_ACQUIRE);
+  uint32_t idx;
+  cli_trace_record_t *rec;
+
+  if (clock == NULL) {
+    return;
+  }
+
+  idx = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+  rec = &ring.records[idx & (CLI_TRACE_NUM - 1)];
+
+  // Invalidate the record before overwriting it, like a sequence lock
+  __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  rec->ts = clock();
+  rec->arg = arg;
+  rec->session = (uint16_t)((uintptr_t)session >> 4);
+  rec->event = (uint8_t)event;
+  rec->phase = (uint8_t)phase;
+  __atomic_store_n(&rec->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+void cli_trace_name(const void *session, const char *group, const char *name) {
+  char buf[CLI_TRACE_NAME_MAX + 1];
+  size_t len;
+
+  if (__atomic_load_n(&ring.clock, __ATOMIC_ACQUIRE) == NULL) {
+    return;
+  }
+
+  if (group != NULL) {
+    snprintf(buf, sizeof(buf), "%s %s", group, name);
+  } else {
+    snprintf(buf, sizeof(buf), "%s", name);
+  }
+  len = strlen(buf);
+
+  for (size_t i = 0; i < len; i += 4) {
+    uint32_t arg = 0;
+
+    for (size_t j = 0; j < 4 && i + j < len; j++) {
+      arg |= (uint32_t)(uint8_t)buf[i + j] << (8 * j);
+    }
+    cli_trace(session, CLI_TRACE_NAME, CLI_TRACE_INSTANT, arg);
+  }
+}
+
+size_t cli_trace_dump(void (*write)(void *ctx, const void *ptr, size_t len),
+                      void *ctx) {
+  uint8_t buf[CLI_TRACE_RECORD_SIZE];
+  uint32_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+  uint32_t first = (head > CLI_TRACE_NUM) ? head - CLI_TRACE_NUM : 0;
+  size_t count = 0;
+
+  memcpy(buf, CLI_TRACE_MAGIC, sizeof(CLI_TRACE_MAGIC) - 1);
+  trace_put32(buf + sizeof(CLI_TRACE_MAGIC) - 1, CLI_TRACE_RECORD_SIZE);
+  write(ctx, buf, sizeof(CLI_TRACE_MAGIC) - 1 + 4);
+
+  for (uint32_t i = first; i != head; i++) {
+    const cli_trace_record_t *rec = &ring.records[i & (CLI_TRACE_NUM - 1)];
+    uint32_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    cli_trace_record_t copy = *rec;
+
+    // Skip the records being written or overwritten while copied
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (seq != i + 1 || __atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq) {
+      continue;
+    }
+
+    trace_put32(buf, seq);
+    trace_put32(buf + 4, copy.ts);
+    trace_put32(buf + 8, copy.arg);
+    buf[12] = (uint8_t)copy.session;
+    buf[13] = (uint8_t)(copy.session >> 8);
+    buf[14] = copy.event;
+    buf[15] = copy.phase;
+    write(ctx, buf, sizeof(buf));
+    count++;
+  }
+  return count;
+}
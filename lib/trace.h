@@ -0,0 +1,152 @@
+/**
+ * @file trace.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Trace points recorded in a lock-free ring
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_TRACE_H
+#define _CLI_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cli.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CLI_TRACE_NUM
+#define CLI_TRACE_NUM (256) /**< Records kept by the ring, a power of 2 */
+#endif
+
+#if (CLI_TRACE_NUM & (CLI_TRACE_NUM - 1)) != 0
+#error "CLI_TRACE_NUM must be a power of 2"
+#endif
+
+#define CLI_TRACE_MAGIC "ucltrace" /**< First bytes of a dump */
+#define CLI_TRACE_RECORD_SIZE (16) /**< Bytes of a record in a dump */
+#define CLI_TRACE_NAME_MAX (16)    /**< Characters of a traced command name */
+
+#define CLI_TRACE_BEGIN 'B'   /**< Phase of the start of a span */
+#define CLI_TRACE_END 'E'     /**< Phase of the end of a span */
+#define CLI_TRACE_INSTANT 'i' /**< Phase of an instant event */
+
+/**
+ * @brief Trace points. A received line goes through the read, echo, parse,
+ * with the nested tokenize and find, and run spans
+ *
+ */
+typedef enum cli_trace_event_e {
+  CLI_TRACE_PUTCHAR = 1, /**< instant, arg is the received byte */
+  CLI_TRACE_PUTBUF,      /**< instant, arg is the number of bytes received */
+  CLI_TRACE_READ,        /**< span, copy of the receive buffer in
+                            cli_mainloop. arg is the number of bytes at the
+                            end */
+  CLI_TRACE_ECHO,        /**< span, arg is the number of echoed bytes */
+  CLI_TRACE_PARSE,       /**< span, tokenizing and lookup of a line. arg is
+                            the number of tokens at the end */
+  CLI_TRACE_TOKENIZE,    /**< span, tokenizing of a line */
+  CLI_TRACE_FIND,        /**< span, lookup of the command in the tables */
+  CLI_TRACE_RUN,         /**< span, handler of a command. arg is the number
+                            of arguments at the start, the status at the end */
+  CLI_TRACE_NAME,        /**< follows the start of a run, arg holds 4
+                            characters of the command name */
+} cli_trace_event_t;
+
+/**
+ * @brief Definition of a trace record. seq is written last so that a reader
+ * skips the records being written
+ *
+ */
+typedef struct cli_trace_record_s {
+  uint32_t seq;     /**< index of the record + 1. 0 while being written */
+  uint32_t ts;      /**< time read from the trace clock */
+  uint32_t arg;     /**< argument of the event */
+  uint16_t session; /**< bits of the address of the session */
+  uint8_t event;    /**< \link cli_trace_event_t \endlink */
+  uint8_t phase;    /**< \link CLI_TRACE_BEGIN \endlink, \link CLI_TRACE_END
+                       \endlink or \link CLI_TRACE_INSTANT \endlink */
+} cli_trace_record_t;
+
+/**
+ * @brief Empty the ring and start recording. Records are only written while
+ * a clock is set
+ *
+ * @param clock free running clock timestamping the records, e.g. CPU cycles
+ */
+void cli_trace_start(cli_cycles_t (*clock)(void));
+
+/**
+ * @brief Stop recording. The records are kept until the next start
+ *
+ */
+void cli_trace_stop(void);
+
+/**
+ * @brief Record an event. Safe to call from several threads and from
+ * interrupts, the newest records overwriting the oldest ones
+ *
+ * @param session the session the event belongs to
+ * @param event \link cli_trace_event_t \endlink
+ * @param phase \link CLI_TRACE_BEGIN \endlink, \link CLI_TRACE_END \endlink or
+ * \link CLI_TRACE_INSTANT \endlink
+ * @param arg argument of the event
+ */
+void cli_trace(const void *session, cli_trace_event_t event, char phase,
+               uint32_t arg);
+
+/**
+ * @brief Record the name of the command whose run just started, up to \link
+ * CLI_TRACE_NAME_MAX \endlink characters in \link CLI_TRACE_NAME \endlink
+ * records
+ *
+ * @param session the session running the command
+ * @param group the group name. NULL for a top-level command
+ * @param name the command name
+ */
+void cli_trace_name(const void *session, const char *group, const char *name);
+
+/**
+ * @brief Write the magic, the record size as a 32 bits little endian value,
+ * then the complete records from the oldest one, every field little endian
+ * in the order of \link cli_trace_record_t \endlink. The records written
+ * meanwhile may be skipped
+ *
+ * @param write function writing len bytes
+ * @param ctx context passed to write
+ * @return size_t number of records written
+ */
+size_t cli_trace_dump(void (*write)(void *ctx, const void *ptr, size_t len),
+                      void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_TRACE_H */
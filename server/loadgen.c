@@ -0,0 +1,440 @@
+/**
+ * @file loadgen.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Closed loop load generator measuring the session server latency
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOADGEN_CMD "ping\r\n"
+
+typedef struct client_s {
+  int fd;
+  size_t remaining; /**< commands left to send */
+  bool started;     /**< first prompt received */
+  char last;        /**< last received byte, prompts may be split */
+  uint64_t t0;      /**< send time of the pending command */
+} client_t;
+
+/**
+ * @brief Sessions driven by one load generator thread
+ *
+ */
+typedef struct worker_s {
+  pthread_t thread;
+  const char *path;
+  client_t *clients;
+  size_t num_clients;
+  uint64_t *samples; /**< latencies in ns */
+  size_t count;      /**< number of samples */
+  int ret;
+} worker_t;
+
+typedef struct result_s {
+  size_t count;
+  double p50_us;
+  double p99_us;
+  double rate;
+} result_t;
+
+static int cmd_ping_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  return 0;
+}
+
+static const cli_cmd_t loadgen_cmds[] = {
+    {.name = "ping", .desc = "Do nothing", .handler = cmd_ping_handler},
+};
+
+static const cli_cmd_list_t loadgen_cmd_list = {
+    .cmds = loadgen_cmds,
+    .cmds_length = ARRAY_SIZE(loadgen_cmds),
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int client_connect(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Every session sends its next command as soon as the prompt of the
+ * previous one is received
+ *
+ */
+static void *worker_thread(void *arg) {
+  worker_t *w = arg;
+  struct epoll_event events[256];
+  size_t done = 0;
+
+  w->ret = -1;
+
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < w->num_clients; i++) {
+    client_t *c = &w->clients[i];
+    c->fd = client_connect(w->path);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+    if (c->fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+      perror("connect");
+      goto out;
+    }
+  }
+
+  while (done < w->num_clients) {
+    int n = epoll_wait(epfd, events, ARRAY_SIZE(events), 5000);
+    if (n <= 0) {
+      fprintf(stderr, "timeout waiting for the server\n");
+      goto out;
+    }
+    for (int i = 0; i < n; i++) {
+      client_t *c = events[i].data.ptr;
+      char buf[4096];
+      ssize_t len = read(c->fd, buf, sizeof(buf));
+      if (len <= 0) {
+        fprintf(stderr, "session closed by the server\n");
+        goto out;
+      }
+      for (ssize_t j = 0; j < len; j++) {
+        if (c->last != '>' || buf[j] != ' ') {
+          c->last = buf[j];
+          continue;
+        }
+        c->last = buf[j];
+        uint64_t t = now_ns();
+        if (c->started) {
+          w->samples[w->count++] = t - c->t0;
+        }
+        c->started = true;
+        if (c->remaining == 0) {
+          done++;
+          continue;
+        }
+        c->remaining--;
+        c->t0 = t;
+        if (write(c->fd, LOADGEN_CMD, sizeof(LOADGEN_CMD) - 1) !=
+            sizeof(LOADGEN_CMD) - 1) {
+          perror("write");
+          goto out;
+        }
+      }
+    }
+  }
+  w->ret = 0;
+
+out:
+  close(epfd);
+  return NULL;
+}
+
+/**
+ * @brief Run sessions spread over threads and merge their latencies
+ *
+ */
+static int run_level(const char *path, size_t sessions, size_t threads,
+                     size_t total, result_t *res) {
+  size_t per_session = (total + sessions - 1) / sessions;
+  client_t *clients = calloc(sessions, sizeof(*clients));
+  uint64_t *samples = malloc(sessions * per_session * sizeof(*samples));
+  worker_t *workers = calloc(threads, sizeof(*workers));
+  size_t started = 0;
+  int ret = -1;
+
+  res->count = 0;
+
+  if (clients == NULL || samples == NULL || workers == NULL) {
+    goto out;
+  }
+
+  for (size_t i = 0; i < sessions; i++) {
+    clients[i].fd = -1;
+    clients[i].remaining = per_session;
+  }
+
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < threads; i++) {
+    worker_t *w = &workers[i];
+    size_t lo = sessions * i / threads;
+    size_t hi = sessions * (i + 1) / threads;
+    w->path = path;
+    w->clients = clients + lo;
+    w->num_clients = hi - lo;
+    w->samples = samples + lo * per_session;
+    if (pthread_create(&w->thread, NULL, worker_thread, w) != 0) {
+      break;
+    }
+    started++;
+  }
+
+  ret = started == threads ? 0 : -1;
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+    ret = workers[i].ret < 0 ? -1 : ret;
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  if (ret == 0) {
+    // Compact the samples of every thread
+    for (size_t i = 0; i < threads; i++) {
+      memmove(samples + res->count, workers[i].samples,
+              workers[i].count * sizeof(*samples));
+      res->count += workers[i].count;
+    }
+    qsort(samples, res->count, sizeof(*samples), cmp_u64);
+    res->p50_us = (double)samples[res->count / 2] / 1e3;
+    res->p99_us = (double)samples[res->count * 99 / 100] / 1e3;
+    res->rate = (double)res->count * 1e9 / (double)elapsed;
+  }
+
+out:
+  for (size_t i = 0; clients != NULL && i < sessions; i++) {
+    if (clients[i].fd >= 0) {
+      close(clients[i].fd);
+    }
+  }
+  free(workers);
+  free(samples);
+  free(clients);
+  return ret;
+}
+
+static size_t parse_list(const char *str, size_t *list, size_t max) {
+  size_t n = 0;
+  char *end;
+
+  while (n < max && *str != '\0') {
+    list[n++] = strtoul(str, &end, 0);
+    str = *end == ',' ? end + 1 : end;
+    if (end == str && *end != '\0') {
+      break;
+    }
+  }
+  return n;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-s PATH] [-b BACKEND] [-r REACTORS] [-j THREADS] "
+          "[-n COMMANDS] [SESSIONS...]\n"
+          "  -s PATH      connect to a running //server:cli_server\n"
+          "               an in-process server is started otherwise\n"
+          "  -b BACKEND   in-process server backend: epoll, uring or all\n"
+          "               (default epoll)\n"
+          "  -r REACTORS  comma separated reactor counts of the in-process\n"
+          "               server, or `all` for 1, 2, 4... up to all cores\n"
+          "               (default 1)\n"
+          "  -j THREADS   load generator threads (default: reactors)\n"
+          "  -n COMMANDS  commands sent per level (default 20000)\n"
+          "  SESSIONS     concurrent sessions per level (default 1 100 1000)\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  static const size_t default_levels[] = {1, 100, 1000};
+  const char *path = NULL;
+  size_t total = 20000;
+  size_t threads = 0;
+  size_t levels[32];
+  size_t num_levels = 0;
+  size_t max_level = 0;
+  size_t reactors[32] = {1};
+  size_t num_reactors = 1;
+  cli_server_backend_t backends[2] = {CLI_SERVER_BACKEND_EPOLL};
+  size_t num_backends = 1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:b:r:j:n:h")) != -1) {
+    switch (opt) {
+    case 's':
+      path = optarg;
+      break;
+    case 'b':
+      num_backends = 0;
+      if (strcmp(optarg, "epoll") == 0 || strcmp(optarg, "all") == 0) {
+        backends[num_backends++] = CLI_SERVER_BACKEND_EPOLL;
+      }
+      if (strcmp(optarg, "uring") == 0 || strcmp(optarg, "all") == 0) {
+        backends[num_backends++] = CLI_SERVER_BACKEND_URING;
+      }
+      if (num_backends == 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'r':
+      if (strcmp(optarg, "all") == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_reactors = 0;
+        for (size_t r = 1; r < (size_t)cores && num_reactors < 31; r *= 2) {
+          reactors[num_reactors++] = r;
+        }
+        reactors[num_reactors++] = cores > 0 ? (size_t)cores : 1;
+      } else {
+        num_reactors = parse_list(optarg, reactors, ARRAY_SIZE(reactors));
+      }
+      break;
+    case 'j':
+      threads = strtoul(optarg, NULL, 0);
+      break;
+    case 'n':
+      total = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  for (int i = optind; i < argc && num_levels < ARRAY_SIZE(levels); i++) {
+    levels[num_levels++] = strtoul(argv[i], NULL, 0);
+  }
+  if (num_levels == 0) {
+    memcpy(levels, default_levels, sizeof(default_levels));
+    num_levels = ARRAY_SIZE(default_levels);
+  }
+  for (size_t i = 0; i < num_levels; i++) {
+    if (levels[i] == 0 || total == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+    max_level = levels[i] > max_level ? levels[i] : max_level;
+  }
+  for (size_t i = 0; i < num_reactors; i++) {
+    if (reactors[i] == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (path != NULL) {
+    // Unknown, the server runs elsewhere
+    num_reactors = 1;
+    num_backends = 1;
+  }
+
+  // Both ends of every session live in this process without -s
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+    rl.rlim_cur = rl.rlim_max;
+    (void)setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  printf("%8s %10s %10s %10s %12s %12s %14s\n", "backend", "reactors",
+         "sessions", "commands", "p50 (us)", "p99 (us)", "commands/s");
+
+  char tmp_path[64];
+  snprintf(tmp_path, sizeof(tmp_path), "/tmp/ucli_loadgen.%d.sock",
+           (int)getpid());
+
+  int ret = 0;
+  for (size_t k = 0; k < num_backends * num_reactors && ret == 0; k++) {
+    cli_server_backend_t backend = backends[k / num_reactors];
+    size_t r = k % num_reactors;
+    cli_server_pool_t pool;
+    const char *dst = path;
+    const char *name = "-";
+
+    if (path == NULL) {
+      dst = tmp_path;
+      name = backend == CLI_SERVER_BACKEND_URING ? "io_uring" : "epoll";
+      // Sessions of the previous level may still be closing
+      if (cli_server_pool_init(&pool, &loadgen_cmd_list, reactors[r],
+                               2 * max_level, backend) < 0 ||
+          cli_server_pool_listen(&pool, dst) < 0 ||
+          cli_server_pool_start(&pool) < 0) {
+        perror("cli_server");
+        return 1;
+      }
+    }
+
+    for (size_t i = 0; i < num_levels; i++) {
+      size_t n = threads ? threads : reactors[r];
+      n = n < levels[i] ? n : levels[i];
+
+      result_t res = {0};
+      if (run_level(dst, levels[i], n, total, &res) < 0) {
+        ret = 1;
+        break;
+      }
+
+      char col[16] = "-";
+      if (path == NULL) {
+        snprintf(col, sizeof(col), "%zu", reactors[r]);
+      }
+      printf("%8s %10s %10zu %10zu %12.1f %12.1f %14.0f\n", name, col,
+             levels[i], res.count, res.p50_us, res.p99_us, res.rate);
+    }
+
+    if (path == NULL) {
+      cli_server_pool_close(&pool);
+      (void)unlink(dst);
+    }
+  }
+  return ret;
+}
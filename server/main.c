@@ -0,0 +1,149 @@
+/**
+ * @file main.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Command line interpreter sessions served over a Unix socket
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "pool.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int cmd_sessions_handler(cli_t *cli, int argc, char **argv) {
+  cli_session_t *s = cli->ctx;
+  char buf[32];
+
+  (void)argc;
+  (void)argv;
+
+  int n = snprintf(buf, sizeof(buf), "%zu\r\n", s->server->count);
+  cli_write(cli, buf, (size_t)n);
+  return 0;
+}
+
+static int cmd_ping_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  return 0;
+}
+
+static const cli_cmd_t cli_server_cmds[] = {
+    {
+        .name = "sessions",
+        .desc = "Print the number of sessions of this reactor",
+        .handler = cmd_sessions_handler,
+    },
+    {
+        .name = "ping",
+        .desc = "Do nothing",
+        .handler = cmd_ping_handler,
+    },
+};
+
+static const cli_cmd_list_t cli_server_cmd_list = {
+    .groups = NULL,
+    .length = 0,
+    .cmds = cli_server_cmds,
+    .cmds_length = ARRAY_SIZE(cli_server_cmds),
+};
+
+int main(int argc, char **argv) {
+  cli_server_pool_t pool;
+  cli_server_backend_t backend = CLI_SERVER_BACKEND_AUTO;
+  size_t reactors = 0;
+  const char *addr = "127.0.0.1";
+  long port = -1;
+  sigset_t set;
+  int sig;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r:b:t:a:")) != -1) {
+    if (opt == 'r') {
+      reactors = strtoul(optarg, NULL, 0);
+    } else if (opt == 't') {
+      port = strtol(optarg, NULL, 0);
+    } else if (opt == 'a') {
+      addr = optarg;
+    } else if (opt == 'b' && strcmp(optarg, "epoll") == 0) {
+      backend = CLI_SERVER_BACKEND_EPOLL;
+    } else if (opt == 'b' && strcmp(optarg, "uring") == 0) {
+      backend = CLI_SERVER_BACKEND_URING;
+    } else {
+      fprintf(stderr,
+              "usage: %s [-r REACTORS] [-b epoll|uring] [-t PORT [-a ADDR]] "
+              "[PATH]\n"
+              "  -t PORT  serve telnet clients on a TCP port instead of PATH\n"
+              "  -a ADDR  IPv4 address of the TCP port (default 127.0.0.1)\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  const char *path = optind < argc ? argv[optind] : "/tmp/ucli.sock";
+  char where[64];
+
+  if (port > 0xFFFF) {
+    fprintf(stderr, "invalid port %ld\n", port);
+    return 1;
+  }
+  if (port >= 0) {
+    snprintf(where, sizeof(where), "telnet %s:%ld", addr, port);
+  } else {
+    snprintf(where, sizeof(where), "%s", path);
+  }
+
+  // Reactor threads inherit the mask, signals are handled below
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  if (cli_server_pool_init(&pool, &cli_server_cmd_list, reactors, 4096,
+                           backend) < 0 ||
+      (port >= 0 ? cli_server_pool_listen_tcp(&pool, addr, (uint16_t)port, true)
+                 : cli_server_pool_listen(&pool, path)) < 0 ||
+      cli_server_pool_start(&pool) < 0) {
+    perror("cli_server");
+    return 1;
+  }
+
+  printf("listening on %s with %zu %s reactors\n", where, pool.num_reactors,
+         pool.reactors[0].backend == CLI_SERVER_BACKEND_URING ? "io_uring"
+                                                              : "epoll");
+  fflush(stdout);
+  sigwait(&set, &sig);
+
+  cli_server_pool_close(&pool);
+  if (port < 0) {
+    (void)unlink(path);
+  }
+  return 0;
+}
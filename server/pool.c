@@ -0,0 +1,138 @@
+/**
+ * @file pool.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Session server sharded over one reactor thread per core
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "pool.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void *cli_server_pool_thread(void *arg) {
+  cli_server_t *srv = arg;
+  (void)cli_server_run(srv);
+  return NULL;
+}
+
+int cli_server_pool_init(cli_server_pool_t *pool,
+                         const cli_cmd_list_t *cmd_list, size_t num_reactors,
+                         size_t max_sessions, cli_server_backend_t backend) {
+  if (num_reactors == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    num_reactors = cores > 0 ? (size_t)cores : 1;
+  }
+
+  pool->num_reactors = 0;
+  pool->num_threads = 0;
+  pool->reactors = calloc(num_reactors, sizeof(*pool->reactors));
+  pool->threads = calloc(num_reactors, sizeof(*pool->threads));
+  if (pool->reactors == NULL || pool->threads == NULL) {
+    cli_server_pool_close(pool);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  for (size_t i = 0; i < num_reactors; i++) {
+    if (cli_server_init_backend(&pool->reactors[i], cmd_list, max_sessions,
+                                backend) < 0) {
+      int err = errno;
+      cli_server_pool_close(pool);
+      errno = err;
+      return -1;
+    }
+    pool->num_reactors++;
+  }
+
+  // The first reactor accepts and spreads the connections
+  pool->reactors[0].peers = pool->reactors;
+  pool->reactors[0].num_peers = num_reactors;
+  return 0;
+}
+
+int cli_server_pool_listen(cli_server_pool_t *pool, const char *path) {
+  return cli_server_listen(&pool->reactors[0], path);
+}
+
+int cli_server_pool_listen_tcp(cli_server_pool_t *pool, const char *addr,
+                               uint16_t port, bool telnet) {
+  for (size_t i = 0; i < pool->num_reactors; i++) {
+    pool->reactors[i].telnet = telnet;
+  }
+  return cli_server_listen_tcp(&pool->reactors[0], addr, port);
+}
+
+int cli_server_pool_start(cli_server_pool_t *pool) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  for (size_t i = pool->num_threads; i < pool->num_reactors; i++) {
+    int err = pthread_create(&pool->threads[i], NULL, cli_server_pool_thread,
+                             &pool->reactors[i]);
+    if (err != 0) {
+      errno = err;
+      return -1;
+    }
+    pool->num_threads++;
+
+    if (cores > 0 && i < (size_t)cores) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(i, &set);
+      (void)pthread_setaffinity_np(pool->threads[i], sizeof(set), &set);
+    }
+  }
+  return 0;
+}
+
+void cli_server_pool_stop(cli_server_pool_t *pool) {
+  for (size_t i = 0; i < pool->num_reactors; i++) {
+    cli_server_stop(&pool->reactors[i]);
+  }
+}
+
+void cli_server_pool_close(cli_server_pool_t *pool) {
+  cli_server_pool_stop(pool);
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  pool->num_threads = 0;
+
+  for (size_t i = 0; i < pool->num_reactors; i++) {
+    cli_server_close(&pool->reactors[i]);
+  }
+  pool->num_reactors = 0;
+
+  free(pool->reactors);
+  free(pool->threads);
+  pool->reactors = NULL;
+  pool->threads = NULL;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file pool.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Session server sharded over one reactor thread per core
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_SERVER_POOL_H
+#define _CLI_SERVER_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "server.h"
+
+#include <pthread.h>
+
+/**
+ * @brief Definition of the reactors pool. Every reactor runs on its own thread
+ * and owns its sessions; they only share the const commands list
+ *
+ */
+typedef struct cli_server_pool_s {
+  cli_server_t *reactors; /**< reactors. The first one accepts connections */
+  size_t num_reactors;    /**< number of reactors */
+  pthread_t *threads;     /**< internal reactor threads */
+  size_t num_threads;     /**< internal number of running threads */
+} cli_server_pool_t;
+
+/**
+ * @brief Initialize the pool
+ *
+ * @param pool the pool struct
+ * @param cmd_list the commands list of every session
+ * @param num_reactors the number of reactors. 0 for one per online core
+ * @param max_sessions the maximum number of concurrent sessions per reactor
+ * @param backend the I/O backend of every reactor see \link
+ * cli_server_init_backend \endlink
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_pool_init(cli_server_pool_t *pool,
+                         const cli_cmd_list_t *cmd_list, size_t num_reactors,
+                         size_t max_sessions, cli_server_backend_t backend);
+
+/**
+ * @brief Listen for connections on a Unix stream socket. The connections are
+ * spread round robin over the reactors
+ *
+ * @param pool the pool struct
+ * @param path the socket path
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_pool_listen(cli_server_pool_t *pool, const char *path);
+
+/**
+ * @brief Listen for connections on a TCP socket. The connections are spread
+ * round robin over the reactors
+ *
+ * @param pool the pool struct
+ * @param addr the IPv4 address to bind
+ * @param port the TCP port
+ * @param telnet sessions speak the telnet protocol
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_pool_listen_tcp(cli_server_pool_t *pool, const char *addr,
+                               uint16_t port, bool telnet);
+
+/**
+ * @brief Start one thread per reactor. Thread i is pinned to core i when there
+ * are enough cores
+ *
+ * @param pool the pool struct
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_pool_start(cli_server_pool_t *pool);
+
+/**
+ * @brief Request all reactors to return. It is safe to call from any thread or
+ * from a signal handler
+ *
+ * @param pool the pool struct
+ */
+void cli_server_pool_stop(cli_server_pool_t *pool);
+
+/**
+ * @brief Stop and join the reactor threads, then close all sessions and
+ * release the pool resources
+ *
+ * @param pool the pool struct
+ */
+void cli_server_pool_close(cli_server_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_SERVER_POOL_H */
@@ -0,0 +1,938 @@
+/**
+ * @file server.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Reactor hosting many command line interpreter sessions over sockets
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "uring.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief Operation of an io_uring completion, kept in the low bits of its
+ * user data. The other bits point to the session or to the server
+ *
+ */
+enum {
+  CLI_URING_READ = 0,
+  CLI_URING_SEND = 1,
+  CLI_URING_ACCEPT = 2,
+  CLI_URING_WAKE = 3,
+  CLI_URING_MASK = 3,
+};
+
+/**
+ * @brief Definition of the io_uring backend state of a server
+ *
+ */
+struct cli_server_uring_s {
+  cli_uring_t ring;  /**< io_uring instance */
+  char *inbufs;      /**< input buffers, CLI_SERVER_URING_READ per session */
+  size_t *free_bufs; /**< stack of unused input buffers */
+  size_t num_free;   /**< number of unused input buffers */
+  size_t num_closed; /**< closed sessions waiting for their completions */
+  bool fixed;        /**< the input buffers are registered */
+  uint64_t wake;     /**< eventfd counter read */
+};
+
+static size_t cli_session_write(void *ctx, const void *ptr, size_t size);
+static int cli_session_flush(void *ctx);
+static void cli_session_quit(void *ctx);
+
+/**
+ * @brief I/O operations shared by all sessions. The session is the context
+ *
+ */
+static const cli_ops_t cli_session_ops = {
+    .write = cli_session_write,
+    .flush = cli_session_flush,
+    .quit = cli_session_quit,
+};
+
+/**
+ * @brief drop the buffered output and close the session after this pass
+ *
+ * @param s the session
+ */
+static void cli_session_abort(cli_session_t *s) {
+  s->out_len = 0;
+  s->failed = true;
+}
+
+/**
+ * @brief send the buffered output of a session without blocking. Unsent bytes
+ * are moved to the start of the buffer. The io_uring backend sends from
+ * \link cli_session_update \endlink only
+ *
+ * @param s the session
+ * @return int 0 on success, -1 if the connection is broken
+ */
+static int cli_session_send(cli_session_t *s) {
+  size_t off = 0;
+
+  if (s->server->uring != NULL) {
+    return 0;
+  }
+
+  while (off < s->out_len) {
+    ssize_t n = send(s->fd, s->out + off, s->out_len - off, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      s->out_len = 0;
+      return -1;
+    }
+    off += (size_t)n;
+  }
+
+  if (off > 0) {
+    memmove(s->out, s->out + off, s->out_len - off);
+    s->out_len -= off;
+  }
+  return 0;
+}
+
+/**
+ * @brief buffer raw bytes for the client
+ *
+ * @param ctx the session
+ * @param ptr the bytes
+ * @param size the number of bytes
+ * @return size_t size, 0 if the session failed
+ */
+static size_t cli_session_append(void *ctx, const void *ptr, size_t size) {
+  cli_session_t *s = ctx;
+
+  if (s->failed) {
+    return 0;
+  }
+
+  if (s->out_len + size > s->out_cap) {
+    // Make room, then grow up to CLI_SERVER_OUT_MAX
+    if (cli_session_send(s) < 0) {
+      cli_session_abort(s);
+      return 0;
+    }
+    size_t cap = s->out_cap ? s->out_cap : 256;
+    while (cap < s->out_len + size && cap < CLI_SERVER_OUT_MAX) {
+      cap *= 2;
+    }
+    cap = cap < CLI_SERVER_OUT_MAX ? cap : CLI_SERVER_OUT_MAX;
+    if (s->out_len + size > cap) {
+      // The client does not read its output
+      cli_session_abort(s);
+      return 0;
+    }
+    if (cap > s->out_cap) {
+      char *out = realloc(s->out, cap);
+      if (out == NULL) {
+        cli_session_abort(s);
+        return 0;
+      }
+      s->out = out;
+      s->out_cap = cap;
+    }
+  }
+
+  memcpy(s->out + s->out_len, ptr, size);
+  s->out_len += size;
+
+  if (s->out_len >= CLI_SERVER_OUT_FLUSH && cli_session_send(s) < 0) {
+    cli_session_abort(s);
+  }
+  return size;
+}
+
+static size_t cli_session_write(void *ctx, const void *ptr, size_t size) {
+  cli_session_t *s = ctx;
+
+  if (s->server->telnet) {
+    return cli_telnet_send(&s->telnet, ptr, size);
+  }
+  return cli_session_append(s, ptr, size);
+}
+
+static void cli_session_telnet_data(void *ctx, const char *ptr, size_t size) {
+  cli_session_t *s = ctx;
+  cli_feed(&s->cli, ptr, size);
+}
+
+static int cli_session_flush(void *ctx) {
+  (void)ctx;
+  // The output is sent once the received bytes are processed
+  return 0;
+}
+
+static void cli_session_quit(void *ctx) {
+  cli_session_t *s = ctx;
+  s->closing = true;
+}
+
+/**
+ * @brief release the session and its socket
+ *
+ * @param s the session
+ */
+static void cli_session_free(cli_session_t *s) {
+  struct cli_server_uring_s *u = s->server->uring;
+
+  if (u != NULL) {
+    u->free_bufs[u->num_free++] = s->buf_idx;
+  }
+
+  close(s->fd);
+  free(s->out);
+  free(s->tx);
+  free(s);
+}
+
+/**
+ * @brief remove the session from the sessions table and release it. With
+ * io_uring operations in flight it is released by their last completion
+ *
+ * @param s the session
+ */
+static void cli_session_close(cli_session_t *s) {
+  cli_server_t *srv = s->server;
+
+  srv->count--;
+  srv->sessions[s->slot] = srv->sessions[srv->count];
+  srv->sessions[s->slot]->slot = s->slot;
+  srv->sessions[srv->count] = NULL;
+
+  if (s->inflight > 0) {
+    // Completes the operations in flight
+    (void)shutdown(s->fd, SHUT_RDWR);
+    s->closed = true;
+    srv->uring->num_closed++;
+    return;
+  }
+  cli_session_free(s);
+}
+
+/**
+ * @brief queue a read of the session socket into its input buffer
+ *
+ * @param s the session
+ * @return int 0 on success, -1 if the submission queue failed
+ */
+static int cli_session_uring_read(cli_session_t *s) {
+  struct cli_server_uring_s *u = s->server->uring;
+  struct io_uring_sqe *sqe = cli_uring_get_sqe(&u->ring);
+
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = u->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd = s->fd;
+  sqe->addr = (uintptr_t)(u->inbufs + s->buf_idx * CLI_SERVER_URING_READ);
+  sqe->len = CLI_SERVER_URING_READ;
+  sqe->buf_index = 0;
+  sqe->user_data = (uintptr_t)s | CLI_URING_READ;
+
+  s->reading = true;
+  s->inflight++;
+  return 0;
+}
+
+/**
+ * @brief queue a send of the output not sent yet
+ *
+ * @param s the session
+ * @return int 0 on success, -1 if the submission queue failed
+ */
+static int cli_session_uring_send(cli_session_t *s) {
+  struct cli_server_uring_s *u = s->server->uring;
+  struct io_uring_sqe *sqe = cli_uring_get_sqe(&u->ring);
+
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = s->fd;
+  sqe->addr = (uintptr_t)(s->tx + s->tx_off);
+  sqe->len = (unsigned)(s->tx_len - s->tx_off);
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = (uintptr_t)s | CLI_URING_SEND;
+
+  s->inflight++;
+  return 0;
+}
+
+/**
+ * @brief io_uring flavour of \link cli_session_update \endlink. The buffered
+ * output becomes the output in flight, the next writes are buffered meanwhile.
+ * Reads are queued again until the buffered output reaches
+ * CLI_SERVER_OUT_FLUSH
+ *
+ * @param s the session
+ * @return bool false if the session was closed
+ */
+static bool cli_session_uring_update(cli_session_t *s) {
+  if (s->failed || (s->closing && s->out_len == 0 && s->tx_len == 0)) {
+    cli_session_close(s);
+    return false;
+  }
+
+  if (s->tx_len == 0 && s->out_len > 0) {
+    char *tx = s->tx;
+    size_t tx_cap = s->tx_cap;
+
+    s->tx = s->out;
+    s->tx_cap = s->out_cap;
+    s->tx_len = s->out_len;
+    s->tx_off = 0;
+    s->out = tx;
+    s->out_cap = tx_cap;
+    s->out_len = 0;
+
+    if (cli_session_uring_send(s) < 0) {
+      cli_session_close(s);
+      return false;
+    }
+  }
+
+  if (!s->reading && !s->closing && s->out_len < CLI_SERVER_OUT_FLUSH &&
+      cli_session_uring_read(s) < 0) {
+    cli_session_close(s);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief send the output of a processing pass and update the events the
+ * session waits for. A session with pending output is not read until the
+ * client drains it
+ *
+ * @param s the session
+ * @return bool false if the session was closed
+ */
+static bool cli_session_update(cli_session_t *s) {
+  if (s->server->uring != NULL) {
+    return cli_session_uring_update(s);
+  }
+
+  if (s->failed || cli_session_send(s) < 0 ||
+      (s->closing && s->out_len == 0)) {
+    cli_session_close(s);
+    return false;
+  }
+
+  bool blocked = s->out_len > 0;
+  if (blocked != s->blocked) {
+    struct epoll_event ev = {.events = blocked ? EPOLLOUT : EPOLLIN,
+                             .data.ptr = s};
+    if (epoll_ctl(s->server->epfd, EPOLL_CTL_MOD, s->fd, &ev) < 0) {
+      cli_session_close(s);
+      return false;
+    }
+    s->blocked = blocked;
+  }
+  return true;
+}
+
+/**
+ * @brief feed the bytes received by a session to its command line interpreter
+ *
+ * @param s the session
+ * @param buf the received bytes
+ * @param n the value returned by read
+ */
+static void cli_session_feed(cli_session_t *s, const char *buf, ssize_t n) {
+  if (n > 0 && s->server->telnet) {
+    cli_telnet_recv(&s->telnet, buf, (size_t)n);
+  } else if (n > 0) {
+    cli_feed(&s->cli, buf, (size_t)n);
+  } else if (n == 0) {
+    s->closing = true; // the client is done sending, it may still read
+  } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    cli_session_abort(s);
+  } else {
+    ; // spurious wake-up
+  }
+}
+
+/**
+ * @brief read from a session socket
+ *
+ * @param s the session
+ */
+static void cli_session_read(cli_session_t *s) {
+  char buf[CLI_SERVER_READ_MAX];
+  ssize_t n;
+
+  do {
+    n = read(s->fd, buf, sizeof(buf));
+  } while (n < 0 && errno == EINTR);
+
+  cli_session_feed(s, buf, n);
+}
+
+/**
+ * @brief open a session for an accepted connection on this reactor or on the
+ * next peer
+ *
+ * @param srv the server struct
+ * @param fd the accepted connection
+ */
+static void cli_server_dispatch(cli_server_t *srv, int fd) {
+  cli_server_t *dst = srv;
+
+  if (srv->num_peers > 0) {
+    dst = &srv->peers[srv->next_peer];
+    srv->next_peer = (srv->next_peer + 1) % srv->num_peers;
+  }
+  if (dst == srv) {
+    (void)cli_server_add(srv, fd);
+  } else {
+    (void)cli_server_handoff(dst, fd);
+  }
+}
+
+/**
+ * @brief accept all pending connections. They are spread round robin over the
+ * peers if any
+ *
+ * @param srv the server struct
+ */
+static void cli_server_accept(cli_server_t *srv) {
+  for (;;) {
+    int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break; // EAGAIN, or out of descriptors until a session closes
+    }
+    cli_server_dispatch(srv, fd);
+  }
+}
+
+/**
+ * @brief open the sessions of the connections handed off to this reactor
+ *
+ * @param srv the server struct
+ */
+static void cli_server_drain_handoff(cli_server_t *srv) {
+  size_t head = __atomic_load_n(&srv->handoff.head, __ATOMIC_ACQUIRE);
+  size_t tail = srv->handoff.tail;
+
+  while (tail != head) {
+    int fd = srv->handoff.fds[tail % CLI_SERVER_HANDOFF_NUM];
+    tail++;
+    __atomic_store_n(&srv->handoff.tail, tail, __ATOMIC_RELEASE);
+    (void)cli_server_add(srv, fd);
+  }
+}
+
+/**
+ * @brief queue an accept on the listening socket
+ *
+ * @param srv the server struct
+ */
+static void cli_server_uring_accept(cli_server_t *srv) {
+  struct io_uring_sqe *sqe = cli_uring_get_sqe(&srv->uring->ring);
+
+  if (sqe != NULL) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = srv->listen_fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = (uintptr_t)srv | CLI_URING_ACCEPT;
+  }
+}
+
+/**
+ * @brief queue a read of the eventfd waking up the reactor
+ *
+ * @param srv the server struct
+ */
+static void cli_server_uring_wake(cli_server_t *srv) {
+  struct io_uring_sqe *sqe = cli_uring_get_sqe(&srv->uring->ring);
+
+  if (sqe != NULL) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = srv->wake_fd;
+    sqe->addr = (uintptr_t)&srv->uring->wake;
+    sqe->len = sizeof(srv->uring->wake);
+    sqe->user_data = (uintptr_t)srv | CLI_URING_WAKE;
+  }
+}
+
+/**
+ * @brief handle the completion of a session operation
+ *
+ * @param s the session
+ * @param op the operation
+ * @param res the operation result
+ */
+static void cli_session_complete(cli_session_t *s, unsigned op, int res) {
+  struct cli_server_uring_s *u = s->server->uring;
+
+  s->inflight--;
+  if (op == CLI_URING_READ) {
+    s->reading = false;
+  }
+
+  if (s->closed) {
+    if (s->inflight == 0) {
+      u->num_closed--;
+      cli_session_free(s);
+    }
+    return;
+  }
+
+  if (op == CLI_URING_READ) {
+    errno = res < 0 ? -res : 0;
+    cli_session_feed(s, u->inbufs + s->buf_idx * CLI_SERVER_URING_READ,
+                     res < 0 ? -1 : res);
+  } else if (res < 0) {
+    cli_session_abort(s);
+  } else {
+    s->tx_off += (size_t)res;
+    if (s->tx_off < s->tx_len) {
+      if (cli_session_uring_send(s) < 0) {
+        cli_session_abort(s);
+      }
+    } else {
+      s->tx_len = 0;
+      s->tx_off = 0;
+    }
+  }
+  (void)cli_session_update(s);
+}
+
+/**
+ * @brief io_uring flavour of \link cli_server_poll \endlink. The reads and
+ * sends queued while handling the completions of a pass are submitted at once
+ * by the next one
+ *
+ * @param srv the server struct
+ * @param timeout_ms maximum time to wait in ms. -1 waits forever
+ * @return int number of handled completions, -1 on error with errno set
+ */
+static int cli_server_uring_poll(cli_server_t *srv, int timeout_ms) {
+  struct cli_server_uring_s *u = srv->uring;
+  struct io_uring_cqe cqe;
+  int n = 0;
+
+  if (cli_uring_enter(&u->ring, timeout_ms) < 0) {
+    return -1;
+  }
+
+  while (cli_uring_pop(&u->ring, &cqe)) {
+    unsigned op = (unsigned)(cqe.user_data & CLI_URING_MASK);
+    void *ptr = (void *)(uintptr_t)(cqe.user_data & ~(uint64_t)CLI_URING_MASK);
+
+    if (op == CLI_URING_ACCEPT) {
+      if (cqe.res >= 0) {
+        cli_server_dispatch(srv, cqe.res);
+      }
+      cli_server_uring_accept(srv);
+    } else if (op == CLI_URING_WAKE) {
+      cli_server_drain_handoff(srv);
+      cli_server_uring_wake(srv);
+    } else {
+      cli_session_complete(ptr, op, cqe.res);
+    }
+    n++;
+  }
+  return n;
+}
+
+/**
+ * @brief set up the io_uring backend. The input buffers of all sessions are
+ * registered once when the memory lock limit allows it
+ *
+ * @param srv the server struct
+ * @return int 0 on success, -1 with errno set if io_uring is not available
+ */
+static int cli_server_uring_init(cli_server_t *srv) {
+  struct cli_server_uring_s *u = calloc(1, sizeof(*u));
+  size_t num = srv->max_sessions ? srv->max_sessions : 1;
+
+  // A read and a send per session, the accept and the eventfd read
+  size_t entries = 2 * num + 2;
+  entries = entries < 32768 ? entries : 32768;
+
+  if (u == NULL || cli_uring_init(&u->ring, (unsigned)entries) < 0) {
+    int err = u == NULL ? ENOMEM : errno;
+    free(u);
+    errno = err;
+    return -1;
+  }
+
+  u->inbufs = malloc(num * CLI_SERVER_URING_READ);
+  u->free_bufs = malloc(num * sizeof(*u->free_bufs));
+  if (u->inbufs == NULL || u->free_bufs == NULL) {
+    cli_uring_close(&u->ring);
+    free(u->inbufs);
+    free(u->free_bufs);
+    free(u);
+    errno = ENOMEM;
+    return -1;
+  }
+  for (size_t i = 0; i < num; i++) {
+    u->free_bufs[u->num_free++] = num - 1 - i;
+  }
+
+  struct iovec iov = {u->inbufs, num * CLI_SERVER_URING_READ};
+  u->fixed = cli_uring_register_buffers(&u->ring, &iov, 1) == 0;
+
+  srv->uring = u;
+  cli_server_uring_wake(srv);
+  return 0;
+}
+
+/**
+ * @brief release the io_uring backend once the closed sessions got their
+ * completions
+ *
+ * @param srv the server struct
+ */
+static void cli_server_uring_close(cli_server_t *srv) {
+  struct cli_server_uring_s *u = srv->uring;
+
+  struct io_uring_cqe cqe;
+
+  for (int i = 0; i < 100 && u->num_closed > 0; i++) {
+    if (cli_uring_enter(&u->ring, 10) < 0) {
+      break;
+    }
+    while (cli_uring_pop(&u->ring, &cqe)) {
+      unsigned op = (unsigned)(cqe.user_data & CLI_URING_MASK);
+      void *ptr =
+          (void *)(uintptr_t)(cqe.user_data & ~(uint64_t)CLI_URING_MASK);
+      if (op == CLI_URING_READ || op == CLI_URING_SEND) {
+        cli_session_complete(ptr, op, cqe.res);
+      } else if (op == CLI_URING_ACCEPT && cqe.res >= 0) {
+        close(cqe.res);
+      } else {
+        ; // the reactor is closing
+      }
+    }
+  }
+
+  cli_uring_close(&u->ring);
+  free(u->inbufs);
+  free(u->free_bufs);
+  free(u);
+  srv->uring = NULL;
+}
+
+int cli_server_init(cli_server_t *srv, const cli_cmd_list_t *cmd_list,
+                    size_t max_sessions) {
+  return cli_server_init_backend(srv, cmd_list, max_sessions,
+                                 CLI_SERVER_BACKEND_EPOLL);
+}
+
+int cli_server_init_backend(cli_server_t *srv, const cli_cmd_list_t *cmd_list,
+                            size_t max_sessions,
+                            cli_server_backend_t backend) {
+  memset(srv, 0, sizeof(*srv));
+  srv->epfd = -1;
+  srv->listen_fd = -1;
+  srv->cmd_list = cmd_list;
+  srv->max_sessions = max_sessions;
+
+  srv->sessions = calloc(max_sessions ? max_sessions : 1,
+                         sizeof(cli_session_t *));
+  srv->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (srv->sessions != NULL && srv->wake_fd >= 0) {
+    if (backend != CLI_SERVER_BACKEND_EPOLL &&
+        cli_server_uring_init(srv) == 0) {
+      srv->backend = CLI_SERVER_BACKEND_URING;
+      return 0;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &srv->wake_fd};
+    if (backend != CLI_SERVER_BACKEND_URING) {
+      srv->backend = CLI_SERVER_BACKEND_EPOLL;
+      srv->epfd = epoll_create1(EPOLL_CLOEXEC);
+      if (srv->epfd >= 0 &&
+          epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->wake_fd, &ev) == 0) {
+        return 0;
+      }
+    }
+  }
+
+  int err = errno;
+  cli_server_close(srv);
+  errno = err;
+  return -1;
+}
+
+/**
+ * @brief bind a listening socket and wait for its connections
+ *
+ * @param srv the server struct
+ * @param addr the socket address
+ * @param len the socket address length
+ * @return int 0 on success, -1 on error with errno set
+ */
+static int cli_server_bind(cli_server_t *srv, const struct sockaddr *addr,
+                           socklen_t len) {
+  // io_uring waits for connections itself
+  int type = SOCK_STREAM | SOCK_CLOEXEC;
+  type |= srv->uring != NULL ? 0 : SOCK_NONBLOCK;
+
+  int fd = socket(addr->sa_family, type, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  int one = 1;
+  if (addr->sa_family == AF_INET) {
+    (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &srv->listen_fd};
+  if (bind(fd, addr, len) < 0 || listen(fd, SOMAXCONN) < 0 ||
+      (srv->uring == NULL &&
+       epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  srv->listen_fd = fd;
+  if (srv->uring != NULL) {
+    cli_server_uring_accept(srv);
+  }
+  return 0;
+}
+
+int cli_server_listen(cli_server_t *srv, const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  (void)unlink(path);
+
+  return cli_server_bind(srv, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+int cli_server_listen_tcp(cli_server_t *srv, const char *addr, uint16_t port) {
+  struct sockaddr_in sin = {.sin_family = AF_INET, .sin_port = htons(port)};
+
+  if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+    errno = EINVAL;
+    return -1;
+  }
+  return cli_server_bind(srv, (struct sockaddr *)&sin, sizeof(sin));
+}
+
+int cli_server_handoff(cli_server_t *srv, int fd) {
+  size_t tail = __atomic_load_n(&srv->handoff.tail, __ATOMIC_ACQUIRE);
+  size_t head = srv->handoff.head;
+  uint64_t one = 1;
+
+  if (head - tail >= CLI_SERVER_HANDOFF_NUM) {
+    close(fd);
+    return -1;
+  }
+
+  srv->handoff.fds[head % CLI_SERVER_HANDOFF_NUM] = fd;
+  __atomic_store_n(&srv->handoff.head, head + 1, __ATOMIC_RELEASE);
+  (void)write(srv->wake_fd, &one, sizeof(one));
+  return 0;
+}
+
+/**
+ * @brief initialise the command line interpreter of a session. With a config,
+ * its buffers are carved out of the mem_len bytes allocated after the session
+ *
+ * @param srv the server struct
+ * @param s the session
+ * @param mem_len the size of the arena following s
+ * @return int 0 on success, -1 if the config is invalid
+ */
+static int cli_session_init(cli_server_t *srv, cli_session_t *s,
+                            size_t mem_len) {
+  if (srv->config == NULL) {
+    cli_init(&s->cli, srv->cmd_list);
+    return 0;
+  }
+  return cli_init_ex(&s->cli, srv->cmd_list, srv->config, s + 1, mem_len);
+}
+
+cli_session_t *cli_server_add(cli_server_t *srv, int fd) {
+  size_t mem_len = srv->config ? cli_mem_size(srv->config) : 0;
+  cli_session_t *s = NULL;
+
+  // Only the epoll backend uses non blocking sockets
+  int flags = fcntl(fd, F_GETFL);
+  flags = srv->uring != NULL ? flags & ~O_NONBLOCK : flags | O_NONBLOCK;
+  // A closed session keeps its input buffer until its reads complete
+  if (srv->count < srv->max_sessions &&
+      (srv->uring == NULL || srv->uring->num_free > 0) && flags >= 0 &&
+      fcntl(fd, F_SETFL, flags) == 0) {
+    s = calloc(1, sizeof(*s) + mem_len);
+  }
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = s};
+  if (s == NULL || cli_session_init(srv, s, mem_len) < 0 ||
+      (srv->uring == NULL &&
+       epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)) {
+    free(s);
+    close(fd);
+    return NULL;
+  }
+
+  s->fd = fd;
+  s->server = srv;
+  s->slot = srv->count;
+  srv->sessions[srv->count++] = s;
+  if (srv->uring != NULL) {
+    s->buf_idx = srv->uring->free_bufs[--srv->uring->num_free];
+  }
+
+  cli_set_ops(&s->cli, &cli_session_ops, s);
+
+  if (srv->telnet) {
+    // Every keystroke is a segment in character mode
+    int one = 1;
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    cli_telnet_init(&s->telnet, cli_session_telnet_data, cli_session_append,
+                    s);
+    cli_telnet_start(&s->telnet);
+  }
+
+  if (srv->on_open) {
+    srv->on_open(s);
+  }
+
+  cli_print_prompt(&s->cli);
+  return cli_session_update(s) ? s : NULL;
+}
+
+int cli_server_poll(cli_server_t *srv, int timeout_ms) {
+  struct epoll_event events[CLI_SERVER_EVENTS];
+
+  if (srv->uring != NULL) {
+    return cli_server_uring_poll(srv, timeout_ms);
+  }
+
+  int n = epoll_wait(srv->epfd, events, CLI_SERVER_EVENTS, timeout_ms);
+  if (n < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    void *ptr = events[i].data.ptr;
+    uint32_t mask = events[i].events;
+
+    if (ptr == &srv->listen_fd) {
+      cli_server_accept(srv);
+    } else if (ptr == &srv->wake_fd) {
+      uint64_t value;
+      (void)read(srv->wake_fd, &value, sizeof(value));
+      cli_server_drain_handoff(srv);
+    } else {
+      cli_session_t *s = ptr;
+      if (mask & EPOLLIN) {
+        cli_session_read(s);
+      } else if (mask & (EPOLLERR | EPOLLHUP)) {
+        cli_session_abort(s);
+      } else {
+        ; // EPOLLOUT, the pending output is sent below
+      }
+      (void)cli_session_update(s);
+    }
+  }
+  return n;
+}
+
+int cli_server_run(cli_server_t *srv) {
+  while (!__atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE)) {
+    if (cli_server_poll(srv, -1) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void cli_server_stop(cli_server_t *srv) {
+  uint64_t one = 1;
+
+  __atomic_store_n(&srv->stop, true, __ATOMIC_RELEASE);
+  (void)write(srv->wake_fd, &one, sizeof(one));
+}
+
+void cli_server_close(cli_server_t *srv) {
+  // Connections handed off but never opened
+  while (srv->handoff.tail != srv->handoff.head) {
+    close(srv->handoff.fds[srv->handoff.tail++ % CLI_SERVER_HANDOFF_NUM]);
+  }
+
+  while (srv->count > 0) {
+    cli_session_close(srv->sessions[srv->count - 1]);
+  }
+  if (srv->uring != NULL) {
+    cli_server_uring_close(srv);
+  }
+  free(srv->sessions);
+  srv->sessions = NULL;
+
+  if (srv->listen_fd >= 0) {
+    close(srv->listen_fd);
+    srv->listen_fd = -1;
+  }
+  if (srv->wake_fd >= 0) {
+    close(srv->wake_fd);
+    srv->wake_fd = -1;
+  }
+  if (srv->epfd >= 0) {
+    close(srv->epfd);
+    srv->epfd = -1;
+  }
+}
@@ -0,0 +1,248 @@
+/**
+ * @file server.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Reactor hosting many command line interpreter sessions over sockets
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_SERVER_H
+#define _CLI_SERVER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lib/cli.h"
+#include "telnet.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CLI_SERVER_READ_MAX
+#define CLI_SERVER_READ_MAX (4096) /**< Bytes read from a socket at once */
+#endif
+
+#ifndef CLI_SERVER_OUT_FLUSH
+#define CLI_SERVER_OUT_FLUSH (4096) /**< Buffered output sent during a pass */
+#endif
+
+#ifndef CLI_SERVER_OUT_MAX
+#define CLI_SERVER_OUT_MAX (64 * 1024) /**< Output kept for a slow client */
+#endif
+
+#ifndef CLI_SERVER_EVENTS
+#define CLI_SERVER_EVENTS (64) /**< Events handled per reactor pass */
+#endif
+
+#ifndef CLI_SERVER_URING_READ
+#define CLI_SERVER_URING_READ (512) /**< io_uring input buffer per session */
+#endif
+
+#ifndef CLI_SERVER_HANDOFF_NUM
+#define CLI_SERVER_HANDOFF_NUM (256) /**< Connections queued for a reactor */
+#endif
+
+/**
+ * @brief Definition of the I/O backends of a reactor
+ *
+ */
+typedef enum cli_server_backend_e {
+  CLI_SERVER_BACKEND_AUTO,  /**< io_uring if available, epoll otherwise */
+  CLI_SERVER_BACKEND_EPOLL, /**< epoll readiness and non blocking sockets */
+  CLI_SERVER_BACKEND_URING, /**< io_uring completions, Linux 5.11 or later */
+} cli_server_backend_t;
+
+typedef struct cli_server_s cli_server_t;
+
+/**
+ * @brief Definition of a session. One command line interpreter per connection
+ *
+ */
+typedef struct cli_session_s {
+  cli_t cli;            /**< command line interpreter of the connection */
+  int fd;               /**< connected socket */
+  size_t slot;          /**< internal index in the sessions table */
+  bool closing;         /**< close once the pending output is sent */
+  bool failed;          /**< internal, close without sending the output */
+  bool blocked;         /**< internal, waiting for the socket to drain */
+  char *out;            /**< internal buffered output */
+  size_t out_len;       /**< internal number of buffered bytes */
+  size_t out_cap;       /**< internal capacity of the output buffer */
+  char *tx;             /**< internal io_uring output in flight */
+  size_t tx_len;        /**< internal number of bytes in flight */
+  size_t tx_off;        /**< internal number of bytes in flight sent */
+  size_t tx_cap;        /**< internal capacity of the output in flight */
+  size_t buf_idx;       /**< internal io_uring input buffer */
+  unsigned inflight;    /**< internal io_uring operations in flight */
+  bool reading;         /**< internal io_uring read in flight */
+  bool closed;          /**< internal, waiting for the last completion */
+  cli_telnet_t telnet;  /**< telnet state if the server speaks telnet */
+  cli_server_t *server; /**< owning server */
+} cli_session_t;
+
+/**
+ * @brief Definition of the server struct
+ *
+ */
+struct cli_server_s {
+  cli_server_backend_t backend;     /**< I/O backend in use */
+  struct cli_server_uring_s *uring; /**< internal io_uring backend state */
+  int epfd;                         /**< internal epoll instance */
+  int listen_fd;                    /**< listening socket. -1 if none */
+  int wake_fd;              /**< internal eventfd used by cli_server_stop */
+  volatile bool stop;       /**< request the reactor to return */
+  cli_session_t **sessions; /**< table of open sessions */
+  size_t count;             /**< number of open sessions */
+  size_t max_sessions;      /**< capacity of the sessions table */
+  const cli_cmd_list_t *cmd_list; /**< commands list shared by all sessions */
+  void (*on_open)(cli_session_t *session); /**< optional, called before the
+                                              first prompt of a session */
+  bool telnet; /**< sessions speak the telnet protocol see \link
+                  cli_telnet_t \endlink. Set it before opening sessions */
+  const cli_config_t *config; /**< optional sizes of the sessions buffers see
+                                 \link cli_init_ex \endlink. NULL for the
+                                 defaults. Set it before opening sessions */
+  struct {
+    int fds[CLI_SERVER_HANDOFF_NUM]; /**< connections handed off */
+    size_t head; /**< written by the handing off thread only */
+    size_t tail; /**< written by the reactor only */
+  } handoff;     /**< internal single producer queue see \link
+                    cli_server_handoff \endlink */
+  cli_server_t *peers; /**< optional reactors accepted connections are spread
+                          over. This reactor included */
+  size_t num_peers;    /**< number of peers */
+  size_t next_peer;    /**< internal round robin index */
+};
+
+/**
+ * @brief Initialize the server with the epoll backend
+ *
+ * @param srv the server struct
+ * @param cmd_list the commands list of every session
+ * @param max_sessions the maximum number of concurrent sessions
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_init(cli_server_t *srv, const cli_cmd_list_t *cmd_list,
+                    size_t max_sessions);
+
+/**
+ * @brief Initialize the server with the given I/O backend. With
+ * CLI_SERVER_BACKEND_AUTO io_uring is used if the kernel supports it and epoll
+ * otherwise. The backend in use is stored in the backend field
+ *
+ * @param srv the server struct
+ * @param cmd_list the commands list of every session
+ * @param max_sessions the maximum number of concurrent sessions
+ * @param backend the I/O backend
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_init_backend(cli_server_t *srv, const cli_cmd_list_t *cmd_list,
+                            size_t max_sessions, cli_server_backend_t backend);
+
+/**
+ * @brief Listen for connections on a Unix stream socket. An existing socket
+ * file is replaced
+ *
+ * @param srv the server struct
+ * @param path the socket path
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_listen(cli_server_t *srv, const char *path);
+
+/**
+ * @brief Listen for connections on a TCP socket, typically with telnet set
+ *
+ * @param srv the server struct
+ * @param addr the IPv4 address to bind, e.g. "127.0.0.1" or "0.0.0.0"
+ * @param port the TCP port
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_server_listen_tcp(cli_server_t *srv, const char *addr, uint16_t port);
+
+/**
+ * @brief Open a session on a connected socket. The server owns the socket
+ * afterwards, also on failure
+ *
+ * @param srv the server struct
+ * @param fd the connected socket
+ * @return cli_session_t* the new session. NULL if the server is full or on
+ * error. With io_uring a closed session counts until its operations in flight
+ * complete
+ */
+cli_session_t *cli_server_add(cli_server_t *srv, int fd);
+
+/**
+ * @brief Hand a connected socket off to a reactor running on another thread.
+ * The reactor opens the session on its next pass. Only one thread may hand
+ * sockets off to a given reactor. The reactor owns the socket afterwards, also
+ * on failure
+ *
+ * @param srv the server struct of the reactor
+ * @param fd the connected socket
+ * @return int 0 on success, -1 if the queue is full
+ */
+int cli_server_handoff(cli_server_t *srv, int fd);
+
+/**
+ * @brief Run one reactor pass: wait for events, accept connections and feed
+ * the received bytes to the sessions
+ *
+ * @param srv the server struct
+ * @param timeout_ms maximum time to wait in ms. -1 waits forever
+ * @return int number of handled events, -1 on error with errno set
+ */
+int cli_server_poll(cli_server_t *srv, int timeout_ms);
+
+/**
+ * @brief Run reactor passes until \link cli_server_stop \endlink is called
+ *
+ * @param srv the server struct
+ * @return int 0 on stop, -1 on error with errno set
+ */
+int cli_server_run(cli_server_t *srv);
+
+/**
+ * @brief Request \link cli_server_run \endlink to return. It is safe to call
+ * from any thread or from a signal handler
+ *
+ * @param srv the server struct
+ */
+void cli_server_stop(cli_server_t *srv);
+
+/**
+ * @brief Close all sessions and release the server resources
+ *
+ * @param srv the server struct
+ */
+void cli_server_close(cli_server_t *srv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_SERVER_H */
@@ -0,0 +1,228 @@
+/**
+ * @file shm.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Command line interpreter hosted over shared memory
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Everything a client sees is captured by cli_exec
+static size_t cli_shm_host_write(void *ctx, const void *ptr, size_t size) {
+  (void)ctx;
+  (void)ptr;
+  return size;
+}
+
+static int cli_shm_host_flush(void *ctx) {
+  (void)ctx;
+  return 0;
+}
+
+// The client detaches on its own
+static void cli_shm_host_quit(void *ctx) { (void)ctx; }
+
+static const cli_ops_t cli_shm_host_ops = {
+    .write = cli_shm_host_write,
+    .flush = cli_shm_host_flush,
+    .quit = cli_shm_host_quit,
+};
+
+static uint64_t cli_shm_host_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+int cli_shm_host_init(cli_shm_host_t *host, const cli_cmd_list_t *cmd_list,
+                      const char *name) {
+  if (strlen(name) >= sizeof(host->name)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  (void)shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+  // The new object is zero filled
+  if (ftruncate(fd, CLI_SHM_REGION_SIZE) < 0) {
+    close(fd);
+    (void)shm_unlink(name);
+    return -1;
+  }
+  host->region = mmap(NULL, CLI_SHM_REGION_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  close(fd);
+  if (host->region == MAP_FAILED) {
+    (void)shm_unlink(name);
+    return -1;
+  }
+
+  strcpy(host->name, name);
+  host->stop = false;
+  host->epoch = 0;
+  host->seq = 0;
+  host->line_len = 0;
+  host->overflow = false;
+  cli_init(&host->cli, cmd_list);
+  cli_set_ops(&host->cli, &cli_shm_host_ops, host);
+  cli_shm_region_init(host->region);
+  (void)cli_shm_end_init(&host->req, host->region, &host->region->req, false);
+  (void)cli_shm_end_init(&host->rsp, host->region, &host->region->rsp, true);
+  return 0;
+}
+
+/**
+ * @brief Publish the reply at once. It is dropped if the client does not make
+ * room for it within \link CLI_SHM_STALL_MS \endlink
+ *
+ */
+static void cli_shm_host_reply(cli_shm_host_t *host, int status, size_t len) {
+  cli_shm_region_t *region = host->region;
+  cli_shm_reply_t reply = {host->epoch, host->seq, status, (uint32_t)len};
+  size_t size = sizeof(reply) + len;
+  uint64_t deadline = cli_shm_host_now_ms() + CLI_SHM_STALL_MS;
+
+  memcpy(host->reply, &reply, sizeof(reply));
+  for (;;) {
+    uint32_t seq = cli_shm_ring_seq(&region->rsp);
+    if (cli_shm_ring_space(&host->rsp) >= size) {
+      (void)cli_shm_ring_write(&host->rsp, host->reply, size);
+      return;
+    }
+
+    uint64_t now = cli_shm_host_now_ms();
+    if (now >= deadline || __atomic_load_n(&host->stop, __ATOMIC_ACQUIRE) ||
+        __atomic_load_n(&region->client, __ATOMIC_ACQUIRE) == 0) {
+      return;
+    }
+    cli_shm_ring_wait(&region->rsp, seq, (int)(deadline - now));
+  }
+}
+
+static void cli_shm_host_exec(cli_shm_host_t *host) {
+  char *out = host->reply + sizeof(cli_shm_reply_t);
+  int status = CLI_ERR_LINE_MAX;
+  size_t len = 0;
+
+  host->seq++;
+  if (!host->overflow) {
+    host->line[host->line_len] = '\0';
+    len = cli_exec(&host->cli, host->line, out, CLI_SHM_OUT_MAX + 1, &status);
+    len = len < CLI_SHM_OUT_MAX ? len : CLI_SHM_OUT_MAX;
+  }
+  host->line_len = 0;
+  host->overflow = false;
+  cli_shm_host_reply(host, status, len);
+}
+
+/**
+ * @brief Split the received bytes into lines
+ *
+ * @return int number of command lines run
+ */
+static int cli_shm_host_input(cli_shm_host_t *host, const char *buf,
+                              size_t len) {
+  int count = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    switch (buf[i]) {
+    case CLI_SHM_CAN:
+      // A client that did not get its CLI_SHM_CAN through still counts
+      host->epoch = __atomic_load_n(&host->region->attaches, __ATOMIC_ACQUIRE);
+      host->seq = 0;
+      host->line_len = 0;
+      host->overflow = false;
+      break;
+    case '\r':
+      break;
+    case '\n':
+      cli_shm_host_exec(host);
+      count++;
+      break;
+    default:
+      if (host->line_len + 1 < sizeof(host->line)) {
+        host->line[host->line_len++] = buf[i];
+      } else {
+        host->overflow = true;
+      }
+      break;
+    }
+  }
+  return count;
+}
+
+int cli_shm_host_poll(cli_shm_host_t *host, int timeout_ms) {
+  cli_shm_region_t *region = host->region;
+  char buf[256];
+  int count = 0;
+
+  uint32_t seq = cli_shm_ring_seq(&region->req);
+  size_t n = cli_shm_ring_read(&host->req, buf, sizeof(buf));
+  if (n == 0 && timeout_ms != 0 &&
+      !__atomic_load_n(&host->stop, __ATOMIC_ACQUIRE)) {
+    cli_shm_ring_wait(&region->req, seq, timeout_ms);
+    n = cli_shm_ring_read(&host->req, buf, sizeof(buf));
+  }
+
+  while (n > 0) {
+    count += cli_shm_host_input(host, buf, n);
+    n = cli_shm_ring_read(&host->req, buf, sizeof(buf));
+  }
+  return count;
+}
+
+void cli_shm_host_run(cli_shm_host_t *host) {
+  while (!__atomic_load_n(&host->stop, __ATOMIC_ACQUIRE)) {
+    (void)cli_shm_host_poll(host, -1);
+  }
+}
+
+void cli_shm_host_stop(cli_shm_host_t *host) {
+  __atomic_store_n(&host->stop, true, __ATOMIC_RELEASE);
+  // A moved futex word wakes a host about to sleep as well
+  __atomic_add_fetch(&host->region->req.seq, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&host->region->rsp.seq, 1, __ATOMIC_SEQ_CST);
+  cli_shm_ring_wake(&host->region->req);
+  cli_shm_ring_wake(&host->region->rsp);
+}
+
+void cli_shm_host_close(cli_shm_host_t *host) {
+  munmap(host->region, CLI_SHM_REGION_SIZE);
+  (void)shm_unlink(host->name);
+}
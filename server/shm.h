@@ -0,0 +1,126 @@
+/**
+ * @file shm.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Command line interpreter hosted over shared memory
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_SHM_H
+#define _CLI_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lib/cli.h"
+#include "shm_ring.h"
+
+#include <limits.h>
+#include <stdbool.h>
+
+#ifndef CLI_SHM_STALL_MS
+#define CLI_SHM_STALL_MS (1000) /**< Wait for a client reading no reply */
+#endif
+
+/**
+ * @brief Output of a command sent to the client. A reply is published at once
+ * so it fits in the response ring
+ *
+ */
+#define CLI_SHM_OUT_MAX (CLI_SHM_RING_SIZE - 1 - sizeof(cli_shm_reply_t))
+
+/**
+ * @brief Definition of the host struct. It serves one client at a time over a
+ * region of \link CLI_SHM_REGION_SIZE \endlink bytes
+ *
+ */
+typedef struct cli_shm_host_s {
+  cli_t cli;                /**< command line interpreter of the clients */
+  cli_shm_region_t *region; /**< mapped region shared with the client */
+  cli_shm_end_t req;        /**< internal consumer end of the requests */
+  cli_shm_end_t rsp;        /**< internal producer end of the replies */
+  char name[NAME_MAX];      /**< POSIX shared memory object name */
+  volatile bool stop;       /**< request the host to return */
+  uint32_t epoch;           /**< internal attach number of the client */
+  uint32_t seq;             /**< internal number of command lines received */
+  char line[CLI_LINE_MAX];  /**< internal line being received */
+  size_t line_len;          /**< internal length of the line */
+  bool overflow;            /**< internal, the line exceeds CLI_LINE_MAX */
+  char reply[CLI_SHM_RING_SIZE]; /**< internal reply, its output and a NULL */
+} cli_shm_host_t;
+
+/**
+ * @brief Create the shared memory object and initialize the host. An existing
+ * object with the same name is replaced
+ *
+ * @param host the host struct
+ * @param cmd_list the commands list
+ * @param name the POSIX shared memory object name, e.g. "/ucli"
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_shm_host_init(cli_shm_host_t *host, const cli_cmd_list_t *cmd_list,
+                      const char *name);
+
+/**
+ * @brief Run the command lines received from the client, each one with \link
+ * cli_exec \endlink, and publish their replies
+ *
+ * @param host the host struct
+ * @param timeout_ms maximum time to wait for a command line in ms. -1 waits
+ * forever
+ * @return int number of command lines run
+ */
+int cli_shm_host_poll(cli_shm_host_t *host, int timeout_ms);
+
+/**
+ * @brief Serve the clients until \link cli_shm_host_stop \endlink is called
+ *
+ * @param host the host struct
+ */
+void cli_shm_host_run(cli_shm_host_t *host);
+
+/**
+ * @brief Request \link cli_shm_host_run \endlink to return. It is safe to call
+ * from any thread or from a signal handler
+ *
+ * @param host the host struct
+ */
+void cli_shm_host_stop(cli_shm_host_t *host);
+
+/**
+ * @brief Unmap and remove the shared memory object. An attached client times
+ * out
+ *
+ * @param host the host struct
+ */
+void cli_shm_host_close(cli_shm_host_t *host);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_SHM_H */
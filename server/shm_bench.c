@@ -0,0 +1,268 @@
+/**
+ * @file shm_bench.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Latency of the shared memory transport against the Unix socket
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "shm.h"
+#include "shm_client.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct result_s {
+  double p50_us;
+  double p99_us;
+  double rate;
+} result_t;
+
+static cli_shm_host_t host;
+
+static int cmd_ping_handler(cli_t *cli, int argc, char **argv) {
+  (void)cli;
+  (void)argc;
+  (void)argv;
+  return 0;
+}
+
+static const cli_cmd_t bench_cmds[] = {
+    {.name = "ping", .desc = "Do nothing", .handler = cmd_ping_handler},
+};
+
+static const cli_cmd_list_t bench_cmd_list = {
+    .cmds = bench_cmds,
+    .cmds_length = ARRAY_SIZE(bench_cmds),
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void result_compute(uint64_t *samples, size_t count, uint64_t elapsed,
+                           result_t *res) {
+  qsort(samples, count, sizeof(*samples), cmp_u64);
+  res->p50_us = (double)samples[count / 2] / 1e3;
+  res->p99_us = (double)samples[count * 99 / 100] / 1e3;
+  res->rate = (double)count * 1e9 / (double)elapsed;
+}
+
+static void *host_thread(void *arg) {
+  cli_shm_host_run(arg);
+  return NULL;
+}
+
+static void on_signal(int sig) {
+  (void)sig;
+  cli_shm_host_stop(&host);
+}
+
+/**
+ * @brief Serve both transports until SIGTERM, in the child process
+ *
+ */
+static int serve(const char *name, const char *path) {
+  cli_server_t srv;
+  pthread_t thread;
+
+  if (cli_shm_host_init(&host, &bench_cmd_list, name) < 0) {
+    perror("cli_shm_host_init");
+    return 1;
+  }
+  if (cli_server_init(&srv, &bench_cmd_list, 1) < 0 ||
+      cli_server_listen(&srv, path) < 0 ||
+      pthread_create(&thread, NULL, host_thread, &host) != 0) {
+    perror("cli_server");
+    cli_shm_host_close(&host);
+    return 1;
+  }
+  signal(SIGTERM, on_signal);
+
+  while (!__atomic_load_n(&host.stop, __ATOMIC_ACQUIRE)) {
+    (void)cli_server_poll(&srv, 100);
+  }
+  pthread_join(thread, NULL);
+  cli_server_close(&srv);
+  cli_shm_host_close(&host);
+  (void)unlink(path);
+  return 0;
+}
+
+static int bench_shm(const char *name, uint64_t *samples, size_t total,
+                     result_t *res) {
+  cli_shm_client_t client;
+  int status;
+
+  // The host may not be ready yet
+  for (int i = 0; cli_shm_client_open(&client, name) < 0; i++) {
+    if ((errno != ENOENT && errno != EPROTO) || i == 1000) {
+      perror("cli_shm_client_open");
+      return -1;
+    }
+    usleep(1000);
+  }
+
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < total; i++) {
+    uint64_t t0 = now_ns();
+    if (cli_shm_client_exec(&client, "ping", NULL, 0, &status, 5000) < 0 ||
+        status != CLI_OK) {
+      perror("cli_shm_client_exec");
+      cli_shm_client_close(&client);
+      return -1;
+    }
+    samples[i] = now_ns() - t0;
+  }
+  result_compute(samples, total, now_ns() - start, res);
+  cli_shm_client_close(&client);
+  return 0;
+}
+
+// Reads until the prompt
+static int recv_prompt(int fd) {
+  char buf[256];
+  char last = 0;
+
+  for (;;) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      return -1;
+    }
+    if ((n >= 2 && buf[n - 2] == '>' && buf[n - 1] == ' ') ||
+        (n == 1 && last == '>' && buf[0] == ' ')) {
+      return 0;
+    }
+    last = buf[n - 1];
+  }
+}
+
+static int bench_socket(const char *path, uint64_t *samples, size_t total,
+                        result_t *res) {
+  static const char cmd[] = "ping\r\n";
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  int ret = -1;
+
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      recv_prompt(fd) < 0) {
+    perror("connect");
+    goto out;
+  }
+
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < total; i++) {
+    uint64_t t0 = now_ns();
+    if (write(fd, cmd, sizeof(cmd) - 1) != sizeof(cmd) - 1 ||
+        recv_prompt(fd) < 0) {
+      perror("session");
+      goto out;
+    }
+    samples[i] = now_ns() - t0;
+  }
+  result_compute(samples, total, now_ns() - start, res);
+  ret = 0;
+
+out:
+  if (fd >= 0) {
+    close(fd);
+  }
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  size_t total = 100000;
+  char name[64];
+  char path[64];
+  result_t res[2];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:h")) != -1) {
+    if (opt == 'n' && (total = strtoul(optarg, NULL, 0)) > 0) {
+      continue;
+    }
+    fprintf(stderr,
+            "usage: %s [-n COMMANDS]\n"
+            "  -n COMMANDS  round trips per transport (default 100000)\n",
+            argv[0]);
+    return opt == 'h' ? 0 : 1;
+  }
+
+  snprintf(name, sizeof(name), "/ucli_shm_bench.%d", (int)getpid());
+  snprintf(path, sizeof(path), "/tmp/ucli_shm_bench.%d.sock", (int)getpid());
+
+  // The host runs in another process, like the daemons it serves
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return 1;
+  }
+  if (pid == 0) {
+    return serve(name, path);
+  }
+
+  uint64_t *samples = malloc(total * sizeof(*samples));
+  int ret = samples != NULL && bench_shm(name, samples, total, &res[0]) == 0 &&
+                    bench_socket(path, samples, total, &res[1]) == 0
+                ? 0
+                : 1;
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  free(samples);
+
+  if (ret == 0) {
+    printf("%12s %10s %12s %12s %14s\n", "transport", "commands", "p50 (us)",
+           "p99 (us)", "commands/s");
+    printf("%12s %10zu %12.1f %12.1f %14.0f\n", "shm", total, res[0].p50_us,
+           res[0].p99_us, res[0].rate);
+    printf("%12s %10zu %12.1f %12.1f %14.0f\n", "unix socket", total,
+           res[1].p50_us, res[1].p99_us, res[1].rate);
+  }
+  return ret;
+}
@@ -0,0 +1,242 @@
+/**
+ * @file shm_client.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Client of a command line interpreter hosted over shared memory
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "shm_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CLI_SHM_ATTACH_MS (1000) /**< Wait for the host to drain requests */
+
+static uint64_t cli_shm_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static uint64_t cli_shm_deadline(int timeout_ms) {
+  return timeout_ms < 0 ? UINT64_MAX : cli_shm_now_ms() + (uint64_t)timeout_ms;
+}
+
+/**
+ * @brief Sleep until a position of the ring moves or the deadline expires
+ *
+ * @return int 0 on wake up, -1 with errno set to ETIMEDOUT on expiry
+ */
+static int cli_shm_client_wait(cli_shm_ring_t *ring, uint32_t seq,
+                               uint64_t deadline) {
+  uint64_t now = cli_shm_now_ms();
+
+  if (deadline == UINT64_MAX) {
+    cli_shm_ring_wait(ring, seq, -1);
+    return 0;
+  }
+  if (now >= deadline) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  cli_shm_ring_wait(ring, seq, (int)(deadline - now));
+  return 0;
+}
+
+/**
+ * @brief Write all the bytes at once, so that the host never sees a part of
+ * them
+ *
+ */
+static int cli_shm_client_send(cli_shm_client_t *client, const void *ptr,
+                               size_t size, uint64_t deadline) {
+  cli_shm_region_t *region = client->region;
+
+  for (;;) {
+    uint32_t seq = cli_shm_ring_seq(&region->req);
+    if (cli_shm_ring_space(&client->req) >= size) {
+      break;
+    }
+    if (cli_shm_client_wait(&region->req, seq, deadline) < 0) {
+      return -1;
+    }
+  }
+  (void)cli_shm_ring_write(&client->req, ptr, size);
+  return 0;
+}
+
+/**
+ * @brief Take the region over, either free or left by a client that exited
+ *
+ */
+static bool cli_shm_client_attach(cli_shm_region_t *region) {
+  int32_t self = (int32_t)getpid();
+  int32_t owner = 0;
+
+  if (__atomic_compare_exchange_n(&region->client, &owner, self, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return true;
+  }
+  if (owner == self || kill(owner, 0) == 0 || errno != ESRCH) {
+    return false;
+  }
+  return __atomic_compare_exchange_n(&region->client, &owner, self, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+int cli_shm_client_open(cli_shm_client_t *client, const char *name) {
+  static const uint8_t can = CLI_SHM_CAN;
+  cli_shm_region_t *region;
+  struct stat st;
+
+  int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if ((size_t)st.st_size < CLI_SHM_REGION_SIZE) {
+    close(fd);
+    errno = EPROTO;
+    return -1;
+  }
+  region = mmap(NULL, CLI_SHM_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    return -1;
+  }
+  if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != CLI_SHM_MAGIC ||
+      region->size != CLI_SHM_REGION_SIZE) {
+    munmap(region, CLI_SHM_REGION_SIZE);
+    errno = EPROTO;
+    return -1;
+  }
+  if (!cli_shm_client_attach(region)) {
+    munmap(region, CLI_SHM_REGION_SIZE);
+    errno = EBUSY;
+    return -1;
+  }
+
+  // Positions left by the previous client are taken over if in the rings
+  if (cli_shm_end_init(&client->req, region, &region->req, true) < 0 ||
+      cli_shm_end_init(&client->rsp, region, &region->rsp, false) < 0) {
+    __atomic_store_n(&region->client, 0, __ATOMIC_RELEASE);
+    munmap(region, CLI_SHM_REGION_SIZE);
+    errno = EPROTO;
+    return -1;
+  }
+  client->region = region;
+  client->epoch = __atomic_add_fetch(&region->attaches, 1, __ATOMIC_ACQ_REL);
+  client->seq = 0;
+
+  // Replies to the previous client are not wanted
+  while (cli_shm_ring_read(&client->rsp, NULL, SIZE_MAX) > 0) {
+  }
+  if (cli_shm_client_send(client, &can, 1,
+                          cli_shm_deadline(CLI_SHM_ATTACH_MS)) < 0) {
+    cli_shm_client_close(client);
+    return -1;
+  }
+  return 0;
+}
+
+int cli_shm_client_exec(cli_shm_client_t *client, const char *line,
+                        char *out_buf, size_t out_cap, int *status,
+                        int timeout_ms) {
+  cli_shm_region_t *region = client->region;
+  uint64_t deadline = cli_shm_deadline(timeout_ms);
+  size_t len = strlen(line);
+  char buf[CLI_SHM_RING_SIZE];
+
+  if (len + 1 >= CLI_SHM_RING_SIZE) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (memchr(line, '\r', len) != NULL || memchr(line, '\n', len) != NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(buf, line, len);
+  buf[len] = '\n';
+  if (cli_shm_client_send(client, buf, len + 1, deadline) < 0) {
+    return -1;
+  }
+  client->seq++;
+
+  for (;;) {
+    cli_shm_reply_t reply;
+    uint32_t seq = cli_shm_ring_seq(&region->rsp);
+
+    if (cli_shm_ring_size(&client->rsp) < sizeof(reply)) {
+      if (cli_shm_client_wait(&region->rsp, seq, deadline) < 0) {
+        return -1;
+      }
+      continue;
+    }
+
+    // The host publishes a reply at once, its output is there as well
+    (void)cli_shm_ring_read(&client->rsp, &reply, sizeof(reply));
+    if (reply.epoch != client->epoch || reply.seq != client->seq) {
+      (void)cli_shm_ring_read(&client->rsp, NULL, reply.len);
+      continue;
+    }
+
+    size_t n = 0;
+    if (out_cap > 0) {
+      n = reply.len < out_cap ? reply.len : out_cap - 1;
+      (void)cli_shm_ring_read(&client->rsp, out_buf, n);
+      out_buf[n] = '\0';
+    }
+    (void)cli_shm_ring_read(&client->rsp, NULL, reply.len - n);
+    if (status != NULL) {
+      *status = reply.status;
+    }
+    return (int)reply.len;
+  }
+}
+
+void cli_shm_client_close(cli_shm_client_t *client) {
+  if (client->region == NULL) {
+    return;
+  }
+  __atomic_store_n(&client->region->client, 0, __ATOMIC_RELEASE);
+  munmap(client->region, CLI_SHM_REGION_SIZE);
+  client->region = NULL;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file shm_client.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Client of a command line interpreter hosted over shared memory
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_SHM_CLIENT_H
+#define _CLI_SHM_CLIENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "shm_ring.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Definition of the client struct
+ *
+ */
+typedef struct cli_shm_client_s {
+  cli_shm_region_t *region; /**< mapped region shared with the host */
+  cli_shm_end_t req;        /**< internal producer end of the requests */
+  cli_shm_end_t rsp;        /**< internal consumer end of the replies */
+  uint32_t epoch;           /**< internal attach number of this client */
+  uint32_t seq;             /**< internal number of command lines sent */
+} cli_shm_client_t;
+
+/**
+ * @brief Attach to the region of a \link cli_shm_host_t \endlink. A single
+ * client may be attached at a time. The region of a client that exited
+ * without \link cli_shm_client_close \endlink is taken over
+ *
+ * @param client the client struct
+ * @param name the POSIX shared memory object name, e.g. "/ucli"
+ * @return int 0 on success, -1 on error with errno set. EBUSY if another
+ * client is attached
+ */
+int cli_shm_client_open(cli_shm_client_t *client, const char *name);
+
+/**
+ * @brief Run a command line on the host and get its output. No system call is
+ * made unless one side has to sleep. A reply arriving after its timeout is
+ * skipped by the next call
+ *
+ * @param client the client struct
+ * @param line the NULL terminated command line without CR or LF
+ * @param out_buf buffer receiving the NULL terminated output of the command.
+ * May be NULL if out_cap is 0
+ * @param out_cap out_buf capacity
+ * @param status if not NULL receives CLI_OK or a CLI_ERR_ status
+ * @param timeout_ms maximum time to wait for the reply in ms. -1 waits forever
+ * @return int length of the whole output, -1 on error with errno set.
+ * ETIMEDOUT if the host did not reply in time
+ */
+int cli_shm_client_exec(cli_shm_client_t *client, const char *line,
+                        char *out_buf, size_t out_cap, int *status,
+                        int timeout_ms);
+
+/**
+ * @brief Detach from the host and unmap the region
+ *
+ * @param client the client struct
+ */
+void cli_shm_client_close(cli_shm_client_t *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_SHM_CLIENT_H */
@@ -0,0 +1,184 @@
+/**
+ * @file shm_ring.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Single producer single consumer rings shared between processes
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "shm_ring.h"
+#include "lib/ringbuffer.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Map a shared ring on a process local ringbuffer_t. Only the position
+ * of the peer is loaded from the region
+ *
+ * @return false if the peer position is out of the ring
+ */
+static bool cli_shm_ring_view(const cli_shm_end_t *end, ringbuffer_t *rb) {
+  uint32_t *peer = end->producer ? &end->ring->rd_pos : &end->ring->wr_pos;
+  uint32_t pos = __atomic_load_n(peer, __ATOMIC_ACQUIRE);
+
+  if (pos >= end->capacity) {
+    return false;
+  }
+  ringbuffer_wrap(rb, end->data, end->capacity);
+  rb->wr_pos = end->producer ? end->pos : pos;
+  rb->rd_pos = end->producer ? pos : end->pos;
+  return true;
+}
+
+static void cli_shm_ring_publish(cli_shm_end_t *end, size_t value) {
+  cli_shm_ring_t *ring = end->ring;
+
+  end->pos = (uint32_t)value;
+  __atomic_store_n(end->producer ? &ring->wr_pos : &ring->rd_pos, end->pos,
+                   __ATOMIC_RELEASE);
+  // Orders the position store before reading waiters, see cli_shm_ring_wait
+  __atomic_add_fetch(&ring->seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->waiters, __ATOMIC_SEQ_CST) != 0) {
+    cli_shm_ring_wake(ring);
+  }
+}
+
+void cli_shm_region_init(cli_shm_region_t *region) {
+  region->size = CLI_SHM_REGION_SIZE;
+  region->req.capacity = CLI_SHM_RING_SIZE;
+  region->req.offset = sizeof(*region);
+  region->rsp.capacity = CLI_SHM_RING_SIZE;
+  region->rsp.offset = sizeof(*region) + CLI_SHM_RING_SIZE;
+  __atomic_store_n(&region->magic, CLI_SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+int cli_shm_end_init(cli_shm_end_t *end, cli_shm_region_t *region,
+                     cli_shm_ring_t *ring, bool producer) {
+  // The layout of cli_shm_region_init, whatever the region holds now
+  size_t offset = sizeof(*region);
+  uint32_t *own = producer ? &ring->wr_pos : &ring->rd_pos;
+
+  if (ring == &region->rsp) {
+    offset += CLI_SHM_RING_SIZE;
+  }
+  end->ring = ring;
+  end->data = (uint8_t *)region + offset;
+  end->capacity = CLI_SHM_RING_SIZE;
+  end->producer = producer;
+  end->pos = __atomic_load_n(own, __ATOMIC_ACQUIRE);
+  if (end->pos >= end->capacity) {
+    end->pos = 0;
+    return -1;
+  }
+  return 0;
+}
+
+size_t cli_shm_ring_write(cli_shm_end_t *end, const void *ptr, size_t size) {
+  const uint8_t *src = ptr;
+  ringbuffer_t rb;
+  size_t n = 0;
+
+  if (!cli_shm_ring_view(end, &rb)) {
+    return 0;
+  }
+  while (n < size && ringbuffer_put(&rb, src[n]) == 0) {
+    n++;
+  }
+  if (n > 0) {
+    cli_shm_ring_publish(end, rb.wr_pos);
+  }
+  return n;
+}
+
+size_t cli_shm_ring_read(cli_shm_end_t *end, void *ptr, size_t size) {
+  uint8_t *dst = ptr;
+  ringbuffer_t rb;
+  uint8_t u8;
+  size_t n = 0;
+
+  if (!cli_shm_ring_view(end, &rb)) {
+    return 0;
+  }
+  while (n < size && ringbuffer_get(&rb, &u8) == 0) {
+    if (dst != NULL) {
+      dst[n] = u8;
+    }
+    n++;
+  }
+  if (n > 0) {
+    cli_shm_ring_publish(end, rb.rd_pos);
+  }
+  return n;
+}
+
+size_t cli_shm_ring_size(const cli_shm_end_t *end) {
+  ringbuffer_t rb;
+  return cli_shm_ring_view(end, &rb) ? ringbuffer_size(&rb) : 0;
+}
+
+size_t cli_shm_ring_space(const cli_shm_end_t *end) {
+  ringbuffer_t rb;
+  if (!cli_shm_ring_view(end, &rb)) {
+    return 0;
+  }
+  return ringbuffer_capacity(&rb) - ringbuffer_size(&rb);
+}
+
+uint32_t cli_shm_ring_seq(cli_shm_ring_t *ring) {
+  return __atomic_load_n(&ring->seq, __ATOMIC_SEQ_CST);
+}
+
+void cli_shm_ring_wait(cli_shm_ring_t *ring, uint32_t seq, int timeout_ms) {
+  for (int i = 0; i < CLI_SHM_SPIN; i++) {
+    if (__atomic_load_n(&ring->seq, __ATOMIC_ACQUIRE) != seq) {
+      return;
+    }
+  }
+
+  struct timespec ts = {
+      .tv_sec = timeout_ms / 1000,
+      .tv_nsec = (long)(timeout_ms % 1000) * 1000000,
+  };
+
+  __atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+  // Either the producer sees the waiter or the futex sees the new seq
+  if (__atomic_load_n(&ring->seq, __ATOMIC_SEQ_CST) == seq) {
+    // Not FUTEX_PRIVATE_FLAG, the word is shared between processes
+    (void)syscall(SYS_futex, &ring->seq, FUTEX_WAIT, seq,
+                  timeout_ms < 0 ? NULL : &ts, NULL, 0);
+  }
+  __atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void cli_shm_ring_wake(cli_shm_ring_t *ring) {
+  (void)syscall(SYS_futex, &ring->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
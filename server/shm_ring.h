@@ -0,0 +1,212 @@
+/**
+ * @file shm_ring.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Single producer single consumer rings shared between processes
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_SHM_RING_H
+#define _CLI_SHM_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CLI_SHM_RING_SIZE
+#define CLI_SHM_RING_SIZE (4096) /**< Bytes of every shared ring */
+#endif
+
+#ifndef CLI_SHM_SPIN
+#define CLI_SHM_SPIN (256) /**< Ring polls before sleeping on the futex */
+#endif
+
+#define CLI_SHM_MAGIC (0x75636c69u) /**< "ucli", set once the region is ready */
+
+#define CLI_SHM_CAN (0x18) /**< Starts a new client, see \link
+                              cli_shm_region_t \endlink */
+
+/**
+ * @brief Definition of a shared ring. Positions are offsets, so the region may
+ * be mapped at a different address in every process. The producer and the
+ * consumer positions live on their own cache line
+ *
+ */
+typedef struct cli_shm_ring_s {
+  uint32_t wr_pos;   /**< written by the producer only */
+  uint32_t pad0[15]; /**< cache line padding */
+  uint32_t rd_pos;   /**< written by the consumer only */
+  uint32_t pad1[15]; /**< cache line padding */
+  uint32_t seq;      /**< futex word, bumped whenever a position moves */
+  uint32_t waiters;  /**< number of threads sleeping on seq */
+  uint32_t capacity; /**< size of the data area, not read back */
+  uint32_t offset;   /**< data area offset, not read back */
+  uint32_t pad2[12]; /**< cache line padding */
+} cli_shm_ring_t;
+
+/**
+ * @brief Definition of the shared region. A client attaches by taking the
+ * client field, then writes \link CLI_SHM_CAN \endlink on the request ring so
+ * that the host drops a partial line left by a previous client. Replies carry
+ * the number of attaches, so a client skips the replies sent to its
+ * predecessors
+ *
+ */
+typedef struct cli_shm_region_s {
+  uint32_t magic;     /**< \link CLI_SHM_MAGIC \endlink once initialized */
+  uint32_t size;      /**< size of the whole region */
+  int32_t client;     /**< pid of the attached client. 0 if none */
+  uint32_t attaches;  /**< number of client attaches */
+  uint32_t pad[12];   /**< cache line padding */
+  cli_shm_ring_t req; /**< command lines from the client to the host */
+  cli_shm_ring_t rsp; /**< replies from the host to the client */
+} cli_shm_region_t;
+
+/**
+ * @brief Header of every reply on the response ring, followed by len bytes of
+ * command output
+ *
+ */
+typedef struct cli_shm_reply_s {
+  uint32_t epoch; /**< number of attaches when the command was received */
+  uint32_t seq;   /**< number of the command line since the attach, from 1 */
+  int32_t status; /**< CLI_OK or a CLI_ERR_ status */
+  uint32_t len;   /**< number of output bytes following */
+} cli_shm_reply_t;
+
+/**
+ * @brief Size of a region holding two rings of \link CLI_SHM_RING_SIZE
+ * \endlink bytes
+ *
+ */
+#define CLI_SHM_REGION_SIZE (sizeof(cli_shm_region_t) + 2 * CLI_SHM_RING_SIZE)
+
+/**
+ * @brief Definition of the process local end of a shared ring. The data area
+ * and the position owned by this end are never read back from the region, so
+ * that a peer writing anything in the region only hands over its position,
+ * which is checked before use
+ *
+ */
+typedef struct cli_shm_end_s {
+  cli_shm_ring_t *ring; /**< the shared ring */
+  uint8_t *data;        /**< data area, from the local layout */
+  uint32_t capacity;    /**< size of the data area */
+  uint32_t pos;         /**< position owned by this end */
+  bool producer;        /**< owns wr_pos, else rd_pos */
+} cli_shm_end_t;
+
+/**
+ * @brief Lay the rings out in a zeroed region and publish the magic number
+ *
+ * @param region the mapped region of \link CLI_SHM_REGION_SIZE \endlink bytes
+ */
+void cli_shm_region_init(cli_shm_region_t *region);
+
+/**
+ * @brief Initialize the local end of a ring of the region, taking over the
+ * position left in the region by a previous owner
+ *
+ * @param end the local end
+ * @param region the mapped region
+ * @param ring &region->req or &region->rsp
+ * @param producer true to write the ring, false to read it
+ * @return int 0 on success, -1 if the position left is out of the ring
+ */
+int cli_shm_end_init(cli_shm_end_t *end, cli_shm_region_t *region,
+                     cli_shm_ring_t *ring, bool producer);
+
+/**
+ * @brief Copy bytes into a ring and wake the consumer. It does not block
+ *
+ * @param end the producer end
+ * @param ptr the bytes
+ * @param size the number of bytes
+ * @return size_t number of bytes copied, less than size if the ring is full
+ */
+size_t cli_shm_ring_write(cli_shm_end_t *end, const void *ptr, size_t size);
+
+/**
+ * @brief Copy bytes out of a ring and wake the producer. It does not block
+ *
+ * @param end the consumer end
+ * @param ptr the destination. NULL discards the bytes
+ * @param size the maximum number of bytes
+ * @return size_t number of bytes copied
+ */
+size_t cli_shm_ring_read(cli_shm_end_t *end, void *ptr, size_t size);
+
+/**
+ * @brief Get the number of bytes the consumer may read
+ *
+ * @param end the consumer end
+ * @return size_t number of bytes. 0 if the producer position is invalid
+ */
+size_t cli_shm_ring_size(const cli_shm_end_t *end);
+
+/**
+ * @brief Get the number of bytes the producer may write
+ *
+ * @param end the producer end
+ * @return size_t number of bytes. 0 if the consumer position is invalid
+ */
+size_t cli_shm_ring_space(const cli_shm_end_t *end);
+
+/**
+ * @brief Get the futex word of a ring. Reading it before testing the ring and
+ * passing it to \link cli_shm_ring_wait \endlink never misses a wake up
+ *
+ * @param ring the ring
+ * @return uint32_t the futex word
+ */
+uint32_t cli_shm_ring_seq(cli_shm_ring_t *ring);
+
+/**
+ * @brief Wait until a position of the ring moves. It spins \link CLI_SHM_SPIN
+ * \endlink times before sleeping on the futex
+ *
+ * @param ring the ring
+ * @param seq the futex word read before testing the ring
+ * @param timeout_ms maximum time to sleep in ms. -1 waits forever
+ */
+void cli_shm_ring_wait(cli_shm_ring_t *ring, uint32_t seq, int timeout_ms);
+
+/**
+ * @brief Wake the threads sleeping on a ring
+ *
+ * @param ring the ring
+ */
+void cli_shm_ring_wake(cli_shm_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_SHM_RING_H */
@@ -0,0 +1,269 @@
+/**
+ * @file telnet.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Telnet protocol layer in front of the line editor
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "telnet.h"
+
+#include <string.h>
+
+/**
+ * @brief Definition of the parser states
+ *
+ */
+enum {
+  CLI_TELNET_STATE_DATA,   /**< data bytes */
+  CLI_TELNET_STATE_IAC,    /**< IAC received */
+  CLI_TELNET_STATE_OPT,    /**< WILL, WONT, DO or DONT received */
+  CLI_TELNET_STATE_SB,     /**< subnegotiation bytes */
+  CLI_TELNET_STATE_SB_IAC, /**< IAC received in a subnegotiation */
+};
+
+/**
+ * @brief Flags of the negotiated options
+ *
+ */
+enum {
+  CLI_TELNET_F_ECHO = 1 << 0,
+  CLI_TELNET_F_SGA = 1 << 1,
+  CLI_TELNET_F_NAWS = 1 << 2,
+  CLI_TELNET_F_LOCAL = CLI_TELNET_F_ECHO | CLI_TELNET_F_SGA,
+  CLI_TELNET_F_REMOTE = CLI_TELNET_F_SGA | CLI_TELNET_F_NAWS,
+};
+
+static uint8_t cli_telnet_flag(uint8_t opt) {
+  switch (opt) {
+  case CLI_TELNET_ECHO:
+    return CLI_TELNET_F_ECHO;
+  case CLI_TELNET_SGA:
+    return CLI_TELNET_F_SGA;
+  case CLI_TELNET_NAWS:
+    return CLI_TELNET_F_NAWS;
+  default:
+    return 0;
+  }
+}
+
+static void cli_telnet_reply(cli_telnet_t *tn, uint8_t verb, uint8_t opt) {
+  const uint8_t cmd[3] = {CLI_TELNET_IAC, verb, opt};
+  (void)tn->send(tn->ctx, cmd, sizeof(cmd));
+}
+
+void cli_telnet_init(cli_telnet_t *tn,
+                     void (*data)(void *ctx, const char *ptr, size_t size),
+                     size_t (*send)(void *ctx, const void *ptr, size_t size),
+                     void *ctx) {
+  memset(tn, 0, sizeof(*tn));
+  tn->data = data;
+  tn->send = send;
+  tn->ctx = ctx;
+}
+
+void cli_telnet_start(cli_telnet_t *tn) {
+  static const uint8_t cmds[] = {
+      CLI_TELNET_IAC, CLI_TELNET_WILL, CLI_TELNET_ECHO,
+      CLI_TELNET_IAC, CLI_TELNET_WILL, CLI_TELNET_SGA,
+      CLI_TELNET_IAC, CLI_TELNET_DO,   CLI_TELNET_SGA,
+      CLI_TELNET_IAC, CLI_TELNET_DO,   CLI_TELNET_NAWS,
+  };
+
+  tn->local_req = CLI_TELNET_F_LOCAL & ~tn->local;
+  tn->remote_req = CLI_TELNET_F_REMOTE & ~tn->remote;
+  (void)tn->send(tn->ctx, cmds, sizeof(cmds));
+}
+
+/**
+ * @brief Answer WILL, WONT, DO and DONT. Answers to our own requests are not
+ * acknowledged, so the negotiation never loops
+ *
+ */
+static void cli_telnet_option(cli_telnet_t *tn, uint8_t verb, uint8_t opt) {
+  uint8_t flag = cli_telnet_flag(opt);
+  bool local = verb == CLI_TELNET_DO || verb == CLI_TELNET_DONT;
+  bool enable = verb == CLI_TELNET_DO || verb == CLI_TELNET_WILL;
+  uint8_t *enabled = local ? &tn->local : &tn->remote;
+  uint8_t *req = local ? &tn->local_req : &tn->remote_req;
+  uint8_t supported = local ? CLI_TELNET_F_LOCAL : CLI_TELNET_F_REMOTE;
+
+  if (enable && !(flag & supported)) {
+    cli_telnet_reply(tn, local ? CLI_TELNET_WONT : CLI_TELNET_DONT, opt);
+    return;
+  }
+
+  if (*req & flag) {
+    *req &= (uint8_t)~flag;
+    *enabled = enable ? *enabled | flag : *enabled & (uint8_t)~flag;
+  } else if (enable && !(*enabled & flag)) {
+    *enabled |= flag;
+    cli_telnet_reply(tn, local ? CLI_TELNET_WILL : CLI_TELNET_DO, opt);
+  } else if (!enable && (*enabled & flag)) {
+    *enabled &= (uint8_t)~flag;
+    cli_telnet_reply(tn, local ? CLI_TELNET_WONT : CLI_TELNET_DONT, opt);
+  } else {
+    ; // already in the requested state
+  }
+}
+
+static void cli_telnet_subneg(cli_telnet_t *tn) {
+  if (tn->sb_len >= 5 && tn->sb[0] == CLI_TELNET_NAWS) {
+    tn->width = (uint16_t)(tn->sb[1] << 8 | tn->sb[2]);
+    tn->height = (uint16_t)(tn->sb[3] << 8 | tn->sb[4]);
+  }
+}
+
+static void cli_telnet_command(cli_telnet_t *tn, uint8_t cmd) {
+  tn->state = CLI_TELNET_STATE_DATA;
+
+  switch (cmd) {
+  case CLI_TELNET_IAC:
+    tn->data(tn->ctx, "\xff", 1);
+    break;
+  case CLI_TELNET_WILL:
+  case CLI_TELNET_WONT:
+  case CLI_TELNET_DO:
+  case CLI_TELNET_DONT:
+    tn->verb = cmd;
+    tn->state = CLI_TELNET_STATE_OPT;
+    break;
+  case CLI_TELNET_SB:
+    tn->sb_len = 0;
+    tn->state = CLI_TELNET_STATE_SB;
+    break;
+  case CLI_TELNET_IP:
+    tn->data(tn->ctx, "\x03", 1); // CTRL-C
+    break;
+  case CLI_TELNET_EC:
+    tn->data(tn->ctx, "\x7f", 1);
+    break;
+  case CLI_TELNET_EL:
+    tn->data(tn->ctx, "\x15", 1); // CTRL-U
+    break;
+  default:
+    break; // NOP, DM, BRK, AO, AYT and GA
+  }
+}
+
+/**
+ * @brief Pass a run of data bytes on, without the NULL following a CR
+ *
+ */
+static void cli_telnet_data(cli_telnet_t *tn, const char *p, size_t n) {
+  if (tn->cr && n > 0 && *p == '\0') {
+    p++;
+    n--;
+  }
+  tn->cr = false;
+
+  while (n > 0) {
+    const char *cr = memchr(p, '\r', n);
+    size_t run = cr != NULL ? (size_t)(cr - p) + 1 : n;
+
+    tn->data(tn->ctx, p, run);
+    p += run;
+    n -= run;
+    if (cr != NULL && n == 0) {
+      tn->cr = true;
+    } else if (cr != NULL && *p == '\0') {
+      p++;
+      n--;
+    } else {
+      ; // CR LF, or no CR
+    }
+  }
+}
+
+void cli_telnet_recv(cli_telnet_t *tn, const char *buf, size_t len) {
+  const char *p = buf;
+  const char *end = buf + len;
+
+  while (p < end) {
+    if (tn->state == CLI_TELNET_STATE_DATA) {
+      const char *iac = memchr(p, CLI_TELNET_IAC, (size_t)(end - p));
+      const char *stop = iac != NULL ? iac : end;
+
+      cli_telnet_data(tn, p, (size_t)(stop - p));
+      p = stop;
+      if (iac != NULL) {
+        tn->state = CLI_TELNET_STATE_IAC;
+        p++;
+      }
+      continue;
+    }
+
+    uint8_t c = (uint8_t)*p++;
+    switch (tn->state) {
+    case CLI_TELNET_STATE_IAC:
+      cli_telnet_command(tn, c);
+      break;
+    case CLI_TELNET_STATE_OPT:
+      tn->state = CLI_TELNET_STATE_DATA;
+      cli_telnet_option(tn, tn->verb, c);
+      break;
+    case CLI_TELNET_STATE_SB:
+      if (c == CLI_TELNET_IAC) {
+        tn->state = CLI_TELNET_STATE_SB_IAC;
+      } else if (tn->sb_len < sizeof(tn->sb)) {
+        tn->sb[tn->sb_len++] = c;
+      } else {
+        ; // too long, dropped
+      }
+      break;
+    default: // CLI_TELNET_STATE_SB_IAC
+      if (c == CLI_TELNET_IAC) {
+        tn->state = CLI_TELNET_STATE_SB;
+        if (tn->sb_len < sizeof(tn->sb)) {
+          tn->sb[tn->sb_len++] = c;
+        }
+      } else {
+        // SE, or a command ending a broken subnegotiation
+        cli_telnet_subneg(tn);
+        cli_telnet_command(tn, c == CLI_TELNET_SE ? CLI_TELNET_NOP : c);
+      }
+      break;
+    }
+  }
+}
+
+size_t cli_telnet_send(cli_telnet_t *tn, const void *ptr, size_t size) {
+  const char *p = ptr;
+  const char *end = p + size;
+
+  while (p < end) {
+    const char *iac = memchr(p, CLI_TELNET_IAC, (size_t)(end - p));
+    // The IAC is sent twice: with its run, then on its own
+    size_t run = iac != NULL ? (size_t)(iac - p) + 1 : (size_t)(end - p);
+
+    if (tn->send(tn->ctx, p, run) != run ||
+        (iac != NULL && tn->send(tn->ctx, iac, 1) != 1)) {
+      return (size_t)(p - (const char *)ptr);
+    }
+    p += run;
+  }
+  return size;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file telnet.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Telnet protocol layer in front of the line editor
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_TELNET_H
+#define _CLI_TELNET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CLI_TELNET_SB_MAX
+#define CLI_TELNET_SB_MAX (16) /**< Subnegotiation bytes kept */
+#endif
+
+/** @brief Telnet commands, RFC 854 */
+#define CLI_TELNET_SE (240)   /**< end of subnegotiation */
+#define CLI_TELNET_NOP (241)  /**< no operation */
+#define CLI_TELNET_DM (242)   /**< data mark */
+#define CLI_TELNET_BRK (243)  /**< break */
+#define CLI_TELNET_IP (244)   /**< interrupt process */
+#define CLI_TELNET_AO (245)   /**< abort output */
+#define CLI_TELNET_AYT (246)  /**< are you there */
+#define CLI_TELNET_EC (247)   /**< erase character */
+#define CLI_TELNET_EL (248)   /**< erase line */
+#define CLI_TELNET_GA (249)   /**< go ahead */
+#define CLI_TELNET_SB (250)   /**< start of subnegotiation */
+#define CLI_TELNET_WILL (251) /**< sender wants to enable an option */
+#define CLI_TELNET_WONT (252) /**< sender refuses an option */
+#define CLI_TELNET_DO (253)   /**< sender wants the receiver to enable */
+#define CLI_TELNET_DONT (254) /**< sender wants the receiver to disable */
+#define CLI_TELNET_IAC (255)  /**< interpret as command */
+
+/** @brief Telnet options */
+#define CLI_TELNET_ECHO (1)  /**< echo, RFC 857 */
+#define CLI_TELNET_SGA (3)   /**< suppress go ahead, RFC 858 */
+#define CLI_TELNET_NAWS (31) /**< negotiate about window size, RFC 1073 */
+
+/**
+ * @brief Definition of the telnet struct. The server echoes and suppresses go
+ * ahead, which puts the client in character mode, and the client reports its
+ * window size
+ *
+ */
+typedef struct cli_telnet_s {
+  void (*data)(void *ctx, const char *ptr,
+               size_t size); /**< receives the data bytes for the line editor */
+  size_t (*send)(void *ctx, const void *ptr,
+                 size_t size); /**< sends raw bytes to the client */
+  void *ctx;                   /**< context passed to data and send */
+  uint8_t state;               /**< internal parser state */
+  uint8_t verb;                /**< internal pending WILL, WONT, DO or DONT */
+  bool cr;                     /**< internal, the last data byte was CR */
+  uint8_t local;               /**< internal options enabled on this side */
+  uint8_t remote;              /**< internal options enabled on the client */
+  uint8_t local_req;           /**< internal WILL sent, not answered yet */
+  uint8_t remote_req;          /**< internal DO sent, not answered yet */
+  uint8_t sb[CLI_TELNET_SB_MAX]; /**< internal subnegotiation bytes */
+  size_t sb_len;                 /**< internal number of subnegotiation bytes */
+  uint16_t width;  /**< window width reported by the client. 0 if unknown */
+  uint16_t height; /**< window height reported by the client. 0 if unknown */
+} cli_telnet_t;
+
+/**
+ * @brief Initialize the telnet struct
+ *
+ * @param tn the telnet struct
+ * @param data receives the data bytes. Commands are stripped, IAC IAC becomes
+ * a single 0xFF, the NULL of CR NULL is dropped, and IP, EC and EL become
+ * CTRL-C, DEL and CTRL-U
+ * @param send sends raw bytes to the client
+ * @param ctx context passed to data and send
+ */
+void cli_telnet_init(cli_telnet_t *tn,
+                     void (*data)(void *ctx, const char *ptr, size_t size),
+                     size_t (*send)(void *ctx, const void *ptr, size_t size),
+                     void *ctx);
+
+/**
+ * @brief Send the initial negotiation: WILL ECHO, WILL SGA, DO SGA and DO NAWS
+ *
+ * @param tn the telnet struct
+ */
+void cli_telnet_start(cli_telnet_t *tn);
+
+/**
+ * @brief Parse bytes received from the client. Data runs are passed to data at
+ * once, a sequence may be split between two calls
+ *
+ * @param tn the telnet struct
+ * @param buf the received bytes
+ * @param len the number of received bytes
+ */
+void cli_telnet_recv(cli_telnet_t *tn, const char *buf, size_t len);
+
+/**
+ * @brief Send data to the client, doubling the IAC bytes
+ *
+ * @param tn the telnet struct
+ * @param ptr the data
+ * @param size the data size
+ * @return size_t size, or less if send failed
+ */
+size_t cli_telnet_send(cli_telnet_t *tn, const void *ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_TELNET_H */
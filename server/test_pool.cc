@@ -0,0 +1,125 @@
+#include "pool.h"
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+static cli_server_pool_t pool;
+
+// Prints the index of the reactor running the session
+static int reactor_handler(cli_t *cli, int argc, char **argv) {
+  cli_session_t *s = (cli_session_t *)cli->ctx;
+  std::string idx = std::to_string(s->server - pool.reactors);
+  (void)argc;
+  (void)argv;
+  cli_write(cli, idx.c_str(), idx.size());
+  return 0;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"reactor", "print the reactor index", reactor_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 1};
+
+class CliServerPoolTest : public ::testing::Test {
+protected:
+  std::string path;
+
+  void SetUp() override {
+    const char *dir = getenv("TEST_TMPDIR");
+    path = std::string(dir ? dir : "/tmp") + "/cli_pool_test.sock";
+    ASSERT_EQ(cli_server_pool_init(&pool, &mock_cmd_list, 3, 8,
+                                   CLI_SERVER_BACKEND_EPOLL), 0);
+    ASSERT_EQ(cli_server_pool_listen(&pool, path.c_str()), 0);
+    ASSERT_EQ(cli_server_pool_start(&pool), 0);
+  }
+
+  void TearDown() override {
+    cli_server_pool_close(&pool);
+    unlink(path.c_str());
+  }
+
+  int connect_session() {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    EXPECT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    return fd;
+  }
+
+  // Reads until the prompt
+  std::string recv_reply(int fd) {
+    std::string reply;
+    char buf[256];
+    while (reply.size() < 2 || reply.compare(reply.size() - 2, 2, "> ")) {
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      reply.append(buf, (size_t)n);
+    }
+    return reply;
+  }
+};
+
+TEST_F(CliServerPoolTest, RoundRobin) {
+  int fds[6];
+  int per_reactor[3] = {0, 0, 0};
+
+  for (int &fd : fds) {
+    fd = connect_session();
+    EXPECT_EQ(recv_reply(fd), CLI_PROMPT "> ");
+  }
+  for (int fd : fds) {
+    ASSERT_EQ(write(fd, "reactor\r\n", 9), 9);
+    std::string reply = recv_reply(fd);
+    ASSERT_EQ(reply.compare(0, 9, "reactor\r\n"), 0) << reply;
+    int idx = reply[9] - '0';
+    ASSERT_GE(idx, 0);
+    ASSERT_LT(idx, 3);
+    per_reactor[idx]++;
+  }
+  EXPECT_EQ(per_reactor[0], 2);
+  EXPECT_EQ(per_reactor[1], 2);
+  EXPECT_EQ(per_reactor[2], 2);
+
+  for (int fd : fds) {
+    close(fd);
+  }
+}
+
+TEST_F(CliServerPoolTest, SharedCommandList) {
+  for (size_t i = 0; i < pool.num_reactors; i++) {
+    EXPECT_EQ(pool.reactors[i].cmd_list, &mock_cmd_list);
+  }
+}
+
+TEST(CliServerHandoffTest, QueueFull) {
+  cli_server_t srv;
+  ASSERT_EQ(cli_server_init(&srv, &mock_cmd_list, CLI_SERVER_HANDOFF_NUM), 0);
+
+  int sv[2];
+  std::vector<int> clients;
+  for (int i = 0; i < CLI_SERVER_HANDOFF_NUM; i++) {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    ASSERT_EQ(cli_server_handoff(&srv, sv[0]), 0);
+    clients.push_back(sv[1]);
+  }
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+  EXPECT_EQ(cli_server_handoff(&srv, sv[0]), -1);
+  close(sv[1]);
+
+  // The reactor opens the queued sessions on its next pass
+  EXPECT_GT(cli_server_poll(&srv, 0), 0);
+  EXPECT_EQ(srv.count, (size_t)CLI_SERVER_HANDOFF_NUM);
+  cli_server_close(&srv);
+  for (int fd : clients) {
+    close(fd);
+  }
+}
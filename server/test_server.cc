@@ -0,0 +1,229 @@
+#include "server.h"
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int print_handler(cli_t *cli, int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    cli_write(cli, argv[i], strlen(argv[i]));
+  }
+  return 0;
+}
+
+// Prints until the socket and CLI_SERVER_OUT_MAX are full
+static int flood_handler(cli_t *cli, int argc, char **argv) {
+  static const char chunk[1024] = {'x'};
+  (void)argc;
+  (void)argv;
+  for (int i = 0; i < 64 * 1024; i++) {
+    if (cli_write(cli, chunk, sizeof(chunk)) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"print", "print args", print_handler, 0},
+    {"flood", "print a lot", flood_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 2};
+
+class CliServerTest : public ::testing::TestWithParam<cli_server_backend_t> {
+protected:
+  cli_server_t srv;
+
+  void SetUp() override {
+    if (cli_server_init_backend(&srv, &mock_cmd_list, 2, GetParam()) < 0) {
+      GTEST_SKIP() << "backend not available: " << strerror(errno);
+    }
+    ASSERT_EQ(srv.backend, GetParam());
+  }
+
+  void TearDown() override {
+    if (!IsSkipped()) {
+      cli_server_close(&srv);
+    }
+  }
+
+  // Returns the client end of a new session
+  int open_session() {
+    int sv[2];
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    if (cli_server_add(&srv, sv[0]) == NULL) {
+      close(sv[1]);
+      return -1;
+    }
+    poll();
+    return sv[1];
+  }
+
+  void send_str(int fd, const char *str) {
+    ASSERT_EQ(write(fd, str, strlen(str)), (ssize_t)strlen(str));
+  }
+
+  std::string recv_str(int fd) {
+    char buf[256];
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    return n > 0 ? std::string(buf, (size_t)n) : std::string();
+  }
+
+  void poll() {
+    while (cli_server_poll(&srv, 0) > 0) {
+    }
+  }
+};
+
+TEST_P(CliServerTest, PromptOnOpen) {
+  int fd = open_session();
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(recv_str(fd), CLI_PROMPT "> ");
+  EXPECT_EQ(srv.count, 1u);
+  close(fd);
+}
+
+TEST_P(CliServerTest, SessionsAreIsolated) {
+  int a = open_session();
+  int b = open_session();
+  recv_str(a);
+  recv_str(b);
+
+  send_str(a, "print aaa\r");
+  send_str(b, "print ");
+  poll();
+  EXPECT_EQ(recv_str(a), "print aaa\r\naaaOk\r\n" CLI_PROMPT "> ");
+  EXPECT_EQ(recv_str(b), "print ");
+
+  send_str(b, "bbb\r\n");
+  poll();
+  EXPECT_EQ(recv_str(b), "bbb\r\nbbbOk\r\n" CLI_PROMPT "> ");
+  EXPECT_EQ(recv_str(a), "");
+  close(a);
+  close(b);
+}
+
+TEST_P(CliServerTest, SessionConfig) {
+  cli_config_t config = {4, 16, 2, 0};
+  srv.config = &config;
+
+  int fd = open_session();
+  ASSERT_GE(fd, 0);
+  recv_str(fd);
+  EXPECT_EQ(srv.sessions[0]->cli.line_max, 16u);
+
+  send_str(fd, "print aaa\r\n");
+  poll();
+  EXPECT_EQ(recv_str(fd), "print aaa\r\naaaOk\r\n" CLI_PROMPT "> ");
+  send_str(fd, "print a b\r\n");
+  poll();
+  EXPECT_NE(recv_str(fd).find("CLI_ARGV_NUM"), std::string::npos);
+  close(fd);
+  poll();
+
+  // Invalid sizes are refused
+  config.line_max = CLI_LINE_MAX + 1;
+  EXPECT_EQ(open_session(), -1);
+  EXPECT_EQ(srv.count, 0u);
+}
+
+TEST_P(CliServerTest, Full) {
+  int a = open_session();
+  int b = open_session();
+  EXPECT_EQ(open_session(), -1);
+  EXPECT_EQ(srv.count, 2u);
+
+  // A closed session frees its slot
+  close(a);
+  poll();
+  EXPECT_EQ(srv.count, 1u);
+  int c = open_session();
+  EXPECT_GE(c, 0);
+  close(b);
+  close(c);
+}
+
+TEST_P(CliServerTest, FullWithClosingSession) {
+  int a = open_session();
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+  int one = 1;
+  ASSERT_EQ(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &one, sizeof(one)), 0);
+  ASSERT_NE(cli_server_add(&srv, sv[0]), nullptr);
+  poll();
+
+  // The client does not read, so a send stays pending
+  for (int i = 0; i < 32; i++) {
+    send_str(sv[1], "print xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\r\n");
+    poll();
+  }
+
+  // The session is closed while its next read is queued, its input buffer
+  // only comes back with the completion of that read
+  send_str(sv[1], "print x\r\n");
+  close(sv[1]);
+  while (srv.count == 2) {
+    ASSERT_GE(cli_server_poll(&srv, 100), 0);
+  }
+  int b = open_session();
+  if (b < 0) {
+    poll();
+    b = open_session();
+  }
+  ASSERT_GE(b, 0);
+  EXPECT_EQ(srv.count, 2u);
+  EXPECT_EQ(recv_str(b), CLI_PROMPT "> ");
+  send_str(b, "print y\r\n");
+  poll();
+  EXPECT_NE(recv_str(b).find("y"), std::string::npos);
+  close(a);
+  close(b);
+}
+
+TEST_P(CliServerTest, Quit) {
+  int fd = open_session();
+  recv_str(fd);
+  send_str(fd, "quit\r\n");
+  poll();
+  EXPECT_EQ(srv.count, 0u);
+  EXPECT_NE(recv_str(fd).find("Ok\r\n"), std::string::npos);
+  EXPECT_EQ(recv_str(fd), "");
+  close(fd);
+}
+
+TEST_P(CliServerTest, ClientDoesNotRead) {
+  int fd = open_session();
+  send_str(fd, "flood\r\n");
+  poll();
+  EXPECT_EQ(srv.count, 0u);
+  close(fd);
+}
+
+TEST_P(CliServerTest, ListenAndStop) {
+  const char *dir = getenv("TEST_TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/cli_server_test.sock";
+  ASSERT_EQ(cli_server_listen(&srv, path.c_str()), 0);
+
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+  poll();
+  EXPECT_EQ(srv.count, 1u);
+  EXPECT_EQ(recv_str(fd), CLI_PROMPT "> ");
+
+  cli_server_stop(&srv);
+  EXPECT_EQ(cli_server_run(&srv), 0);
+  close(fd);
+  unlink(path.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, CliServerTest,
+                         ::testing::Values(CLI_SERVER_BACKEND_EPOLL,
+                                           CLI_SERVER_BACKEND_URING));
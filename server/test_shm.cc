@@ -0,0 +1,209 @@
+#include "shm.h"
+#include "shm_client.h"
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+static cli_shm_host_t host;
+
+static int print_handler(cli_t *cli, int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    cli_write(cli, argv[i], strlen(argv[i]));
+    cli_write(cli, ";", 1);
+  }
+  return 0;
+}
+
+static int fail_handler(cli_t *cli, int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  cli_write(cli, "failed", 6);
+  return -1;
+}
+
+static int flood_handler(cli_t *cli, int argc, char **argv) {
+  std::string chunk(1000, 'x');
+  (void)argc;
+  (void)argv;
+  for (int i = 0; i < 10; i++) {
+    cli_write(cli, chunk.c_str(), chunk.size());
+  }
+  return 0;
+}
+
+static int sleep_handler(cli_t *cli, int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  usleep(200 * 1000);
+  return cli->ctx == &host ? 0 : -1;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"print", "print args", print_handler, 0},
+    {"fail", "fail cmd", fail_handler, 0},
+    {"flood", "print 10000 bytes", flood_handler, 0},
+    {"sleep", "sleep 200 ms", sleep_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 4};
+
+class CliShmTest : public ::testing::Test {
+protected:
+  std::string name;
+  std::thread thread;
+  cli_shm_client_t client;
+  char out[64];
+  int status;
+
+  void SetUp() override {
+    name = "/cli_shm_test." + std::to_string(getpid());
+    ASSERT_EQ(cli_shm_host_init(&host, &mock_cmd_list, name.c_str()), 0);
+    thread = std::thread(cli_shm_host_run, &host);
+    ASSERT_EQ(cli_shm_client_open(&client, name.c_str()), 0);
+    status = 1;
+  }
+
+  void TearDown() override {
+    cli_shm_client_close(&client);
+    cli_shm_host_stop(&host);
+    thread.join();
+    cli_shm_host_close(&host);
+  }
+
+  int exec(const char *line) {
+    return cli_shm_client_exec(&client, line, out, sizeof(out), &status, 5000);
+  }
+};
+
+TEST_F(CliShmTest, Exec) {
+  EXPECT_EQ(exec("print a b"), 4);
+  EXPECT_STREQ(out, "a;b;");
+  EXPECT_EQ(status, CLI_OK);
+
+  for (int i = 0; i < 1000; i++) {
+    std::string arg = std::to_string(i);
+    ASSERT_EQ(exec(("print " + arg).c_str()), (int)arg.size() + 1);
+    ASSERT_EQ(std::string(out), arg + ";");
+  }
+}
+
+TEST_F(CliShmTest, Status) {
+  EXPECT_EQ(exec("fail"), 6);
+  EXPECT_EQ(status, CLI_ERR_HANDLER);
+  EXPECT_STREQ(out, "failed");
+
+  EXPECT_EQ(exec("unknown"), 0);
+  EXPECT_EQ(status, CLI_ERR_UNKNOWN);
+
+  EXPECT_EQ(exec(""), 0);
+  EXPECT_EQ(status, CLI_OK);
+
+  std::string line = "print " + std::string(CLI_LINE_MAX, 'x');
+  EXPECT_EQ(exec(line.c_str()), 0);
+  EXPECT_EQ(status, CLI_ERR_LINE_MAX);
+
+  EXPECT_EQ(exec("print a\nprint b"), -1);
+  EXPECT_EQ(errno, EINVAL);
+  line = std::string(CLI_SHM_RING_SIZE, 'x');
+  EXPECT_EQ(exec(line.c_str()), -1);
+  EXPECT_EQ(errno, EMSGSIZE);
+
+  // The session is still in step
+  EXPECT_EQ(exec("print c"), 2);
+  EXPECT_STREQ(out, "c;");
+}
+
+TEST_F(CliShmTest, OutputTruncation) {
+  EXPECT_EQ(exec("flood"), (int)CLI_SHM_OUT_MAX);
+  EXPECT_EQ(strlen(out), sizeof(out) - 1);
+
+  EXPECT_EQ(cli_shm_client_exec(&client, "print abc", NULL, 0, &status, 5000),
+            4);
+  EXPECT_EQ(status, CLI_OK);
+}
+
+TEST_F(CliShmTest, SingleClient) {
+  cli_shm_client_t other;
+  EXPECT_EQ(cli_shm_client_open(&other, name.c_str()), -1);
+  EXPECT_EQ(errno, EBUSY);
+
+  cli_shm_client_close(&client);
+  ASSERT_EQ(cli_shm_client_open(&client, name.c_str()), 0);
+  EXPECT_EQ(exec("print a"), 2);
+  EXPECT_STREQ(out, "a;");
+
+  EXPECT_EQ(cli_shm_client_open(&other, "/cli_shm_test.nonexistent"), -1);
+  EXPECT_EQ(errno, ENOENT);
+}
+
+TEST_F(CliShmTest, LateReplySkipped) {
+  EXPECT_EQ(cli_shm_client_exec(&client, "sleep", out, sizeof(out), &status,
+                                10),
+            -1);
+  EXPECT_EQ(errno, ETIMEDOUT);
+
+  EXPECT_EQ(exec("print a"), 2);
+  EXPECT_STREQ(out, "a;");
+}
+
+TEST_F(CliShmTest, PreviousClientLeftovers) {
+  // A client exits in the middle of a line and without reading its reply
+  EXPECT_EQ(cli_shm_client_exec(&client, "sleep", out, sizeof(out), &status,
+                                10),
+            -1);
+  cli_shm_ring_write(&client.req, "print junk", 10);
+  cli_shm_client_close(&client);
+
+  ASSERT_EQ(cli_shm_client_open(&client, name.c_str()), 0);
+  EXPECT_EQ(exec("print a"), 2);
+  EXPECT_STREQ(out, "a;");
+  EXPECT_EQ(status, CLI_OK);
+}
+
+TEST_F(CliShmTest, AttachWithoutCan) {
+  // A client attaches, then fails to send CLI_SHM_CAN before it gives up
+  __atomic_add_fetch(&client.region->attaches, 1, __ATOMIC_ACQ_REL);
+  cli_shm_client_close(&client);
+
+  ASSERT_EQ(cli_shm_client_open(&client, name.c_str()), 0);
+  EXPECT_EQ(exec("print a"), 2);
+  EXPECT_STREQ(out, "a;");
+}
+
+TEST_F(CliShmTest, CorruptRegionIgnored) {
+  cli_shm_region_t *region = client.region;
+
+  // The layout is process local, the host reads from its own data area
+  region->req.offset = UINT32_MAX;
+  region->req.capacity = UINT32_MAX;
+  region->rsp.offset = UINT32_MAX;
+  region->rsp.capacity = UINT32_MAX;
+  EXPECT_EQ(exec("print a"), 2);
+  EXPECT_STREQ(out, "a;");
+
+  // A peer position out of the ring is not followed
+  uint32_t rd_pos = region->req.rd_pos;
+  uint32_t wr_pos = region->rsp.wr_pos;
+  region->req.rd_pos = CLI_SHM_RING_SIZE;
+  region->rsp.wr_pos = UINT32_MAX;
+  EXPECT_EQ(cli_shm_ring_space(&client.req), 0u);
+  EXPECT_EQ(cli_shm_ring_size(&client.rsp), 0u);
+  EXPECT_EQ(cli_shm_ring_write(&client.req, "x", 1), 0u);
+  EXPECT_EQ(cli_shm_ring_read(&client.rsp, NULL, 1), 0u);
+  region->req.rd_pos = rd_pos;
+  region->rsp.wr_pos = wr_pos;
+  EXPECT_EQ(exec("print b"), 2);
+  EXPECT_STREQ(out, "b;");
+
+  // Nor is a position left by a previous client
+  cli_shm_client_close(&client);
+  cli_shm_client_t other;
+  ASSERT_EQ(cli_shm_client_open(&other, name.c_str()), 0);
+  other.region->req.wr_pos = CLI_SHM_RING_SIZE;
+  cli_shm_client_close(&other);
+  EXPECT_EQ(cli_shm_client_open(&client, name.c_str()), -1);
+  EXPECT_EQ(errno, EPROTO);
+}
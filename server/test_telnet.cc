@@ -0,0 +1,205 @@
+#include "server.h"
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+static std::vector<std::string> runs;
+static std::string sent;
+
+static void mock_data(void *ctx, const char *ptr, size_t size) {
+  (void)ctx;
+  runs.push_back(std::string(ptr, size));
+}
+
+static size_t mock_send(void *ctx, const void *ptr, size_t size) {
+  (void)ctx;
+  sent.append((const char *)ptr, size);
+  return size;
+}
+
+static const char will_echo[] = "\xff\xfb\x01";
+static const char will_sga[] = "\xff\xfb\x03";
+static const char do_sga[] = "\xff\xfd\x03";
+static const char do_naws[] = "\xff\xfd\x1f";
+
+class CliTelnetTest : public ::testing::Test {
+protected:
+  cli_telnet_t tn;
+
+  void SetUp() override {
+    runs.clear();
+    sent.clear();
+    cli_telnet_init(&tn, mock_data, mock_send, NULL);
+  }
+
+  void recv(const std::string &str) {
+    cli_telnet_recv(&tn, str.data(), str.size());
+  }
+
+  std::string data() {
+    std::string all;
+    for (const std::string &run : runs) {
+      all += run;
+    }
+    return all;
+  }
+};
+
+TEST_F(CliTelnetTest, Negotiation) {
+  cli_telnet_start(&tn);
+  EXPECT_EQ(sent, std::string(will_echo) + will_sga + do_sga + do_naws);
+
+  // Answers to our requests are not acknowledged
+  sent.clear();
+  recv("\xff\xfd\x01\xff\xfd\x03\xff\xfb\x03\xff\xfb\x1f");
+  EXPECT_EQ(sent, "");
+  recv("\xff\xfd\x01");
+  EXPECT_EQ(sent, "");
+
+  // Unsupported options are refused
+  recv("\xff\xfd\x22\xff\xfb\x18");
+  EXPECT_EQ(sent, "\xff\xfc\x22\xff\xfe\x18");
+
+  // Disabling an enabled option is acknowledged once
+  sent.clear();
+  recv("\xff\xfe\x01");
+  recv("\xff\xfe\x01");
+  EXPECT_EQ(sent, "\xff\xfc\x01");
+  recv("\xff\xfd\x01");
+  EXPECT_EQ(sent, std::string("\xff\xfc\x01") + will_echo);
+  EXPECT_EQ(data(), "");
+}
+
+TEST_F(CliTelnetTest, RefusedRequest) {
+  cli_telnet_start(&tn);
+  sent.clear();
+  recv("\xff\xfc\x1f");
+  recv("\xff\xfe\x01");
+  EXPECT_EQ(sent, "");
+  // The client changes its mind
+  recv("\xff\xfb\x1f");
+  EXPECT_EQ(sent, do_naws);
+}
+
+TEST_F(CliTelnetTest, DataRuns) {
+  std::string line(1000, 'a');
+  recv(line + "\xff\xf1" + line);
+  ASSERT_EQ(runs.size(), 2u);
+  EXPECT_EQ(runs[0], line);
+
+  runs.clear();
+  recv("a\xff\xff"
+       "b\xff\xf4"
+       "c\xff\xf7\xff\xf8");
+  EXPECT_EQ(data(), "a\xff"
+                    "b\x03"
+                    "c\x7f\x15");
+}
+
+TEST_F(CliTelnetTest, CarriageReturn) {
+  recv(std::string("ls\r\0pwd\r\n", 9));
+  EXPECT_EQ(data(), "ls\rpwd\r\n");
+
+  runs.clear();
+  recv("x\r");
+  recv(std::string("\0y", 2));
+  EXPECT_EQ(data(), "x\ry");
+}
+
+TEST_F(CliTelnetTest, SplitSequences) {
+  static const char input[] = "a\xff\xfd\x22"
+                              "b\xff\xff"
+                              "c\xff\xfa\x1f\x00\x50\x00\x18\xff\xf0"
+                              "d";
+  for (size_t i = 0; i < sizeof(input) - 1; i++) {
+    recv(std::string(1, input[i]));
+  }
+  EXPECT_EQ(data(), "ab\xff"
+                    "cd");
+  EXPECT_EQ(sent, "\xff\xfc\x22");
+  EXPECT_EQ(tn.width, 80);
+  EXPECT_EQ(tn.height, 24);
+}
+
+TEST_F(CliTelnetTest, WindowSize) {
+  recv(std::string("\xff\xfa\x1f\x00\xff\xff\x01\x00\xff\xf0", 10));
+  EXPECT_EQ(tn.width, 255);
+  EXPECT_EQ(tn.height, 256);
+
+  // Unknown subnegotiations are skipped
+  recv(std::string("\xff\xfa\x18\x00xterm\xff\xf0z", 12));
+  EXPECT_EQ(data(), "z");
+  EXPECT_EQ(tn.width, 255);
+}
+
+TEST_F(CliTelnetTest, SendEscapesIac) {
+  EXPECT_EQ(cli_telnet_send(&tn, "a\xff"
+                                 "b\xff",
+                            4),
+            4u);
+  EXPECT_EQ(sent, "a\xff\xff"
+                  "b\xff\xff");
+}
+
+static int iac_handler(cli_t *cli, int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  cli_write(cli, "\xff", 1);
+  return 0;
+}
+
+static const cli_cmd_t mock_cmds[] = {
+    {"iac", "print 0xFF", iac_handler, 0},
+};
+
+static const cli_cmd_list_t mock_cmd_list = {NULL, 0, mock_cmds, 1};
+
+// A scripted telnet client on a TCP session
+TEST(CliTelnetServerTest, Session) {
+  cli_server_t srv;
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  char buf[256];
+
+  ASSERT_EQ(cli_server_init(&srv, &mock_cmd_list, 2), 0);
+  srv.telnet = true;
+  ASSERT_EQ(cli_server_listen_tcp(&srv, "127.0.0.1", 0), 0);
+  ASSERT_EQ(getsockname(srv.listen_fd, (struct sockaddr *)&addr, &len), 0);
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+  while (srv.count == 0) {
+    cli_server_poll(&srv, 100);
+  }
+
+  ssize_t n = read(fd, buf, sizeof(buf));
+  ASSERT_GT(n, 0);
+  EXPECT_EQ(std::string(buf, (size_t)n),
+            std::string(will_echo) + will_sga + do_sga + do_naws +
+                CLI_PROMPT "> ");
+
+  // Character mode: Enter is CR NUL, the echo is done by the server
+  static const char input[] = "\xff\xfd\x01\xff\xfb\x1f"
+                              "\xff\xfa\x1f\x00\x50\x00\x18\xff\xf0"
+                              "iac\r";
+  ASSERT_EQ(write(fd, input, sizeof(input)), (ssize_t)sizeof(input));
+  std::string reply;
+  while (reply.find(CLI_PROMPT "> ") == std::string::npos) {
+    cli_server_poll(&srv, 100);
+    n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n > 0) {
+      reply.append(buf, (size_t)n);
+    }
+  }
+  // The output is escaped
+  EXPECT_EQ(reply, "iac\r\n\xff\xffOk\r\n" CLI_PROMPT "> ");
+  EXPECT_EQ(srv.sessions[0]->telnet.width, 80);
+
+  close(fd);
+  cli_server_close(&srv);
+}
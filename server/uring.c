@@ -0,0 +1,210 @@
+/**
+ * @file uring.c
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Minimal io_uring instance on top of the raw system calls
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+
+#include "uring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static int cli_uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int cli_uring_sys_enter(int fd, unsigned to_submit,
+                               unsigned min_complete, unsigned flags,
+                               const void *arg, size_t argsz) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      arg, argsz);
+}
+
+int cli_uring_init(cli_uring_t *ring, unsigned entries) {
+  struct io_uring_params p;
+
+  memset(ring, 0, sizeof(*ring));
+  memset(&p, 0, sizeof(p));
+
+  ring->fd = cli_uring_setup(entries, &p);
+  if (ring->fd < 0) {
+    return -1;
+  }
+
+  // Timeouts are passed to io_uring_enter, errors must not be dropped
+  const unsigned required =
+      IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+  if ((p.features & required) != required) {
+    close(ring->fd);
+    ring->fd = -1;
+    errno = ENOSYS;
+    return -1;
+  }
+
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  // Single mmap, the completion ring shares the submission ring mapping
+  ring->sq_ring_size = sq_size > cq_size ? sq_size : cq_size;
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    int err = errno;
+    cli_uring_close(ring);
+    errno = err;
+    return -1;
+  }
+
+  char *sq = ring->sq_ring;
+  ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  ring->sqe_tail = *ring->sq_tail;
+
+  char *cq = ring->sq_ring;
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  for (unsigned i = 0; i <= ring->sq_mask; i++) {
+    ring->sq_array[i] = i;
+  }
+  return 0;
+}
+
+/**
+ * @brief publish the prepared entries to the kernel
+ *
+ * @param ring the io_uring struct
+ * @return unsigned number of published entries not yet consumed
+ */
+static unsigned cli_uring_flush(cli_uring_t *ring) {
+  __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+  return ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}
+
+struct io_uring_sqe *cli_uring_get_sqe(cli_uring_t *ring) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+  if (ring->sqe_tail - head > ring->sq_mask) {
+    // Full, submit without waiting
+    if (cli_uring_enter(ring, 0) < 0) {
+      return NULL;
+    }
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head > ring->sq_mask) {
+      errno = EBUSY;
+      return NULL;
+    }
+  }
+
+  struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+  ring->sqe_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int cli_uring_enter(cli_uring_t *ring, int timeout_ms) {
+  unsigned to_submit = cli_uring_flush(ring);
+  unsigned flags = 0;
+  unsigned wait_nr = 0;
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  const void *argp = NULL;
+  size_t argsz = 0;
+
+  if (timeout_ms != 0) {
+    flags |= IORING_ENTER_GETEVENTS;
+    wait_nr = 1;
+  }
+  if (timeout_ms > 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (__u64)(uintptr_t)&ts;
+    argp = &arg;
+    argsz = sizeof(arg);
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  if (to_submit == 0 && wait_nr == 0) {
+    return 0;
+  }
+
+  // A completion already pending satisfies the wait
+  int ret = cli_uring_sys_enter(ring->fd, to_submit, wait_nr, flags, argp,
+                                argsz);
+  if (ret < 0 && (errno == ETIME || errno == EINTR)) {
+    return 0;
+  }
+  return ret < 0 ? -1 : 0;
+}
+
+bool cli_uring_pop(cli_uring_t *ring, struct io_uring_cqe *cqe) {
+  unsigned head = *ring->cq_head;
+
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  *cqe = ring->cqes[head & ring->cq_mask];
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+int cli_uring_register_buffers(cli_uring_t *ring, const struct iovec *iov,
+                               unsigned num) {
+  long ret = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                     iov, num);
+  return ret < 0 ? -1 : 0;
+}
+
+void cli_uring_close(cli_uring_t *ring) {
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  if (ring->fd >= 0) {
+    close(ring->fd);
+  }
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file uring.h
+ * @author Ahmed Zamouche (ahmed.zamouche@gmail.com)
+ * @brief Minimal io_uring instance on top of the raw system calls
+ * @version 0.1
+ * @date 2019-12-01
+ *
+ *  @copyright Copyright (c) 2019
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Ahmed Zamouche
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _CLI_SERVER_URING_H
+#define _CLI_SERVER_URING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+/**
+ * @brief Definition of the io_uring instance. The submission and completion
+ * rings are shared with the kernel
+ *
+ */
+typedef struct cli_uring_s {
+  int fd;                    /**< io_uring file descriptor */
+  unsigned *sq_head;         /**< submission queue head, moved by the kernel */
+  unsigned *sq_tail;         /**< submission queue tail */
+  unsigned sq_mask;          /**< submission queue index mask */
+  unsigned *sq_array;        /**< submission queue indirection array */
+  struct io_uring_sqe *sqes; /**< submission queue entries */
+  unsigned sqe_tail;         /**< local tail of the prepared entries */
+  unsigned *cq_head;         /**< completion queue head */
+  unsigned *cq_tail;         /**< completion queue tail, moved by the kernel */
+  unsigned cq_mask;          /**< completion queue index mask */
+  struct io_uring_cqe *cqes; /**< completion queue entries */
+  void *sq_ring;             /**< mapped submission and completion rings */
+  size_t sq_ring_size;       /**< size of the mapped rings */
+  size_t sqes_size;          /**< size of the mapped submission entries */
+} cli_uring_t;
+
+/**
+ * @brief Set up an io_uring instance. Kernels older than 5.11 are refused
+ *
+ * @param ring the io_uring struct
+ * @param entries minimum number of submission queue entries
+ * @return int 0 on success, -1 with errno set if io_uring is not available
+ */
+int cli_uring_init(cli_uring_t *ring, unsigned entries);
+
+/**
+ * @brief Get a cleared submission queue entry. Entries are submitted by \link
+ * cli_uring_enter \endlink. A full queue is submitted first
+ *
+ * @param ring the io_uring struct
+ * @return struct io_uring_sqe* the entry. NULL if the submission failed
+ */
+struct io_uring_sqe *cli_uring_get_sqe(cli_uring_t *ring);
+
+/**
+ * @brief Submit the prepared entries and wait for completions with a single
+ * system call
+ *
+ * @param ring the io_uring struct
+ * @param timeout_ms maximum time to wait for a completion in ms. -1 waits
+ * forever and 0 does not wait
+ * @return int 0 on success or timeout, -1 on error with errno set
+ */
+int cli_uring_enter(cli_uring_t *ring, int timeout_ms);
+
+/**
+ * @brief Pop the next completion
+ *
+ * @param ring the io_uring struct
+ * @param cqe the completion copy
+ * @return bool false if there is no completion
+ */
+bool cli_uring_pop(cli_uring_t *ring, struct io_uring_cqe *cqe);
+
+/**
+ * @brief Register fixed buffers used by IORING_OP_READ_FIXED
+ *
+ * @param ring the io_uring struct
+ * @param iov the buffers
+ * @param num number of buffers
+ * @return int 0 on success, -1 on error with errno set
+ */
+int cli_uring_register_buffers(cli_uring_t *ring, const struct iovec *iov,
+                               unsigned num);
+
+/**
+ * @brief Release the io_uring instance. Operations in flight are cancelled
+ *
+ * @param ring the io_uring struct
+ */
+void cli_uring_close(cli_uring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLI_SERVER_URING_H */
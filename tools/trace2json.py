@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Convert a uCLI trace dump into Chrome trace-event JSON.
+
+The dump is written by cli_trace_dump (lib/trace.h): the magic "ucltrace",
+the record size as a 32 bits little endian value, then fixed size records.
+Open the JSON in https://ui.perfetto.dev or chrome://tracing. Every session
+is a process with two threads: "rx" for the bytes received through
+cli_putchar/cli_putbuf and "main" for the stages run by cli_mainloop.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"ucltrace"
+RECORD = struct.Struct("<IIIHBB")  # seq, ts, arg, session, event, phase
+
+PUTCHAR, PUTBUF, READ, ECHO, PARSE, TOKENIZE, FIND, RUN, NAME = range(1, 10)
+
+NAMES = {
+    PUTCHAR: "putchar",
+    PUTBUF: "putbuf",
+    READ: "read",
+    ECHO: "echo",
+    PARSE: "parse",
+    TOKENIZE: "tokenize",
+    FIND: "find",
+    RUN: "run",
+}
+
+# Name of the argument of every event, at its start and at its end
+ARGS = {
+    PUTCHAR: ("char", None),
+    PUTBUF: ("bytes", None),
+    READ: (None, "bytes"),
+    ECHO: ("bytes", None),
+    PARSE: (None, "argc"),
+    TOKENIZE: (None, "argc"),
+    FIND: ("argc", "found"),
+    RUN: ("argc", "status"),
+}
+
+TID_MAIN = 1
+TID_RX = 2
+
+
+def read_records(data):
+    """Return the (seq, ts, arg, session, event, phase) tuples of a dump."""
+    if data[:len(MAGIC)] != MAGIC:
+        raise ValueError("not a trace dump")
+    (size,) = struct.unpack_from("<I", data, len(MAGIC))
+    if size < RECORD.size:
+        raise ValueError("record size %d too small" % size)
+    records = []
+    for off in range(len(MAGIC) + 4, len(data) - size + 1, size):
+        records.append(RECORD.unpack_from(data, off))
+    return sorted(records)
+
+
+def arg_value(key, arg):
+    if key == "char":
+        return chr(arg) if 0x20 <= arg < 0x7f else "0x%02x" % arg
+    if key == "status":
+        return arg - (1 << 32) if arg & 0x80000000 else arg
+    return arg
+
+
+def convert(records, hz):
+    """Build the trace events, timestamps in microseconds."""
+    events = []
+    stacks = {}  # open spans per (session, tid)
+    runs = {}  # last run started per session, collecting its name
+    sessions = set()
+    now = None
+    last = 0
+
+    for _, ts, arg, session, event, phase in records:
+        # Timestamps are 32 bits wide and wrap around
+        delta = (ts - last) & 0xFFFFFFFF
+        if delta & 0x80000000:
+            delta -= 1 << 32
+        now = 0 if now is None else now + delta
+        last = ts
+
+        if event == NAME:
+            run = runs.get(session)
+            if run is not None:
+                run["name"] += struct.pack("<I", arg).rstrip(b"\0").decode(
+                    "ascii", "replace")
+            continue
+        if event not in NAMES:
+            continue
+
+        tid = TID_RX if event in (PUTCHAR, PUTBUF) else TID_MAIN
+        stack = stacks.setdefault((session, tid), [])
+        key = ARGS[event][1 if phase == ord("E") else 0]
+        ev = {
+            "name": NAMES[event],
+            "cat": "cli",
+            "ph": chr(phase),
+            "ts": now * 1e6 / hz,
+            "pid": session,
+            "tid": tid,
+        }
+        if key is not None:
+            ev["args"] = {key: arg_value(key, arg)}
+
+        if phase == ord("B"):
+            stack.append(event)
+            if event == RUN:
+                ev["name"] = ""
+                runs[session] = ev
+        elif phase == ord("E"):
+            # The start of the span was overwritten in the ring
+            if not stack:
+                continue
+            stack.pop()
+            if event == RUN:
+                runs.pop(session, None)
+        else:
+            ev["s"] = "t"
+        sessions.add(session)
+        events.append(ev)
+
+    for ev in events:
+        if ev["name"] == "":
+            ev["name"] = "run"
+
+    for session in sorted(sessions):
+        events.append({"name": "process_name", "ph": "M", "pid": session,
+                       "args": {"name": "session 0x%04x" % session}})
+        for tid, name in ((TID_MAIN, "main"), (TID_RX, "rx")):
+            events.append({"name": "thread_name", "ph": "M", "pid": session,
+                           "tid": tid, "args": {"name": name}})
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="file written by cli_trace_dump")
+    parser.add_argument("output", nargs="?", help="JSON file, stdout if none")
+    parser.add_argument("-f", "--hz", type=float, default=1e6,
+                        help="frequency of the trace clock (default 1e6, "
+                        "microseconds)")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        trace = convert(read_records(f.read()), args.hz)
+
+    if args.output is None:
+        json.dump(trace, sys.stdout)
+    else:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())